@@ -0,0 +1,120 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Deterministic pseudo-random number generator (SplitMix64). Each benchmark thread uses its own generator derived from the benchmark seed, so that runs with the same seed and thread count produce the same operations.
+ */
+typedef struct {
+    uint64_t state;
+} DFBenchmarkRandom;
+
+static inline uint64_t
+DFBenchmarkRandomNext(DFBenchmarkRandom *random) {
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/*! Returns uniformly distributed value in range [0, 1).
+ */
+static inline double
+DFBenchmarkRandomDouble(DFBenchmarkRandom *random) {
+    return (DFBenchmarkRandomNext(random) >> 11) * 0x1.0p-53;
+}
+
+/*! Returns monotonic time in nanoseconds.
+ */
+extern uint64_t
+DFBenchmarkTime(void);
+
+/*! Returns peak resident set size of the process, in bytes.
+ */
+extern unsigned long long
+DFBenchmarkMaximumResidentSize(void);
+
+
+/*! Generates ranks in range [0, count) that follow Zipfian distribution, rank 0 is the most popular one. Uses the algorithm from "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.) which is also used by YCSB.
+ @note Generator is immutable and can be shared between threads.
+ */
+@interface DFBenchmarkZipfianGenerator : NSObject
+
+/*! Initializes generator.
+ @param exponent Skew of the distribution in range [0, 1). Exponent of 0 produces uniformly distributed ranks, YCSB uses 0.99.
+ */
+- (instancetype)initWithCount:(uint64_t)count exponent:(double)exponent NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (uint64_t)nextRank:(DFBenchmarkRandom *)random;
+
+@end
+
+
+/*! Distribution of the value sizes. Distributions are described by strings: "fixed:<size>", "uniform:<min>-<max>" or "lognormal:<median>" (sigma of 1). Sizes are in bytes.
+ */
+@interface DFBenchmarkValueSizeDistribution : NSObject
+
+/*! Returns distribution described by the given string or nil if the string is invalid.
+ */
++ (nullable instancetype)distributionWithString:(NSString *)string;
+
+/*! Upper bound of the generated sizes. Log-normal sizes are capped at 4 MB.
+ */
+@property (nonatomic, readonly) NSUInteger maximumSize;
+
+- (NSUInteger)nextSize:(DFBenchmarkRandom *)random;
+
+@end
+
+
+typedef NS_ENUM(NSUInteger, DFBenchmarkOperationType) {
+    DFBenchmarkOperationTypeGet,
+    DFBenchmarkOperationTypeSet,
+    DFBenchmarkOperationTypeRemove
+};
+
+/*! Recorded key access trace.
+ @discussion Traces are text files with one access per line: "get <key>", "set <key> [<size>]", "del <key>" or just "<key>" which is a read. Empty lines and lines that start with # are ignored.
+ */
+@interface DFBenchmarkTrace : NSObject
+
++ (nullable instancetype)traceWithContentsOfFile:(NSString *)path error:(NSError *__autoreleasing *)error;
+
+@property (nonatomic, readonly) NSUInteger count;
+
+/*! Number of distinct keys in the trace.
+ */
+@property (nonatomic, readonly) NSUInteger keyCount;
+
+- (DFBenchmarkOperationType)typeAtIndex:(NSUInteger)index;
+- (NSString *)keyAtIndex:(NSUInteger)index;
+
+/*! Returns value size recorded for the access, 0 if the trace doesn't specify one.
+ */
+- (NSUInteger)sizeAtIndex:(NSUInteger)index;
+
+@end
+
+
+/*! Collects operation latencies. Percentiles are exact, they are computed from all the collected samples.
+ @note Not thread-safe, each benchmark thread collects latencies separately and the results are merged afterwards.
+ */
+@interface DFBenchmarkLatencies : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+
+- (void)addLatency:(uint64_t)latency;
+- (void)addLatencies:(DFBenchmarkLatencies *)latencies;
+
+/*! Returns dictionary with count, mean, p50, p99, p999 and max latencies in microseconds.
+ */
+- (NSDictionary<NSString *, NSNumber *> *)summary;
+
+@end
+
+NS_ASSUME_NONNULL_END
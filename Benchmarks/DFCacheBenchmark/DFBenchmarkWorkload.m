@@ -0,0 +1,287 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFBenchmarkWorkload.h"
+#import <math.h>
+#import <sys/resource.h>
+#import <time.h>
+
+uint64_t
+DFBenchmarkTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * NSEC_PER_SEC + (uint64_t)time.tv_nsec;
+}
+
+unsigned long long
+DFBenchmarkMaximumResidentSize(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return (unsigned long long)usage.ru_maxrss; // bytes
+#else
+    return (unsigned long long)usage.ru_maxrss * 1024; // kilobytes
+#endif
+}
+
+
+@implementation DFBenchmarkZipfianGenerator {
+    uint64_t _count;
+    double _theta;
+    double _alpha;
+    double _zetan;
+    double _eta;
+}
+
+- (instancetype)initWithCount:(uint64_t)count exponent:(double)exponent {
+    if (self = [super init]) {
+        _count = MAX(count, 1);
+        _theta = MIN(MAX(exponent, 0), 0.999);
+        double zeta2 = 0;
+        for (uint64_t i = 1; i <= _count; i++) {
+            const double term = 1.0 / pow((double)i, _theta);
+            _zetan += term;
+            if (i <= 2) {
+                zeta2 += term;
+            }
+        }
+        _alpha = 1.0 / (1.0 - _theta);
+        _eta = _count > 1 ? (1.0 - pow(2.0 / _count, 1.0 - _theta)) / (1.0 - zeta2 / _zetan) : 0;
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+- (uint64_t)nextRank:(DFBenchmarkRandom *)random {
+    const double u = DFBenchmarkRandomDouble(random);
+    const double uz = u * _zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, _theta)) {
+        return MIN(1, _count - 1);
+    }
+    const uint64_t rank = (uint64_t)(_count * pow(_eta * u - _eta + 1.0, _alpha));
+    return MIN(rank, _count - 1);
+}
+
+@end
+
+
+typedef NS_ENUM(NSUInteger, _DFBenchmarkValueSizeKind) {
+    _DFBenchmarkValueSizeKindFixed,
+    _DFBenchmarkValueSizeKindUniform,
+    _DFBenchmarkValueSizeKindLogNormal
+};
+
+static const NSUInteger _DFBenchmarkMaximumLogNormalSize = 4 * 1024 * 1024;
+
+@implementation DFBenchmarkValueSizeDistribution {
+    _DFBenchmarkValueSizeKind _kind;
+    NSUInteger _minimumSize;
+    NSUInteger _median;
+}
+
++ (instancetype)distributionWithString:(NSString *)string {
+    NSArray *components = [string componentsSeparatedByString:@":"];
+    if (components.count != 2) {
+        return nil;
+    }
+    NSString *kind = components[0];
+    NSString *value = components[1];
+    DFBenchmarkValueSizeDistribution *distribution = [DFBenchmarkValueSizeDistribution new];
+    if ([kind isEqualToString:@"fixed"]) {
+        distribution->_kind = _DFBenchmarkValueSizeKindFixed;
+        distribution->_minimumSize = distribution->_maximumSize = (NSUInteger)value.longLongValue;
+    } else if ([kind isEqualToString:@"uniform"]) {
+        NSArray *bounds = [value componentsSeparatedByString:@"-"];
+        if (bounds.count != 2) {
+            return nil;
+        }
+        distribution->_kind = _DFBenchmarkValueSizeKindUniform;
+        distribution->_minimumSize = (NSUInteger)[bounds[0] longLongValue];
+        distribution->_maximumSize = (NSUInteger)[bounds[1] longLongValue];
+    } else if ([kind isEqualToString:@"lognormal"]) {
+        distribution->_kind = _DFBenchmarkValueSizeKindLogNormal;
+        distribution->_median = (NSUInteger)value.longLongValue;
+        distribution->_minimumSize = 1;
+        distribution->_maximumSize = _DFBenchmarkMaximumLogNormalSize;
+    } else {
+        return nil;
+    }
+    if (distribution->_maximumSize == 0 || distribution->_minimumSize > distribution->_maximumSize) {
+        return nil;
+    }
+    return distribution;
+}
+
+- (NSUInteger)nextSize:(DFBenchmarkRandom *)random {
+    switch (_kind) {
+        case _DFBenchmarkValueSizeKindFixed:
+            return _maximumSize;
+        case _DFBenchmarkValueSizeKindUniform:
+            return _minimumSize + (NSUInteger)(DFBenchmarkRandomNext(random) % (_maximumSize - _minimumSize + 1));
+        case _DFBenchmarkValueSizeKindLogNormal: {
+            // Box-Muller transform, sigma = 1
+            const double u1 = 1.0 - DFBenchmarkRandomDouble(random);
+            const double u2 = DFBenchmarkRandomDouble(random);
+            const double normal = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+            const double size = _median * exp(normal);
+            return (NSUInteger)MIN(MAX(size, _minimumSize), _maximumSize);
+        }
+    }
+}
+
+@end
+
+
+@implementation DFBenchmarkTrace {
+    NSMutableData *_types;
+    NSMutableData *_sizes;
+    NSMutableArray *_keys;
+}
+
++ (instancetype)traceWithContentsOfFile:(NSString *)path error:(NSError *__autoreleasing *)error {
+    NSString *contents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:error];
+    if (!contents) {
+        return nil;
+    }
+    DFBenchmarkTrace *trace = [DFBenchmarkTrace new];
+    trace->_types = [NSMutableData new];
+    trace->_sizes = [NSMutableData new];
+    trace->_keys = [NSMutableArray new];
+    NSMutableDictionary *uniqueKeys = [NSMutableDictionary new];
+    NSCharacterSet *whitespaces = [NSCharacterSet whitespaceCharacterSet];
+    __block NSUInteger lineNumber = 0;
+    __block NSString *invalidLine;
+    [contents enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) {
+        lineNumber++;
+        NSMutableArray *components = [NSMutableArray new];
+        for (NSString *component in [line componentsSeparatedByCharactersInSet:whitespaces]) {
+            if (component.length) {
+                [components addObject:component];
+            }
+        }
+        if (!components.count || [components[0] hasPrefix:@"#"]) {
+            return;
+        }
+        DFBenchmarkOperationType type = DFBenchmarkOperationTypeGet;
+        NSString *key;
+        uint64_t size = 0;
+        if (components.count == 1) {
+            key = components[0];
+        } else {
+            NSString *operation = [components[0] lowercaseString];
+            if ([operation isEqualToString:@"get"] && components.count == 2) {
+                type = DFBenchmarkOperationTypeGet;
+            } else if ([operation isEqualToString:@"set"] && components.count <= 3) {
+                type = DFBenchmarkOperationTypeSet;
+                size = components.count == 3 ? (uint64_t)[components[2] longLongValue] : 0;
+            } else if ([operation isEqualToString:@"del"] && components.count == 2) {
+                type = DFBenchmarkOperationTypeRemove;
+            } else {
+                invalidLine = [NSString stringWithFormat:@"%lu: %@", (unsigned long)lineNumber, line];
+                *stop = YES;
+                return;
+            }
+            key = components[1];
+        }
+        NSString *uniqueKey = uniqueKeys[key];
+        if (!uniqueKey) {
+            uniqueKeys[key] = uniqueKey = key;
+        }
+        uint8_t typeValue = (uint8_t)type;
+        [trace->_types appendBytes:&typeValue length:sizeof(typeValue)];
+        [trace->_sizes appendBytes:&size length:sizeof(size)];
+        [trace->_keys addObject:uniqueKey];
+    }];
+    if (invalidLine) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSLocalizedDescriptionKey : [NSString stringWithFormat:@"Invalid trace line %@", invalidLine] }];
+        }
+        return nil;
+    }
+    trace->_keyCount = uniqueKeys.count;
+    return trace;
+}
+
+- (NSUInteger)count {
+    return _keys.count;
+}
+
+- (DFBenchmarkOperationType)typeAtIndex:(NSUInteger)index {
+    return ((const uint8_t *)_types.bytes)[index];
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index {
+    return _keys[index];
+}
+
+- (NSUInteger)sizeAtIndex:(NSUInteger)index {
+    return (NSUInteger)((const uint64_t *)_sizes.bytes)[index];
+}
+
+@end
+
+
+@implementation DFBenchmarkLatencies {
+    NSMutableData *_latencies;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _latencies = [NSMutableData new];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _latencies.length / sizeof(uint64_t);
+}
+
+- (void)addLatency:(uint64_t)latency {
+    [_latencies appendBytes:&latency length:sizeof(latency)];
+}
+
+- (void)addLatencies:(DFBenchmarkLatencies *)latencies {
+    [_latencies appendData:latencies->_latencies];
+}
+
+static int
+_DFBenchmarkCompareLatencies(const void *lhs, const void *rhs) {
+    const uint64_t a = *(const uint64_t *)lhs, b = *(const uint64_t *)rhs;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+- (NSDictionary *)summary {
+    const NSUInteger count = self.count;
+    if (!count) {
+        return @{ @"count" : @0 };
+    }
+    NSMutableData *sorted = [_latencies mutableCopy];
+    uint64_t *latencies = sorted.mutableBytes;
+    qsort(latencies, count, sizeof(uint64_t), _DFBenchmarkCompareLatencies);
+    long double total = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        total += latencies[i];
+    }
+    double (^percentile)(double) = ^double(double percentile) {
+        const NSUInteger rank = MAX(1, (NSUInteger)ceil(percentile / 100.0 * count));
+        return latencies[MIN(rank, count) - 1] / 1e3;
+    };
+    return @{ @"count" : @(count),
+              @"mean_us" : @((double)(total / count) / 1e3),
+              @"p50_us" : @(percentile(50)),
+              @"p99_us" : @(percentile(99)),
+              @"p999_us" : @(percentile(99.9)),
+              @"max_us" : @(latencies[count - 1] / 1e3) };
+}
+
+@end
@@ -0,0 +1,505 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFBenchmarkWorkload.h"
+#import "DFCache.h"
+#import "DFMemoryCache.h"
+#import <pthread.h>
+#import <unistd.h>
+
+static NSString *const DFBenchmarkUsage =
+@"usage: dfcache-benchmark [-option value ...]\n"
+@"\n"
+@"  -workload            zipf-read | read-write | batch | trace (default zipf-read)\n"
+@"  -trace               path to the trace file, required by the trace workload\n"
+@"  -keys                number of distinct keys (default 10000)\n"
+@"  -operations          number of operations (default 100000)\n"
+@"  -threads             number of threads issuing operations (default 1)\n"
+@"  -seed                random seed (default 1)\n"
+@"  -read-ratio          fraction of reads (default 1.0, 0.8 for read-write)\n"
+@"  -zipf                Zipfian exponent in [0, 1), 0 is uniform (default 0.99)\n"
+@"  -value-size          fixed:N | uniform:MIN-MAX | lognormal:MEDIAN (default fixed:4096)\n"
+@"  -batch-size          number of keys in a batch read (default 16)\n"
+@"  -read-through        store values on read misses, YES | NO (default YES)\n"
+@"  -preload             store all keys before the run, YES | NO (default YES, NO for trace)\n"
+@"  -memory-count-limit  memory cache count limit, 0 disables memory cache (default 1000)\n"
+@"  -memory-segmented    use segmented LRU memory cache, YES | NO (default NO)\n"
+@"  -disk-capacity       disk cache capacity in bytes (default 104857600)\n"
+@"  -cleanup-rate        disk cache cleanup rate (default 0.75)\n"
+@"  -io-queues           number of DFCache IO queues (default 1)\n"
+@"  -directory           directory for the benchmark cache (default temporary directory)\n"
+@"  -output              path to the JSON report (default standard output)\n";
+
+/*! Benchmark parameters parsed from the command line arguments.
+ */
+@interface DFBenchmarkConfiguration : NSObject
+
+@property (nonatomic, copy) NSString *workload;
+@property (nonatomic) DFBenchmarkTrace *trace;
+@property (nonatomic) NSString *tracePath;
+@property (nonatomic) NSUInteger keyCount;
+@property (nonatomic) NSUInteger operationCount;
+@property (nonatomic) NSUInteger threadCount;
+@property (nonatomic) uint64_t seed;
+@property (nonatomic) double readRatio;
+@property (nonatomic) double zipfExponent;
+@property (nonatomic) NSString *valueSizeString;
+@property (nonatomic) DFBenchmarkValueSizeDistribution *valueSizes;
+@property (nonatomic) NSUInteger batchSize;
+@property (nonatomic) BOOL readThrough;
+@property (nonatomic) BOOL preload;
+@property (nonatomic) NSUInteger memoryCountLimit;
+@property (nonatomic) BOOL memorySegmented;
+@property (nonatomic) unsigned long long diskCapacity;
+@property (nonatomic) float cleanupRate;
+@property (nonatomic) NSUInteger ioQueueCount;
+@property (nonatomic) NSString *directory;
+@property (nonatomic) NSString *outputPath;
+
+@end
+
+@implementation DFBenchmarkConfiguration
+
+/*! Returns configuration from the arguments domain of the user defaults, which contains "-option value" pairs passed to the process. Returns nil and prints error if the arguments are invalid.
+ */
++ (instancetype)configurationWithArguments:(NSDictionary *)arguments {
+    NSString *(^option)(NSString *, NSString *) = ^NSString *(NSString *name, NSString *defaultValue) {
+        id value = arguments[name];
+        return value ? [value description] : defaultValue;
+    };
+    DFBenchmarkConfiguration *configuration = [DFBenchmarkConfiguration new];
+    configuration.workload = option(@"workload", @"zipf-read");
+    NSArray *workloads = @[ @"zipf-read", @"read-write", @"batch", @"trace" ];
+    if (![workloads containsObject:configuration.workload]) {
+        fprintf(stderr, "Unknown workload %s\n", configuration.workload.UTF8String);
+        return nil;
+    }
+    BOOL isTrace = [configuration.workload isEqualToString:@"trace"];
+    configuration.tracePath = option(@"trace", nil);
+    if (isTrace) {
+        if (!configuration.tracePath) {
+            fprintf(stderr, "Trace workload requires -trace\n");
+            return nil;
+        }
+        NSError *error;
+        configuration.trace = [DFBenchmarkTrace traceWithContentsOfFile:configuration.tracePath error:&error];
+        if (!configuration.trace) {
+            fprintf(stderr, "Failed to read trace: %s\n", error.localizedDescription.UTF8String);
+            return nil;
+        }
+    }
+    configuration.keyCount = isTrace ? configuration.trace.keyCount : (NSUInteger)MAX(option(@"keys", @"10000").longLongValue, 1);
+    configuration.operationCount = isTrace ? configuration.trace.count : (NSUInteger)MAX(option(@"operations", @"100000").longLongValue, 0);
+    configuration.threadCount = (NSUInteger)MAX(option(@"threads", @"1").longLongValue, 1);
+    configuration.seed = (uint64_t)option(@"seed", @"1").longLongValue;
+    NSString *defaultReadRatio = [configuration.workload isEqualToString:@"read-write"] ? @"0.8" : @"1.0";
+    configuration.readRatio = MIN(MAX(option(@"read-ratio", defaultReadRatio).doubleValue, 0), 1);
+    configuration.zipfExponent = option(@"zipf", @"0.99").doubleValue;
+    configuration.valueSizeString = option(@"value-size", @"fixed:4096");
+    configuration.valueSizes = [DFBenchmarkValueSizeDistribution distributionWithString:configuration.valueSizeString];
+    if (!configuration.valueSizes) {
+        fprintf(stderr, "Invalid value size distribution %s\n", configuration.valueSizeString.UTF8String);
+        return nil;
+    }
+    configuration.batchSize = (NSUInteger)MAX(option(@"batch-size", @"16").longLongValue, 1);
+    configuration.readThrough = option(@"read-through", @"YES").boolValue;
+    configuration.preload = option(@"preload", isTrace ? @"NO" : @"YES").boolValue;
+    configuration.memoryCountLimit = (NSUInteger)MAX(option(@"memory-count-limit", @"1000").longLongValue, 0);
+    configuration.memorySegmented = option(@"memory-segmented", @"NO").boolValue;
+    configuration.diskCapacity = (unsigned long long)MAX(option(@"disk-capacity", @"104857600").longLongValue, 0);
+    configuration.cleanupRate = option(@"cleanup-rate", @"0.75").floatValue;
+    configuration.ioQueueCount = (NSUInteger)MAX(option(@"io-queues", @"1").longLongValue, 1);
+    configuration.directory = option(@"directory", NSTemporaryDirectory());
+    configuration.outputPath = option(@"output", nil);
+    return configuration;
+}
+
+- (NSDictionary *)JSONObject {
+    return @{ @"workload" : _workload,
+              @"trace" : _tracePath ?: [NSNull null],
+              @"keys" : @(_keyCount),
+              @"operations" : @(_operationCount),
+              @"threads" : @(_threadCount),
+              @"seed" : @(_seed),
+              @"read_ratio" : @(_readRatio),
+              @"zipf" : @(_zipfExponent),
+              @"value_size" : _valueSizeString,
+              @"batch_size" : @(_batchSize),
+              @"read_through" : @(_readThrough),
+              @"preload" : @(_preload),
+              @"memory_count_limit" : @(_memoryCountLimit),
+              @"memory_segmented" : @(_memorySegmented),
+              @"disk_capacity" : @(_diskCapacity),
+              @"cleanup_rate" : @(_cleanupRate),
+              @"io_queues" : @(_ioQueueCount) };
+}
+
+@end
+
+
+/*! Results collected by a single benchmark thread.
+ */
+@interface DFBenchmarkThreadResult : NSObject
+
+@property (nonatomic, readonly) DFBenchmarkLatencies *getLatencies;
+@property (nonatomic, readonly) DFBenchmarkLatencies *setLatencies;
+@property (nonatomic, readonly) DFBenchmarkLatencies *removeLatencies;
+@property (nonatomic, readonly) DFBenchmarkLatencies *batchLatencies;
+@property (nonatomic) uint64_t readCount;
+@property (nonatomic) uint64_t hitCount;
+@property (nonatomic) uint64_t operationCount;
+
+- (void)addResult:(DFBenchmarkThreadResult *)result;
+
+@end
+
+@implementation DFBenchmarkThreadResult
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _getLatencies = [DFBenchmarkLatencies new];
+        _setLatencies = [DFBenchmarkLatencies new];
+        _removeLatencies = [DFBenchmarkLatencies new];
+        _batchLatencies = [DFBenchmarkLatencies new];
+    }
+    return self;
+}
+
+- (void)addResult:(DFBenchmarkThreadResult *)result {
+    [_getLatencies addLatencies:result.getLatencies];
+    [_setLatencies addLatencies:result.setLatencies];
+    [_removeLatencies addLatencies:result.removeLatencies];
+    [_batchLatencies addLatencies:result.batchLatencies];
+    _readCount += result.readCount;
+    _hitCount += result.hitCount;
+    _operationCount += result.operationCount;
+}
+
+@end
+
+
+/*! Runs the workload described by configuration against DFCache.
+ */
+@interface DFBenchmark : NSObject
+
+- (instancetype)initWithConfiguration:(DFBenchmarkConfiguration *)configuration cache:(DFCache *)cache;
+
+/*! Stores every key of the synthetic workload and waits until the values are written to disk.
+ */
+- (void)preload;
+
+/*! Runs the workload on the configured number of threads and returns merged results.
+ */
+- (DFBenchmarkThreadResult *)run;
+
+/*! Waits until all the values stored by the benchmark are written to disk.
+ */
+- (void)drainPendingWrites;
+
+@end
+
+@implementation DFBenchmark {
+    DFBenchmarkConfiguration *_configuration;
+    DFCache *_cache;
+    DFBenchmarkZipfianGenerator *_zipfian;
+    NSData *_valueBytes;
+    NSMutableSet *_writtenKeys;
+    pthread_mutex_t _writtenKeysMutex;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_writtenKeysMutex);
+}
+
+- (instancetype)initWithConfiguration:(DFBenchmarkConfiguration *)configuration cache:(DFCache *)cache {
+    if (self = [super init]) {
+        _configuration = configuration;
+        _cache = cache;
+        _zipfian = [[DFBenchmarkZipfianGenerator alloc] initWithCount:configuration.keyCount exponent:configuration.zipfExponent];
+        _writtenKeys = [NSMutableSet new];
+        pthread_mutex_init(&_writtenKeysMutex, NULL);
+
+        // Values are slices of a single block of random (incompressible) bytes.
+        DFBenchmarkRandom random = { configuration.seed };
+        NSMutableData *bytes = [NSMutableData dataWithLength:configuration.valueSizes.maximumSize + 64];
+        uint8_t *buffer = bytes.mutableBytes;
+        for (NSUInteger i = 0; i < bytes.length; i++) {
+            buffer[i] = (uint8_t)DFBenchmarkRandomNext(&random);
+        }
+        _valueBytes = bytes;
+    }
+    return self;
+}
+
+- (NSString *)_keyForRank:(uint64_t)rank {
+    return [NSString stringWithFormat:@"key_%llu", rank];
+}
+
+- (NSData *)_valueWithSize:(NSUInteger)size random:(DFBenchmarkRandom *)random {
+    size = size ?: [_configuration.valueSizes nextSize:random];
+    const NSUInteger offset = (NSUInteger)(DFBenchmarkRandomNext(random) % 64);
+    return [NSData dataWithBytes:(const uint8_t *)_valueBytes.bytes + offset length:MIN(size, _valueBytes.length - offset)];
+}
+
+- (void)_storeValue:(NSData *)value forKey:(NSString *)key result:(DFBenchmarkThreadResult *)result {
+    const uint64_t startTime = DFBenchmarkTime();
+    [_cache storeObject:value forKey:key];
+    [result.setLatencies addLatency:DFBenchmarkTime() - startTime];
+    pthread_mutex_lock(&_writtenKeysMutex);
+    [_writtenKeys addObject:key];
+    pthread_mutex_unlock(&_writtenKeysMutex);
+}
+
+- (void)preload {
+    DFBenchmarkRandom random = { _configuration.seed ^ 0x5DEECE66Dull };
+    DFBenchmarkThreadResult *result = [DFBenchmarkThreadResult new];
+    for (uint64_t rank = 0; rank < _configuration.keyCount; rank++) {
+        @autoreleasepool {
+            [self _storeValue:[self _valueWithSize:0 random:&random] forKey:[self _keyForRank:rank] result:result];
+        }
+    }
+    [self drainPendingWrites];
+}
+
+/*! Batch data reads flush pending writes for the keys on their IO queues, so once they return every value stored before is on disk.
+ */
+- (void)drainPendingWrites {
+    pthread_mutex_lock(&_writtenKeysMutex);
+    NSArray *keys = [_writtenKeys allObjects];
+    [_writtenKeys removeAllObjects];
+    pthread_mutex_unlock(&_writtenKeysMutex);
+    const NSUInteger chunkSize = 256;
+    for (NSUInteger i = 0; i < keys.count; i += chunkSize) {
+        @autoreleasepool {
+            [_cache batchCachedDataForKeys:[keys subarrayWithRange:NSMakeRange(i, MIN(chunkSize, keys.count - i))]];
+        }
+    }
+}
+
+- (DFBenchmarkThreadResult *)run {
+    const NSUInteger threadCount = _configuration.threadCount;
+    NSMutableArray *results = [NSMutableArray new];
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        [results addObject:[DFBenchmarkThreadResult new]];
+    }
+    if (threadCount == 1) {
+        [self _runThreadAtIndex:0 result:results[0]];
+    } else {
+        dispatch_group_t group = dispatch_group_create();
+        for (NSUInteger i = 0; i < threadCount; i++) {
+            dispatch_group_enter(group);
+            NSThread *thread = [[NSThread alloc] initWithTarget:self selector:@selector(_runThreadWithArguments:) object:@[ @(i), results[i], group ]];
+            [thread start];
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }
+    DFBenchmarkThreadResult *result = [DFBenchmarkThreadResult new];
+    for (DFBenchmarkThreadResult *threadResult in results) {
+        [result addResult:threadResult];
+    }
+    return result;
+}
+
+- (void)_runThreadWithArguments:(NSArray *)arguments {
+    [self _runThreadAtIndex:[arguments[0] unsignedIntegerValue] result:arguments[1]];
+    dispatch_group_leave(arguments[2]);
+}
+
+- (void)_runThreadAtIndex:(NSUInteger)index result:(DFBenchmarkThreadResult *)result {
+    DFBenchmarkRandom random = { _configuration.seed + 0x9E3779B97F4A7C15ull * (index + 1) };
+    DFBenchmarkRandomNext(&random);
+    const NSUInteger threadCount = _configuration.threadCount;
+    if (_configuration.trace) {
+        // Each thread replays every threadCount-th access of the trace.
+        DFBenchmarkTrace *trace = _configuration.trace;
+        for (NSUInteger i = index; i < trace.count; i += threadCount) {
+            @autoreleasepool {
+                [self _replayAccessAtIndex:i trace:trace random:&random result:result];
+            }
+        }
+        return;
+    }
+    const NSUInteger operationCount = _configuration.operationCount / threadCount + (index < _configuration.operationCount % threadCount ? 1 : 0);
+    const BOOL isBatch = [_configuration.workload isEqualToString:@"batch"];
+    for (NSUInteger i = 0; i < operationCount; i++) {
+        @autoreleasepool {
+            const BOOL isRead = DFBenchmarkRandomDouble(&random) < _configuration.readRatio;
+            if (isRead && isBatch) {
+                [self _performBatchReadWithRandom:&random result:result];
+            } else if (isRead) {
+                [self _performReadForKey:[self _keyForRank:[_zipfian nextRank:&random]] size:0 random:&random result:result];
+            } else {
+                [self _storeValue:[self _valueWithSize:0 random:&random] forKey:[self _keyForRank:[_zipfian nextRank:&random]] result:result];
+            }
+            result.operationCount++;
+        }
+    }
+}
+
+- (void)_performReadForKey:(NSString *)key size:(NSUInteger)size random:(DFBenchmarkRandom *)random result:(DFBenchmarkThreadResult *)result {
+    const uint64_t startTime = DFBenchmarkTime();
+    id object = [_cache cachedObjectForKey:key];
+    [result.getLatencies addLatency:DFBenchmarkTime() - startTime];
+    result.readCount++;
+    if (object) {
+        result.hitCount++;
+    } else if (_configuration.readThrough) {
+        [self _storeValue:[self _valueWithSize:size random:random] forKey:key result:result];
+    }
+}
+
+- (void)_performBatchReadWithRandom:(DFBenchmarkRandom *)random result:(DFBenchmarkThreadResult *)result {
+    NSMutableOrderedSet *keys = [NSMutableOrderedSet new];
+    for (NSUInteger i = 0; i < _configuration.batchSize; i++) {
+        [keys addObject:[self _keyForRank:[_zipfian nextRank:random]]];
+    }
+    const uint64_t startTime = DFBenchmarkTime();
+    NSDictionary *batch = [_cache batchCachedObjectsForKeys:keys.array];
+    [result.batchLatencies addLatency:DFBenchmarkTime() - startTime];
+    result.readCount += keys.count;
+    result.hitCount += batch.count;
+    if (_configuration.readThrough && batch.count < keys.count) {
+        for (NSString *key in keys) {
+            if (!batch[key]) {
+                [self _storeValue:[self _valueWithSize:0 random:random] forKey:key result:result];
+            }
+        }
+    }
+}
+
+- (void)_replayAccessAtIndex:(NSUInteger)index trace:(DFBenchmarkTrace *)trace random:(DFBenchmarkRandom *)random result:(DFBenchmarkThreadResult *)result {
+    NSString *key = [trace keyAtIndex:index];
+    switch ([trace typeAtIndex:index]) {
+        case DFBenchmarkOperationTypeGet:
+            [self _performReadForKey:key size:[trace sizeAtIndex:index] random:random result:result];
+            break;
+        case DFBenchmarkOperationTypeSet:
+            [self _storeValue:[self _valueWithSize:[trace sizeAtIndex:index] random:random] forKey:key result:result];
+            break;
+        case DFBenchmarkOperationTypeRemove: {
+            const uint64_t startTime = DFBenchmarkTime();
+            [_cache removeObjectForKey:key];
+            [result.removeLatencies addLatency:DFBenchmarkTime() - startTime];
+            break;
+        }
+    }
+    result.operationCount++;
+}
+
+@end
+
+
+static NSDictionary *
+DFBenchmarkMetricsJSONObject(DFCacheMetrics *metrics) {
+    NSDictionary *names = @{ @(DFCacheOperationMemoryLookup) : @"memory_lookup",
+                             @(DFCacheOperationIOQueueWait) : @"io_queue_wait",
+                             @(DFCacheOperationDiskRead) : @"disk_read",
+                             @(DFCacheOperationDecode) : @"decode",
+                             @(DFCacheOperationEncode) : @"encode",
+                             @(DFCacheOperationDiskWrite) : @"disk_write",
+                             @(DFCacheOperationCleanup) : @"cleanup" };
+    NSMutableDictionary *operations = [NSMutableDictionary new];
+    [names enumerateKeysAndObjectsUsingBlock:^(NSNumber *operation, NSString *name, BOOL *stop) {
+        DFCacheLatencyHistogram *histogram = [metrics latencyHistogramForOperation:operation.unsignedIntegerValue];
+        operations[name] = @{ @"count" : @(histogram.count),
+                              @"mean_us" : @(histogram.meanDuration * 1e6),
+                              @"p50_us" : @([histogram durationAtPercentile:50] * 1e6),
+                              @"p99_us" : @([histogram durationAtPercentile:99] * 1e6),
+                              @"p999_us" : @([histogram durationAtPercentile:99.9] * 1e6) };
+    }];
+    return @{ @"memory_hits" : @(metrics.memoryHitCount),
+              @"disk_hits" : @(metrics.diskHitCount),
+              @"misses" : @(metrics.missCount),
+              @"expired_count" : @(metrics.expiredCount),
+              @"expired_bytes" : @(metrics.expiredSize),
+              @"evicted_count" : @(metrics.evictedCount),
+              @"evicted_bytes" : @(metrics.evictedSize),
+              @"max_io_queue_depth" : @(metrics.maximumIOQueueDepth),
+              @"operations" : operations };
+}
+
+int main(int argc, const char * argv[]) {
+    @autoreleasepool {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0) {
+                fprintf(stdout, "%s", DFBenchmarkUsage.UTF8String);
+                return EXIT_SUCCESS;
+            }
+        }
+        NSDictionary *arguments = [[NSUserDefaults standardUserDefaults] volatileDomainForName:NSArgumentDomain];
+        DFBenchmarkConfiguration *configuration = [DFBenchmarkConfiguration configurationWithArguments:arguments];
+        if (!configuration) {
+            fprintf(stderr, "%s", DFBenchmarkUsage.UTF8String);
+            return EXIT_FAILURE;
+        }
+
+        NSString *path = [configuration.directory stringByAppendingPathComponent:[NSString stringWithFormat:@"DFCacheBenchmark-%d", getpid()]];
+        NSError *error;
+        DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:path error:&error];
+        if (!diskCache) {
+            fprintf(stderr, "Failed to create disk cache at %s: %s\n", path.UTF8String, error.localizedDescription.UTF8String);
+            return EXIT_FAILURE;
+        }
+        diskCache.capacity = configuration.diskCapacity;
+        diskCache.cleanupRate = configuration.cleanupRate;
+        DFMemoryCache *memoryCache;
+        if (configuration.memoryCountLimit > 0) {
+            memoryCache = [DFMemoryCache new];
+            memoryCache.segmented = configuration.memorySegmented;
+            memoryCache.countLimit = configuration.memoryCountLimit;
+        }
+        DFCache *cache = [[DFCache alloc] initWithDiskCache:diskCache memoryCache:memoryCache];
+        cache.ioQueueCount = configuration.ioQueueCount;
+        [cache setCleanupTimerEnabled:NO];
+        cache.metricsEnabled = YES;
+
+        DFBenchmark *benchmark = [[DFBenchmark alloc] initWithConfiguration:configuration cache:cache];
+        if (configuration.preload) {
+            [benchmark preload];
+        }
+        [cache resetMetrics];
+
+        const uint64_t startTime = DFBenchmarkTime();
+        DFBenchmarkThreadResult *result = [benchmark run];
+        const double duration = (DFBenchmarkTime() - startTime) / 1e9;
+
+        [benchmark drainPendingWrites];
+        DFCacheMetrics *metrics = [cache metrics];
+
+        NSDictionary *report = @{ @"configuration" : [configuration JSONObject],
+                                  @"duration_s" : @(duration),
+                                  @"operations" : @(result.operationCount),
+                                  @"throughput_ops_s" : @(duration > 0 ? result.operationCount / duration : 0),
+                                  @"reads" : @(result.readCount),
+                                  @"hits" : @(result.hitCount),
+                                  @"hit_ratio" : @(result.readCount ? (double)result.hitCount / result.readCount : 0),
+                                  @"memory_hit_ratio" : @(result.readCount ? (double)metrics.memoryHitCount / result.readCount : 0),
+                                  @"latency" : @{ @"get" : [result.getLatencies summary],
+                                                  @"set" : [result.setLatencies summary],
+                                                  @"remove" : [result.removeLatencies summary],
+                                                  @"batch" : [result.batchLatencies summary] },
+                                  @"disk_bytes" : @([diskCache contentsSize]),
+                                  @"max_rss_bytes" : @(DFBenchmarkMaximumResidentSize()),
+                                  @"cache_metrics" : DFBenchmarkMetricsJSONObject(metrics) };
+
+        [cache removeAllObjects];
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+        NSData *data = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+        if (!data) {
+            fprintf(stderr, "Failed to encode report: %s\n", error.localizedDescription.UTF8String);
+            return EXIT_FAILURE;
+        }
+        if (configuration.outputPath) {
+            if (![data writeToFile:configuration.outputPath options:NSDataWritingAtomic error:&error]) {
+                fprintf(stderr, "Failed to write report: %s\n", error.localizedDescription.UTF8String);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fwrite(data.bytes, 1, data.length, stdout);
+            fputc('\n', stdout);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Builds dfcache-benchmark command line tool from the DFCache sources.
+#
+# usage: Benchmarks/build.sh [output-path]
+
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+OUTPUT="${1:-$ROOT/Benchmarks/build/dfcache-benchmark}"
+
+mkdir -p "$(dirname "$OUTPUT")"
+
+# Source directories contain spaces, arguments are collected as positional parameters.
+set --
+for DIR in "$ROOT/DFCache" "$ROOT"/DFCache/*/ "$ROOT/Benchmarks/DFCacheBenchmark"; do
+    set -- "$@" "-I${DIR%/}"
+done
+for FILE in "$ROOT"/DFCache/*.m "$ROOT"/DFCache/*/*.m "$ROOT"/Benchmarks/DFCacheBenchmark/*.m; do
+    set -- "$@" "$FILE"
+done
+
+xcrun clang -fobjc-arc -O3 -DNDEBUG -mmacosx-version-min=10.12 \
+    -framework Foundation -framework CoreGraphics \
+    -lz -Wl,-weak-lcompression \
+    -o "$OUTPUT" "$@"
+
+echo "$OUTPUT"
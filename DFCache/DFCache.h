@@ -4,35 +4,53 @@
 
 #import <Foundation/Foundation.h>
 #import "DFDiskCache.h"
+#import "DFMemoryCache.h"
 #import "DFValueTransformer.h"
+#import "DFValueTransformerCompressing.h"
+#import "DFValueTransformerPropertyList.h"
 #import "DFValueTransformerFactory.h"
 #import "DFCacheImageDecoder.h"
+#import "DFCacheMetrics.h"
+#import "DFCacheAdmissionFilter.h"
 #import "NSURL+DFExtendedFileAttributes.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
-/*! Extended attribute name used to store metadata (see NSURL+DFExtendedFileAttributes).
+/*! Attribute name used to store metadata (see DFFileStorage attributes API). Disk cache stores attributes in the entry header along with the entry data.
  */
 extern NSString *const DFCacheAttributeMetadataKey;
 
+/*! Priority of the prefetched keys. Keys with higher priority are prefetched first, keys with the same priority are prefetched in the order they were requested.
+ */
+typedef NS_ENUM(NSUInteger, DFCachePrefetchPriority) {
+    DFCachePrefetchPriorityLow,
+    DFCachePrefetchPriorityNormal,
+    DFCachePrefetchPriorityHigh
+};
+
 
 /* DFCache key features:
  
  - Concise, extensible and well-documented API.
  - Thoroughly tested. Written for and used heavily in the iOS application with more than half a million active users.
  - LRU cleanup (discards least recently used items first).
- - Metadata implemented on top on UNIX extended file attributes.
+ - Memory cache with strict cost and count limits, LRU eviction and time to live support.
+ - Native expiration of the cached entries checked without touching the disk.
+ - Metadata stored in the compact binary entry header along with the entry data.
  - First class UIImage support including background image decompression.
- - Builtin support for objects conforming to <NSCoding> protocol. Can be extended to support more protocols and classes.
+ - Builtin support for objects conforming to <NSCoding> protocol and optional compact binary format for property lists. Can be extended to support more protocols and classes.
  - Batch methods to retrieve cached entries.
+ - Prefetching of objects into memory cache with priorities, cancellation and a cost budget. Warm-up of the most frequently accessed objects.
+ - Built-in metrics: hits and misses by tier, latency histograms of the cache operations, IO queue depth and cleanup statistics.
+ - Optional TinyLFU admission filter that keeps one-off keys from churning memory and disk cache.
  */
 
 /*! Asynchronous composite in-memory and on-disk cache with LRU cleanup.
- @discussion Uses NSCache for in-memory caching and DFDiskCache for on-disk caching. Provides API for associating metadata with cache entries.
- @note Encoding and decoding is implemented using id<DFValueTransforming> protocol. DFCache has several builtin value transformers that support object conforming to <NSCoding> protocol and images (UIImage). Use value transformer factory (id<DFValueTransformerFactory>) to extend cache functionality.
- @note All disk IO operations (including operations that associate metadata with cache entries) are run on a serial dispatch queue. If you store the object using DFCache asynchronous API and then immediately retrieve it you are guaranteed to get the object back.
- @note Default disk capacity is 100 Mb. Disk cleanup is implemented using LRU algorithm, the least recently used items are discarded first. Disk cleanup is automatically scheduled to run repeatedly.
- @note NSCache auto-removal policies have change with the release of iOS 7.0. Make sure that you use reasonable total cost limit or count limit. Or else NSCache won't be able to evict memory properly. Typically, the obvious cost is the size of the object in bytes. Keep in mind that DFCache automatically removes all object from memory cache on memory warning for you.
+ @discussion Uses DFMemoryCache (or any NSCache) for in-memory caching and DFDiskCache for on-disk caching. Provides API for associating metadata with cache entries.
+ @note Encoding and decoding is implemented using id<DFValueTransforming> protocol. DFCache has several builtin value transformers that support objects conforming to <NSCoding> protocol, property lists (see DFValueTransformerFactory prefersPropertyListTransformer) and images (UIImage). Use value transformer factory (id<DFValueTransformerFactory>) to extend cache functionality.
+ @note All disk IO operations (including operations that associate metadata with cache entries) for a given key are run on the same serial dispatch queue. If you store the object using DFCache asynchronous API and then immediately retrieve it you are guaranteed to get the object back. Objects are encoded concurrently before they get to IO queues, disk operations for the key wait for the pending write. Operations for different keys might run concurrently when ioQueueCount is greater than 1. Disk cleanup runs on a separate serial queue and doesn't block disk IO, entries that are written while cleanup is discarding them are kept.
+ @note Default disk capacity is 100 Mb. Disk cleanup is driven by the disk cache eviction policy, the least recently used items are discarded first by default (see DFDiskCacheEvictionPolicy). Disk cleanup is started by writes that make disk usage reach high watermark and is also scheduled to run repeatedly. Cleanup runs in short slices, so that it doesn't stall disk IO.
+ @note Cost of the objects stored in memory cache is provided by value transformers (see DFValueTransforming costForValue:). Make sure that you use reasonable total cost limit or count limit. DFMemoryCache enforces limits strictly and evicts the least recently used objects first, NSCache auto-removal policies are unpredictable. Typically, the obvious cost is the size of the object in bytes. Keep in mind that DFCache automatically removes all object from memory cache on memory warning (or under memory pressure on OS X) for you.
  */
 @interface DFCache : NSObject
 
@@ -42,13 +60,13 @@ extern NSString *const DFCacheAttributeMetadataKey;
  */
 - (instancetype)initWithDiskCache:(nullable DFDiskCache *)diskCache memoryCache:(nullable NSCache *)memoryCache NS_DESIGNATED_INITIALIZER;
 
-/*! Initializes cache by creating DFDiskCache instance with a given name and calling designated initializer.
+/*! Initializes cache by creating DFDiskCache instance with a given name and calling designated initializer. Disk cache capacity is set to 100 Mb, cleanup rate is set to 0.5.
  @param name Name used to initialize disk cache. Raises NSInvalidArgumentException if name length is 0.
  @param memoryCache Memory cache. Pass nil to disable in-memory cache.
  */
 - (instancetype)initWithName:(NSString *)name memoryCache:(nullable NSCache *)memoryCache;
 
-/*! Initializes cache by creating DFDiskCache instance with a given name and NSCache instance and calling designated initializer.
+/*! Initializes cache by creating DFDiskCache instance with a given name and DFMemoryCache instance and calling designated initializer. Memory cache total cost limit is set to 15% of physical memory, count limit is set to 1000 objects. Objects whose costs are not reported by value transformers only count towards the count limit.
  @param name Name used to initialize disk cache. Raises NSInvalidArgumentException if name length is 0.
  */
 - (instancetype)initWithName:(NSString *)name;
@@ -69,6 +87,11 @@ extern NSString *const DFCacheAttributeMetadataKey;
  */
 @property (nullable, nonatomic, readonly) NSCache *memoryCache;
 
+/*! Number of serial dispatch queues that disk IO operations are distributed across. Keys are assigned to queues by hash, all the operations for a given key are run on the same queue. Default value is 1 which means that all disk IO operations are serialized.
+ @discussion Operations that affect all entries (like removeAllObjects) wait for all queues to finish pending operations. When the value changes new queues wait for the operations that were already dispatched to the previous queues.
+ */
+@property (nonatomic) NSUInteger ioQueueCount;
+
 #pragma mark - Read
 
 /*! Reads object from either in-memory or on-disk cache. Refreshes object in memory cache it it was retrieved from disk. Uses value transformer provided by value transformer factory.
@@ -85,6 +108,7 @@ extern NSString *const DFCacheAttributeMetadataKey;
 #pragma mark - Write
 
 /*! Stores object into memory cache. Retrieves value transformer from factory, encodes object and stores data into disk cache. Value transformer gets associated with data.
+ @discussion Object is encoded on the processing queue and the encoded data is then written on the IO queue, so encoding doesn't block disk IO. Pending writes for the same key are merged, if the object is stored again before the previous write reaches disk only the last object is written.
  @param object The object to store into memory cache.
  @param key The unique key.
  */
@@ -97,6 +121,20 @@ extern NSString *const DFCacheAttributeMetadataKey;
  */
 - (void)storeObject:(id)object forKey:(NSString *)key data:(nullable NSData *)data;
 
+/*! Stores object into memory cache and encoded object into disk cache. Object expires after the given time interval.
+ @discussion Expired objects are never returned. Expiration is checked against the in-memory index of the disk cache without touching the disk and against DFMemoryCache time to live (objects stored in NSCache are not expired in memory). Expired entries are removed lazily when accessed and by disk cleanup before any other entries. For more info see DFDiskCache setData:attributes:expirationDate:forKey:.
+ @param object The object to store into memory cache.
+ @param key The unique key.
+ @param timeToLive Time interval after which the object expires. Time to live of 0 means that object never expires.
+ */
+- (void)storeObject:(id)object forKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive;
+
+/*! Stores object into memory cache and data into disk cache. Object expires after the given time interval. For more info see storeObject:forKey:timeToLive:.
+ @param data Data to store into disk cache.
+ @param timeToLive Time interval after which the object expires. Time to live of 0 means that object never expires.
+ */
+- (void)storeObject:(id)object forKey:(NSString *)key data:(nullable NSData *)data timeToLive:(NSTimeInterval)timeToLive;
+
 /*! Stores object into memory cache. Retrieves value transformer from factory and uses it to calculate object cost.
  @param object The object to store into memory cache.
  */
@@ -127,6 +165,7 @@ extern NSString *const DFCacheAttributeMetadataKey;
 - (nullable NSDictionary *)metadataForKey:(NSString *)key;
 
 /*! Sets metadata for provided key. 
+ @discussion Metadata that consists of property list objects is encoded as a binary property list, other metadata is archived using NSKeyedArchiver.
  @warning Method will have no effect if there is no entry under the given key.
  @param metadata Dictionary with metadata.
  @param key The unique key.
@@ -148,7 +187,7 @@ extern NSString *const DFCacheAttributeMetadataKey;
 #pragma mark - Cleanup
 
 /*! Sets cleanup time interval and schedules cleanup timer with the given time interval. 
- @discussion Cleanup timer is scheduled only if automatic cleanup is enabled. Default value is 60 seconds.
+ @discussion Cleanup timer is scheduled only if automatic cleanup is enabled. Default value is 60 seconds. Timer is a fallback, writes that make disk usage reach high watermark start cleanup immediately.
  */
 - (void)setCleanupTimerInterval:(NSTimeInterval)timeInterval;
 
@@ -156,10 +195,80 @@ extern NSString *const DFCacheAttributeMetadataKey;
  */
 - (void)setCleanupTimerEnabled:(BOOL)enabled;
 
-/*! Cleanup disk cache asynchronously. For more info see DFDiskCache - (void)cleanup.
+/*! Duration of a single cleanup slice. Default value is 5 ms.
+ @discussion Cleanup is performed in slices that discard entries until the duration is exhausted, cleanup yields between slices. Limits the time that disk operations compete with cleanup.
+ */
+@property (nonatomic) NSTimeInterval cleanupSliceDuration;
+
+/*! Cleanup disk cache asynchronously in time-bounded slices. For more info see DFDiskCache - (void)cleanupWithTimeBudget:.
+ @discussion Cleanup is started automatically when writes make disk usage reach high watermark of the disk cache. Cleanup timer is a fallback.
  */
 - (void)cleanupDiskCache;
 
+#pragma mark - Prefetch
+
+/*! Maximum total cost of the prefetched objects. Prefetching pauses when the limit is reached and resumes when prefetching of some of the keys is cancelled or when prefetched objects are evicted from memory cache (eviction is noticed by the lookups that miss and when more keys are prefetched). Default value is 0 which means that the limit is a quarter of the memory cache total cost limit (no limit if memory cache doesn't have one).
+ @discussion Cost of the object is known only after it's decoded, the limit might be exceeded by the objects that are being prefetched when the limit is reached.
+ */
+@property (nonatomic) NSUInteger prefetchCostLimit;
+
+/*! Prefetches objects for the given keys with normal priority. For more info see prefetchObjectsForKeys:priority:.
+ */
+- (void)prefetchObjectsForKeys:(NSArray<NSString *> *)keys;
+
+/*! Reads and decodes objects for the given keys and puts them into memory cache ahead of the lookups.
+ @discussion Objects are read and decoded on a background priority queue by a small number of workers, so that prefetching doesn't compete with the regular lookups. Keys that are already in memory cache or are being read are skipped. Prefetching keys that are already waiting to be prefetched changes their priority. Does nothing if the receiver doesn't have memory cache.
+ @param keys Array of the unique keys ordered by importance.
+ @param priority Priority of the keys.
+ */
+- (void)prefetchObjectsForKeys:(NSArray<NSString *> *)keys priority:(DFCachePrefetchPriority)priority;
+
+/*! Cancels prefetching for the given keys. Objects that were already prefetched stay in memory cache but no longer count towards prefetch cost limit. Disk reads that are already in progress are not interrupted.
+ */
+- (void)cancelPrefetchingForKeys:(NSArray<NSString *> *)keys;
+
+/*! Cancels prefetching for all keys.
+ */
+- (void)cancelAllPrefetching;
+
+/*! Cancels prefetching for all the keys that are not in the given array and prefetches the given keys. Use this method to keep prefetching in sync with the visible area of the scrolling list.
+ @param keys Array of the unique keys that are going to be needed soon, ordered by importance.
+ */
+- (void)updatePrefetchWindowWithKeys:(NSArray<NSString *> *)keys priority:(DFCachePrefetchPriority)priority;
+
+/*! Prefetches objects that were accessed most frequently with low priority. Access frequency is recorded by the disk cache and persists between launches, call this method on startup to warm up memory cache.
+ @param count Maximum number of objects to prefetch.
+ */
+- (void)prefetchMostFrequentlyAccessedObjects:(NSUInteger)count;
+
+#pragma mark - Admission
+
+/*! Admission filter that decides whether the objects stored by the receiver are worth putting into memory cache and writing to disk cache. Default value is nil which means that all objects are admitted.
+ @discussion Lookups and writes of objects (and data) record accesses to the keys. Filter is consulted only when admitting the entry might evict other entries: when the object doesn't fit into DFMemoryCache limits (always for other NSCache instances) and when disk usage has reached high watermark of the disk cache. Disk admission is decided on the processing queue before the object is encoded, it doesn't block the caller, objects that are rejected by the disk tier are not encoded. Rejected entry replaces the previous entry for the key, the previous entry is removed from the tier. Objects read from disk and prefetched objects are always put into memory cache. Streamed writes are not filtered.
+ */
+@property (nullable, atomic) DFCacheAdmissionFilter *admissionFilter;
+
+#pragma mark - Metrics
+
+/*! Enables recording of the cache metrics. Default value is NO.
+ @discussion Metrics are recorded using atomic counters and latency histograms without taking locks. When metrics are disabled each operation pays for a single check.
+ */
+@property (nonatomic, getter=isMetricsEnabled) BOOL metricsEnabled;
+
+/*! Returns snapshot of the cache metrics. Returns nil if metrics are disabled.
+ */
+- (nullable DFCacheMetrics *)metrics;
+
+/*! Resets metrics counters and histograms.
+ */
+- (void)resetMetrics;
+
+/*! Periodically reports snapshot of the cache metrics while metrics are enabled.
+ @param timeInterval Reporting time interval.
+ @param handler Called on the main thread with the metrics snapshot. Pass nil to stop reporting.
+ */
+- (void)setMetricsReportingInterval:(NSTimeInterval)timeInterval handler:(void (^__nullable)(DFCacheMetrics *metrics))handler;
+
 #pragma mark - Data
 
 /*! Retrieves data from disk cache.
@@ -179,6 +288,38 @@ extern NSString *const DFCacheAttributeMetadataKey;
  */
 - (void)storeData:(NSData *)data forKey:(NSString *)key;
 
+/*! Stores data into disk cache asynchronously. Data expires after the given time interval.
+ @param timeToLive Time interval after which the data expires. Time to live of 0 means that data never expires.
+ */
+- (void)storeData:(NSData *)data forKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive;
+
+#pragma mark - Streaming
+
+/*! Stores data produced by the block into disk cache asynchronously, chunk by chunk, so that memory usage doesn't depend on the size of the data.
+ @discussion Block is called on a background queue, it writes the data using the given writer and returns YES when finished or NO to cancel the write. Data is written into a temporary file, the entry is atomically replaced on the IO queue for the key after the block returns YES. Writes that are pending for the key at that moment are written before the entry is replaced. Object for the key is removed from memory cache when the entry is replaced.
+ @param timeToLive Time interval after which the data expires. Time to live of 0 means that data never expires.
+ @param completion Completion block that is called on the main thread with YES if the entry was replaced.
+ */
+- (void)storeDataForKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive writingBlock:(BOOL (^)(DFFileStorageWriter *writer))block completion:(void (^__nullable)(BOOL success))completion;
+
+/*! Reads the stream on a background queue and stores its contents into disk cache asynchronously. Stream is opened if needed and is closed when it's read. For more info see storeDataForKey:timeToLive:writingBlock:completion:.
+ */
+- (void)storeDataFromStream:(NSInputStream *)stream forKey:(NSString *)key completion:(void (^__nullable)(BOOL success))completion;
+
+/*! Returns input stream that reads the data for the given key from disk cache in chunks. Stream reads the data as it was when the stream was created even if the entry is replaced or removed afterwards.
+ @note Stream should be read synchronously, it doesn't deliver events when scheduled in a run loop.
+ */
+- (nullable NSInputStream *)cachedDataStreamForKey:(NSString *)key;
+
+/*! Reads up to length bytes of the data for the given key starting at the given offset from disk cache without reading the rest of the data. Returns shorter (or empty) data if the range extends beyond the end of the data.
+ @param completion Completion block that is called on the main thread with nil if there is no data for the given key.
+ */
+- (void)cachedDataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length completion:(void (^__nullable)(NSData *__nullable data))completion;
+
+/*! Reads up to length bytes of the data for the given key starting at the given offset from disk cache synchronously.
+ */
+- (nullable NSData *)cachedDataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length;
+
 @end
 
 
@@ -194,11 +335,18 @@ extern NSString *const DFCacheAttributeMetadataKey;
 @interface DFCache (DFCacheExtended)
 
 /*! Retrieves batch of NSData instances for the given keys.
+ @discussion Batch methods group keys by IO queues and take a single queue hop per chunk of keys (up to 256 keys) during which files are read concurrently.
  @param keys Array of the unique keys.
  @param completion Completion block. Batch dictionary contains key:data pairs.
  */
 - (void)batchCachedDataForKeys:(NSArray *)keys completion:(void (^__nullable)(NSDictionary *__nullable batch))completion;
 
+/*! Retrieves batch of NSData instances for the given keys, partial results are reported as soon as they are read.
+ @param progressHandler Called on the main thread for each partial batch with key:data pairs.
+ @param completion Completion block. Batch dictionary contains all key:data pairs.
+ */
+- (void)batchCachedDataForKeys:(NSArray *)keys progressHandler:(void (^__nullable)(NSDictionary *partialBatch))progressHandler completion:(void (^__nullable)(NSDictionary *__nullable batch))completion;
+
 /*! Returns dictionary with NSData instances that correspond to the given keys.
  @param keys Array of the unique keys.
  @return NSDictionary instance with key:data pairs.
@@ -206,11 +354,18 @@ extern NSString *const DFCacheAttributeMetadataKey;
 - (nullable NSDictionary *)batchCachedDataForKeys:(NSArray *)keys;
 
 /*! Retrieves batch of objects that correspond to the given keys.
+ @discussion Objects found in the memory cache are reported first. The rest are read in batch, decoded concurrently and put into the memory cache.
  @param keys Array of the unique keys.
  @param completion Completion block. Batch dictionary contains key : object pairs retrieved from receiver.
  */
 - (void)batchCachedObjectsForKeys:(NSArray *)keys completion:(void (^__nullable)(NSDictionary *__nullable batch))completion;
 
+/*! Retrieves batch of objects that correspond to the given keys, partial results are reported as soon as they are available. Use this method for very large key sets.
+ @param progressHandler Called on the main thread for each partial batch with key : object pairs.
+ @param completion Completion block. Batch dictionary contains all key : object pairs.
+ */
+- (void)batchCachedObjectsForKeys:(NSArray *)keys progressHandler:(void (^__nullable)(NSDictionary *partialBatch))progressHandler completion:(void (^__nullable)(NSDictionary *__nullable batch))completion;
+
 /*! Returns batch of objects that correspond to the given keys.
  @param keys Array of the unique keys.
  @return NSDictionary instance with key:data pairs.
@@ -3,37 +3,229 @@
 // Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
 
 #import "DFCache.h"
+#import "DFCacheMetricsRecorder.h"
 #import "DFCachePrivate.h"
 #import "DFCacheTimer.h"
 #import "DFValueTransformer.h"
 #import "DFValueTransformerFactory.h"
-#import "NSURL+DFExtendedFileAttributes.h"
+#import <pthread.h>
 
 
 NSString *const DFCacheAttributeMetadataKey = @"_df_cache_metadata_key";
 
-/*! Extended attribute name used to store value transformer associated with data.
+/*! Maximum number of keys read during a single IO queue hop by batch methods.
+ */
+static const NSUInteger DFCacheBatchChunkSize = 256;
+
+/*! Maximum number of files read concurrently by batch methods.
+ */
+static const NSUInteger DFCacheBatchMaxConcurrentReads = 8;
+
+/*! Maximum number of objects prefetched concurrently.
+ */
+static const NSUInteger DFCachePrefetchMaxConcurrentReads = 2;
+
+/*! Pause between cleanup slices.
+ */
+static const NSTimeInterval DFCacheCleanupSliceInterval = 0.01;
+
+/*! Count limit of the memory cache created by initWithName:. Bounds memory cache when value transformers don't report object costs.
+ */
+static const NSUInteger DFCacheDefaultMemoryCacheCountLimit = 1000;
+
+/*! Attribute name used to store value transformer associated with data.
  */
 static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_value_transformer_name_key";
 
+/*! Value transformer name is stored as UTF-8 string. Previous versions stored names archived with NSKeyedArchiver.
+ */
+static NSString *
+_DFCacheDecodeValueTransformerName(NSData *data) {
+    if (!data.length) {
+        return nil;
+    }
+    if (data.length >= 6 && memcmp(data.bytes, "bplist", 6) == 0) {
+        id name = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+        return [name isKindOfClass:[NSString class]] ? name : nil;
+    }
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+/*! Metadata that consists of property list objects is encoded as a binary property list which is much more compact and faster to decode than a keyed archive.
+ */
+static NSData *
+_DFCacheEncodeMetadata(NSDictionary *metadata) {
+    NSData *data;
+    if ([NSPropertyListSerialization propertyList:metadata isValidForFormat:NSPropertyListBinaryFormat_v1_0]) {
+        data = [NSPropertyListSerialization dataWithPropertyList:metadata format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+    }
+    return data ?: [NSKeyedArchiver archivedDataWithRootObject:metadata];
+}
+
+static void
+_DFCacheCompleteStreamingWrite(void (^completion)(BOOL success), BOOL success) {
+    if (completion) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(success);
+        });
+    }
+}
+
+/*! Keyed archives are property lists themselves, they are recognized by the archiver key. Metadata archived by the previous versions is decoded the same way.
+ */
+static NSDictionary *
+_DFCacheDecodeMetadata(NSData *data) {
+    if (!data) {
+        return nil;
+    }
+    id metadata = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:nil];
+    if ([metadata isKindOfClass:[NSDictionary class]] && metadata[@"$archiver"] && metadata[@"$objects"]) {
+        metadata = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    }
+    return [metadata isKindOfClass:[NSDictionary class]] ? metadata : nil;
+}
+
+
+/*! Disk read and decode that is shared by all the concurrent lookups for the same key.
+ */
+@interface DFCachePendingRead : NSObject
+
+/*! Group is entered when the read is created and is left when the object is read.
+ */
+@property (nonatomic, readonly) dispatch_group_t group;
+@property (nullable, nonatomic) id object;
+
+/*! Cost of the object, set when the object is put into the memory cache.
+ */
+@property (nonatomic) NSUInteger cost;
+
+/*! Set when the object is written or removed while being read. Result of the invalidated read is still delivered to the lookups that joined it but is not put into the memory cache.
+ */
+@property (atomic, getter=isInvalidated) BOOL invalidated;
+
+@end
+
+@implementation DFCachePendingRead
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _group = dispatch_group_create();
+        dispatch_group_enter(_group);
+    }
+    return self;
+}
+
+@end
+
+
+/*! Write that is buffered until its data is encoded and written to disk. Writes for the same key are merged, only the last one is written.
+ */
+@interface DFCachePendingWrite : NSObject
+
+/*! Group is entered while the write is being processed: admitted and encoded.
+ */
+@property (nonatomic, readonly) dispatch_group_t group;
+@property (nullable, nonatomic) NSData *data;
+/*! YES if the write was rejected by the admission filter. Rejected write removes the previous entry for the key.
+ */
+@property (nonatomic, getter=isRejected) BOOL rejected;
+@property (nullable, nonatomic) NSString *valueTransformerName;
+@property (nullable, nonatomic) NSDate *expirationDate;
+
+@end
+
+@implementation DFCachePendingWrite
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _group = dispatch_group_create();
+    }
+    return self;
+}
+
+@end
+
+
+@interface DFCache ()
+
+/*! Serial dispatch queues used for disk IO operations. Keys are distributed across queues by hash so that all operations for a given key are run on the same queue. If you store the object using DFCache asynchronous API and then immediately try to retrieve it then you are guaranteed to get the object back.
+ */
+@property (atomic) NSArray *ioQueues;
+
+/*! Concurrent dispatch queue used for dispatching blocks that decode cached data.
+ */
+@property (nonatomic, readonly) dispatch_queue_t processingQueue;
+
+/*! Records cache metrics, nil when metrics are disabled.
+ */
+@property (nullable, atomic) DFCacheMetricsRecorder *metricsRecorder;
+
+- (DFCachePendingRead *)_pendingReadForKey:(NSString *)key isNew:(BOOL *)isNew;
+- (void)_completeRead:(DFCachePendingRead *)read forKey:(NSString *)key object:(id)object valueTransformer:(id<DFValueTransforming>)valueTransformer expirationDate:(NSDate *)expirationDate;
+- (void)_enumerateIOQueuesForKeys:(NSArray *)keys usingBlock:(void (^)(dispatch_queue_t queue, NSArray *keys))block;
+- (void)_flushPendingWriteForKey:(NSString *)key;
+
+@end
 
 @implementation DFCache {
     BOOL _cleanupTimerEnabled;
     NSTimeInterval _cleanupTimeInterval;
     NSTimer *__weak _cleanupTimer;
     
-    /*! Serial dispatch queue used for all disk IO operations. If you store the object using DFCache asynchronous API and then immediately try to retrieve it then you are guaranteed to get the object back.
+    /*! Serial dispatch queue used for disk cleanup. Cleanup doesn't block IO queues.
      */
-    dispatch_queue_t _ioQueue;
-    
-    /*! Concurrent dispatch queue used for dispatching blocks that decode cached data.
+    dispatch_queue_t _cleanupQueue;
+
+    /*! YES while cleanup slices are being performed. Only accessed on the cleanup queue.
+     */
+    BOOL _cleanupInProgress;
+
+    /*! Reads that are currently in progress, concurrent lookups for the same key join existing reads.
+     */
+    NSMutableDictionary *_pendingReads;
+    /*! Guards pending reads. Recursive, completed reads put objects into the memory cache with the lock held and memory cache might call back into the cache (e.g. from eviction handler).
+     */
+    pthread_mutex_t _pendingReadsMutex;
+
+    /*! Writes that are not yet written to disk, the last write for each key wins.
+     */
+    NSMutableDictionary *_pendingWrites;
+    pthread_mutex_t _pendingWritesMutex;
+
+    /*! Keys waiting to be prefetched, one ordered set per priority.
+     */
+    NSArray *_prefetchQueues;
+    /*! Keys that are being prefetched.
+     */
+    NSMutableSet *_prefetchingKeys;
+    /*! Costs of the prefetched objects that count towards prefetch cost limit.
+     */
+    NSMutableDictionary *_prefetchedCosts;
+    NSUInteger _prefetchedCost;
+    NSUInteger _prefetchWorkerCount;
+    pthread_mutex_t _prefetchMutex;
+
+    /*! Timer that reports metrics on the main queue.
+     */
+    dispatch_source_t _metricsTimer;
+
+    /*! Purges memory cache under memory pressure on the platforms that don't send memory warnings.
      */
-    dispatch_queue_t _processingQueue;
+    dispatch_source_t _memoryPressureSource;
 }
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
     [_cleanupTimer invalidate];
+    if (_metricsTimer) {
+        dispatch_source_cancel(_metricsTimer);
+    }
+    if (_memoryPressureSource) {
+        dispatch_source_cancel(_memoryPressureSource);
+    }
+    pthread_mutex_destroy(&_pendingReadsMutex);
+    pthread_mutex_destroy(&_pendingWritesMutex);
+    pthread_mutex_destroy(&_prefetchMutex);
 }
 
 - (instancetype)initWithDiskCache:(DFDiskCache *)diskCache memoryCache:(NSCache *)memoryCache {
@@ -43,15 +235,33 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         
         _valueTransfomerFactory = [DFValueTransformerFactory defaultFactory];
         
-        _ioQueue = dispatch_queue_create("DFCache::IOQueue", DISPATCH_QUEUE_SERIAL);
+        _ioQueueCount = 1;
+        self.ioQueues = [DFCache _ioQueuesWithCount:_ioQueueCount];
+        _cleanupQueue = dispatch_queue_create("DFCache::CleanupQueue", DISPATCH_QUEUE_SERIAL);
         _processingQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
         
+        _pendingReads = [NSMutableDictionary new];
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&_pendingReadsMutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        _pendingWrites = [NSMutableDictionary new];
+        pthread_mutex_init(&_pendingWritesMutex, NULL);
+        _prefetchQueues = @[ [NSMutableOrderedSet new], [NSMutableOrderedSet new], [NSMutableOrderedSet new] ];
+        _prefetchingKeys = [NSMutableSet new];
+        _prefetchedCosts = [NSMutableDictionary new];
+        pthread_mutex_init(&_prefetchMutex, NULL);
+        
+        _cleanupSliceDuration = 0.005;
         _cleanupTimeInterval = 60.f;
         _cleanupTimerEnabled = YES;
         [self _scheduleCleanupTimer];
         
 #if TARGET_OS_IOS || TARGET_OS_TV
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+#else
+        [self _observeMemoryPressure];
 #endif
     }
     return self;
@@ -68,8 +278,10 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
 }
 
 - (instancetype)initWithName:(NSString *)name {
-    NSCache *memoryCache = [NSCache new];
+    DFMemoryCache *memoryCache = [DFMemoryCache new];
     memoryCache.name = name;
+    memoryCache.totalCostLimit = (NSUInteger)MIN([NSProcessInfo processInfo].physicalMemory * 0.15, NSUIntegerMax);
+    memoryCache.countLimit = DFCacheDefaultMemoryCacheCountLimit;
     return [self initWithName:name memoryCache:memoryCache];
 }
 
@@ -85,100 +297,375 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         _dwarf_cache_callback(completion, nil);
         return;
     }
-    id object = [self.memoryCache objectForKey:key];
+    [self.admissionFilter recordAccessForKey:key];
+    id object = [self _memoryCachedObjectForKey:key];
     if (object) {
         _dwarf_cache_callback(completion, object);
         return;
     }
-    dispatch_async(_processingQueue, ^{
-        @autoreleasepool {
-            id object = [self _cachedObjectForKey:key];
-            _dwarf_cache_callback(completion, object);
-        }
-    });
+    BOOL isNewRead;
+    DFCachePendingRead *read = [self _pendingReadForKey:key isNew:&isNewRead];
+    if (isNewRead) {
+        dispatch_async(_processingQueue, ^{
+            @autoreleasepool {
+                [self _performRead:read forKey:key];
+            }
+        });
+    }
+    if (completion) {
+        dispatch_group_notify(read.group, dispatch_get_main_queue(), ^{
+            completion(read.object);
+        });
+    }
 }
 
 - (id)cachedObjectForKey:(NSString *)key {
     if (!key.length) {
         return nil;
     }
-    id object = [self.memoryCache objectForKey:key];
+    [self.admissionFilter recordAccessForKey:key];
+    id object = [self _memoryCachedObjectForKey:key];
     if (object) {
         return object;
     }
-    @autoreleasepool {
-        return [self _cachedObjectForKey:key];
+    BOOL isNewRead;
+    DFCachePendingRead *read = [self _pendingReadForKey:key isNew:&isNewRead];
+    if (isNewRead) {
+        @autoreleasepool {
+            [self _performRead:read forKey:key];
+        }
+    } else {
+        dispatch_group_wait(read.group, DISPATCH_TIME_FOREVER);
+    }
+    return read.object;
+}
+
+/*! Returns read that is in progress for the given key or registers a new one. The caller that registered a new read is responsible for performing it.
+ */
+- (DFCachePendingRead *)_pendingReadForKey:(NSString *)key isNew:(BOOL *)isNew {
+    pthread_mutex_lock(&_pendingReadsMutex);
+    DFCachePendingRead *read = _pendingReads[key];
+    *isNew = read == nil;
+    if (!read) {
+        read = [DFCachePendingRead new];
+        _pendingReads[key] = read;
     }
+    pthread_mutex_unlock(&_pendingReadsMutex);
+    return read;
+}
+
+- (void)_performRead:(DFCachePendingRead *)read forKey:(NSString *)key {
+    id<DFValueTransforming> valueTransformer;
+    NSDate *expirationDate;
+    id object = [self _cachedObjectForKey:key valueTransformer:&valueTransformer expirationDate:&expirationDate];
+    [self _completeRead:read forKey:key object:object valueTransformer:valueTransformer expirationDate:expirationDate];
 }
 
-- (id)_cachedObjectForKey:(NSString *)key {
+/*! Delivers the object to the lookups that joined the read and puts the object into the memory cache unless the read was invalidated.
+ @param expirationDate Expiration date of the disk entry that the object was read from, the object lives in memory cache only until the entry expires.
+ @discussion Invalidation is checked and the object is put into the memory cache under the same lock that writes take to invalidate the read. The write that doesn't invalidate the read puts its object into the memory cache after the read does, so the stale object never replaces it.
+ */
+- (void)_completeRead:(DFCachePendingRead *)read forKey:(NSString *)key object:(id)object valueTransformer:(id<DFValueTransforming>)valueTransformer expirationDate:(NSDate *)expirationDate {
+    read.object = object;
+    NSTimeInterval timeToLive = 0;
+    if (object) {
+        if (expirationDate) {
+            timeToLive = MAX([expirationDate timeIntervalSinceNow], DBL_MIN);
+        }
+        read.cost = [self _costForObject:object valueTransformer:valueTransformer];
+    }
+    pthread_mutex_lock(&_pendingReadsMutex);
+    if (_pendingReads[key] == read) {
+        [_pendingReads removeObjectForKey:key];
+    }
+    if (!read.isInvalidated && object) {
+        [self _setObject:object forKey:key cost:read.cost timeToLive:timeToLive];
+    }
+    pthread_mutex_unlock(&_pendingReadsMutex);
+    dispatch_group_leave(read.group);
+}
+
+/*! Invalidates read that is in progress for the given key so that a stale object doesn't get into the memory cache. Lookups that start after invalidation start a new read.
+ */
+- (void)_invalidatePendingReadForKey:(NSString *)key {
+    pthread_mutex_lock(&_pendingReadsMutex);
+    DFCachePendingRead *read = _pendingReads[key];
+    if (read) {
+        read.invalidated = YES;
+        [_pendingReads removeObjectForKey:key];
+    }
+    pthread_mutex_unlock(&_pendingReadsMutex);
+}
+
+- (void)_invalidateAllPendingReads {
+    pthread_mutex_lock(&_pendingReadsMutex);
+    for (DFCachePendingRead *read in [_pendingReads allValues]) {
+        read.invalidated = YES;
+    }
+    [_pendingReads removeAllObjects];
+    pthread_mutex_unlock(&_pendingReadsMutex);
+}
+
+/*! Reads data, attributes and expiration date of the entry on the IO queue for the key, so that they all belong to the same version of the entry, and decodes the data.
+ */
+- (id)_cachedObjectForKey:(NSString *)key valueTransformer:(id<DFValueTransforming> *)outValueTransformer expirationDate:(NSDate **)outExpirationDate {
     NSData *__block data;
     NSString *__block valueTransformerName;
-    dispatch_sync(_ioQueue, ^{
-        NSURL *fileURL = [self.diskCache URLForKey:key];
-        data = [NSData dataWithContentsOfURL:fileURL];
-        if (data) {
-            valueTransformerName = [fileURL df_extendedAttributeValueForKey:DFCacheAttributeValueTransformerNameKey error:nil];
-        }
-    });
+    NSDate *__block expirationDate;
+    dispatch_sync([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        NSDictionary *attributes;
+        data = [self _diskDataForKey:key attributes:&attributes expirationDate:&expirationDate];
+        valueTransformerName = _DFCacheDecodeValueTransformerName(attributes[DFCacheAttributeValueTransformerNameKey]);
+    }]);
+    *outExpirationDate = expirationDate;
     id<DFValueTransforming> valueTransformer = [self.valueTransfomerFactory valueTransformerForName:valueTransformerName];
+    *outValueTransformer = valueTransformer;
+    return [self _decodeData:data valueTransformer:valueTransformer];
+}
+
+/*! Returns object from memory cache and records memory lookup. Object that was prefetched but is no longer in memory cache stops counting towards prefetch cost limit.
+ */
+- (id)_memoryCachedObjectForKey:(NSString *)key {
+    NSCache *memoryCache = self.memoryCache;
+    if (!memoryCache) {
+        return nil;
+    }
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    const uint64_t startTime = metrics ? _dwarf_cache_time() : 0;
+    id object = [memoryCache objectForKey:key];
+    if (metrics) {
+        [metrics recordOperation:DFCacheOperationMemoryLookup startTime:startTime];
+        if (object) {
+            [metrics recordMemoryHit];
+        }
+    }
+    if (!object) {
+        [self _releaseEvictedPrefetchedObjectForKey:key];
+    }
+    return object;
+}
+
+/*! Reads data from disk cache and records disk read. Must be called on the IO queue for the key.
+ @param expirationDate Expiration date of the entry, read along with the data.
+ */
+- (NSData *)_diskDataForKey:(NSString *)key attributes:(NSDictionary **)attributes expirationDate:(NSDate **)expirationDate {
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    if (!metrics) {
+        return [self.diskCache dataForKey:key attributes:attributes expirationDate:expirationDate];
+    }
+    const uint64_t startTime = _dwarf_cache_time();
+    NSData *data = [self.diskCache dataForKey:key attributes:attributes expirationDate:expirationDate];
+    [metrics recordOperation:DFCacheOperationDiskRead startTime:startTime];
+    if (data) {
+        [metrics recordDiskHit];
+    } else {
+        [metrics recordMiss];
+    }
+    return data;
+}
+
+- (id)_decodeData:(NSData *)data valueTransformer:(id<DFValueTransforming>)valueTransformer {
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    if (!metrics || !data) {
+        return [valueTransformer reverseTransfomedValue:data];
+    }
+    const uint64_t startTime = _dwarf_cache_time();
     id object = [valueTransformer reverseTransfomedValue:data];
-    [self _setObject:object forKey:key valueTransformer:valueTransformer];
+    [metrics recordOperation:DFCacheOperationDecode startTime:startTime];
     return object;
 }
 
 #pragma mark - Write
 
 - (void)storeObject:(id)object forKey:(NSString *)key {
-    [self storeObject:object forKey:key data:nil];
+    [self storeObject:object forKey:key data:nil timeToLive:0];
+}
+
+- (void)storeObject:(id)object forKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive {
+    [self storeObject:object forKey:key data:nil timeToLive:timeToLive];
 }
 
 - (void)storeObject:(id)object forKey:(NSString *)key data:(NSData *)data {
+    [self storeObject:object forKey:key data:data timeToLive:0];
+}
+
+- (void)storeObject:(id)object forKey:(NSString *)key data:(NSData *)data timeToLive:(NSTimeInterval)timeToLive {
     if (!key.length) {
         return;
     }
     NSString *valueTransformerName = [self.valueTransfomerFactory valueTransformerNameForValue:object];
     id<DFValueTransforming> valueTransformer = [self.valueTransfomerFactory valueTransformerForName:valueTransformerName];
     
-    [self _setObject:object forKey:key valueTransformer:valueTransformer];
+    [self.admissionFilter recordAccessForKey:key];
+    [self _invalidatePendingReadForKey:key];
+    if (object) {
+        NSUInteger cost = [self _costForObject:object valueTransformer:valueTransformer];
+        if ([self _admitsObjectWithCost:cost forKey:key]) {
+            [self _setObject:object forKey:key cost:cost timeToLive:timeToLive];
+        } else {
+            [self.memoryCache removeObjectForKey:key];
+        }
+    }
     
     if (!data && !valueTransformer) {
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        @autoreleasepool {
-            NSData *encodedData = data;
-            if (!encodedData) {
-                encodedData = [valueTransformer transformedValue:object];
-            }
-            if (encodedData) {
-                NSURL *fileURL = [self.diskCache URLForKey:key];
-                [encodedData writeToURL:fileURL atomically:YES];
-                if (valueTransformerName) {
-                    [fileURL df_setExtendedAttributeValue:valueTransformerName forKey:DFCacheAttributeValueTransformerNameKey];
-                }
-            }
-        }
-    });
+    DFCachePendingWrite *write = [DFCachePendingWrite new];
+    write.data = data;
+    write.valueTransformerName = valueTransformerName;
+    write.expirationDate = timeToLive > 0 ? [NSDate dateWithTimeIntervalSinceNow:timeToLive] : nil;
+    [self _processWrite:write forKey:key object:object valueTransformer:valueTransformer];
+    [self _enqueueWrite:write forKey:key];
 }
 
 - (void)setObject:(id)object forKey:(NSString *)key {
-    [self _setObject:object forKey:key valueTransformer:nil];
+    if (object && key.length) {
+        [self _invalidatePendingReadForKey:key];
+    }
+    [self _setObject:object forKey:key valueTransformer:nil timeToLive:0];
+}
+
+- (NSData *)_encodeObject:(id)object valueTransformer:(id<DFValueTransforming>)valueTransformer {
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    if (!metrics) {
+        return [valueTransformer transformedValue:object];
+    }
+    const uint64_t startTime = _dwarf_cache_time();
+    NSData *data = [valueTransformer transformedValue:object];
+    [metrics recordOperation:DFCacheOperationEncode startTime:startTime];
+    return data;
 }
 
-- (void)_setObject:(id)object forKey:(NSString *)key valueTransformer:(id<DFValueTransforming>)valueTransformer {
+/*! Time to live is only supported by DFMemoryCache, NSCache keeps objects until they are evicted.
+ */
+- (void)_setObject:(id)object forKey:(NSString *)key valueTransformer:(id<DFValueTransforming>)valueTransformer timeToLive:(NSTimeInterval)timeToLive {
     if (!object || !key.length) {
         return;
     }
+    [self _setObject:object forKey:key cost:[self _costForObject:object valueTransformer:valueTransformer] timeToLive:timeToLive];
+}
+
+- (void)_setObject:(id)object forKey:(NSString *)key cost:(NSUInteger)cost timeToLive:(NSTimeInterval)timeToLive {
+    NSCache *memoryCache = self.memoryCache;
+    if (timeToLive > 0 && [memoryCache isKindOfClass:[DFMemoryCache class]]) {
+        [(DFMemoryCache *)memoryCache setObject:object forKey:key cost:cost timeToLive:timeToLive];
+    } else {
+        [memoryCache setObject:object forKey:key cost:cost];
+    }
+}
+
+/*! Returns cost of the object provided by the value transformer. Transformer is retrieved from factory if it's not provided.
+ */
+- (NSUInteger)_costForObject:(id)object valueTransformer:(id<DFValueTransforming>)valueTransformer {
     if (!valueTransformer) {
         NSString *valueTransformerName = [self.valueTransfomerFactory valueTransformerNameForValue:object];
         valueTransformer = [self.valueTransfomerFactory valueTransformerForName:valueTransformerName];
     }
-    NSUInteger cost = 0;
-    if ([valueTransformer respondsToSelector:@selector(costForValue:)]) {
-        cost = [valueTransformer costForValue:object];
+    return [valueTransformer respondsToSelector:@selector(costForValue:)] ? [valueTransformer costForValue:object] : 0;
+}
+
+#pragma mark - Write (Admission)
+
+/*! Returns YES if the object should be put into memory cache. Admission filter is consulted only if the object doesn't fit into DFMemoryCache limits, limits of other NSCache instances are not observable.
+ */
+- (BOOL)_admitsObjectWithCost:(NSUInteger)cost forKey:(NSString *)key {
+    DFCacheAdmissionFilter *admissionFilter = self.admissionFilter;
+    if (!admissionFilter) {
+        return YES;
     }
-    [self.memoryCache setObject:object forKey:key cost:cost];
+    NSCache *memoryCache = self.memoryCache;
+    if ([memoryCache isKindOfClass:[DFMemoryCache class]]) {
+        DFMemoryCache *cache = (DFMemoryCache *)memoryCache;
+        BOOL fitsCost = cache.totalCostLimit == 0 || cache.totalCost + cost <= cache.totalCostLimit;
+        BOOL fitsCount = cache.countLimit == 0 || cache.count < cache.countLimit;
+        if (fitsCost && fitsCount) {
+            return YES;
+        }
+    }
+    return [admissionFilter shouldAdmitKey:key toTier:DFCacheTierMemory];
+}
+
+/*! Returns YES if the entry should be written to disk cache. Admission filter is consulted only when disk usage has reached high watermark, writes that don't make cleanup evict other entries are always admitted.
+ @note Checking disk usage might load the disk cache index or wait for the shared index lock, must not be called on the caller's thread.
+ */
+- (BOOL)_admitsDiskWriteForKey:(NSString *)key {
+    DFCacheAdmissionFilter *admissionFilter = self.admissionFilter;
+    return !admissionFilter || !self.diskCache.needsCleanup || [admissionFilter shouldAdmitKey:key toTier:DFCacheTierDisk];
+}
+
+#pragma mark - Write (Buffering)
+
+/*! Decides whether the write is admitted to disk cache and encodes the object unless the write already has data. Runs concurrently on the processing queue, IO queues only write the encoded data. Admission is decided before encoding, rejected objects are not encoded.
+ */
+- (void)_processWrite:(DFCachePendingWrite *)write forKey:(NSString *)key object:(id)object valueTransformer:(id<DFValueTransforming>)valueTransformer {
+    if (write.data && !self.admissionFilter) {
+        return;
+    }
+    dispatch_group_async(write.group, _processingQueue, ^{
+        @autoreleasepool {
+            if (![self _admitsDiskWriteForKey:key]) {
+                write.rejected = YES;
+                write.data = nil;
+            } else if (!write.data) {
+                write.data = [self _encodeObject:object valueTransformer:valueTransformer];
+            }
+        }
+    });
+}
+
+/*! Registers the write as the last write for the key and schedules it to be written once the data is encoded. Writes that are superseded by a later write or removal before they reach the IO queue are skipped.
+ */
+- (void)_enqueueWrite:(DFCachePendingWrite *)write forKey:(NSString *)key {
+    pthread_mutex_lock(&_pendingWritesMutex);
+    _pendingWrites[key] = write;
+    pthread_mutex_unlock(&_pendingWritesMutex);
+    dispatch_group_notify(write.group, _processingQueue, ^{
+        dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+            @autoreleasepool {
+                [self _flushPendingWrite:write forKey:key];
+            }
+        }]);
+    });
+}
+
+/*! Writes the pending write to disk unless it was superseded. Rejected write removes the previous entry for the key so that it doesn't outlive the write. Must be called on the IO queue for the key after the write is processed.
+ */
+- (void)_flushPendingWrite:(DFCachePendingWrite *)write forKey:(NSString *)key {
+    pthread_mutex_lock(&_pendingWritesMutex);
+    BOOL isCurrent = _pendingWrites[key] == write;
+    if (isCurrent) {
+        [_pendingWrites removeObjectForKey:key];
+    }
+    pthread_mutex_unlock(&_pendingWritesMutex);
+    if (isCurrent && write.isRejected) {
+        [self.diskCache removeDataForKey:key];
+    } else if (isCurrent && write.data) {
+        NSDictionary *attributes = write.valueTransformerName ? @{ DFCacheAttributeValueTransformerNameKey : [write.valueTransformerName dataUsingEncoding:NSUTF8StringEncoding] } : nil;
+        DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+        const uint64_t startTime = metrics ? _dwarf_cache_time() : 0;
+        [self.diskCache setData:write.data attributes:attributes expirationDate:write.expirationDate forKey:key];
+        [metrics recordOperation:DFCacheOperationDiskWrite startTime:startTime];
+        [self _cleanupDiskCacheIfNeeded];
+    }
+}
+
+/*! Writes pending write for the key to disk (waiting for the data to be encoded if necessary) so that the disk operation that follows observes it. Must be called on the IO queue for the key.
+ */
+- (void)_flushPendingWriteForKey:(NSString *)key {
+    pthread_mutex_lock(&_pendingWritesMutex);
+    DFCachePendingWrite *write = _pendingWrites[key];
+    pthread_mutex_unlock(&_pendingWritesMutex);
+    if (write) {
+        dispatch_group_wait(write.group, DISPATCH_TIME_FOREVER);
+        [self _flushPendingWrite:write forKey:key];
+    }
+}
+
+- (void)_cancelPendingWriteForKey:(NSString *)key {
+    pthread_mutex_lock(&_pendingWritesMutex);
+    [_pendingWrites removeObjectForKey:key];
+    pthread_mutex_unlock(&_pendingWritesMutex);
 }
 
 #pragma mark - Remove
@@ -188,13 +675,18 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         return;
     }
     for (NSString *key in keys) {
+        [self _invalidatePendingReadForKey:key];
+        [self _cancelPendingWriteForKey:key];
         [self.memoryCache removeObjectForKey:key];
     }
-    dispatch_async(_ioQueue, ^{
-        for (NSString *key in keys) {
-            [self.diskCache removeDataForKey:key];
-        }
-    });
+    [self cancelPrefetchingForKeys:keys];
+    [self _enumerateIOQueuesForKeys:keys usingBlock:^(dispatch_queue_t queue, NSArray *queueKeys) {
+        dispatch_async(queue, [self _IOQueueBlockWithBlock:^{
+            for (NSString *key in queueKeys) {
+                [self.diskCache removeDataForKey:key];
+            }
+        }]);
+    }];
 }
 
 - (void)removeObjectForKey:(NSString *)key {
@@ -204,10 +696,15 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
 }
 
 - (void)removeAllObjects {
+    [self _invalidateAllPendingReads];
+    pthread_mutex_lock(&_pendingWritesMutex);
+    [_pendingWrites removeAllObjects];
+    pthread_mutex_unlock(&_pendingWritesMutex);
+    [self cancelAllPrefetching];
     [self.memoryCache removeAllObjects];
-    dispatch_async(_ioQueue, ^{
+    [self _dispatchBarrierAsync:^{
         [self.diskCache removeAllData];
-    });
+    }];
 }
 
 #pragma mark - Metadata
@@ -217,10 +714,10 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         return nil;
     }
     NSDictionary *__block metadata;
-    dispatch_sync(_ioQueue, ^{
-        NSURL *fileURL = [self.diskCache URLForKey:key];
-        metadata = [fileURL df_extendedAttributeValueForKey:DFCacheAttributeMetadataKey error:nil];
-    });
+    dispatch_sync([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        metadata = _DFCacheDecodeMetadata([self.diskCache attributeForName:DFCacheAttributeMetadataKey key:key]);
+    }]);
     return metadata;
 }
 
@@ -228,33 +725,33 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
     if (!metadata || !key.length) {
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        NSURL *fileURL = [self.diskCache URLForKey:key];
-        [fileURL df_setExtendedAttributeValue:metadata forKey:DFCacheAttributeMetadataKey];
-    });
+    dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        [self.diskCache setAttribute:_DFCacheEncodeMetadata(metadata) forName:DFCacheAttributeMetadataKey key:key];
+    }]);
 }
 
 - (void)setMetadataValues:(NSDictionary *)keyedValues forKey:(NSString *)key {
     if (!keyedValues.count || !key.length) {
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        NSURL *fileURL = [self.diskCache URLForKey:key];
-        NSDictionary *metadata = [fileURL df_extendedAttributeValueForKey:DFCacheAttributeMetadataKey error:nil];
+    dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        NSDictionary *metadata = _DFCacheDecodeMetadata([self.diskCache attributeForName:DFCacheAttributeMetadataKey key:key]);
         NSMutableDictionary *mutableMetadata = [[NSMutableDictionary alloc] initWithDictionary:metadata];
         [mutableMetadata addEntriesFromDictionary:keyedValues];
-        [fileURL df_setExtendedAttributeValue:mutableMetadata forKey:DFCacheAttributeMetadataKey];
-    });
+        [self.diskCache setAttribute:_DFCacheEncodeMetadata(mutableMetadata) forName:DFCacheAttributeMetadataKey key:key];
+    }]);
 }
 
 - (void)removeMetadataForKey:(NSString *)key {
     if (!key.length) {
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        NSURL *fileURL = [self.diskCache URLForKey:key];
-        [fileURL df_removeExtendedAttributeForKey:DFCacheAttributeMetadataKey];
-    });
+    dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        [self.diskCache removeAttributeForName:DFCacheAttributeMetadataKey key:key];
+    }]);
 }
 
 #pragma mark - Cleanup
@@ -284,17 +781,355 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
 }
 
 - (void)cleanupDiskCache {
-    dispatch_async(_ioQueue, ^{
-        [self.diskCache cleanup];
+    dispatch_async(_cleanupQueue, ^{
+        [self _performCleanupSlices];
     });
 }
 
+/*! Starts cleanup as soon as a write makes disk usage reach high watermark, doesn't wait for the cleanup timer.
+ */
+- (void)_cleanupDiskCacheIfNeeded {
+    if (self.diskCache.needsCleanup) {
+        [self cleanupDiskCache];
+    }
+}
+
+/*! Performs cleanup in time-bounded slices, yields the disk to IO queues between slices. Must be called on the cleanup queue.
+ */
+- (void)_performCleanupSlices {
+    if (_cleanupInProgress) {
+        return;
+    }
+    _cleanupInProgress = YES;
+    [self _performNextCleanupSlice];
+}
+
+- (void)_performNextCleanupSlice {
+    DFDiskCache *diskCache = self.diskCache;
+    if (!diskCache) {
+        _cleanupInProgress = NO;
+        return;
+    }
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    const uint64_t startTime = metrics ? _dwarf_cache_time() : 0;
+    DFDiskCacheCleanupStatistics statistics;
+    BOOL finished = [diskCache cleanupWithTimeBudget:_cleanupSliceDuration statistics:&statistics];
+    [metrics recordOperation:DFCacheOperationCleanup startTime:startTime];
+    [metrics recordCleanupStatistics:statistics];
+    if (finished) {
+        _cleanupInProgress = NO;
+        return;
+    }
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(DFCacheCleanupSliceInterval * NSEC_PER_SEC)), _cleanupQueue, ^{
+        [self _performNextCleanupSlice];
+    });
+}
+
+#pragma mark - Memory Pressure
+
 #if TARGET_OS_IOS || TARGET_OS_TV
 - (void)_didReceiveMemoryWarning:(NSNotification *__unused)notification {
-    [self.memoryCache removeAllObjects];
+    [self _purgeMemoryCache];
+}
+#else
+/*! DFMemoryCache doesn't evict objects on its own under memory pressure like NSCache does.
+ */
+- (void)_observeMemoryPressure {
+    _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+    DFCache *__weak weakSelf = self;
+    dispatch_source_set_event_handler(_memoryPressureSource, ^{
+        [weakSelf _purgeMemoryCache];
+    });
+    dispatch_resume(_memoryPressureSource);
 }
 #endif
 
+- (void)_purgeMemoryCache {
+    [self cancelAllPrefetching];
+    [self.memoryCache removeAllObjects];
+}
+
+#pragma mark - Prefetch
+
+@synthesize prefetchCostLimit = _prefetchCostLimit;
+
+- (NSUInteger)prefetchCostLimit {
+    pthread_mutex_lock(&_prefetchMutex);
+    NSUInteger prefetchCostLimit = _prefetchCostLimit;
+    pthread_mutex_unlock(&_prefetchMutex);
+    return prefetchCostLimit;
+}
+
+- (void)setPrefetchCostLimit:(NSUInteger)prefetchCostLimit {
+    pthread_mutex_lock(&_prefetchMutex);
+    _prefetchCostLimit = prefetchCostLimit;
+    [self _startPrefetchingIfNeeded];
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+- (void)prefetchObjectsForKeys:(NSArray *)keys {
+    [self prefetchObjectsForKeys:keys priority:DFCachePrefetchPriorityNormal];
+}
+
+- (void)prefetchObjectsForKeys:(NSArray *)keys priority:(DFCachePrefetchPriority)priority {
+    if (!keys.count || !self.memoryCache) {
+        return;
+    }
+    pthread_mutex_lock(&_prefetchMutex);
+    [self _enqueuePrefetchingForKeys:keys priority:priority];
+    [self _startPrefetchingIfNeeded];
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+- (void)cancelPrefetchingForKeys:(NSArray *)keys {
+    if (!keys.count) {
+        return;
+    }
+    pthread_mutex_lock(&_prefetchMutex);
+    for (NSString *key in keys) {
+        [self _cancelPrefetchingForKey:key];
+    }
+    [self _startPrefetchingIfNeeded];
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+- (void)cancelAllPrefetching {
+    pthread_mutex_lock(&_prefetchMutex);
+    for (NSMutableOrderedSet *queue in _prefetchQueues) {
+        [queue removeAllObjects];
+    }
+    [_prefetchingKeys removeAllObjects];
+    [_prefetchedCosts removeAllObjects];
+    _prefetchedCost = 0;
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+- (void)updatePrefetchWindowWithKeys:(NSArray *)keys priority:(DFCachePrefetchPriority)priority {
+    if (!self.memoryCache) {
+        return;
+    }
+    NSSet *windowKeys = [NSSet setWithArray:keys ?: @[]];
+    pthread_mutex_lock(&_prefetchMutex);
+    NSMutableSet *staleKeys = [NSMutableSet setWithSet:_prefetchingKeys];
+    [staleKeys addObjectsFromArray:[_prefetchedCosts allKeys]];
+    for (NSMutableOrderedSet *queue in _prefetchQueues) {
+        [staleKeys addObjectsFromArray:[queue array]];
+    }
+    [staleKeys minusSet:windowKeys];
+    for (NSString *key in staleKeys) {
+        [self _cancelPrefetchingForKey:key];
+    }
+    [self _enqueuePrefetchingForKeys:keys priority:priority];
+    [self _startPrefetchingIfNeeded];
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+- (void)prefetchMostFrequentlyAccessedObjects:(NSUInteger)count {
+    if (!count || !self.memoryCache || !self.diskCache) {
+        return;
+    }
+    // Loading disk cache index might take a while, keys are retrieved on the background queue.
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [self prefetchObjectsForKeys:[self.diskCache keysOfMostFrequentlyAccessedEntries:count] priority:DFCachePrefetchPriorityLow];
+    });
+}
+
+/*! Adds keys to the prefetch queue with the given priority, keys that are already waiting in other queues are moved. Keys that are being prefetched or were already prefetched (and are still in memory cache) are skipped. Must be called with the prefetch lock held.
+ */
+- (void)_enqueuePrefetchingForKeys:(NSArray *)keys priority:(DFCachePrefetchPriority)priority {
+    NSMutableOrderedSet *priorityQueue = _prefetchQueues[MIN(priority, _prefetchQueues.count - 1)];
+    for (NSString *key in keys) {
+        if (!key.length || [_prefetchingKeys containsObject:key]) {
+            continue;
+        }
+        if (_prefetchedCosts[key]) {
+            if ([self _memoryCacheContainsObjectForKey:key]) {
+                continue;
+            }
+            [self _releasePrefetchedCostForKey:key];
+        }
+        for (NSMutableOrderedSet *queue in _prefetchQueues) {
+            if (queue != priorityQueue) {
+                [queue removeObject:key];
+            }
+        }
+        [priorityQueue addObject:key];
+    }
+}
+
+/*! Must be called with the prefetch lock held.
+ */
+- (void)_cancelPrefetchingForKey:(NSString *)key {
+    for (NSMutableOrderedSet *queue in _prefetchQueues) {
+        [queue removeObject:key];
+    }
+    [_prefetchingKeys removeObject:key];
+    [self _releasePrefetchedCostForKey:key];
+}
+
+/*! Must be called with the prefetch lock held.
+ */
+- (void)_releasePrefetchedCostForKey:(NSString *)key {
+    NSNumber *cost = _prefetchedCosts[key];
+    if (cost) {
+        _prefetchedCost -= MIN(_prefetchedCost, cost.unsignedIntegerValue);
+        [_prefetchedCosts removeObjectForKey:key];
+    }
+}
+
+/*! Called when the memory cache lookup misses. Object could have been prefetched and then evicted from memory cache, it no longer counts towards prefetch cost limit.
+ */
+- (void)_releaseEvictedPrefetchedObjectForKey:(NSString *)key {
+    pthread_mutex_lock(&_prefetchMutex);
+    if (_prefetchedCosts[key]) {
+        [self _releasePrefetchedCostForKey:key];
+        [self _startPrefetchingIfNeeded];
+    }
+    pthread_mutex_unlock(&_prefetchMutex);
+}
+
+/*! Returns YES if memory cache contains object for the given key. DFMemoryCache is checked without updating recency of the object.
+ */
+- (BOOL)_memoryCacheContainsObjectForKey:(NSString *)key {
+    NSCache *memoryCache = self.memoryCache;
+    if ([memoryCache isKindOfClass:[DFMemoryCache class]]) {
+        return [(DFMemoryCache *)memoryCache containsObjectForKey:key];
+    }
+    return [memoryCache objectForKey:key] != nil;
+}
+
+/*! Returns YES if there are keys waiting to be prefetched and prefetch cost limit is not reached. Prefetched objects that were evicted from memory cache are released first when the limit is reached. Must be called with the prefetch lock held.
+ */
+- (BOOL)_canPrefetch {
+    NSUInteger costLimit = _prefetchCostLimit ?: self.memoryCache.totalCostLimit / 4;
+    if (costLimit && _prefetchedCost >= costLimit) {
+        for (NSString *key in [_prefetchedCosts allKeys]) {
+            if (![self _memoryCacheContainsObjectForKey:key]) {
+                [self _releasePrefetchedCostForKey:key];
+            }
+        }
+        if (_prefetchedCost >= costLimit) {
+            return NO;
+        }
+    }
+    for (NSMutableOrderedSet *queue in _prefetchQueues) {
+        if (queue.count) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+/*! Starts workers until there are enough of them to prefetch the pending keys. Must be called with the prefetch lock held.
+ */
+- (void)_startPrefetchingIfNeeded {
+    while (_prefetchWorkerCount < DFCachePrefetchMaxConcurrentReads && [self _canPrefetch]) {
+        _prefetchWorkerCount++;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            [self _performPrefetching];
+        });
+    }
+}
+
+/*! Prefetches keys with the highest priority first until there are no more keys to prefetch or prefetch cost limit is reached.
+ */
+- (void)_performPrefetching {
+    for (;;) {
+        @autoreleasepool {
+            pthread_mutex_lock(&_prefetchMutex);
+            NSString *key;
+            if ([self _canPrefetch]) {
+                for (NSMutableOrderedSet *queue in [_prefetchQueues reverseObjectEnumerator]) {
+                    if (queue.count) {
+                        key = queue.firstObject;
+                        [queue removeObjectAtIndex:0];
+                        break;
+                    }
+                }
+                [_prefetchingKeys addObject:key];
+            } else {
+                _prefetchWorkerCount--;
+            }
+            pthread_mutex_unlock(&_prefetchMutex);
+            if (!key) {
+                return;
+            }
+            NSUInteger cost = [self _prefetchObjectForKey:key];
+            pthread_mutex_lock(&_prefetchMutex);
+            // Prefetching is cancelled if the key was removed while the object was being read.
+            if ([_prefetchingKeys containsObject:key]) {
+                [_prefetchingKeys removeObject:key];
+                if (cost) {
+                    _prefetchedCosts[key] = @(cost);
+                    _prefetchedCost += cost;
+                }
+            }
+            pthread_mutex_unlock(&_prefetchMutex);
+        }
+    }
+}
+
+/*! Reads object and puts it into memory cache unless it's already there or is being read.
+ @return Cost of the prefetched object, 0 if the object wasn't prefetched.
+ */
+- (NSUInteger)_prefetchObjectForKey:(NSString *)key {
+    if ([self _memoryCacheContainsObjectForKey:key]) {
+        return 0;
+    }
+    BOOL isNewRead;
+    DFCachePendingRead *read = [self _pendingReadForKey:key isNew:&isNewRead];
+    if (!isNewRead) {
+        return 0;
+    }
+    [self _performRead:read forKey:key];
+    return read.isInvalidated ? 0 : read.cost;
+}
+
+#pragma mark - Metrics
+
+- (BOOL)isMetricsEnabled {
+    return self.metricsRecorder != nil;
+}
+
+- (void)setMetricsEnabled:(BOOL)metricsEnabled {
+    @synchronized(self) {
+        if (metricsEnabled != (self.metricsRecorder != nil)) {
+            self.metricsRecorder = metricsEnabled ? [DFCacheMetricsRecorder new] : nil;
+        }
+    }
+}
+
+- (DFCacheMetrics *)metrics {
+    return [self.metricsRecorder metrics];
+}
+
+- (void)resetMetrics {
+    [self.metricsRecorder reset];
+}
+
+- (void)setMetricsReportingInterval:(NSTimeInterval)timeInterval handler:(void (^)(DFCacheMetrics *))handler {
+    @synchronized(self) {
+        if (_metricsTimer) {
+            dispatch_source_cancel(_metricsTimer);
+            _metricsTimer = nil;
+        }
+        if (!handler || timeInterval <= 0) {
+            return;
+        }
+        _metricsTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        const uint64_t interval = (uint64_t)(timeInterval * NSEC_PER_SEC);
+        dispatch_source_set_timer(_metricsTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10);
+        DFCache *__weak weakSelf = self;
+        dispatch_source_set_event_handler(_metricsTimer, ^{
+            DFCacheMetrics *metrics = [weakSelf metrics];
+            if (metrics) {
+                handler(metrics);
+            }
+        });
+        dispatch_resume(_metricsTimer);
+    }
+}
+
 #pragma mark - Data
 
 - (void)cachedDataForKey:(NSString *)key completion:(void (^)(NSData *))completion {
@@ -305,29 +1140,219 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         _dwarf_cache_callback(completion, nil);
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        NSData *data = [self.diskCache dataForKey:key];
+    [self.admissionFilter recordAccessForKey:key];
+    dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        NSData *data = [self _diskDataForKey:key attributes:NULL expirationDate:NULL];
         _dwarf_cache_callback(completion, data);
-    });
+    }]);
 }
 
 - (NSData *)cachedDataForKey:(NSString *)key {
     if (!key.length) {
         return nil;
     }
+    [self.admissionFilter recordAccessForKey:key];
     NSData *__block data;
-    dispatch_sync(_ioQueue, ^{
-        data = [self.diskCache dataForKey:key];
-    });
+    dispatch_sync([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        data = [self _diskDataForKey:key attributes:NULL expirationDate:NULL];
+    }]);
     return data;
 }
 
 - (void)storeData:(NSData *)data forKey:(NSString *)key {
+    [self storeData:data forKey:key timeToLive:0];
+}
+
+- (void)storeData:(NSData *)data forKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive {
     if (!data || !key.length) {
         return;
     }
-    dispatch_async(_ioQueue, ^{
-        [self.diskCache setData:data forKey:key];
+    [self.admissionFilter recordAccessForKey:key];
+    [self _invalidatePendingReadForKey:key];
+    DFCachePendingWrite *write = [DFCachePendingWrite new];
+    write.data = data;
+    write.expirationDate = timeToLive > 0 ? [NSDate dateWithTimeIntervalSinceNow:timeToLive] : nil;
+    [self _processWrite:write forKey:key object:nil valueTransformer:nil];
+    [self _enqueueWrite:write forKey:key];
+}
+
+#pragma mark - Streaming
+
+- (void)storeDataForKey:(NSString *)key timeToLive:(NSTimeInterval)timeToLive writingBlock:(BOOL (^)(DFFileStorageWriter *))block completion:(void (^)(BOOL))completion {
+    DFDiskCache *diskCache = self.diskCache;
+    if (!key.length || !block || !diskCache) {
+        _DFCacheCompleteStreamingWrite(completion, NO);
+        return;
+    }
+    NSDate *expirationDate = timeToLive > 0 ? [NSDate dateWithTimeIntervalSinceNow:timeToLive] : nil;
+    // Data is written into the temporary file off the IO queues, only the commit is serialized with other operations for the key.
+    dispatch_async(_processingQueue, ^{
+        DFFileStorageWriter *writer = [diskCache writerForKey:key attributes:nil expirationDate:expirationDate];
+        BOOL success = NO;
+        @autoreleasepool {
+            success = writer && block(writer);
+        }
+        if (!success) {
+            [writer cancel];
+            _DFCacheCompleteStreamingWrite(completion, NO);
+            return;
+        }
+        dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+            [self _flushPendingWriteForKey:key];
+            DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+            const uint64_t startTime = metrics ? _dwarf_cache_time() : 0;
+            BOOL committed = [writer close];
+            [metrics recordOperation:DFCacheOperationDiskWrite startTime:startTime];
+            if (committed) {
+                [self _invalidatePendingReadForKey:key];
+                [self.memoryCache removeObjectForKey:key];
+                [self _cleanupDiskCacheIfNeeded];
+            }
+            _DFCacheCompleteStreamingWrite(completion, committed);
+        }]);
+    });
+}
+
+- (void)storeDataFromStream:(NSInputStream *)stream forKey:(NSString *)key completion:(void (^)(BOOL))completion {
+    if (!stream) {
+        _DFCacheCompleteStreamingWrite(completion, NO);
+        return;
+    }
+    [self storeDataForKey:key timeToLive:0 writingBlock:^BOOL(DFFileStorageWriter *writer) {
+        BOOL success = [writer writeContentsOfStream:stream];
+        [stream close];
+        return success;
+    } completion:completion];
+}
+
+- (NSInputStream *)cachedDataStreamForKey:(NSString *)key {
+    if (!key.length) {
+        return nil;
+    }
+    NSInputStream *__block stream;
+    dispatch_sync([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        stream = [self.diskCache inputStreamForKey:key];
+    }]);
+    return stream;
+}
+
+- (void)cachedDataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length completion:(void (^)(NSData *))completion {
+    if (!completion) {
+        return;
+    }
+    if (!key.length) {
+        _dwarf_cache_callback(completion, nil);
+        return;
+    }
+    dispatch_async([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        NSData *data = [self.diskCache dataForKey:key offset:offset length:length];
+        _dwarf_cache_callback(completion, data);
+    }]);
+}
+
+- (NSData *)cachedDataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length {
+    if (!key.length) {
+        return nil;
+    }
+    NSData *__block data;
+    dispatch_sync([self _ioQueueForKey:key], [self _IOQueueBlockWithBlock:^{
+        [self _flushPendingWriteForKey:key];
+        data = [self.diskCache dataForKey:key offset:offset length:length];
+    }]);
+    return data;
+}
+
+#pragma mark - IO Queues
+
+- (void)setIoQueueCount:(NSUInteger)ioQueueCount {
+    ioQueueCount = MAX(ioQueueCount, 1);
+    @synchronized(self) {
+        if (_ioQueueCount == ioQueueCount) {
+            return;
+        }
+        _ioQueueCount = ioQueueCount;
+        NSArray *previousQueues = self.ioQueues;
+        NSArray *queues = [DFCache _ioQueuesWithCount:ioQueueCount];
+        
+        // New queues wait for the operations that were already dispatched to the previous queues.
+        dispatch_group_t group = dispatch_group_create();
+        for (dispatch_queue_t queue in previousQueues) {
+            dispatch_group_async(group, queue, ^{});
+        }
+        for (dispatch_queue_t queue in queues) {
+            dispatch_async(queue, ^{
+                dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+            });
+        }
+        self.ioQueues = queues;
+    }
+}
+
++ (NSArray *)_ioQueuesWithCount:(NSUInteger)count {
+    NSMutableArray *queues = [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [queues addObject:dispatch_queue_create("DFCache::IOQueue", DISPATCH_QUEUE_SERIAL)];
+    }
+    return queues;
+}
+
+- (dispatch_queue_t)_ioQueueForKey:(NSString *)key {
+    NSArray *queues = self.ioQueues;
+    return queues.count == 1 ? queues[0] : queues[key.hash % queues.count];
+}
+
+/*! Returns block that records IO queue depth and the time the block waits in the IO queue when metrics are enabled. Returned block must be dispatched to the IO queue immediately.
+ */
+- (dispatch_block_t)_IOQueueBlockWithBlock:(dispatch_block_t)block {
+    DFCacheMetricsRecorder *metrics = self.metricsRecorder;
+    return metrics ? [metrics IOQueueBlockWithBlock:block] : block;
+}
+
+/*! Groups keys by IO queues they map to.
+ */
+- (void)_enumerateIOQueuesForKeys:(NSArray *)keys usingBlock:(void (^)(dispatch_queue_t queue, NSArray *keys))block {
+    NSArray *queues = self.ioQueues;
+    if (queues.count == 1) {
+        block(queues[0], keys);
+        return;
+    }
+    NSMutableDictionary *keysByQueue = [NSMutableDictionary new];
+    for (NSString *key in keys) {
+        NSNumber *index = @(key.hash % queues.count);
+        NSMutableArray *queueKeys = keysByQueue[index];
+        if (!queueKeys) {
+            queueKeys = [NSMutableArray new];
+            keysByQueue[index] = queueKeys;
+        }
+        [queueKeys addObject:key];
+    }
+    [keysByQueue enumerateKeysAndObjectsUsingBlock:^(NSNumber *index, NSArray *queueKeys, BOOL *stop) {
+        block(queues[index.unsignedIntegerValue], queueKeys);
+    }];
+}
+
+/*! Executes block after all the operations that were already dispatched to IO queues and cleanup queue are finished. All of the queues are suspended until the block finishes executing.
+ */
+- (void)_dispatchBarrierAsync:(dispatch_block_t)block {
+    NSMutableArray *queues = [NSMutableArray arrayWithArray:self.ioQueues];
+    [queues addObject:_cleanupQueue];
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_t completion = dispatch_group_create();
+    dispatch_group_enter(completion);
+    for (dispatch_queue_t queue in queues) {
+        dispatch_group_enter(group);
+        dispatch_async(queue, ^{
+            dispatch_group_leave(group);
+            dispatch_group_wait(completion, DISPATCH_TIME_FOREVER);
+        });
+    }
+    dispatch_group_notify(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        block();
+        dispatch_group_leave(completion);
     });
 }
 
@@ -359,13 +1384,21 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
 @implementation DFCache (DFCacheExtended)
 
 - (void)batchCachedDataForKeys:(NSArray *)keys completion:(void (^)(NSDictionary *batch))completion {
+    [self batchCachedDataForKeys:keys progressHandler:nil completion:completion];
+}
+
+- (void)batchCachedDataForKeys:(NSArray *)keys progressHandler:(void (^)(NSDictionary *))progressHandler completion:(void (^)(NSDictionary *))completion {
     if (!keys.count) {
         _dwarf_cache_callback(completion, nil);
         return;
     }
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        NSDictionary *batch = [self batchCachedDataForKeys:keys];
-        _dwarf_cache_callback(completion, batch);
+    NSMutableDictionary *batch = [NSMutableDictionary new];
+    dispatch_group_t group = dispatch_group_create();
+    [self _batchCachedDataForKeys:keys group:group handler:[DFCache _mainQueueHandlerWithBatch:batch progressHandler:progressHandler]];
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (completion) {
+            completion([batch copy]);
+        }
     });
 }
 
@@ -374,23 +1407,32 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         return nil;
     }
     NSMutableDictionary *batch = [NSMutableDictionary new];
-    for (NSString *key in keys) {
-        NSData *data = [self cachedDataForKey:key];
-        if (data) {
-            batch[key] = data;
+    dispatch_group_t group = dispatch_group_create();
+    [self _batchCachedDataForKeys:keys group:group handler:^(NSDictionary *partialBatch) {
+        @synchronized(batch) {
+            [batch addEntriesFromDictionary:partialBatch];
         }
-    }
+    }];
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
     return [batch copy];
 }
 
 - (void)batchCachedObjectsForKeys:(NSArray *)keys completion:(void (^)(NSDictionary *))completion {
+    [self batchCachedObjectsForKeys:keys progressHandler:nil completion:completion];
+}
+
+- (void)batchCachedObjectsForKeys:(NSArray *)keys progressHandler:(void (^)(NSDictionary *))progressHandler completion:(void (^)(NSDictionary *))completion {
     if (!keys.count) {
         _dwarf_cache_callback(completion, nil);
         return;
     }
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        NSDictionary *batch = [self batchCachedObjectsForKeys:keys];
-        _dwarf_cache_callback(completion, batch);
+    NSMutableDictionary *batch = [NSMutableDictionary new];
+    dispatch_group_t group = dispatch_group_create();
+    [self _batchCachedObjectsForKeys:keys group:group handler:[DFCache _mainQueueHandlerWithBatch:batch progressHandler:progressHandler]];
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (completion) {
+            completion([batch copy]);
+        }
     });
 }
 
@@ -399,13 +1441,179 @@ static NSString *const DFCacheAttributeValueTransformerNameKey = @"_df_cache_val
         return nil;
     }
     NSMutableDictionary *batch = [NSMutableDictionary new];
+    dispatch_group_t group = dispatch_group_create();
+    [self _batchCachedObjectsForKeys:keys group:group handler:^(NSDictionary *partialBatch) {
+        @synchronized(batch) {
+            [batch addEntriesFromDictionary:partialBatch];
+        }
+    }];
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return [batch copy];
+}
+
+/*! Returns handler that accumulates partial batches on the main queue and reports progress. Partial batches are dispatched to the main queue before the work that produced them finishes, so the group notification that is scheduled on the main queue is always called after all of them.
+ */
++ (void (^)(NSDictionary *))_mainQueueHandlerWithBatch:(NSMutableDictionary *)batch progressHandler:(void (^)(NSDictionary *))progressHandler {
+    return ^(NSDictionary *partialBatch) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [batch addEntriesFromDictionary:partialBatch];
+            if (progressHandler) {
+                progressHandler(partialBatch);
+            }
+        });
+    };
+}
+
+#pragma mark - Batch (Private)
+
+/*! Returns unique non-empty keys preserving order.
+ */
++ (NSArray *)_batchKeys:(NSArray *)keys {
+    NSMutableOrderedSet *batchKeys = [[NSMutableOrderedSet alloc] initWithCapacity:keys.count];
     for (NSString *key in keys) {
-        id object = [self cachedObjectForKey:key];
+        if (key.length) {
+            [batchKeys addObject:key];
+        }
+    }
+    return [batchKeys array];
+}
+
+- (void)_batchCachedDataForKeys:(NSArray *)keys group:(dispatch_group_t)group handler:(void (^)(NSDictionary *partialBatch))handler {
+    NSArray *batchKeys = [DFCache _batchKeys:keys];
+    DFCacheAdmissionFilter *admissionFilter = self.admissionFilter;
+    for (NSString *key in batchKeys) {
+        [admissionFilter recordAccessForKey:key];
+    }
+    [self _readBatchForKeys:batchKeys objects:NO group:group handler:^(NSArray *chunkKeys, NSArray *data, NSArray *valueTransformerNames, NSArray *expirationDates) {
+        NSMutableDictionary *partialBatch = [NSMutableDictionary new];
+        [chunkKeys enumerateObjectsUsingBlock:^(NSString *key, NSUInteger idx, BOOL *stop) {
+            if (data[idx] != [NSNull null]) {
+                partialBatch[key] = data[idx];
+            }
+        }];
+        if (partialBatch.count) {
+            handler(partialBatch);
+        }
+    }];
+}
+
+/*! Objects found in the memory cache are reported first. Keys that are already being read join pending reads, the rest are read in batch and decoded concurrently on the processing queue.
+ */
+- (void)_batchCachedObjectsForKeys:(NSArray *)keys group:(dispatch_group_t)group handler:(void (^)(NSDictionary *partialBatch))handler {
+    NSMutableDictionary *memoryBatch = [NSMutableDictionary new];
+    NSMutableDictionary *reads = [NSMutableDictionary new];
+    NSMutableArray *readKeys = [NSMutableArray new];
+    DFCacheAdmissionFilter *admissionFilter = self.admissionFilter;
+    for (NSString *key in [DFCache _batchKeys:keys]) {
+        [admissionFilter recordAccessForKey:key];
+        id object = [self _memoryCachedObjectForKey:key];
         if (object) {
-            batch[key] = object;
+            memoryBatch[key] = object;
+            continue;
         }
+        BOOL isNewRead;
+        DFCachePendingRead *read = [self _pendingReadForKey:key isNew:&isNewRead];
+        if (isNewRead) {
+            reads[key] = read;
+            [readKeys addObject:key];
+        } else {
+            dispatch_group_enter(group);
+            dispatch_group_notify(read.group, self.processingQueue, ^{
+                if (read.object) {
+                    handler(@{ key : read.object });
+                }
+                dispatch_group_leave(group);
+            });
+        }
+    }
+    if (memoryBatch.count) {
+        handler(memoryBatch);
     }
-    return batch;
+    [self _readBatchForKeys:readKeys objects:YES group:group handler:^(NSArray *chunkKeys, NSArray *data, NSArray *valueTransformerNames, NSArray *expirationDates) {
+        dispatch_group_async(group, self.processingQueue, ^{
+            NSUInteger count = chunkKeys.count;
+            id __strong *objects = (id __strong *)calloc(count, sizeof(id));
+            id __strong *valueTransformers = (id __strong *)calloc(count, sizeof(id));
+            dispatch_apply(count, self.processingQueue, ^(size_t i) {
+                @autoreleasepool {
+                    if (data[i] != [NSNull null]) {
+                        NSString *name = valueTransformerNames[i] != [NSNull null] ? valueTransformerNames[i] : nil;
+                        valueTransformers[i] = [self.valueTransfomerFactory valueTransformerForName:name];
+                        objects[i] = [self _decodeData:data[i] valueTransformer:valueTransformers[i]];
+                    }
+                }
+            });
+            // Memory cache is populated in a single pass once the whole chunk is decoded.
+            NSMutableDictionary *partialBatch = [NSMutableDictionary new];
+            for (NSUInteger i = 0; i < count; i++) {
+                NSString *key = chunkKeys[i];
+                [self _completeRead:reads[key] forKey:key object:objects[i] valueTransformer:valueTransformers[i] expirationDate:(expirationDates[i] != [NSNull null] ? expirationDates[i] : nil)];
+                if (objects[i]) {
+                    partialBatch[key] = objects[i];
+                }
+                objects[i] = nil;
+                valueTransformers[i] = nil;
+            }
+            free(objects);
+            free(valueTransformers);
+            if (partialBatch.count) {
+                handler(partialBatch);
+            }
+        });
+    }];
+}
+
+/*! Reads data for the given keys. Keys are grouped by IO queues and split into chunks. Each chunk takes a single IO queue hop during which files are read concurrently by a bounded number of workers.
+ @param objects If YES, value transformer names and expiration dates that are needed to decode objects and to put them into memory cache are read along with the data.
+ @param handler Called for each chunk on the IO queue. Data, value transformer names and expiration dates arrays match keys, missing values are represented by NSNull.
+ */
+- (void)_readBatchForKeys:(NSArray *)keys objects:(BOOL)objects group:(dispatch_group_t)group handler:(void (^)(NSArray *keys, NSArray *data, NSArray *valueTransformerNames, NSArray *expirationDates))handler {
+    if (!keys.count) {
+        return;
+    }
+    [self _enumerateIOQueuesForKeys:keys usingBlock:^(dispatch_queue_t queue, NSArray *queueKeys) {
+        for (NSUInteger location = 0; location < queueKeys.count; location += DFCacheBatchChunkSize) {
+            NSArray *chunkKeys = [queueKeys subarrayWithRange:NSMakeRange(location, MIN(DFCacheBatchChunkSize, queueKeys.count - location))];
+            dispatch_group_async(group, queue, [self _IOQueueBlockWithBlock:^{
+                @autoreleasepool {
+                    for (NSString *key in chunkKeys) {
+                        [self _flushPendingWriteForKey:key];
+                    }
+                    NSUInteger count = chunkKeys.count;
+                    id __strong *data = (id __strong *)calloc(count, sizeof(id));
+                    id __strong *names = (id __strong *)calloc(count, sizeof(id));
+                    id __strong *expirationDates = (id __strong *)calloc(count, sizeof(id));
+                    size_t workers = MIN(count, DFCacheBatchMaxConcurrentReads);
+                    dispatch_apply(workers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+                        for (size_t i = worker; i < count; i += workers) {
+                            @autoreleasepool {
+                                NSDictionary *attributes;
+                                NSDate *expirationDate;
+                                data[i] = [self _diskDataForKey:chunkKeys[i] attributes:(objects ? &attributes : NULL) expirationDate:(objects ? &expirationDate : NULL)];
+                                names[i] = _DFCacheDecodeValueTransformerName(attributes[DFCacheAttributeValueTransformerNameKey]);
+                                expirationDates[i] = expirationDate;
+                            }
+                        }
+                    });
+                    NSMutableArray *chunkData = [[NSMutableArray alloc] initWithCapacity:count];
+                    NSMutableArray *chunkNames = [[NSMutableArray alloc] initWithCapacity:count];
+                    NSMutableArray *chunkExpirationDates = [[NSMutableArray alloc] initWithCapacity:count];
+                    for (NSUInteger i = 0; i < count; i++) {
+                        [chunkData addObject:data[i] ?: [NSNull null]];
+                        [chunkNames addObject:names[i] ?: [NSNull null]];
+                        [chunkExpirationDates addObject:expirationDates[i] ?: [NSNull null]];
+                        data[i] = nil;
+                        names[i] = nil;
+                        expirationDates[i] = nil;
+                    }
+                    free(data);
+                    free(names);
+                    free(expirationDates);
+                    handler(chunkKeys, chunkData, chunkNames, chunkExpirationDates);
+                }
+            }]);
+        }
+    }];
 }
 
 - (void)firstCachedObjectForKeys:(NSArray *)keys completion:(void (^)(id, NSString *))completion {
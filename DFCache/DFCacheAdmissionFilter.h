@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Cache tiers that admission filter makes decisions for.
+ */
+typedef NS_ENUM(NSUInteger, DFCacheTier) {
+    DFCacheTierMemory,
+    DFCacheTierDisk
+};
+
+/*! TinyLFU admission filter that decides whether a new entry is worth storing based on how often its key was accessed recently.
+ @discussion Access frequencies are estimated by a count-min sketch with 4-bit counters that takes a fixed amount of memory regardless of the number of keys. Sketch ages periodically: once the number of recorded accesses reaches the sample size all counters are halved, so that keys that were popular a long time ago don't stay admitted forever.
+ @note Keys that are accessed only once (one-hit wonders) have a frequency of 1, the default disk admission frequency of 2 rejects them until they are accessed again. Filter is thread-safe.
+ */
+@interface DFCacheAdmissionFilter : NSObject
+
+/*! Initializes filter with the number of counters per sketch row (rounded up to the power of two). Use a number that is close to the number of entries that the cache holds, estimates become less accurate when the number of distinct keys in the sample is much larger.
+ */
+- (instancetype)initWithWidth:(NSUInteger)width NS_DESIGNATED_INITIALIZER;
+
+/*! Initializes filter with the width of 16384 counters.
+ */
+- (instancetype)init;
+
+/*! Number of recorded accesses after which the estimated frequencies are halved. Default value is 10 * width.
+ */
+@property (nonatomic) NSUInteger sampleSize;
+
+/*! Minimum estimated frequency of the key at which new objects are put into memory cache. Default value is 0 which means that all objects are admitted.
+ */
+@property (atomic) NSUInteger memoryAdmissionFrequency;
+
+/*! Minimum estimated frequency of the key at which new entries are written to disk cache. Default value is 2.
+ */
+@property (atomic) NSUInteger diskAdmissionFrequency;
+
+/*! Number of entries rejected by the filter since the filter was created or counters were reset.
+ */
+@property (nonatomic, readonly) uint64_t rejectedMemoryCount;
+@property (nonatomic, readonly) uint64_t rejectedDiskCount;
+
+/*! Records access to the key. Estimated frequencies saturate at 15.
+ */
+- (void)recordAccessForKey:(NSString *)key;
+
+/*! Returns estimated number of accesses to the key since it was last halved by aging. Estimate might be higher but is never lower than the actual number of accesses.
+ */
+- (NSUInteger)frequencyForKey:(NSString *)key;
+
+/*! Returns YES if estimated frequency of the key reaches admission frequency of the given tier. Rejections are counted.
+ */
+- (BOOL)shouldAdmitKey:(NSString *)key toTier:(DFCacheTier)tier;
+
+/*! Resets estimated frequencies and rejection counters.
+ */
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCacheAdmissionFilter.h"
+#import "DFCacheFrequencySketch.h"
+#import <pthread.h>
+#import <stdatomic.h>
+
+@implementation DFCacheAdmissionFilter {
+    DFCacheFrequencySketch *_sketch;
+    pthread_mutex_t _mutex;
+    _Atomic(uint64_t) _rejectedCounts[2];
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (instancetype)initWithWidth:(NSUInteger)width {
+    if (self = [super init]) {
+        _sketch = [[DFCacheFrequencySketch alloc] initWithWidth:width];
+        pthread_mutex_init(&_mutex, NULL);
+        atomic_init(&_rejectedCounts[DFCacheTierMemory], 0);
+        atomic_init(&_rejectedCounts[DFCacheTierDisk], 0);
+        _diskAdmissionFrequency = 2;
+    }
+    return self;
+}
+
+- (instancetype)init {
+    return [self initWithWidth:16384];
+}
+
+- (NSUInteger)sampleSize {
+    pthread_mutex_lock(&_mutex);
+    NSUInteger sampleSize = _sketch.sampleSize;
+    pthread_mutex_unlock(&_mutex);
+    return sampleSize;
+}
+
+- (void)setSampleSize:(NSUInteger)sampleSize {
+    pthread_mutex_lock(&_mutex);
+    _sketch.sampleSize = MAX(sampleSize, 1);
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (uint64_t)rejectedMemoryCount {
+    return atomic_load_explicit(&_rejectedCounts[DFCacheTierMemory], memory_order_relaxed);
+}
+
+- (uint64_t)rejectedDiskCount {
+    return atomic_load_explicit(&_rejectedCounts[DFCacheTierDisk], memory_order_relaxed);
+}
+
+- (void)recordAccessForKey:(NSString *)key {
+    if (!key) {
+        return;
+    }
+    const uint64_t hash = [DFCacheFrequencySketch hashForString:key];
+    pthread_mutex_lock(&_mutex);
+    [_sketch incrementHash:hash];
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (NSUInteger)frequencyForKey:(NSString *)key {
+    if (!key) {
+        return 0;
+    }
+    const uint64_t hash = [DFCacheFrequencySketch hashForString:key];
+    pthread_mutex_lock(&_mutex);
+    NSUInteger frequency = [_sketch frequencyForHash:hash];
+    pthread_mutex_unlock(&_mutex);
+    return frequency;
+}
+
+- (BOOL)shouldAdmitKey:(NSString *)key toTier:(DFCacheTier)tier {
+    const NSUInteger admissionFrequency = tier == DFCacheTierMemory ? self.memoryAdmissionFrequency : self.diskAdmissionFrequency;
+    if (admissionFrequency == 0 || [self frequencyForKey:key] >= admissionFrequency) {
+        return YES;
+    }
+    atomic_fetch_add_explicit(&_rejectedCounts[tier], 1, memory_order_relaxed);
+    return NO;
+}
+
+- (void)reset {
+    pthread_mutex_lock(&_mutex);
+    [_sketch removeAllCounts];
+    pthread_mutex_unlock(&_mutex);
+    atomic_store_explicit(&_rejectedCounts[DFCacheTierMemory], 0, memory_order_relaxed);
+    atomic_store_explicit(&_rejectedCounts[DFCacheTierDisk], 0, memory_order_relaxed);
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { memoryAdmissionFrequency = %lu; diskAdmissionFrequency = %lu; rejectedMemoryCount = %llu; rejectedDiskCount = %llu }", [self class], self, (unsigned long)self.memoryAdmissionFrequency, (unsigned long)self.diskAdmissionFrequency, self.rejectedMemoryCount, self.rejectedDiskCount];
+}
+
+@end
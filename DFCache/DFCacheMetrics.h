@@ -0,0 +1,112 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Operations which latencies are recorded by the cache metrics.
+ */
+typedef NS_ENUM(NSUInteger, DFCacheOperation) {
+    /*! Lookup in the memory cache.
+     */
+    DFCacheOperationMemoryLookup = 0,
+    /*! Time that disk operation waits in the IO queue before it starts. Synchronous methods block the caller for this time.
+     */
+    DFCacheOperationIOQueueWait = 1,
+    /*! Read of the entry data and attributes from disk cache.
+     */
+    DFCacheOperationDiskRead = 2,
+    /*! Decoding of the object by the value transformer.
+     */
+    DFCacheOperationDecode = 3,
+    /*! Encoding of the object by the value transformer.
+     */
+    DFCacheOperationEncode = 4,
+    /*! Write of the entry to disk cache.
+     */
+    DFCacheOperationDiskWrite = 5,
+    /*! Single disk cleanup slice.
+     */
+    DFCacheOperationCleanup = 6
+};
+
+/*! Immutable snapshot of the latency distribution of the cache operation.
+ @discussion Durations are recorded with nanosecond resolution into buckets that split each power of two range into 16 linear sub-buckets (similar to HDR histograms), so that durations reported by the histogram are within 6.25% of the recorded ones.
+ */
+@interface DFCacheLatencyHistogram : NSObject
+
+/*! Number of recorded durations.
+ */
+@property (nonatomic, readonly) uint64_t count;
+
+/*! Sum of the recorded durations.
+ */
+@property (nonatomic, readonly) NSTimeInterval totalDuration;
+
+@property (nonatomic, readonly) NSTimeInterval minimumDuration;
+@property (nonatomic, readonly) NSTimeInterval maximumDuration;
+@property (nonatomic, readonly) NSTimeInterval meanDuration;
+
+/*! Returns duration that the given percentage of the recorded durations doesn't exceed. Returns 0 if there are no recorded durations.
+ @param percentile Percentile in range [0, 100], e.g. 99.9.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile;
+
+/*! Unavailable initializer, histograms are created by the cache.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+
+/*! Immutable snapshot of the cache metrics. Counters and histograms are cumulative since the metrics were enabled or reset.
+ */
+@interface DFCacheMetrics : NSObject
+
+/*! Time interval since the metrics were enabled or reset.
+ */
+@property (nonatomic, readonly) NSTimeInterval duration;
+
+/*! Number of object lookups that were served by the memory cache.
+ */
+@property (nonatomic, readonly) uint64_t memoryHitCount;
+
+/*! Number of disk reads that found the entry. Concurrent lookups for the same key that share a single read are counted once.
+ */
+@property (nonatomic, readonly) uint64_t diskHitCount;
+
+/*! Number of disk reads that didn't find the entry.
+ */
+@property (nonatomic, readonly) uint64_t missCount;
+
+/*! Number of expired entries discarded by disk cleanup and their total size, in bytes.
+ */
+@property (nonatomic, readonly) uint64_t expiredCount;
+@property (nonatomic, readonly) unsigned long long expiredSize;
+
+/*! Number of entries evicted by disk cleanup and their total size, in bytes.
+ */
+@property (nonatomic, readonly) uint64_t evictedCount;
+@property (nonatomic, readonly) unsigned long long evictedSize;
+
+/*! Number of disk operations that were dispatched to IO queues and are not yet finished at the time of the snapshot.
+ */
+@property (nonatomic, readonly) NSUInteger ioQueueDepth;
+
+/*! Maximum number of disk operations that were waiting for IO queues or running at the same time.
+ */
+@property (nonatomic, readonly) NSUInteger maximumIOQueueDepth;
+
+/*! Returns latency histogram of the given operation.
+ */
+- (DFCacheLatencyHistogram *)latencyHistogramForOperation:(DFCacheOperation)operation;
+
+/*! Unavailable initializer, metrics are created by the cache.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,100 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCacheMetrics.h"
+#import "DFCacheMetricsRecorder.h"
+#import "DFCachePrivate.h"
+
+@implementation DFCacheLatencyHistogram {
+    uint64_t _buckets[DFCacheLatencyBucketCount];
+    uint64_t _minimum;
+    uint64_t _maximum;
+}
+
+- (instancetype)initWithBuckets:(const uint64_t *)buckets count:(uint64_t)count totalDuration:(uint64_t)totalDuration minimumDuration:(uint64_t)minimumDuration maximumDuration:(uint64_t)maximumDuration {
+    if (self = [super init]) {
+        memcpy(_buckets, buckets, sizeof(_buckets));
+        _count = count;
+        _minimum = count ? minimumDuration : 0;
+        _maximum = maximumDuration;
+        _totalDuration = totalDuration / 1e9;
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+- (NSTimeInterval)minimumDuration {
+    return _minimum / 1e9;
+}
+
+- (NSTimeInterval)maximumDuration {
+    return _maximum / 1e9;
+}
+
+- (NSTimeInterval)meanDuration {
+    return _count ? _totalDuration / _count : 0;
+}
+
+/*! Counts are copied from the recorder bucket by bucket while durations are being recorded, so the total of the buckets might be slightly different from the count.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile {
+    uint64_t total = 0;
+    for (NSUInteger i = 0; i < DFCacheLatencyBucketCount; i++) {
+        total += _buckets[i];
+    }
+    if (!total) {
+        return 0;
+    }
+    const uint64_t rank = MAX(1, (uint64_t)ceil(MIN(MAX(percentile, 0), 100) / 100.0 * total));
+    uint64_t cumulativeCount = 0;
+    for (NSUInteger i = 0; i < DFCacheLatencyBucketCount; i++) {
+        cumulativeCount += _buckets[i];
+        if (cumulativeCount >= rank) {
+            uint64_t duration = MIN(MAX(_dwarf_cache_latency_bucket_upper_bound(i), _minimum), _maximum);
+            return duration / 1e9;
+        }
+    }
+    return self.maximumDuration;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { count = %llu; mean = %.3f ms; p50 = %.3f ms; p99 = %.3f ms; max = %.3f ms }", [self class], self, _count, self.meanDuration * 1000.0, [self durationAtPercentile:50] * 1000.0, [self durationAtPercentile:99] * 1000.0, self.maximumDuration * 1000.0];
+}
+
+@end
+
+
+@implementation DFCacheMetrics {
+    NSArray *_histograms;
+}
+
+- (instancetype)initWithDuration:(NSTimeInterval)duration histograms:(NSArray *)histograms {
+    if (self = [super init]) {
+        _duration = duration;
+        _histograms = [histograms copy];
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+- (DFCacheLatencyHistogram *)latencyHistogramForOperation:(DFCacheOperation)operation {
+    if (operation >= _histograms.count) {
+        [NSException raise:NSInvalidArgumentException format:@"Invalid operation %lu", (unsigned long)operation];
+    }
+    return _histograms[operation];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { memory_hits = %llu; disk_hits = %llu; misses = %llu; evicted = %llu (%@); expired = %llu (%@); io_queue_depth = %lu (max %lu) }", [self class], self, _memoryHitCount, _diskHitCount, _missCount, _evictedCount, _dwarf_bytes_to_str(_evictedSize), _expiredCount, _dwarf_bytes_to_str(_expiredSize), (unsigned long)_ioQueueDepth, (unsigned long)_maximumIOQueueDepth];
+}
+
+@end
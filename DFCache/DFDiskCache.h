@@ -3,32 +3,152 @@
 // Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
 
 #import <Foundation/Foundation.h>
+#import "DFDiskCacheEvictionPolicy.h"
 #import "DFFileStorage.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 static const unsigned long long DFDiskCacheCapacityUnlimited = 0;
 
-/*! Disk cache extends file storage functionality by providing LRU (least recently used) cleanup. Cleanup doesn't get called automatically.
+/*! Durability of the disk cache writes, i.e. whether written entries survive a crash or a power loss.
+ */
+typedef NS_ENUM(NSUInteger, DFDiskCacheDurability) {
+    /*! Writes are not synchronized to stable storage. Entries are still replaced atomically and verified using checksums, so a crash never leaves an entry with partial data or attributes, but the recent writes might be lost.
+     */
+    DFDiskCacheDurabilityNone = 0,
+    /*! Writes are synchronized to stable storage in groups, after durabilityBatchSize writes or durabilityBatchInterval after the first unsynchronized write, whichever comes first. Group costs one sync per written file, one sync per directory and a single drive cache flush. Only the writes of the last group might be lost.
+     */
+    DFDiskCacheDurabilityBatched = 1,
+    /*! Each write is synchronized to stable storage before the method returns.
+     */
+    DFDiskCacheDurabilityPerWrite = 2
+};
+
+/*! Number and total size of the entries discarded by cleanup.
+ */
+typedef struct {
+    NSUInteger expiredCount;
+    unsigned long long expiredSize;
+    NSUInteger evictedCount;
+    unsigned long long evictedSize;
+} DFDiskCacheCleanupStatistics;
+
+/*! Disk cache extends file storage functionality by providing cleanup driven by a pluggable eviction policy, LRU (least recently used) by default. Cleanup doesn't get called automatically.
+ @discussion Entry files start with a compact binary header followed by the entry attributes and data, so that data and attributes are read with a single read and are replaced atomically together. Files written by the previous versions (raw data with attributes stored in extended file attributes) are still readable, they are migrated to the new format on first access. Since entry files contain headers, use disk cache API rather than reading files at pathForKey: directly.
+ @discussion Disk cache keeps an in-memory index of the entries sizes, access dates and access counts. The index is built on first access and is kept up to date by the disk cache methods. Index changes are recorded into an append-only journal (hidden files in the storage directory) which is periodically compacted into a snapshot. On launch the journal is replayed and checked against the storage directory listing, storage directory is fully scanned only when the journal is missing or corrupted. Files added to the storage directory bypassing disk cache API after the index was built are not accounted for.
+ @discussion Shared disk cache can be used by multiple processes (or multiple disk cache instances) at the same time. For more info see initWithPath:shared:error:.
  */
 @interface DFDiskCache : DFFileStorage
 
 - (instancetype)initWithName:(NSString *)name;
 
+/*! Initializes disk cache with the directory with a given name in caches directory. For more info see initWithPath:shared:error:.
+ */
+- (nullable instancetype)initWithName:(NSString *)name shared:(BOOL)shared;
+
+/*! Initializes disk cache with the given storage directory.
+ @discussion Shared disk cache coordinates with the other processes and disk cache instances that use the same directory in shared mode through an index stored in a memory-mapped file in the storage directory. Index keeps sizes, access and expiration dates of the entries and is protected by a file lock, so that the directory is scanned only by the first process that uses it and each process sees the writes, removals and evictions of the others. Only one process performs cleanup at a time, cleanup called while another process is cleaning up returns immediately. Entries are written to temporary files and renamed into place under the file lock, so readers never see partially written entries and cleanup never removes an entry that was written while it was being evicted.
+ @discussion Shared disk cache doesn't use the index journal, entries are never packed into segments and are evicted in the order of their last access by any process, eviction policy is not consulted. Keys of the entries written by other processes are unknown, they are not reported by keysOfMostFrequentlyAccessedEntries:. All processes must use the same directory layout settings.
+ @param shared Pass YES to use the directory in shared mode. Non-shared disk caches must not use the directory at the same time.
+ @return Disk cache or nil if the storage directory or the shared index can't be opened.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path shared:(BOOL)shared error:(NSError **)error;
+
+/*! Returns YES if the disk cache was initialized in shared mode.
+ */
+@property (nonatomic, readonly, getter=isShared) BOOL shared;
+
 /*! Maximum disk cache capacity. Default value is 100 Mb.
  @discussion Not a strict limit. Disk storage is actually cleaned up only when cleanup method gets called.
  */
 @property (nonatomic) unsigned long long capacity;
 
-/*! Remaining disk usage after cleanup. The rate must be in the range of 0.0 to 1.0 where 1.0 represents full disk capacity. Default and recommended value is 0.5.
+/*! Remaining disk usage after cleanup (low watermark). The rate must be in the range of 0.0 to 1.0 where 1.0 represents full disk capacity. Default and recommended value is 0.5.
  */
 @property (nonatomic) float cleanupRate;
 
-/*! Cleans up disk cache by discarding the least recently used items.
- @discussion Cleanup algorithm runs only if max disk cache capacity is set to non-zero value. Target size is calculated by multiplying disk capacity and cleanup rate.
+/*! Disk usage at which cleanup starts discarding entries (high watermark). The rate must be in the range of 0.0 to 1.0 where 1.0 represents full disk capacity. Default value is 0.9.
+ @discussion Once started, cleanup discards entries until disk usage drops below the cleanup rate. Keeping the gap between watermarks small makes each cleanup shorter. If the cleanup rate is higher than the high watermark, cleanup starts at the cleanup rate.
+ */
+@property (nonatomic) float highWatermark;
+
+/*! Returns YES if disk usage reached high watermark.
+ */
+@property (nonatomic, readonly) BOOL needsCleanup;
+
+/*! Eviction policy that decides which entries are discarded first during cleanup. Default policy is DFDiskCacheEvictionPolicyLRU.
+ @discussion Recency and frequency are tracked by the disk cache itself and survive relaunches, file system access dates are not used. Setting the policy populates it with the existing entries ordered by access date. Each disk cache requires its own policy instance.
+ */
+@property (nonatomic) id<DFDiskCacheEvictionPolicy> evictionPolicy;
+
+/*! Maximum size of the data that is packed into segment files instead of being stored in a standalone file. Default value is 0 which means that all entries are stored in standalone files.
+ @discussion Small entries are appended to large segment files (hidden directory in the storage directory) and are read back with a single pread. This saves an inode, a minimum allocation block and an open/read/close sequence per entry. Replacing and removing packed entries leaves dead space in segments which is reclaimed by compaction during cleanup. Large entries are still stored in standalone files. Ignored by shared disk cache.
+ @warning Packed entries don't have files, pathForKey: and URLForKey: methods return paths to files that don't exist for them.
+ */
+@property (nonatomic) NSUInteger packedEntrySizeLimit;
+
+/*! Size of the segment file after which a new segment is started. Default value is 4 Mb.
+ */
+@property (nonatomic) unsigned long long segmentSizeLimit;
+
+/*! Durability of the writes. Default value is DFDiskCacheDurabilityNone.
+ @discussion Synchronizing each write to stable storage is expensive, especially under write bursts. Batched durability amortizes the cost by committing writes in groups. Removals are not synchronized, entries removed shortly before a crash might reappear.
+ */
+@property (nonatomic) DFDiskCacheDurability durability;
+
+/*! Number of writes after which the group is committed when durability is DFDiskCacheDurabilityBatched. Default value is 64.
+ */
+@property (nonatomic) NSUInteger durabilityBatchSize;
+
+/*! Maximum time that the write waits for the group to be committed when durability is DFDiskCacheDurabilityBatched. Default value is 1 second.
+ */
+@property (nonatomic) NSTimeInterval durabilityBatchInterval;
+
+/*! Atomically writes entry with the given data and attributes that expires at the given date.
+ @discussion Expiration dates are kept in the in-memory index (and are persisted in the index journal), checking whether the entry has expired doesn't touch the disk. Expired entries are never returned, they are removed lazily when accessed and by cleanup which discards expired entries before consulting the eviction policy. Changing attributes of the entry preserves its expiration date. Entries restored by a full storage scan (when the journal is missing or corrupted) don't expire.
+ @param expirationDate Expiration date. Pass nil if the entry should never expire.
+ */
+- (void)setData:(NSData *)data attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes expirationDate:(nullable NSDate *)expirationDate forKey:(NSString *)key;
+
+/*! Returns writer that streams the data of the entry for the given key into disk cache chunk by chunk. Entry is atomically replaced when the writer is closed. For more info see DFFileStorage writerForKey:attributes:.
+ @discussion Streamed entries are always stored in standalone entry files, they are never packed into segments. Once the writer is closed, entry takes part in capacity accounting and cleanup like the entries written by setData: methods. Cleanup is not triggered by the write itself. Temporary files of the writers that were never closed (e.g. when the app was terminated) are removed when the disk cache is next used, once they haven't been modified for an hour.
+ @param expirationDate Expiration date. Pass nil if the entry should never expire.
+ */
+- (nullable DFFileStorageWriter *)writerForKey:(NSString *)key attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes expirationDate:(nullable NSDate *)expirationDate;
+
+/*! Synchronously commits the pending group of writes when durability is DFDiskCacheDurabilityBatched, e.g. before the app is suspended. Segments and the index journal are synchronized regardless of durability, entry files are not tracked when durability is DFDiskCacheDurabilityNone.
+ */
+- (void)synchronize;
+
+/*! Returns expiration date of the entry for the given key. Returns nil if the entry never expires or doesn't exist. Doesn't touch the disk.
+ */
+- (nullable NSDate *)expirationDateForKey:(NSString *)key;
+
+/*! Reads data and attributes of the entry for the given key and returns expiration date of the same version of the entry that the data is read from (nil if the entry never expires). Expiration date is looked up along with the location of the entry, there is no separate lookup.
+ */
+- (nullable NSData *)dataForKey:(NSString *)key attributes:(NSDictionary<NSString *, NSData *> *_Nullable *_Nullable)attributes expirationDate:(NSDate *_Nullable *_Nullable)expirationDate;
+
+/*! Returns keys of up to count entries that were accessed most frequently, most frequently accessed first. Access counts are persisted in the index journal, so the order survives relaunches. Doesn't touch the disk besides loading the index.
+ @discussion Entries restored by a full storage scan and entries written by the previous versions without keys are not reported.
+ */
+- (NSArray<NSString *> *)keysOfMostFrequentlyAccessedEntries:(NSUInteger)count;
+
+/*! Cleans up disk cache by discarding expired entries and entries chosen by the eviction policy. Equivalent to calling cleanupWithTimeBudget: until it returns YES.
+ @discussion Expired entries are always discarded first. Eviction runs only if max disk cache capacity is set to non-zero value. Entries are discarded when disk usage reaches high watermark until it drops below the target size that is calculated by multiplying disk capacity and cleanup rate. Cleanup doesn't scan storage directory, it uses in-memory index instead. Cleanup also compacts segments that consist mostly of dead space, writes buffered journal records to disk and compacts the journal when needed.
  */
 - (void)cleanup;
 
+/*! Performs a slice of cleanup that discards entries until the time budget is exhausted. At least one entry is discarded per slice.
+ @discussion Allows to spread cleanup over time, so that disk IO performed by cleanup doesn't stall other disk operations for long. Cleanup started by a slice is continued by the following slices until disk usage drops below the cleanup rate. Segments compaction and journal synchronization are performed by the last slice.
+ @return YES if cleanup is finished.
+ */
+- (BOOL)cleanupWithTimeBudget:(NSTimeInterval)timeBudget;
+
+/*! Performs a slice of cleanup and reports the number and size of the discarded entries. For more info see cleanupWithTimeBudget:.
+ @param statistics On return contains statistics of the entries discarded by the slice.
+ */
+- (BOOL)cleanupWithTimeBudget:(NSTimeInterval)timeBudget statistics:(nullable DFDiskCacheCleanupStatistics *)statistics;
+
 /*! Returns path to caches directory.
  */
 + (NSString *)cachesDirectoryPath;
@@ -4,56 +4,1221 @@
 
 #import "DFCachePrivate.h"
 #import "DFDiskCache.h"
+#import "DFDiskCacheEntryFile.h"
+#import "DFDiskCacheIndex.h"
+#import "DFDiskCacheJournal.h"
+#import "DFDiskCacheSegments.h"
+#import "DFDiskCacheSharedIndex.h"
+#import "DFFileStoragePrivate.h"
+#import "NSURL+DFExtendedFileAttributes.h"
+#import <fcntl.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
-@implementation DFDiskCache
+/*! Name of the hidden directory that contains segment files.
+ */
+static NSString *const DFDiskCacheSegmentsDirectoryName = @".df_segments";
+
+/*! Temporary files that weren't modified for this long are left by the writes that were interrupted, e.g. when the app was terminated while streaming an entry. Recently modified files might belong to the writes that are still in progress in this or other processes.
+ */
+static const NSTimeInterval DFDiskCacheTemporaryFileStaleInterval = 3600.0;
+
+enum {
+    /*! Number of locks that entry files are distributed across by file name.
+     */
+    DFDiskCacheEntryLockCount = 16
+};
+
+/*! Returns a copy of the entry stored under a different file name.
+ */
+static DFDiskCacheEntry *
+_DFDiskCacheEntryWithFilename(DFDiskCacheEntry *entry, NSString *filename) {
+    DFDiskCacheEntry *copy = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+    copy.key = entry.key;
+    copy.size = entry.size;
+    copy.accessDate = entry.accessDate;
+    copy.accessCount = entry.accessCount;
+    copy.expirationDate = entry.expirationDate;
+    copy.location = entry.location;
+    return copy;
+}
+
+/*! Overwrites the placeholder header at the beginning of the entry file.
+ */
+static BOOL
+_DFDiskCacheWriteHeader(int fd, NSData *header) {
+    const uint8_t *bytes = header.bytes;
+    size_t length = header.length;
+    off_t offset = 0;
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+    return YES;
+}
+
+@implementation DFDiskCache {
+    /*! In-memory index of the storage contents. Populated lazily by replaying the journal or by scanning storage directory.
+     */
+    DFDiskCacheIndex *_index;
+
+    /*! Segment files that small entries are packed into.
+     */
+    DFDiskCacheSegments *_segments;
+
+    /*! Index shared with other processes that use the same storage directory, nil unless the disk cache is shared. Local index is kept in sync with the shared index lazily, when the entries are accessed.
+     @note Shared index lock is always taken before the index lock, never the other way around.
+     */
+    DFDiskCacheSharedIndex *_sharedIndex;
+
+    /*! YES when disk usage reached high watermark and cleanup slices haven't brought it below the low watermark yet.
+     */
+    BOOL _evicting;
+
+    /*! YES when the index contains entries with SHA-1 file names that couldn't be migrated to the MurmurHash3 names when the index was loaded because their keys are unknown. Such entries are migrated on first access.
+     */
+    BOOL _mayContainLegacyEntries;
+
+    /*! YES until the storage directory is checked for stale temporary files. Directory is checked when the index is restored from the journal, or by the first cleanup otherwise.
+     */
+    BOOL _needsTemporaryFilesSweep;
+
+    /*! Serialize replacing entry files with cleanup removing files of the discarded entries. Entry file is renamed into place and recorded in the index under the lock for its file name, cleanup checks under the same lock that the entry wasn't written again before removing the file. Not used in shared mode, the shared index lock serves the same purpose.
+     @note Entry lock is always taken before the index lock.
+     */
+    pthread_mutex_t _entryLocks[DFDiskCacheEntryLockCount];
+
+    /*! Guards the pending group of writes.
+     */
+    pthread_mutex_t _durabilityMutex;
+
+    /*! Paths of the entry files written since the group was last committed.
+     */
+    NSMutableSet *_unsynchronizedPaths;
+    NSUInteger _unsynchronizedWriteCount;
+    BOOL _commitScheduled;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_durabilityMutex);
+    for (NSUInteger i = 0; i < DFDiskCacheEntryLockCount; i++) {
+        pthread_mutex_destroy(&_entryLocks[i]);
+    }
+}
 
 - (instancetype)initWithPath:(NSString *)path error:(NSError **)error {
+    return [self initWithPath:path shared:NO error:error];
+}
+
+- (instancetype)initWithPath:(NSString *)path shared:(BOOL)shared error:(NSError **)error {
     if (self = [super initWithPath:path error:error]) {
-        _capacity = 1024 * 1024 * 100; // 100 Mb
         _cleanupRate = 0.5f;
+        _highWatermark = 0.9f;
+        // Shared index replaces the journal, the journal can't be appended to by multiple processes.
+        _index = [[DFDiskCacheIndex alloc] initWithJournal:(shared ? nil : [[DFDiskCacheJournal alloc] initWithDirectoryPath:path])];
+        self.capacity = 1024 * 1024 * 100; // 100 Mb
+        _segments = [[DFDiskCacheSegments alloc] initWithDirectoryPath:[path stringByAppendingPathComponent:DFDiskCacheSegmentsDirectoryName]];
+        pthread_mutex_init(&_durabilityMutex, NULL);
+        for (NSUInteger i = 0; i < DFDiskCacheEntryLockCount; i++) {
+            pthread_mutex_init(&_entryLocks[i], NULL);
+        }
+        _unsynchronizedPaths = [NSMutableSet new];
+        _durabilityBatchSize = 64;
+        _durabilityBatchInterval = 1.0;
+        _needsTemporaryFilesSweep = YES;
+        if (shared) {
+            _sharedIndex = [[DFDiskCacheSharedIndex alloc] initWithDirectoryPath:path error:error];
+            if (!_sharedIndex) {
+                return nil;
+            }
+        }
     }
     return self;
 }
 
 - (instancetype)initWithName:(NSString *)name {
+    return [self initWithName:name shared:NO];
+}
+
+- (instancetype)initWithName:(NSString *)name shared:(BOOL)shared {
     NSString *directoryPath = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:name];
-    return [self initWithPath:directoryPath error:nil];
+    return [self initWithPath:directoryPath shared:shared error:nil];
 }
 
-- (void)cleanup {
-    if (_capacity == DFDiskCacheCapacityUnlimited) {
+- (BOOL)isShared {
+    return _sharedIndex != nil;
+}
+
+- (void)setCapacity:(unsigned long long)capacity {
+    _capacity = capacity;
+    _index.capacity = capacity;
+}
+
+- (id<DFDiskCacheEvictionPolicy>)evictionPolicy {
+    return _index.evictionPolicy;
+}
+
+- (void)setEvictionPolicy:(id<DFDiskCacheEvictionPolicy>)evictionPolicy {
+    _index.evictionPolicy = evictionPolicy;
+}
+
+#pragma mark - DFFileStorage
+
+- (NSData *)dataForKey:(NSString *)key {
+    return [self dataForKey:key attributes:NULL];
+}
+
+- (NSData *)dataForKey:(NSString *)key attributes:(NSDictionary **)attributes {
+    return [self dataForKey:key attributes:attributes expirationDate:NULL];
+}
+
+- (NSData *)dataForKey:(NSString *)key attributes:(NSDictionary **)attributes expirationDate:(NSDate **)outExpirationDate {
+    if (!key) {
+        return nil;
+    }
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    DFDiskCacheLocation location;
+    NSTimeInterval expirationDate = 0;
+    BOOL expired;
+    BOOL exists = [self _getLocation:&location expirationDate:&expirationDate forKey:key filename:filename expired:&expired];
+    if (expired) {
+        [self _discardExpiredContentsAtLocation:location key:key];
+        return nil;
+    }
+    if (outExpirationDate) {
+        *outExpirationDate = expirationDate ? [NSDate dateWithTimeIntervalSinceReferenceDate:expirationDate] : nil;
+    }
+    if (exists && DFDiskCacheLocationIsPacked(location)) {
+        NSData *data = [self _packedDataForFilename:filename location:location attributes:attributes];
+        if (data) {
+            [index touchFilename:filename];
+        }
+        return data;
+    }
+    NSData *data = [self _fileDataForKey:key attributes:attributes];
+    if (data) {
+        [_sharedIndex touchFilename:filename];
+        _dwarf_cache_bytes size;
+        if (![index touchFilename:filename] && _dwarf_cache_allocated_size([self pathForKey:key], &size)) {
+            [index setSize:size forFilename:filename key:key];
+        }
+    } else {
+        [index removeFilename:filename];
+        if (_sharedIndex) {
+            [self _removeSharedEntryIfMissingForFilename:filename path:[self pathForKey:key]];
+        }
+    }
+    return data;
+}
+
+- (void)setData:(NSData *)data attributes:(NSDictionary *)attributes forKey:(NSString *)key {
+    [self setData:data attributes:attributes expirationDate:nil forKey:key];
+}
+
+- (void)setData:(NSData *)data attributes:(NSDictionary *)attributes expirationDate:(NSDate *)expirationDate forKey:(NSString *)key {
+    [self _setData:data attributes:attributes expirationDate:expirationDate.timeIntervalSinceReferenceDate forKey:key];
+}
+
+- (void)_setData:(NSData *)data attributes:(NSDictionary *)attributes expirationDate:(NSTimeInterval)expirationDate forKey:(NSString *)key {
+    if (!data || !key) {
+        return;
+    }
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    if (_mayContainLegacyEntries) {
+        [self _removeLegacyEntryForKey:key];
+    }
+    DFDiskCacheLocation location, previousLocation;
+    if (!_sharedIndex && data.length <= _packedEntrySizeLimit && [_segments appendData:data attributes:attributes filename:filename location:&location]) {
+        if ([index setSize:location.length location:location expirationDate:expirationDate forFilename:filename key:key previousLocation:&previousLocation]) {
+            [self _discardContentsAtLocation:previousLocation key:key];
+        }
+        [self _didWriteEntryAtPath:nil];
+        return;
+    }
+    NSString *path = [self pathForKey:key];
+    const BOOL synchronize = _durability == DFDiskCacheDurabilityPerWrite;
+    // Data is written outside of the entry lock, only the rename is serialized with cleanup.
+    NSString *temporaryPath = [DFDiskCacheEntryFile writeTemporaryFileWithData:data attributes:attributes forPath:path synchronize:synchronize];
+    if ([self _replaceEntryFileAtPath:path withTemporaryFileAtPath:temporaryPath key:key filename:filename expirationDate:expirationDate]) {
+        if (synchronize) {
+            // Persists the rename.
+            _dwarf_cache_fsync_path([path stringByDeletingLastPathComponent], NO);
+        }
+        [self _didWriteEntryAtPath:path];
+    }
+}
+
+- (void)removeDataForKey:(NSString *)key {
+    if (!key) {
+        return;
+    }
+    NSString *filename = [self filenameForKey:key];
+    if (_sharedIndex) {
+        DFDiskCacheIndex *index = [self _loadedIndex];
+        [_sharedIndex lock];
+        [super removeDataForKey:key];
+        [_sharedIndex removeFilename:filename];
+        [_sharedIndex unlock];
+        [index removeFilename:filename];
+        return;
+    }
+    DFDiskCacheLocation location;
+    if ([[self _loadedIndex] removeFilename:filename location:&location] && DFDiskCacheLocationIsPacked(location)) {
+        [_segments releaseLocation:location];
+        [_segments appendTombstoneForFilename:filename];
+    } else {
+        [super removeDataForKey:key];
+    }
+    if (_mayContainLegacyEntries) {
+        [self _removeLegacyEntryForKey:key];
+    }
+}
+
+- (void)removeAllData {
+    pthread_mutex_lock(&_durabilityMutex);
+    [_unsynchronizedPaths removeAllObjects];
+    _unsynchronizedWriteCount = 0;
+    pthread_mutex_unlock(&_durabilityMutex);
+    if (_sharedIndex) {
+        [self _removeAllSharedData];
+        return;
+    }
+    [_segments removeAllSegments];
+    [super removeAllData];
+    [_index removeAllEntries];
+}
+
+- (BOOL)containsDataForKey:(NSString *)key {
+    if (!key) {
+        return NO;
+    }
+    DFDiskCacheLocation location;
+    BOOL expired;
+    BOOL exists = [self _getLocation:&location forKey:key filename:[self filenameForKey:key] expired:&expired];
+    if (expired) {
+        [self _discardExpiredContentsAtLocation:location key:key];
+    }
+    return exists;
+}
+
+- (NSData *)attributeForName:(NSString *)name key:(NSString *)key {
+    if (!name || !key) {
+        return nil;
+    }
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheLocation location;
+    BOOL expired;
+    BOOL exists = [self _getLocation:&location forKey:key filename:filename expired:&expired];
+    if (expired) {
+        [self _discardExpiredContentsAtLocation:location key:key];
+        return nil;
+    }
+    if (exists && DFDiskCacheLocationIsPacked(location)) {
+        NSDictionary *attributes;
+        return [self _packedDataForFilename:filename location:location attributes:&attributes] ? attributes[name] : nil;
+    }
+    BOOL legacy;
+    NSDictionary *attributes = [DFDiskCacheEntryFile attributesAtPath:[self pathForKey:key] legacy:&legacy];
+    return legacy ? [super attributeForName:name key:key] : attributes[name];
+}
+
+- (void)setAttribute:(NSData *)data forName:(NSString *)name key:(NSString *)key {
+    if (!data || !name || !key) {
+        return;
+    }
+    [self _updateAttributes:^(NSMutableDictionary *attributes) {
+        attributes[name] = data;
+    } forKey:key];
+}
+
+- (void)removeAttributeForName:(NSString *)name key:(NSString *)key {
+    if (!name || !key) {
+        return;
+    }
+    [self _updateAttributes:^(NSMutableDictionary *attributes) {
+        [attributes removeObjectForKey:name];
+    } forKey:key];
+}
+
+/*! Attributes are stored along with the entry data, both packed entries and entry files are immutable. Changing attributes writes an updated copy of the entry, expiration date is preserved.
+ */
+- (void)_updateAttributes:(void (^)(NSMutableDictionary *attributes))block forKey:(NSString *)key {
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    DFDiskCacheLocation location;
+    BOOL expired;
+    if (![self _getLocation:&location forKey:key filename:filename expired:&expired]) {
+        if (expired) {
+            [self _discardExpiredContentsAtLocation:location key:key];
+        }
+        return;
+    }
+    NSDictionary *attributes;
+    NSData *data = DFDiskCacheLocationIsPacked(location) ? [self _packedDataForFilename:filename location:location attributes:&attributes] : [self _fileDataForKey:key attributes:&attributes];
+    if (data) {
+        NSMutableDictionary *mutableAttributes = [[NSMutableDictionary alloc] initWithDictionary:attributes];
+        block(mutableAttributes);
+        [self _setData:data attributes:mutableAttributes expirationDate:[index expirationDateForFilename:filename] forKey:key];
+    }
+}
+
+- (NSDate *)expirationDateForKey:(NSString *)key {
+    if (!key) {
+        return nil;
+    }
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    if (_sharedIndex) {
+        [self _synchronizeSharedEntryForFilename:filename key:key];
+    } else if (_mayContainLegacyEntries && ![index containsFilename:filename]) {
+        [self _migrateLegacyEntryForKey:key filename:filename];
+    }
+    NSTimeInterval expirationDate = [index expirationDateForFilename:filename];
+    return expirationDate ? [NSDate dateWithTimeIntervalSinceReferenceDate:expirationDate] : nil;
+}
+
+- (NSArray *)keysOfMostFrequentlyAccessedEntries:(NSUInteger)count {
+    return count ? [[self _loadedIndex] keysOfMostFrequentlyAccessedEntries:count] : @[];
+}
+
+- (_dwarf_cache_bytes)contentsSize {
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    return _sharedIndex ? _sharedIndex.totalSize : index.totalSize;
+}
+
+#pragma mark - Streaming
+
+- (DFFileStorageWriter *)writerForKey:(NSString *)key attributes:(NSDictionary *)attributes {
+    return [self writerForKey:key attributes:attributes expirationDate:nil];
+}
+
+- (DFFileStorageWriter *)writerForKey:(NSString *)key attributes:(NSDictionary *)attributes expirationDate:(NSDate *)expirationDate {
+    if (!key) {
+        return nil;
+    }
+    // Entry file starts with a placeholder header which is overwritten once the data length and checksum are known.
+    NSData *header = [DFDiskCacheEntryFile headerDataWithAttributes:attributes dataLength:0 dataChecksum:0];
+    DFFileStorageWriter *writer = [[DFFileStorageWriter alloc] initWithStorage:self key:key path:[self pathForKey:key] attributes:attributes prefix:header];
+    writer.expirationDate = expirationDate;
+    return writer;
+}
+
+- (BOOL)_commitWriter:(DFFileStorageWriter *)writer {
+    NSString *key = writer.key;
+    NSData *header = [DFDiskCacheEntryFile headerDataWithAttributes:writer.attributes dataLength:writer.length dataChecksum:writer.dataChecksum];
+    BOOL success = _DFDiskCacheWriteHeader(writer.fileDescriptor, header);
+    success = success && (_durability != DFDiskCacheDurabilityPerWrite || _dwarf_cache_fsync(writer.fileDescriptor, NO));
+    success = [writer closeFileDescriptor] && success;
+    if (!success) {
+        return NO;
+    }
+    NSString *filename = [self filenameForKey:key];
+    [self _loadedIndex];
+    if (_mayContainLegacyEntries) {
+        [self _removeLegacyEntryForKey:key];
+    }
+    NSString *path = writer.path;
+    if (![self _replaceEntryFileAtPath:path withTemporaryFileAtPath:writer.temporaryPath key:key filename:filename expirationDate:writer.expirationDate.timeIntervalSinceReferenceDate]) {
+        return NO;
+    }
+    if (_durability == DFDiskCacheDurabilityPerWrite) {
+        // Persists the rename.
+        _dwarf_cache_fsync_path([path stringByDeletingLastPathComponent], NO);
+    }
+    [self _didWriteEntryAtPath:path];
+    return YES;
+}
+
+/*! Packed entries are read into memory (they are small by definition), entry files are opened and only their headers are read.
+ */
+- (int)_openDataForKey:(NSString *)key offset:(unsigned long long *)offset length:(unsigned long long *)length packedData:(NSData **)packedData {
+    *packedData = nil;
+    NSString *filename = [self filenameForKey:key];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    DFDiskCacheLocation location;
+    BOOL expired;
+    BOOL exists = [self _getLocation:&location forKey:key filename:filename expired:&expired];
+    if (expired) {
+        [self _discardExpiredContentsAtLocation:location key:key];
+        return -1;
+    }
+    if (exists && DFDiskCacheLocationIsPacked(location)) {
+        *packedData = [self _packedDataForFilename:filename location:location attributes:NULL];
+        if (*packedData) {
+            [index touchFilename:filename];
+        }
+        return -1;
+    }
+    NSString *path = [self pathForKey:key];
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    BOOL legacy;
+    if (fd >= 0 && ![DFDiskCacheEntryFile getDataOffset:offset length:length fileDescriptor:fd legacy:&legacy]) {
+        close(fd);
+        fd = -1;
+        // Corrupted files are removed.
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    }
+    if (fd < 0) {
+        [index removeFilename:filename];
+        if (_sharedIndex) {
+            [self _removeSharedEntryIfMissingForFilename:filename path:path];
+        }
+        return -1;
+    }
+    [_sharedIndex touchFilename:filename];
+    _dwarf_cache_bytes size;
+    if (![index touchFilename:filename] && _dwarf_cache_allocated_size(path, &size)) {
+        [index setSize:size forFilename:filename key:key];
+    }
+    return fd;
+}
+
+#pragma mark - Entry Files (Replacing)
+
+- (pthread_mutex_t *)_entryLockForFilename:(NSString *)filename {
+    return &_entryLocks[filename.hash % DFDiskCacheEntryLockCount];
+}
+
+/*! Renames the temporary entry file into place and records the entry in the index. Entry is removed from the index if the file can't be renamed. Rename and index update are performed under the entry lock (the shared index lock in shared mode), cleanup never removes the file that replaced the file of the discarded entry (see _discardContentsOfEntry: and _discardSharedEntries:deadline:count:size:).
+ @param temporaryPath Path of the temporary file, nil if the temporary file couldn't be written. Temporary file is removed if it can't be renamed.
+ @return YES if the entry file was replaced.
+ */
+- (BOOL)_replaceEntryFileAtPath:(NSString *)path withTemporaryFileAtPath:(NSString *)temporaryPath key:(NSString *)key filename:(NSString *)filename expirationDate:(NSTimeInterval)expirationDate {
+    if (_sharedIndex) {
+        [_sharedIndex lock];
+        BOOL success = temporaryPath && rename(temporaryPath.fileSystemRepresentation, path.fileSystemRepresentation) == 0;
+        if (success) {
+            [self _recordSharedEntryForKey:key filename:filename path:path expirationDate:expirationDate];
+        } else {
+            [_index removeFilename:filename];
+            [self _removeSharedEntryIfMissingForFilename:filename path:path];
+        }
+        [_sharedIndex unlock];
+        if (temporaryPath && !success) {
+            unlink(temporaryPath.fileSystemRepresentation);
+        }
+        return success;
+    }
+    pthread_mutex_t *lock = [self _entryLockForFilename:filename];
+    pthread_mutex_lock(lock);
+    BOOL success = temporaryPath && rename(temporaryPath.fileSystemRepresentation, path.fileSystemRepresentation) == 0;
+    _dwarf_cache_bytes size;
+    DFDiskCacheLocation previousLocation;
+    if (success && _dwarf_cache_allocated_size(path, &size)) {
+        if ([_index setSize:size location:DFDiskCacheLocationFile expirationDate:expirationDate forFilename:filename key:key previousLocation:&previousLocation] && DFDiskCacheLocationIsPacked(previousLocation)) {
+            [_segments releaseLocation:previousLocation];
+        }
+    } else if ([_index removeFilename:filename location:&previousLocation] && DFDiskCacheLocationIsPacked(previousLocation)) {
+        [_segments releaseLocation:previousLocation];
+    }
+    pthread_mutex_unlock(lock);
+    if (temporaryPath && !success) {
+        unlink(temporaryPath.fileSystemRepresentation);
+    }
+    return success;
+}
+
+#pragma mark - Durability
+
+/*! Synchronizes the write according to the durability. Entry files written with per-write durability are already synchronized by the write itself.
+ @param path Path of the entry file, nil for packed entries.
+ */
+- (void)_didWriteEntryAtPath:(NSString *)path {
+    if (_durability == DFDiskCacheDurabilityPerWrite) {
+        if (!path) {
+            [_segments synchronize];
+        }
+        [_index synchronizeJournal];
+        [_sharedIndex synchronize];
+        _dwarf_cache_fsync_path(self.path, YES);
+    } else if (_durability == DFDiskCacheDurabilityBatched) {
+        pthread_mutex_lock(&_durabilityMutex);
+        if (path) {
+            [_unsynchronizedPaths addObject:path];
+        }
+        _unsynchronizedWriteCount++;
+        BOOL commit = _unsynchronizedWriteCount >= MAX(_durabilityBatchSize, 1);
+        BOOL schedule = !commit && !_commitScheduled;
+        if (schedule) {
+            _commitScheduled = YES;
+        }
+        pthread_mutex_unlock(&_durabilityMutex);
+        if (commit) {
+            // The write that completes the group pays for the whole group.
+            [self _commitWritesIfNeeded:YES];
+        } else if (schedule) {
+            DFDiskCache *__weak weakSelf = self;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_durabilityBatchInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+                [weakSelf _commitWritesIfNeeded:NO];
+            });
+        }
+    }
+}
+
+- (void)synchronize {
+    [self _commitWritesIfNeeded:YES];
+}
+
+/*! Commits the pending group of writes: syncs each written file once, then directories, segments and journal, and flushes the drive cache once for the whole group.
+ @param force If NO, returns immediately when there are no pending writes.
+ */
+- (void)_commitWritesIfNeeded:(BOOL)force {
+    pthread_mutex_lock(&_durabilityMutex);
+    NSSet *paths = [_unsynchronizedPaths copy];
+    NSUInteger count = _unsynchronizedWriteCount;
+    [_unsynchronizedPaths removeAllObjects];
+    _unsynchronizedWriteCount = 0;
+    _commitScheduled = NO;
+    pthread_mutex_unlock(&_durabilityMutex);
+    if (!force && !count) {
+        return;
+    }
+    NSMutableSet *directories = [NSMutableSet new];
+    for (NSString *path in paths) {
+        // Files removed since they were written are skipped.
+        if (_dwarf_cache_fsync_path(path, NO)) {
+            [directories addObject:[path stringByDeletingLastPathComponent]];
+        }
+    }
+    for (NSString *directory in directories) {
+        _dwarf_cache_fsync_path(directory, NO);
+    }
+    [_segments synchronize];
+    [_index synchronizeJournal];
+    [_sharedIndex synchronize];
+    _dwarf_cache_fsync_path(self.path, YES);
+}
+
+#pragma mark - Entry Files
+
+/*! Reads entry file. Legacy files (written without a header, with attributes stored in extended file attributes) are rewritten in the current format on first access. Corrupted files are removed.
+ */
+- (NSData *)_fileDataForKey:(NSString *)key attributes:(NSDictionary **)attributes {
+    NSString *path = [self pathForKey:key];
+    BOOL legacy;
+    NSDictionary *fileAttributes;
+    NSData *data = [DFDiskCacheEntryFile dataAtPath:path attributes:&fileAttributes mappedReadThreshold:self.mappedReadThreshold legacy:&legacy];
+    if (!data) {
+        if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+        return nil;
+    }
+    if (legacy) {
+        fileAttributes = [self _legacyAttributesAtPath:path];
+        if ([DFDiskCacheEntryFile writeData:data attributes:fileAttributes toPath:path synchronize:(_durability == DFDiskCacheDurabilityPerWrite)]) {
+            _dwarf_cache_bytes size;
+            if (_dwarf_cache_allocated_size(path, &size)) {
+                [_index setSize:size forFilename:[self filenameForKey:key] key:key];
+            }
+        }
+    }
+    if (attributes) {
+        *attributes = fileAttributes;
+    }
+    return data;
+}
+
+/*! Returns attributes that previous versions stored in extended file attributes. System attributes are not migrated.
+ */
+- (NSDictionary *)_legacyAttributesAtPath:(NSString *)path {
+    NSURL *fileURL = [NSURL fileURLWithPath:path];
+    NSMutableDictionary *attributes = [NSMutableDictionary new];
+    for (NSString *name in [fileURL df_extendedAttributesList:NULL]) {
+        if ([name hasPrefix:@"com.apple."]) {
+            continue;
+        }
+        NSData *value = [fileURL df_extendedAttributeDataForKey:name error:NULL options:0];
+        if (value) {
+            attributes[name] = value;
+        }
+    }
+    return attributes;
+}
+
+#pragma mark - Segments
+
+- (void)setSegmentSizeLimit:(unsigned long long)segmentSizeLimit {
+    _segments.segmentSizeLimit = segmentSizeLimit;
+}
+
+- (unsigned long long)segmentSizeLimit {
+    return _segments.segmentSizeLimit;
+}
+
+/*! Reads packed entry. If the entry was moved by compaction while being read, the read is retried at the new location. Entry is removed from the index if it can't be read.
+ */
+- (NSData *)_packedDataForFilename:(NSString *)filename location:(DFDiskCacheLocation)location attributes:(NSDictionary **)attributes {
+    NSData *data = [_segments dataAtLocation:location filename:filename attributes:attributes];
+    if (data) {
+        return data;
+    }
+    DFDiskCacheLocation currentLocation;
+    if (![_index getLocation:&currentLocation forFilename:filename]) {
+        return nil;
+    }
+    if (!DFDiskCacheLocationEqualToLocation(location, currentLocation) && DFDiskCacheLocationIsPacked(currentLocation)) {
+        data = [_segments dataAtLocation:currentLocation filename:filename attributes:attributes];
+        location = currentLocation;
+    }
+    if (!data && [_index getLocation:&currentLocation forFilename:filename] && DFDiskCacheLocationEqualToLocation(location, currentLocation)) {
+        [_index removeFilename:filename];
+        [_segments releaseLocation:location];
+    }
+    return data;
+}
+
+/*! Discards contents of the entry that was replaced by a packed entry or removed from the index.
+ */
+- (void)_discardContentsAtLocation:(DFDiskCacheLocation)location key:(NSString *)key {
+    if (DFDiskCacheLocationIsPacked(location)) {
+        [_segments releaseLocation:location];
+    } else {
+        [[NSFileManager defaultManager] removeItemAtPath:[self pathForKey:key] error:nil];
+    }
+}
+
+/*! Discards contents of the entry that was removed from the index because it expired. Packed entries get tombstones so that expired entries are not restored if segments are scanned.
+ */
+- (void)_discardExpiredContentsAtLocation:(DFDiskCacheLocation)location key:(NSString *)key {
+    if (_sharedIndex) {
+        [self _discardExpiredSharedEntryForKey:key];
         return;
     }
+    [self _discardContentsAtLocation:location key:key];
+    if (DFDiskCacheLocationIsPacked(location)) {
+        [_segments appendTombstoneForFilename:[self filenameForKey:key]];
+    }
+}
+
+#pragma mark - Index
+
+- (DFDiskCacheIndex *)_loadedIndex {
+    if (!_index.isLoaded) {
+        DFDiskCache *__weak weakSelf = self;
+        // Shared entries are loaded under the shared index lock which has to be taken before the index lock.
+        [_sharedIndex lock];
+        [_index loadEntriesIfNeeded:^NSArray *{
+            return [weakSelf _loadEntries];
+        }];
+        [_sharedIndex unlock];
+    }
+    return _index;
+}
+
+/*! Replays the journal and checks it against the storage directory. Falls back to a full scan when the journal is missing or corrupted.
+ @note Called with the index lock held.
+ */
+- (NSArray *)_loadEntries {
+    if (_sharedIndex) {
+        return [self _loadSharedEntries];
+    }
+    NSArray *entries = [self _restoreEntries];
+    for (DFDiskCacheEntry *entry in entries) {
+        if (DFDiskCacheLocationIsPacked(entry.location)) {
+            [_segments retainLocation:entry.location];
+        }
+    }
+    return entries;
+}
+
+- (NSArray *)_restoreEntries {
+    DFDiskCacheJournal *journal = _index.journal;
+    NSArray *entries = [journal replay];
+    if (!entries) {
+        return [self _scanEntries];
+    }
+    // Listing directory is much cheaper than fetching resource values for each file. Only the files that the journal doesn't know about are examined.
+    NSMutableDictionary *entriesByFilename = [[NSMutableDictionary alloc] initWithCapacity:entries.count];
+    for (DFDiskCacheEntry *entry in entries) {
+        entriesByFilename[entry.filename] = entry;
+    }
+    NSMutableArray *validatedEntries = [[NSMutableArray alloc] initWithCapacity:entries.count];
+    __block BOOL synchronized = YES;
+    [self _enumerateFilesAtPath:self.path level:0 usingBlock:^(NSString *filename, NSString *path) {
+        DFDiskCacheEntry *entry = entriesByFilename[filename];
+        _dwarf_cache_bytes size = 0;
+        if (entry) {
+            [entriesByFilename removeObjectForKey:filename];
+        } else if (!_dwarf_cache_allocated_size(path, &size)) {
+            return;
+        }
+        NSString *storedFilename = [self _relocateFileWithFilename:filename atPath:path key:entry.key];
+        if (entry && ![storedFilename isEqualToString:filename]) {
+            entry = _DFDiskCacheEntryWithFilename(entry, storedFilename);
+            synchronized = NO;
+        }
+        if (!entry) {
+            entry = [[DFDiskCacheEntry alloc] initWithFilename:storedFilename];
+            entry.size = size;
+            entry.accessDate = CFAbsoluteTimeGetCurrent();
+            synchronized = NO;
+        }
+        [validatedEntries addObject:entry];
+    }];
+    _needsTemporaryFilesSweep = NO;
+    // Packed entries are not listed in the storage directory, they are valid as long as their segments exist.
+    for (DFDiskCacheEntry *entry in [entriesByFilename allValues]) {
+        if (DFDiskCacheLocationIsPacked(entry.location) && [_segments containsSegment:entry.location.segment]) {
+            [validatedEntries addObject:entry];
+            [entriesByFilename removeObjectForKey:entry.filename];
+            _mayContainLegacyEntries = _mayContainLegacyEntries || [self _isLegacyFilename:entry.filename];
+        }
+    }
+    if (!synchronized || entriesByFilename.count) {
+        [journal setNeedsCompaction];
+    }
+    return validatedEntries;
+}
+
+- (NSArray *)_scanEntries {
+    NSMutableDictionary *entries = [NSMutableDictionary new];
+    for (DFDiskCacheEntry *entry in [_segments scanEntries]) {
+        entries[entry.filename] = entry;
+        _mayContainLegacyEntries = _mayContainLegacyEntries || [self _isLegacyFilename:entry.filename];
+    }
+    // Standalone files take precedence over packed entries.
     NSArray *resourceKeys = @[NSURLContentAccessDateKey, NSURLFileAllocatedSizeKey];
-    NSArray *contents = [self contentsWithResourceKeys:resourceKeys];
-    NSMutableDictionary *fileAttributes = [NSMutableDictionary dictionary];
-    _dwarf_cache_bytes contentsSize = 0;
-    for (NSURL *fileURL in contents) {
+    for (NSURL *fileURL in [self contentsWithResourceKeys:resourceKeys]) {
         NSDictionary *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:NULL];
         if (resourceValues) {
-            fileAttributes[fileURL] = resourceValues;
-            NSNumber *fileSize = resourceValues[NSURLFileAllocatedSizeKey];
-            contentsSize += [fileSize unsignedLongLongValue];
+            NSString *filename = [self _relocateFileWithFilename:[fileURL lastPathComponent] atPath:fileURL.path key:nil];
+            DFDiskCacheEntry *entry = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+            entry.size = [resourceValues[NSURLFileAllocatedSizeKey] unsignedLongLongValue];
+            entry.accessDate = [resourceValues[NSURLContentAccessDateKey] timeIntervalSinceReferenceDate];
+            entries[entry.filename] = entry;
         }
     }
-    if (contentsSize < _capacity) {
+    return [entries allValues];
+}
+
+#pragma mark - Shared Mode
+
+/*! Loads entries from the shared index, populates the shared index first if it wasn't populated by any process yet.
+ @note Called with the shared index lock and the index lock held, the locks are taken in that order.
+ */
+- (NSArray *)_loadSharedEntries {
+    [self _populateSharedIndexIfNeeded];
+    NSArray *entries = [_sharedIndex allEntries];
+    // Legacy entries are migrated by the scan that populates the shared index or not at all, their keys are unknown.
+    _mayContainLegacyEntries = NO;
+    return entries;
+}
+
+/*! Populates the shared index by scanning the storage directory if the index was just created or was found corrupted. Packed entries are not supported in shared mode and are skipped.
+ @note Called with the shared index lock held.
+ */
+- (void)_populateSharedIndexIfNeeded {
+    if (_sharedIndex.isPopulated) {
         return;
     }
-    const _dwarf_cache_bytes desiredSize = _capacity * _cleanupRate;
-    NSArray *sortedFiles = [fileAttributes keysSortedByValueWithOptions:NSSortConcurrent usingComparator:^NSComparisonResult(id obj1, id obj2) {
-        return [obj1[NSURLContentAccessDateKey] compare:obj2[NSURLContentAccessDateKey]];
+    NSMutableArray *entries = [NSMutableArray new];
+    for (DFDiskCacheEntry *entry in [self _scanEntries]) {
+        if (!DFDiskCacheLocationIsPacked(entry.location)) {
+            [entries addObject:entry];
+        }
+    }
+    [_sharedIndex populateWithEntries:entries];
+}
+
+/*! Updates the entry in the local index from the shared index, entries are written, replaced and removed by other processes.
+ */
+- (void)_synchronizeSharedEntryForFilename:(NSString *)filename key:(NSString *)key {
+    unsigned long long size;
+    NSTimeInterval expirationDate;
+    [_sharedIndex lock];
+    [self _populateSharedIndexIfNeeded];
+    BOOL exists = [_sharedIndex getSize:&size expirationDate:&expirationDate forFilename:filename];
+    [_sharedIndex unlock];
+    if (!exists) {
+        [_index removeFilename:filename];
+    } else if (![_index containsFilename:filename] || [_index expirationDateForFilename:filename] != expirationDate) {
+        [_index setSize:size location:DFDiskCacheLocationFile expirationDate:expirationDate forFilename:filename key:key previousLocation:NULL];
+    }
+}
+
+/*! Records the entry file that was just renamed into place in the shared index. Evictors of all processes remove files under the shared index lock, so the file can't be mistaken for the file of the entry that is being evicted as long as it is renamed and recorded under the same lock.
+ @note Called with the shared index lock held.
+ */
+- (void)_recordSharedEntryForKey:(NSString *)key filename:(NSString *)filename path:(NSString *)path expirationDate:(NSTimeInterval)expirationDate {
+    _dwarf_cache_bytes size;
+    if (_dwarf_cache_allocated_size(path, &size)) {
+        [_sharedIndex setSize:size expirationDate:expirationDate forFilename:filename];
+        [_index setSize:size location:DFDiskCacheLocationFile expirationDate:expirationDate forFilename:filename key:key previousLocation:NULL];
+    } else {
+        [_sharedIndex removeFilename:filename];
+        [_index removeFilename:filename];
+    }
+}
+
+/*! Removes the entry from the shared index after a failed read unless another process has written a new file in the meantime.
+ */
+- (void)_removeSharedEntryIfMissingForFilename:(NSString *)filename path:(NSString *)path {
+    [_sharedIndex lock];
+    _dwarf_cache_bytes size;
+    if (!_dwarf_cache_allocated_size(path, &size)) {
+        [_sharedIndex removeFilename:filename];
+    }
+    [_sharedIndex unlock];
+}
+
+/*! Discards expired entry unless it was replaced by another process after it was found expired.
+ */
+- (void)_discardExpiredSharedEntryForKey:(NSString *)key {
+    NSString *filename = [self filenameForKey:key];
+    NSTimeInterval expirationDate;
+    [_sharedIndex lock];
+    if ([_sharedIndex getSize:NULL expirationDate:&expirationDate forFilename:filename] && expirationDate > 0 && expirationDate <= CFAbsoluteTimeGetCurrent()) {
+        [_sharedIndex removeFilename:filename];
+        [self _removeFileWithFilename:filename];
+    }
+    [_sharedIndex unlock];
+}
+
+/*! Removes entry files of all processes. Shared index files are hidden and are kept, other processes keep them open.
+ */
+- (void)_removeAllSharedData {
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    [_sharedIndex lock];
+    [self _enumerateFilesAtPath:self.path level:0 usingBlock:^(NSString *filename, NSString *path) {
+        unlink(path.fileSystemRepresentation);
     }];
-    for (NSURL *fileURL in sortedFiles) {
-        if (contentsSize < desiredSize) {
-            break;
+    [_sharedIndex removeAllEntries];
+    [_sharedIndex unlock];
+    [index removeAllEntries];
+}
+
+#pragma mark - Layout
+
+/*! Enumerates entry files in the storage directory and in its fanout subdirectories. Subdirectories are enumerated regardless of the current fanout so that files stay visible when the fanout is changed. Stale temporary files found along the way are removed (see DFDiskCacheTemporaryFileStaleInterval).
+ */
+- (void)_enumerateFilesAtPath:(NSString *)directoryPath level:(NSUInteger)level usingBlock:(void (^)(NSString *filename, NSString *path))block {
+    for (NSString *filename in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directoryPath error:nil]) {
+        NSString *path = [directoryPath stringByAppendingPathComponent:filename];
+        if ([filename hasPrefix:@"."]) {
+            if (_dwarf_cache_is_temporary_filename(filename)) {
+                [self _removeTemporaryFileIfStaleAtPath:path];
+            }
+            continue;
         }
-        if ([[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil]) {
-            NSNumber *fileSize = fileAttributes[fileURL][NSURLFileAllocatedSizeKey];
-            contentsSize -= [fileSize unsignedLongLongValue];
+        if (filename.length == 2) {
+            if (level < DFFileStorageMaximumDirectoryFanout) {
+                [self _enumerateFilesAtPath:path level:level + 1 usingBlock:block];
+            }
+        } else {
+            block(filename, path);
         }
     }
 }
 
+- (void)_removeTemporaryFileIfStaleAtPath:(NSString *)path {
+    struct stat info;
+    if (lstat(path.fileSystemRepresentation, &info) == 0 && S_ISREG(info.st_mode) && difftime(time(NULL), info.st_mtime) >= DFDiskCacheTemporaryFileStaleInterval) {
+        unlink(path.fileSystemRepresentation);
+    }
+}
+
+/*! Returns YES if the file name was produced by SHA-1 while the storage uses MurmurHash3.
+ */
+- (BOOL)_isLegacyFilename:(NSString *)filename {
+    return self.keyHash == DFFileStorageKeyHashMurmur3 && filename.length == _dwarf_cache_sha1_length;
+}
+
+/*! Returns YES if the file name could have been produced by the current hash function.
+ */
+- (BOOL)_isCurrentFilename:(NSString *)filename {
+    return filename.length == (self.keyHash == DFFileStorageKeyHashMurmur3 ? _dwarf_cache_murmur3_length : _dwarf_cache_sha1_length);
+}
+
+/*! Moves entry file to the location that matches current layout.
+ @param key The key that was used to store the entry, file stored using a different hash function can only be renamed if the key is known.
+ @return The file name under which the file is stored after relocation.
+ */
+- (NSString *)_relocateFileWithFilename:(NSString *)filename atPath:(NSString *)path key:(NSString *)key {
+    NSString *currentFilename = filename;
+    if (![self _isCurrentFilename:filename]) {
+        if (key) {
+            currentFilename = [self filenameForKey:key];
+        } else {
+            _mayContainLegacyEntries = _mayContainLegacyEntries || [self _isLegacyFilename:filename];
+        }
+    }
+    NSString *currentPath = [self pathForFilename:currentFilename];
+    if ([currentPath isEqualToString:path] || _dwarf_cache_move_item(path, currentPath)) {
+        return currentFilename;
+    }
+    _mayContainLegacyEntries = _mayContainLegacyEntries || [self _isLegacyFilename:filename];
+    return filename;
+}
+
+/*! Returns the location of the entry for the given key, migrates the entry stored under SHA-1 file name if there is one.
+ */
+- (BOOL)_getLocation:(DFDiskCacheLocation *)location forKey:(NSString *)key filename:(NSString *)filename expired:(BOOL *)expired {
+    return [self _getLocation:location expirationDate:NULL forKey:key filename:filename expired:expired];
+}
+
+/*! Same as _getLocation:forKey:filename:expired:, also returns expiration date of the entry.
+ */
+- (BOOL)_getLocation:(DFDiskCacheLocation *)location expirationDate:(NSTimeInterval *)expirationDate forKey:(NSString *)key filename:(NSString *)filename expired:(BOOL *)expired {
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    if (_sharedIndex) {
+        [self _synchronizeSharedEntryForFilename:filename key:key];
+    }
+    BOOL exists = [index getLocation:location expirationDate:expirationDate forFilename:filename expired:expired];
+    if (!exists && !*expired && _mayContainLegacyEntries && [self _migrateLegacyEntryForKey:key filename:filename]) {
+        exists = [index getLocation:location expirationDate:expirationDate forFilename:filename expired:expired];
+    }
+    return exists;
+}
+
+/*! Moves the entry stored under SHA-1 file name to the current file name. Packed entries are rewritten, entry files are renamed.
+ @return YES if the entry was migrated.
+ */
+- (BOOL)_migrateLegacyEntryForKey:(NSString *)key filename:(NSString *)filename {
+    const char *string = [key UTF8String];
+    NSString *legacyFilename = _dwarf_cache_sha1(string, (uint32_t)strlen(string));
+    DFDiskCacheIndex *index = _index;
+    DFDiskCacheLocation location;
+    BOOL expired;
+    if (![index getLocation:&location forFilename:legacyFilename expired:&expired]) {
+        if (expired) {
+            [self _discardLegacyContentsAtLocation:location filename:legacyFilename];
+        }
+        return NO;
+    }
+    NSTimeInterval expirationDate = [index expirationDateForFilename:legacyFilename];
+    if (DFDiskCacheLocationIsPacked(location)) {
+        NSDictionary *attributes;
+        NSData *data = [_segments dataAtLocation:location filename:legacyFilename attributes:&attributes];
+        if ([index removeFilename:legacyFilename location:&location]) {
+            [self _discardLegacyContentsAtLocation:location filename:legacyFilename];
+        }
+        if (data) {
+            [self _setData:data attributes:attributes expirationDate:expirationDate forKey:key];
+        }
+        return data != nil;
+    }
+    NSString *path = [self pathForFilename:filename];
+    _dwarf_cache_bytes size;
+    BOOL moved = [self _moveLegacyFileWithFilename:legacyFilename toPath:path] && _dwarf_cache_allocated_size(path, &size);
+    [index removeFilename:legacyFilename];
+    if (moved) {
+        [index setSize:size location:DFDiskCacheLocationFile expirationDate:expirationDate forFilename:filename key:key previousLocation:NULL];
+    }
+    return moved;
+}
+
+/*! Removes the entry stored under SHA-1 file name for the given key, if there is one.
+ */
+- (void)_removeLegacyEntryForKey:(NSString *)key {
+    const char *string = [key UTF8String];
+    NSString *legacyFilename = _dwarf_cache_sha1(string, (uint32_t)strlen(string));
+    DFDiskCacheLocation location;
+    if ([_index removeFilename:legacyFilename location:&location]) {
+        [self _discardLegacyContentsAtLocation:location filename:legacyFilename];
+    }
+}
+
+- (BOOL)_moveLegacyFileWithFilename:(NSString *)legacyFilename toPath:(NSString *)path {
+    return _dwarf_cache_move_item([self pathForFilename:legacyFilename], path) || _dwarf_cache_move_item([self.path stringByAppendingPathComponent:legacyFilename], path);
+}
+
+- (void)_discardLegacyContentsAtLocation:(DFDiskCacheLocation)location filename:(NSString *)legacyFilename {
+    if (DFDiskCacheLocationIsPacked(location)) {
+        [_segments releaseLocation:location];
+        [_segments appendTombstoneForFilename:legacyFilename];
+    } else {
+        [self _removeFileWithFilename:legacyFilename];
+    }
+}
+
+/*! Removes entry file, files that weren't relocated are stored in the storage directory.
+ */
+- (void)_removeFileWithFilename:(NSString *)filename {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager removeItemAtPath:[self pathForFilename:filename] error:nil] && self.directoryFanout > 0) {
+        [fileManager removeItemAtPath:[self.path stringByAppendingPathComponent:filename] error:nil];
+    }
+}
+
+#pragma mark - Cleanup
+
+- (BOOL)needsCleanup {
+    return _capacity != DFDiskCacheCapacityUnlimited && self.contentsSize >= [self _highWatermarkSize];
+}
+
+/*! Returns disk usage at which cleanup starts. Cleanup rate that is set above high watermark moves the start up, so that the cleanup that starts always has entries to discard.
+ */
+- (_dwarf_cache_bytes)_highWatermarkSize {
+    return _capacity * MAX(_highWatermark, _cleanupRate);
+}
+
+- (void)cleanup {
+    [self cleanupWithTimeBudget:DBL_MAX];
+}
+
+- (BOOL)cleanupWithTimeBudget:(NSTimeInterval)timeBudget {
+    return [self cleanupWithTimeBudget:timeBudget statistics:NULL];
+}
+
+- (BOOL)cleanupWithTimeBudget:(NSTimeInterval)timeBudget statistics:(DFDiskCacheCleanupStatistics *)statistics {
+    DFDiskCacheCleanupStatistics discarded;
+    if (!statistics) {
+        statistics = &discarded;
+    }
+    *statistics = (DFDiskCacheCleanupStatistics){0};
+    @synchronized(self) {
+        DFDiskCacheIndex *index = [self _loadedIndex];
+        const CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + timeBudget;
+        if (_sharedIndex) {
+            BOOL finished = [self _cleanupSharedStorageWithDeadline:deadline statistics:statistics];
+            if (finished) {
+                [self _removeStaleTemporaryFilesIfNeeded];
+            }
+            return finished;
+        }
+        // Expired entries are discarded first, before the entries chosen by the eviction policy.
+        DFDiskCacheEntry *expiredEntry;
+        while ((expiredEntry = [index removeExpiredEntry])) {
+            [self _discardContentsOfEntry:expiredEntry];
+            statistics->expiredCount++;
+            statistics->expiredSize += expiredEntry.size;
+            if (DFDiskCacheLocationIsPacked(expiredEntry.location)) {
+                [_segments appendTombstoneForFilename:expiredEntry.filename];
+            }
+            if (CFAbsoluteTimeGetCurrent() >= deadline) {
+                return NO;
+            }
+        }
+        if (_capacity != DFDiskCacheCapacityUnlimited) {
+            if (!_evicting && index.totalSize >= [self _highWatermarkSize]) {
+                _evicting = YES;
+            }
+            if (_evicting) {
+                const _dwarf_cache_bytes desiredSize = _capacity * _cleanupRate;
+                DFDiskCacheEntry *entry;
+                while (index.totalSize >= desiredSize && (entry = [index evictEntry])) {
+                    [self _discardContentsOfEntry:entry];
+                    statistics->evictedCount++;
+                    statistics->evictedSize += entry.size;
+                    if (CFAbsoluteTimeGetCurrent() >= deadline && index.totalSize >= desiredSize) {
+                        return NO;
+                    }
+                }
+                _evicting = NO;
+            }
+        }
+        // Segments are only touched when some of them consist mostly of dead space.
+        const BOOL compact = [_segments needsCompaction];
+        if (compact) {
+            [_segments compactWithIndex:index];
+        }
+        [self _synchronizeJournal];
+        if (compact && _durability != DFDiskCacheDurabilityNone) {
+            // Records moved by compaction are synchronized before the writes that follow cleanup.
+            [self synchronize];
+        }
+        [self _removeStaleTemporaryFilesIfNeeded];
+        return YES;
+    }
+}
+
+/*! Discards contents of the entry removed by cleanup. Evicted entries don't need tombstones, restoring them after the journal is lost is harmless.
+ @discussion Cleanup doesn't wait for the writes. The entry might have been written to a new file after it was removed from the index, in which case the file belongs to the new entry and is kept. Entry lock guarantees that the file is not replaced while it's being checked and removed.
+ */
+- (void)_discardContentsOfEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheLocation location = entry.location;
+    if (DFDiskCacheLocationIsPacked(location)) {
+        [_segments releaseLocation:location];
+        return;
+    }
+    NSString *filename = entry.filename;
+    pthread_mutex_t *lock = [self _entryLockForFilename:filename];
+    pthread_mutex_lock(lock);
+    DFDiskCacheLocation currentLocation;
+    if (![_index getLocation:&currentLocation forFilename:filename] || DFDiskCacheLocationIsPacked(currentLocation)) {
+        [self _removeFileWithFilename:filename];
+    }
+    pthread_mutex_unlock(lock);
+}
+
+/*! Cleans up storage shared by multiple processes. Only one process (or disk cache instance) cleans up the storage at a time, the others skip cleanup while it's in progress. Entries are evicted in the order of their last access by any process, eviction policy is not consulted.
+ */
+- (BOOL)_cleanupSharedStorageWithDeadline:(CFAbsoluteTime)deadline statistics:(DFDiskCacheCleanupStatistics *)statistics {
+    if (![_sharedIndex tryLockEviction]) {
+        return YES;
+    }
+    BOOL finished = [self _discardSharedEntries:[_sharedIndex expiredEntriesAtDate:CFAbsoluteTimeGetCurrent()] deadline:deadline count:&statistics->expiredCount size:&statistics->expiredSize];
+    if (finished && _capacity != DFDiskCacheCapacityUnlimited) {
+        const _dwarf_cache_bytes totalSize = _sharedIndex.totalSize;
+        if (!_evicting && totalSize >= [self _highWatermarkSize]) {
+            _evicting = YES;
+        }
+        if (_evicting) {
+            const _dwarf_cache_bytes desiredSize = _capacity * _cleanupRate;
+            if (totalSize >= desiredSize) {
+                // Victims are chosen again by each slice, entries might have been accessed by other processes in the meantime.
+                NSArray *entries = [_sharedIndex leastRecentlyUsedEntriesWithTotalSize:totalSize - desiredSize + 1];
+                finished = [self _discardSharedEntries:entries deadline:deadline count:&statistics->evictedCount size:&statistics->evictedSize];
+            }
+            _evicting = !finished;
+        }
+    }
+    if (finished && _durability != DFDiskCacheDurabilityNone) {
+        [_sharedIndex synchronize];
+    }
+    [_sharedIndex unlockEviction];
+    return finished;
+}
+
+/*! Discards entries in small chunks, each chunk under the shared index lock so that other processes are not blocked for long. Entries that were accessed or replaced since they were chosen are skipped.
+ @return NO if the deadline was reached before all entries were discarded.
+ */
+- (BOOL)_discardSharedEntries:(NSArray *)entries deadline:(CFAbsoluteTime)deadline count:(NSUInteger *)count size:(unsigned long long *)size {
+    const NSUInteger chunkSize = 32;
+    for (NSUInteger start = 0; start < entries.count; start += chunkSize) {
+        [_sharedIndex lock];
+        for (DFDiskCacheEntry *entry in [entries subarrayWithRange:NSMakeRange(start, MIN(chunkSize, entries.count - start))]) {
+            if ([_sharedIndex removeEntry:entry]) {
+                [self _removeFileWithFilename:entry.filename];
+                [_index removeFilename:entry.filename];
+                (*count)++;
+                *size += entry.size;
+            }
+        }
+        [_sharedIndex unlock];
+        if (start + chunkSize < entries.count && CFAbsoluteTimeGetCurrent() >= deadline) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+/*! Removes stale temporary files unless they were already removed when the index was restored from the journal.
+ */
+- (void)_removeStaleTemporaryFilesIfNeeded {
+    if (_needsTemporaryFilesSweep) {
+        _needsTemporaryFilesSweep = NO;
+        [self _enumerateFilesAtPath:self.path level:0 usingBlock:^(NSString *filename, NSString *path) {}];
+    }
+}
+
+- (void)_synchronizeJournal {
+    [_index flushJournal];
+    [_index compactJournalIfNeeded];
+}
+
 + (NSString *)cachesDirectoryPath {
     return [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
 }
@@ -61,7 +1226,10 @@
 #pragma mark - Miscellaneous
 
 - (NSString *)debugDescription {
-    return [NSString stringWithFormat:@"<%@ %p> { capacity: %@; usage: %@; files: %lu }", [self class], self, _dwarf_bytes_to_str(self.capacity), _dwarf_bytes_to_str(self.contentsSize), (unsigned long)[self contentsWithResourceKeys:nil].count];
+    DFDiskCacheIndex *index = [self _loadedIndex];
+    const _dwarf_cache_bytes usage = _sharedIndex ? _sharedIndex.totalSize : index.totalSize;
+    const NSUInteger count = _sharedIndex ? _sharedIndex.count : index.count;
+    return [NSString stringWithFormat:@"<%@ %p> { capacity: %@; usage: %@; files: %lu; shared: %@; segments: %@ (%@ live) }", [self class], self, _dwarf_bytes_to_str(self.capacity), _dwarf_bytes_to_str(usage), (unsigned long)count, _sharedIndex ? @"YES" : @"NO", _dwarf_bytes_to_str(_segments.totalSize), _dwarf_bytes_to_str(_segments.liveSize)];
 }
 
 @end
@@ -0,0 +1,131 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Entry of the disk cache index. Describes a single stored value.
+ @discussion Entries are managed by the disk cache. Recency and frequency are tracked by the disk cache itself and are persisted in the index journal, they don't depend on file system access dates.
+ */
+@interface DFDiskCacheEntry : NSObject
+
+- (instancetype)initWithFilename:(NSString *)filename;
+
+/*! Name of the file in the storage directory.
+ */
+@property (nonatomic, readonly) NSString *filename;
+
+/*! The key that was used to store the entry. Might be nil for entries that were found by scanning the storage directory.
+ */
+@property (nullable, nonatomic, copy) NSString *key;
+
+/*! Allocated size of the file (or the length of the segment record for packed entries), in bytes.
+ */
+@property (nonatomic) unsigned long long size;
+
+/*! Last access date expressed as a time interval since reference date.
+ */
+@property (nonatomic) NSTimeInterval accessDate;
+
+/*! Number of times the entry was accessed or written.
+ */
+@property (nonatomic) NSUInteger accessCount;
+
+/*! Expiration date expressed as a time interval since reference date, 0 if the entry never expires. Expired entries are removed before the disk cache consults the eviction policy.
+ */
+@property (nonatomic) NSTimeInterval expirationDate;
+
+/*! Object that an eviction policy can associate with the entry to keep its bookkeeping (e.g. list node or heap index).
+ */
+@property (nullable, nonatomic) id policyContext;
+
+@end
+
+
+/*! Eviction policy decides which entries the disk cache discards first when it runs out of capacity.
+ @discussion Disk cache notifies the policy about every change in its index and asks it for the victims during cleanup. Calls are serialized by the disk cache, policies don't have to be thread-safe. Policies should keep their per-entry state in the policyContext property of the entry. Policy must not retain entries beyond the didRemoveEntry: and didEvictEntry: calls.
+ */
+@protocol DFDiskCacheEvictionPolicy <NSObject>
+
+/*! Called when the new entry is added to the index. Entries restored from the journal are added in the order of their access dates.
+ */
+- (void)didAddEntry:(DFDiskCacheEntry *)entry;
+
+/*! Called when the data of the existing entry is replaced.
+ */
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize;
+
+/*! Called when the entry is read.
+ */
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry;
+
+/*! Called when the entry is explicitly removed.
+ */
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry;
+
+/*! Called when the entry returned by nextVictim is evicted.
+ */
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry;
+
+/*! Returns the entry that should be evicted next without removing it.
+ */
+- (nullable DFDiskCacheEntry *)nextVictim;
+
+/*! Called when all entries are removed.
+ */
+- (void)removeAllEntries;
+
+@optional
+
+/*! Capacity of the disk cache, in bytes. Set by the disk cache for the policies that partition capacity. DFDiskCacheCapacityUnlimited (0) means that capacity is unlimited.
+ */
+@property (nonatomic) unsigned long long capacity;
+
+@end
+
+
+/*! Discards the least recently used entries first. Default disk cache eviction policy.
+ */
+@interface DFDiskCacheEvictionPolicyLRU : NSObject <DFDiskCacheEvictionPolicy>
+
+@end
+
+
+/*! Discards the least frequently used entries first, the least recently used among them first. Constant time operations (frequency buckets).
+ */
+@interface DFDiskCacheEvictionPolicyLFU : NSObject <DFDiskCacheEvictionPolicy>
+
+@end
+
+
+/*! Greedy-Dual-Size-Frequency. Size-aware policy that discards entries with the lowest priority, where priority is (inflation + frequency / size). Inflation grows with each eviction which ages entries that are no longer used. Favours keeping many small frequently used entries over a few large ones.
+ */
+@interface DFDiskCacheEvictionPolicyGDSF : NSObject <DFDiskCacheEvictionPolicy>
+
+@end
+
+
+/*! Window TinyLFU. New entries are admitted into a small LRU window (1% of capacity by default), the rest of the capacity is a segmented LRU (probation and protected segments). When the window overflows, its victim competes with the main segment victim and the one with the lower estimated frequency is discarded. Frequencies are estimated by a count-min sketch with periodic aging which also remembers entries that were evicted. Scan resistant.
+ */
+@interface DFDiskCacheEvictionPolicyWTinyLFU : NSObject <DFDiskCacheEvictionPolicy>
+
+/*! Fraction of the capacity used for the admission window. Default value is 0.01.
+ */
+@property (nonatomic) double windowRatio;
+
+/*! Fraction of the main segment capacity used for the protected segment. Default value is 0.8.
+ */
+@property (nonatomic) double protectedRatio;
+
+@end
+
+
+/*! Adaptive Replacement Cache. Balances between recency (entries accessed once) and frequency (entries accessed at least twice) using ghost lists of recently evicted entries to adapt the balance. Sizes are measured in bytes. Scan resistant.
+ */
+@interface DFDiskCacheEvictionPolicyARC : NSObject <DFDiskCacheEvictionPolicy>
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,546 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCacheFrequencySketch.h"
+#import "DFDiskCacheEvictionPolicy.h"
+#import "DFDiskCacheIndex.h"
+#import "DFDiskCacheList.h"
+
+@implementation DFDiskCacheEntry
+
+- (instancetype)initWithFilename:(NSString *)filename {
+    if (self = [super init]) {
+        _filename = [filename copy];
+        _accessCount = 1;
+    }
+    return self;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { filename = %@; key = %@; size = %llu; access_date = %@; access_count = %lu; expiration_date = %@; segment = %u; offset = %llu }", [self class], self, _filename, _key, _size, [NSDate dateWithTimeIntervalSinceReferenceDate:_accessDate], (unsigned long)_accessCount, _expirationDate ? [NSDate dateWithTimeIntervalSinceReferenceDate:_expirationDate] : nil, _location.segment, _location.offset];
+}
+
+@end
+
+
+#pragma mark - LRU
+
+@implementation DFDiskCacheEvictionPolicyLRU {
+    DFDiskCacheList *_list;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _list = [DFDiskCacheList new];
+    }
+    return self;
+}
+
+- (void)didAddEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = [[DFDiskCacheListNode alloc] initWithEntry:entry];
+    entry.policyContext = node;
+    [_list appendNode:node];
+}
+
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize {
+    [_list setSize:entry.size forNode:entry.policyContext];
+    [_list moveNodeToTail:entry.policyContext];
+}
+
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry {
+    [_list moveNodeToTail:entry.policyContext];
+}
+
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry {
+    [_list removeNode:entry.policyContext];
+    entry.policyContext = nil;
+}
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    [self didRemoveEntry:entry];
+}
+
+- (DFDiskCacheEntry *)nextVictim {
+    return _list.head.entry;
+}
+
+- (void)removeAllEntries {
+    [_list removeAllNodes];
+}
+
+@end
+
+
+#pragma mark - LFU
+
+@implementation DFDiskCacheEvictionPolicyLFU {
+    /*! Lists of nodes with the same frequency, the least recently used node goes first.
+     */
+    NSMutableDictionary *_buckets;
+    NSUInteger _minFrequency;
+    BOOL _minFrequencyInvalid;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _buckets = [NSMutableDictionary new];
+        _minFrequencyInvalid = YES;
+    }
+    return self;
+}
+
+- (void)didAddEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = [[DFDiskCacheListNode alloc] initWithEntry:entry];
+    entry.policyContext = node;
+    [self _insertNode:node frequency:entry.accessCount];
+}
+
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [self _removeNode:node];
+    node.size = entry.size;
+    [self _insertNode:node frequency:entry.accessCount];
+}
+
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [self _removeNode:node];
+    [self _insertNode:node frequency:entry.accessCount];
+}
+
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry {
+    [self _removeNode:entry.policyContext];
+    entry.policyContext = nil;
+}
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    [self didRemoveEntry:entry];
+}
+
+- (DFDiskCacheEntry *)nextVictim {
+    if (_minFrequencyInvalid) {
+        if (!_buckets.count) {
+            return nil;
+        }
+        _minFrequency = [[[_buckets allKeys] valueForKeyPath:@"@min.unsignedIntegerValue"] unsignedIntegerValue];
+        _minFrequencyInvalid = NO;
+    }
+    DFDiskCacheList *list = _buckets[@(_minFrequency)];
+    return list.head.entry;
+}
+
+- (void)removeAllEntries {
+    for (DFDiskCacheList *list in [_buckets allValues]) {
+        [list removeAllNodes];
+    }
+    [_buckets removeAllObjects];
+    _minFrequencyInvalid = YES;
+}
+
+- (void)_insertNode:(DFDiskCacheListNode *)node frequency:(NSUInteger)frequency {
+    frequency = MAX(frequency, 1);
+    DFDiskCacheList *list = _buckets[@(frequency)];
+    if (!list) {
+        list = [DFDiskCacheList new];
+        _buckets[@(frequency)] = list;
+    }
+    node.value = frequency;
+    [list appendNode:node];
+    if (!_minFrequencyInvalid && frequency < _minFrequency) {
+        _minFrequency = frequency;
+    }
+}
+
+- (void)_removeNode:(DFDiskCacheListNode *)node {
+    DFDiskCacheList *list = node.list;
+    if (!list) {
+        return;
+    }
+    [list removeNode:node];
+    if (!list.count) {
+        NSUInteger frequency = (NSUInteger)node.value;
+        [_buckets removeObjectForKey:@(frequency)];
+        if (frequency == _minFrequency) {
+            _minFrequencyInvalid = YES;
+        }
+    }
+}
+
+@end
+
+
+#pragma mark - GDSF
+
+@interface _DFGDSFNode : NSObject {
+    @package
+    DFDiskCacheEntry *__unsafe_unretained _entry;
+    double _priority;
+    NSUInteger _index;
+}
+
+@end
+
+@implementation _DFGDSFNode
+
+@end
+
+
+@implementation DFDiskCacheEvictionPolicyGDSF {
+    /*! Binary min-heap of nodes ordered by priority.
+     */
+    NSMutableArray *_heap;
+    double _inflation;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _heap = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (double)_priorityForEntry:(DFDiskCacheEntry *)entry {
+    return _inflation + (double)entry.accessCount / (double)MAX(entry.size, 1);
+}
+
+- (void)didAddEntry:(DFDiskCacheEntry *)entry {
+    _DFGDSFNode *node = [_DFGDSFNode new];
+    node->_entry = entry;
+    node->_priority = [self _priorityForEntry:entry];
+    node->_index = _heap.count;
+    entry.policyContext = node;
+    [_heap addObject:node];
+    [self _siftUp:node->_index];
+}
+
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize {
+    [self didAccessEntry:entry];
+}
+
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry {
+    _DFGDSFNode *node = entry.policyContext;
+    node->_priority = [self _priorityForEntry:entry];
+    [self _siftUp:node->_index];
+    [self _siftDown:node->_index];
+}
+
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry {
+    _DFGDSFNode *node = entry.policyContext;
+    if (!node) {
+        return;
+    }
+    NSUInteger index = node->_index;
+    NSUInteger last = _heap.count - 1;
+    if (index != last) {
+        [self _swap:index with:last];
+    }
+    [_heap removeLastObject];
+    if (index < _heap.count) {
+        [self _siftUp:index];
+        [self _siftDown:index];
+    }
+    entry.policyContext = nil;
+}
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    _DFGDSFNode *node = entry.policyContext;
+    if (node) {
+        // Inflation ages the entries that remain in the cache.
+        _inflation = MAX(_inflation, node->_priority);
+    }
+    [self didRemoveEntry:entry];
+}
+
+- (DFDiskCacheEntry *)nextVictim {
+    _DFGDSFNode *node = [_heap firstObject];
+    return node ? node->_entry : nil;
+}
+
+- (void)removeAllEntries {
+    [_heap removeAllObjects];
+    _inflation = 0.0;
+}
+
+- (void)_swap:(NSUInteger)i with:(NSUInteger)j {
+    _DFGDSFNode *node1 = _heap[i];
+    _DFGDSFNode *node2 = _heap[j];
+    _heap[i] = node2;
+    _heap[j] = node1;
+    node1->_index = j;
+    node2->_index = i;
+}
+
+- (void)_siftUp:(NSUInteger)index {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (((_DFGDSFNode *)_heap[parent])->_priority <= ((_DFGDSFNode *)_heap[index])->_priority) {
+            break;
+        }
+        [self _swap:index with:parent];
+        index = parent;
+    }
+}
+
+- (void)_siftDown:(NSUInteger)index {
+    NSUInteger count = _heap.count;
+    while (YES) {
+        NSUInteger smallest = index;
+        NSUInteger left = 2 * index + 1;
+        NSUInteger right = left + 1;
+        if (left < count && ((_DFGDSFNode *)_heap[left])->_priority < ((_DFGDSFNode *)_heap[smallest])->_priority) {
+            smallest = left;
+        }
+        if (right < count && ((_DFGDSFNode *)_heap[right])->_priority < ((_DFGDSFNode *)_heap[smallest])->_priority) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        [self _swap:index with:smallest];
+        index = smallest;
+    }
+}
+
+@end
+
+
+#pragma mark - W-TinyLFU
+
+@implementation DFDiskCacheEvictionPolicyWTinyLFU {
+    DFDiskCacheList *_window;
+    DFDiskCacheList *_probation;
+    DFDiskCacheList *_protected;
+    DFCacheFrequencySketch *_sketch;
+}
+
+@synthesize capacity = _capacity;
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _windowRatio = 0.01;
+        _protectedRatio = 0.8;
+        _window = [DFDiskCacheList new];
+        _probation = [DFDiskCacheList new];
+        _protected = [DFDiskCacheList new];
+        _sketch = [[DFCacheFrequencySketch alloc] initWithWidth:16384];
+    }
+    return self;
+}
+
+- (unsigned long long)_effectiveCapacity {
+    return _capacity ?: (_window.size + _probation.size + _protected.size);
+}
+
+- (void)_recordAccessToEntry:(DFDiskCacheEntry *)entry {
+    [_sketch incrementHash:[DFCacheFrequencySketch hashForString:entry.filename]];
+}
+
+- (NSUInteger)_frequencyForNode:(DFDiskCacheListNode *)node {
+    return [_sketch frequencyForHash:[DFCacheFrequencySketch hashForString:node.filename]];
+}
+
+- (void)didAddEntry:(DFDiskCacheEntry *)entry {
+    [self _recordAccessToEntry:entry];
+    DFDiskCacheListNode *node = [[DFDiskCacheListNode alloc] initWithEntry:entry];
+    entry.policyContext = node;
+    [_window appendNode:node];
+}
+
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [node.list setSize:entry.size forNode:node];
+    [self didAccessEntry:entry];
+}
+
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry {
+    [self _recordAccessToEntry:entry];
+    DFDiskCacheListNode *node = entry.policyContext;
+    if (node.list == _probation) {
+        // Promote to the protected segment, demote protected entries that don't fit into probation.
+        [_probation removeNode:node];
+        [_protected appendNode:node];
+        unsigned long long capacity = [self _effectiveCapacity];
+        unsigned long long protectedLimit = (capacity - capacity * _windowRatio) * _protectedRatio;
+        while (_protected.size > protectedLimit && _protected.head != node) {
+            DFDiskCacheListNode *demoted = _protected.head;
+            [_protected removeNode:demoted];
+            [_probation appendNode:demoted];
+        }
+    } else {
+        [node.list moveNodeToTail:node];
+    }
+}
+
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [node.list removeNode:node];
+    entry.policyContext = nil;
+}
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    // Sketch still remembers frequency of the evicted entry.
+    [self didRemoveEntry:entry];
+}
+
+- (DFDiskCacheEntry *)nextVictim {
+    unsigned long long capacity = [self _effectiveCapacity];
+    unsigned long long windowLimit = capacity * _windowRatio;
+    unsigned long long mainLimit = capacity - windowLimit;
+    while (_window.size > windowLimit && _window.head) {
+        DFDiskCacheListNode *candidate = _window.head;
+        if (_probation.size + _protected.size + candidate.size <= mainLimit) {
+            [_window removeNode:candidate];
+            [_probation appendNode:candidate];
+            continue;
+        }
+        DFDiskCacheListNode *victim = _probation.head ?: _protected.head;
+        if (!victim || [self _frequencyForNode:candidate] <= [self _frequencyForNode:victim]) {
+            return candidate.entry;
+        }
+        // Candidate wins admission, main segment victim is evicted instead.
+        [_window removeNode:candidate];
+        [_probation appendNode:candidate];
+        return victim.entry;
+    }
+    return (_probation.head ?: _protected.head ?: _window.head).entry;
+}
+
+- (void)removeAllEntries {
+    [_window removeAllNodes];
+    [_probation removeAllNodes];
+    [_protected removeAllNodes];
+    [_sketch removeAllCounts];
+}
+
+@end
+
+
+#pragma mark - ARC
+
+@implementation DFDiskCacheEvictionPolicyARC {
+    /*! Resident entries that were accessed once (T1) and at least twice (T2).
+     */
+    DFDiskCacheList *_recent;
+    DFDiskCacheList *_frequent;
+
+    /*! Ghost entries recently evicted from T1 (B1) and T2 (B2).
+     */
+    DFDiskCacheList *_recentGhosts;
+    DFDiskCacheList *_frequentGhosts;
+    NSMutableDictionary *_ghosts;
+
+    /*! Target size of T1, in bytes.
+     */
+    double _target;
+}
+
+@synthesize capacity = _capacity;
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _recent = [DFDiskCacheList new];
+        _frequent = [DFDiskCacheList new];
+        _recentGhosts = [DFDiskCacheList new];
+        _frequentGhosts = [DFDiskCacheList new];
+        _ghosts = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (double)_effectiveCapacity {
+    return _capacity ?: (_recent.size + _frequent.size);
+}
+
+- (void)didAddEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = [[DFDiskCacheListNode alloc] initWithEntry:entry];
+    entry.policyContext = node;
+    DFDiskCacheListNode *ghost = _ghosts[entry.filename];
+    double size = MAX(entry.size, 1);
+    if (ghost.list == _recentGhosts) {
+        double delta = MAX((double)_frequentGhosts.size / MAX(_recentGhosts.size, 1), 1.0) * size;
+        _target = MIN([self _effectiveCapacity], _target + delta);
+        [self _removeGhost:ghost];
+        [_frequent appendNode:node];
+    } else if (ghost.list == _frequentGhosts) {
+        double delta = MAX((double)_recentGhosts.size / MAX(_frequentGhosts.size, 1), 1.0) * size;
+        _target = MAX(0.0, _target - delta);
+        [self _removeGhost:ghost];
+        [_frequent appendNode:node];
+    } else {
+        [_recent appendNode:node];
+    }
+    [self _trimGhosts];
+}
+
+- (void)didUpdateEntry:(DFDiskCacheEntry *)entry previousSize:(unsigned long long)previousSize {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [node.list setSize:entry.size forNode:node];
+    [self didAccessEntry:entry];
+}
+
+- (void)didAccessEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = entry.policyContext;
+    if (node.list == _recent) {
+        [_recent removeNode:node];
+        [_frequent appendNode:node];
+    } else {
+        [node.list moveNodeToTail:node];
+    }
+}
+
+- (void)didRemoveEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = entry.policyContext;
+    [node.list removeNode:node];
+    entry.policyContext = nil;
+}
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    DFDiskCacheListNode *node = entry.policyContext;
+    DFDiskCacheList *ghosts = node.list == _recent ? _recentGhosts : _frequentGhosts;
+    [self didRemoveEntry:entry];
+    if (node) {
+        node.entry = nil;
+        [self _removeGhost:_ghosts[node.filename]];
+        [ghosts appendNode:node];
+        _ghosts[node.filename] = node;
+        [self _trimGhosts];
+    }
+}
+
+- (DFDiskCacheEntry *)nextVictim {
+    if (_recent.head && (_recent.size > _target || !_frequent.head)) {
+        return _recent.head.entry;
+    }
+    return _frequent.head.entry ?: _recent.head.entry;
+}
+
+- (void)removeAllEntries {
+    [_recent removeAllNodes];
+    [_frequent removeAllNodes];
+    [_recentGhosts removeAllNodes];
+    [_frequentGhosts removeAllNodes];
+    [_ghosts removeAllObjects];
+    _target = 0.0;
+}
+
+- (void)_removeGhost:(DFDiskCacheListNode *)ghost {
+    if (ghost) {
+        [ghost.list removeNode:ghost];
+        [_ghosts removeObjectForKey:ghost.filename];
+    }
+}
+
+/*! Keeps T1 + B1 within capacity and all lists within twice the capacity.
+ */
+- (void)_trimGhosts {
+    double capacity = [self _effectiveCapacity];
+    while (_recentGhosts.head && _recent.size + _recentGhosts.size > capacity) {
+        [self _removeGhost:_recentGhosts.head];
+    }
+    while (_frequentGhosts.head && _recent.size + _frequent.size + _recentGhosts.size + _frequentGhosts.size > 2 * capacity) {
+        [self _removeGhost:_frequentGhosts.head];
+    }
+}
+
+@end
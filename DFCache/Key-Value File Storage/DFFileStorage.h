@@ -3,9 +3,25 @@
 // Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
 
 #import <Foundation/Foundation.h>
+#import "DFFileStorageWriter.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
+/*! Hash function that maps keys to file names.
+ */
+typedef NS_ENUM(NSUInteger, DFFileStorageKeyHash) {
+    /*! SHA-1, file names are 40 digit hexadecimal numbers. Used by all previous versions.
+     */
+    DFFileStorageKeyHashSHA1 = 0,
+    /*! 128-bit MurmurHash3, file names are 32 digit hexadecimal numbers. Non-cryptographic hash that is several times faster than SHA-1.
+     */
+    DFFileStorageKeyHashMurmur3 = 1
+};
+
+/*! Maximum number of subdirectory levels that files are distributed across.
+ */
+static const NSUInteger DFFileStorageMaximumDirectoryFanout = 2;
+
 /*! Key-value file storage.
  @discussion File storage doesn't limit your access to the underlying storage directory.
  */
@@ -25,14 +41,56 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, readonly) NSString *path;
 
-/*! Returns the contents of the file for the given key.
+/*! Minimum size of the file that is read into memory-mapped data instead of being copied into a heap buffer. Default value is 0 which means that files are never mapped.
+ @discussion Mapped reads avoid memory spikes and copying for large files, pages are loaded lazily as the data is accessed and are backed by the file rather than by swap. Mapping is safe because files are always replaced atomically, the data remains valid even if the file is replaced or removed while it is mapped.
+ */
+@property (nonatomic) unsigned long long mappedReadThreshold;
+
+/*! Hash function that maps keys to file names. Default value is DFFileStorageKeyHashSHA1.
+ @discussion Set the hash function and directory fanout before storage is used.
+ */
+@property (nonatomic) DFFileStorageKeyHash keyHash;
+
+/*! Number of subdirectory levels (0 to 2) that files are distributed across. Each level is named after the next two hexadecimal digits of the file name, e.g. ab/cd/abcd..., so that each directory contains at most 256 subdirectories. Default value is 0, all files are stored in the storage directory.
+ @discussion Large flat directories make lookups slower, use fanout for the storages that contain hundreds of thousands of files.
+ @note Files stored using the previous layout (SHA-1 file names in the storage directory) remain readable when either hash function or fanout is changed. Such files are moved to the current layout the first time they are accessed.
+ */
+@property (nonatomic) NSUInteger directoryFanout;
+
+/*! Returns the contents of the file for the given key. Returns memory-mapped data for the files larger than mappedReadThreshold.
  */
 - (nullable NSData *)dataForKey:(NSString *)key;
 
-/*! Creates a file with the specified content for the given key.
+/*! Returns the contents of the file for the given key along with all the attributes associated with it.
+ @param attributes On return contains dictionary with attribute name : attribute data pairs. You may specify nil for this parameter if you do not want the attributes.
+ */
+- (nullable NSData *)dataForKey:(NSString *)key attributes:(NSDictionary<NSString *, NSData *> *_Nullable *_Nullable)attributes;
+
+/*! Atomically writes a file with the specified content for the given key.
  */
 - (void)setData:(NSData *)data forKey:(NSString *)key;
 
+/*! Atomically writes a file with the specified content for the given key and associates attributes with it.
+ @param attributes Dictionary with attribute name : attribute data pairs.
+ */
+- (void)setData:(NSData *)data attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes forKey:(NSString *)key;
+
+/*! Returns writer that streams the data of the entry for the given key into storage chunk by chunk, so that memory usage doesn't depend on the size of the entry. Entry is atomically replaced with the written data when the writer is closed.
+ @param attributes Dictionary with attribute name : attribute data pairs that are associated with the entry when the writer is closed.
+ @return Writer or nil if the temporary file can't be created.
+ */
+- (nullable DFFileStorageWriter *)writerForKey:(NSString *)key attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes;
+
+/*! Returns input stream that reads the data of the entry for the given key in chunks. Stream reads the entry as it was when the stream was created even if the entry is replaced or removed afterwards.
+ @note Stream should be read synchronously, it doesn't deliver events when scheduled in a run loop.
+ */
+- (nullable NSInputStream *)inputStreamForKey:(NSString *)key;
+
+/*! Reads up to length bytes of the data of the entry for the given key starting at the given offset without reading the rest of the entry. Returns shorter (or empty) data if the range extends beyond the end of the data.
+ @return Data or nil if there is no entry for the given key.
+ */
+- (nullable NSData *)dataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length;
+
 /*! Removes the file for the given key.
  */
 - (void)removeDataForKey:(NSString *)key;
@@ -45,6 +103,19 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)containsDataForKey:(NSString *)key;
 
+/*! Returns data of the attribute with a given name associated with the entry for the given key.
+ @discussion File storage implements attributes on top of extended file attributes (see NSURL+DFExtendedFileAttributes). Subclasses might store attributes differently.
+ */
+- (nullable NSData *)attributeForName:(NSString *)name key:(NSString *)key;
+
+/*! Associates attribute data with the entry for the given key. Has no effect if there is no entry for the given key.
+ */
+- (void)setAttribute:(NSData *)data forName:(NSString *)name key:(NSString *)key;
+
+/*! Removes the attribute with a given name from the entry for the given key.
+ */
+- (void)removeAttributeForName:(NSString *)name key:(NSString *)key;
+
 /*! Returns file name for the given key.
  */
 - (NSString *)filenameForKey:(NSString *)key;
@@ -53,6 +124,10 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (NSString *)pathForKey:(NSString *)key;
 
+/*! Returns file path for the given file name taking directory fanout into account.
+ */
+- (NSString *)pathForFilename:(NSString *)filename;
+
 /* Returns file URL for the given key.
  */
 - (NSURL *)URLForKey:(NSString *)key;
@@ -61,7 +136,7 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (unsigned long long)contentsSize;
 
-/*! Returns URLs of items contained into storage.
+/*! Returns URLs of files contained in storage, including files in fanout subdirectories.
  @param keys An array of keys that identify the file properties that you want pre-fetched for each item in the storage. For each returned URL, the specified properties are fetched and cached in the NSURL object. For a list of keys you can specify, see Common File System Resource Keys.
  */
 - (nullable NSArray *)contentsWithResourceKeys:(nullable NSArray *)keys;
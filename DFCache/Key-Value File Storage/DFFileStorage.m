@@ -4,9 +4,50 @@
 
 #import "DFCachePrivate.h"
 #import "DFFileStorage.h"
+#import "DFFileStorageInputStream.h"
+#import "DFFileStoragePrivate.h"
+#import "NSURL+DFExtendedFileAttributes.h"
+#import <dirent.h>
+#import <fcntl.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+typedef NS_ENUM(NSUInteger, _DFFileStorageLegacyFiles) {
+    _DFFileStorageLegacyFilesUnknown,
+    _DFFileStorageLegacyFilesNone,
+    _DFFileStorageLegacyFilesPresent
+};
+
+/*! Reads up to length bytes at the given offset, stops at the end of the file.
+ */
+static NSData *
+_DFFileStorageReadData(int fd, unsigned long long offset, NSUInteger length) {
+    NSMutableData *data = [[NSMutableData alloc] initWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    NSUInteger count = 0;
+    while (count < length) {
+        ssize_t result = pread(fd, bytes + count, length - count, (off_t)(offset + count));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return nil;
+        }
+        if (result == 0) {
+            break;
+        }
+        count += (NSUInteger)result;
+    }
+    data.length = count;
+    return data;
+}
 
 @implementation DFFileStorage {
     NSFileManager *_fileManager;
+
+    /*! Whether storage directory contains files stored using the previous layout, checked once when the layout is different.
+     */
+    _DFFileStorageLegacyFiles _legacyFiles;
 }
 
 - (instancetype)initWithPath:(NSString *)path error:(NSError *__autoreleasing *)error {
@@ -29,33 +70,130 @@
 }
 
 - (NSData *)dataForKey:(NSString *)key {
-    return key ? [_fileManager contentsAtPath:[self pathForKey:key]] : nil;
+    if (!key) {
+        return nil;
+    }
+    NSData *data = [self _dataAtPath:[self pathForKey:key]];
+    if (!data && [self _moveLegacyFileForKey:key]) {
+        data = [self _dataAtPath:[self pathForKey:key]];
+    }
+    return data;
+}
+
+- (NSData *)_dataAtPath:(NSString *)path {
+    if (_mappedReadThreshold > 0) {
+        struct stat info;
+        if (stat(path.fileSystemRepresentation, &info) != 0) {
+            return nil;
+        }
+        if ((unsigned long long)info.st_size >= _mappedReadThreshold) {
+            return [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+        }
+    }
+    return [_fileManager contentsAtPath:path];
+}
+
+- (NSData *)dataForKey:(NSString *)key attributes:(NSDictionary **)attributes {
+    NSData *data = [self dataForKey:key];
+    if (data && attributes) {
+        NSURL *fileURL = [self URLForKey:key];
+        NSMutableDictionary *fileAttributes = [NSMutableDictionary new];
+        for (NSString *name in [fileURL df_extendedAttributesList:NULL]) {
+            NSData *value = [fileURL df_extendedAttributeDataForKey:name error:NULL options:0];
+            if (value) {
+                fileAttributes[name] = value;
+            }
+        }
+        *attributes = fileAttributes;
+    }
+    return data;
 }
 
 - (void)setData:(NSData *)data forKey:(NSString *)key {
-    if (data && key) {
-        [_fileManager createFileAtPath:[self pathForKey:key] contents:data attributes:nil];
+    [self setData:data attributes:nil forKey:key];
+}
+
+- (void)setData:(NSData *)data attributes:(NSDictionary *)attributes forKey:(NSString *)key {
+    if (!data || !key) {
+        return;
+    }
+    NSString *path = [self pathForKey:key];
+    if (![data writeToFile:path options:NSDataWritingAtomic error:nil]) {
+        // Fanout subdirectories are created lazily.
+        if (!_directoryFanout || ![_fileManager createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil] || ![data writeToFile:path options:NSDataWritingAtomic error:nil]) {
+            return;
+        }
+    }
+    if ([self _mayContainLegacyFiles]) {
+        [_fileManager removeItemAtPath:[self _legacyPathForKey:key] error:nil];
+    }
+    if (attributes.count) {
+        NSURL *fileURL = [NSURL fileURLWithPath:path];
+        [attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSData *value, BOOL *stop) {
+            [fileURL df_setExtendedAttributeData:value forKey:name options:0];
+        }];
     }
 }
 
 - (void)removeDataForKey:(NSString *)key {
     if (key) {
         [_fileManager removeItemAtPath:[self pathForKey:key] error:nil];
+        if ([self _mayContainLegacyFiles]) {
+            [_fileManager removeItemAtPath:[self _legacyPathForKey:key] error:nil];
+        }
     }
 }
 
 - (void)removeAllData {
     [_fileManager removeItemAtPath:_path error:nil];
     [_fileManager createDirectoryAtPath:_path withIntermediateDirectories:YES attributes:nil error:nil];
+    _legacyFiles = _DFFileStorageLegacyFilesUnknown;
+}
+
+- (NSData *)attributeForName:(NSString *)name key:(NSString *)key {
+    if (!name || !key) {
+        return nil;
+    }
+    [self _resolveLegacyFileForKey:key];
+    return [[self URLForKey:key] df_extendedAttributeDataForKey:name error:NULL options:0];
+}
+
+- (void)setAttribute:(NSData *)data forName:(NSString *)name key:(NSString *)key {
+    if (data && name && key) {
+        [self _resolveLegacyFileForKey:key];
+        [[self URLForKey:key] df_setExtendedAttributeData:data forKey:name options:0];
+    }
+}
+
+- (void)removeAttributeForName:(NSString *)name key:(NSString *)key {
+    if (name && key) {
+        [self _resolveLegacyFileForKey:key];
+        [[self URLForKey:key] df_removeExtendedAttributeForKey:name];
+    }
 }
 
 - (NSString *)filenameForKey:(NSString *)key {
     const char *string = [key UTF8String];
-    return _dwarf_cache_sha1(string, (uint32_t)strlen(string));
+    uint32_t length = (uint32_t)strlen(string);
+    return _keyHash == DFFileStorageKeyHashMurmur3 ? _dwarf_cache_murmur3(string, length) : _dwarf_cache_sha1(string, length);
 }
 
 - (NSString *)pathForKey:(NSString *)key {
-    return key ? [_path stringByAppendingPathComponent:[self filenameForKey:key]] : nil;
+    return key ? [self pathForFilename:[self filenameForKey:key]] : nil;
+}
+
+- (NSString *)pathForFilename:(NSString *)filename {
+    NSUInteger fanout = MIN(_directoryFanout, DFFileStorageMaximumDirectoryFanout);
+    if (!fanout || filename.length < 2 * fanout) {
+        return [_path stringByAppendingPathComponent:filename];
+    }
+    NSMutableString *relativePath = [[NSMutableString alloc] initWithCapacity:3 * fanout + filename.length];
+    for (NSUInteger level = 0; level < fanout; level++) {
+        [relativePath appendString:[filename substringWithRange:NSMakeRange(2 * level, 2)]];
+        [relativePath appendString:@"/"];
+    }
+    [relativePath appendString:filename];
+    return [_path stringByAppendingPathComponent:relativePath];
 }
 
 - (NSURL *)URLForKey:(NSString *)key {
@@ -63,9 +201,148 @@
 }
 
 - (BOOL)containsDataForKey:(NSString *)key {
-    return key ? [_fileManager fileExistsAtPath:[self pathForKey:key]] : NO;
+    if (!key) {
+        return NO;
+    }
+    return [_fileManager fileExistsAtPath:[self pathForKey:key]] || [self _moveLegacyFileForKey:key];
+}
+
+#pragma mark - Streaming
+
+- (DFFileStorageWriter *)writerForKey:(NSString *)key attributes:(NSDictionary *)attributes {
+    if (!key) {
+        return nil;
+    }
+    return [[DFFileStorageWriter alloc] initWithStorage:self key:key path:[self pathForKey:key] attributes:attributes prefix:nil];
 }
 
+- (BOOL)_commitWriter:(DFFileStorageWriter *)writer {
+    if (![writer closeFileDescriptor]) {
+        return NO;
+    }
+    if (writer.attributes.count) {
+        NSURL *fileURL = [NSURL fileURLWithPath:writer.temporaryPath];
+        [writer.attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSData *value, BOOL *stop) {
+            [fileURL df_setExtendedAttributeData:value forKey:name options:0];
+        }];
+    }
+    if (rename(writer.temporaryPath.fileSystemRepresentation, writer.path.fileSystemRepresentation) != 0) {
+        return NO;
+    }
+    if ([self _mayContainLegacyFiles]) {
+        [_fileManager removeItemAtPath:[self _legacyPathForKey:writer.key] error:nil];
+    }
+    return YES;
+}
+
+- (NSInputStream *)inputStreamForKey:(NSString *)key {
+    if (!key) {
+        return nil;
+    }
+    unsigned long long offset, length;
+    NSData *packedData;
+    int fd = [self _openDataForKey:key offset:&offset length:&length packedData:&packedData];
+    if (fd < 0) {
+        return packedData ? [NSInputStream inputStreamWithData:packedData] : nil;
+    }
+    return [[DFFileStorageInputStream alloc] initWithFileDescriptor:fd offset:offset length:length];
+}
+
+- (NSData *)dataForKey:(NSString *)key offset:(unsigned long long)offset length:(NSUInteger)length {
+    if (!key) {
+        return nil;
+    }
+    unsigned long long dataOffset, dataLength;
+    NSData *packedData;
+    int fd = [self _openDataForKey:key offset:&dataOffset length:&dataLength packedData:&packedData];
+    if (fd < 0) {
+        if (!packedData) {
+            return nil;
+        }
+        if (offset >= packedData.length) {
+            return [NSData data];
+        }
+        return [packedData subdataWithRange:NSMakeRange((NSUInteger)offset, MIN(length, packedData.length - (NSUInteger)offset))];
+    }
+    offset = MIN(offset, dataLength);
+    NSData *data = _DFFileStorageReadData(fd, dataOffset + offset, (NSUInteger)MIN((unsigned long long)length, dataLength - offset));
+    close(fd);
+    return data;
+}
+
+- (int)_openDataForKey:(NSString *)key offset:(unsigned long long *)offset length:(unsigned long long *)length packedData:(NSData **)packedData {
+    *packedData = nil;
+    int fd = open([self pathForKey:key].fileSystemRepresentation, O_RDONLY);
+    if (fd < 0 && [self _moveLegacyFileForKey:key]) {
+        fd = open([self pathForKey:key].fileSystemRepresentation, O_RDONLY);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+    *offset = 0;
+    *length = (unsigned long long)info.st_size;
+    return fd;
+}
+
+#pragma mark - Layout
+
+- (BOOL)_isLegacyLayout {
+    return _keyHash == DFFileStorageKeyHashSHA1 && _directoryFanout == 0;
+}
+
+/*! Returns YES if the layout is different from the previous layout and the storage directory contains SHA-1 named files. Checked once, the directory listing stops at the first such file.
+ */
+- (BOOL)_mayContainLegacyFiles {
+    if ([self _isLegacyLayout]) {
+        return NO;
+    }
+    if (_legacyFiles == _DFFileStorageLegacyFilesUnknown) {
+        BOOL present = NO;
+        DIR *directory = opendir(_path.fileSystemRepresentation);
+        if (directory) {
+            struct dirent *entry;
+            while (!present && (entry = readdir(directory))) {
+                present = entry->d_name[0] != '.' && strlen(entry->d_name) == _dwarf_cache_sha1_length && entry->d_type != DT_DIR;
+            }
+            closedir(directory);
+        }
+        _legacyFiles = present ? _DFFileStorageLegacyFilesPresent : _DFFileStorageLegacyFilesNone;
+    }
+    return _legacyFiles == _DFFileStorageLegacyFilesPresent;
+}
+
+- (NSString *)_legacyPathForKey:(NSString *)key {
+    const char *string = [key UTF8String];
+    return [_path stringByAppendingPathComponent:_dwarf_cache_sha1(string, (uint32_t)strlen(string))];
+}
+
+/*! Moves the file stored using the previous layout to the current location.
+ @return YES if the file was moved.
+ */
+- (BOOL)_moveLegacyFileForKey:(NSString *)key {
+    if (![self _mayContainLegacyFiles]) {
+        return NO;
+    }
+    NSString *legacyPath = [self _legacyPathForKey:key];
+    NSString *path = [self pathForKey:key];
+    return ![legacyPath isEqualToString:path] && _dwarf_cache_move_item(legacyPath, path);
+}
+
+/*! Moves the file stored using the previous layout before the attributes are accessed.
+ */
+- (void)_resolveLegacyFileForKey:(NSString *)key {
+    if ([self _mayContainLegacyFiles] && ![_fileManager fileExistsAtPath:[self pathForKey:key]]) {
+        [self _moveLegacyFileForKey:key];
+    }
+}
+
+#pragma mark - Contents
+
 - (_dwarf_cache_bytes)contentsSize {
     _dwarf_cache_bytes size = 0;
     NSArray *contents = [self contentsWithResourceKeys:@[NSURLFileAllocatedSizeKey]];
@@ -79,7 +356,25 @@
 
 - (NSArray *)contentsWithResourceKeys:(NSArray *)keys {
     NSURL *rootURL = [NSURL fileURLWithPath:_path isDirectory:YES];
-    return [_fileManager contentsOfDirectoryAtURL:rootURL includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:nil];
+    NSArray *contents = [_fileManager contentsOfDirectoryAtURL:rootURL includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:nil];
+    // Fanout subdirectories are listed regardless of the current fanout so that files stay visible when the fanout is changed.
+    NSMutableArray *files = [[NSMutableArray alloc] initWithCapacity:contents.count];
+    [self _appendContents:contents level:0 toFiles:files resourceKeys:keys];
+    return files;
+}
+
+- (void)_appendContents:(NSArray *)contents level:(NSUInteger)level toFiles:(NSMutableArray *)files resourceKeys:(NSArray *)keys {
+    for (NSURL *URL in contents) {
+        // File names are much longer, only the subdirectory names consist of two characters.
+        if ([URL lastPathComponent].length == 2) {
+            if (level < DFFileStorageMaximumDirectoryFanout) {
+                NSArray *subcontents = [_fileManager contentsOfDirectoryAtURL:URL includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:nil];
+                [self _appendContents:subcontents level:level + 1 toFiles:files resourceKeys:keys];
+            }
+        } else {
+            [files addObject:URL];
+        }
+    }
 }
 
 - (NSString *)debugDescription {
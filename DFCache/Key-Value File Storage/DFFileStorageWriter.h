@@ -0,0 +1,52 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Writes entry data into file storage chunk by chunk so that entries of any size can be stored using constant memory. Writers are created by file storage (see writerForKey:attributes:).
+ @discussion Data is written into a hidden temporary file which atomically replaces the entry when the writer is closed. Until then readers observe the previous entry (if any). Writer that is cancelled or deallocated without being closed discards the written data.
+ @note Writer is not thread-safe, it should be used by a single thread at a time.
+ */
+@interface DFFileStorageWriter : NSObject
+
+/*! Key of the entry being written.
+ */
+@property (nonatomic, readonly) NSString *key;
+
+/*! Number of data bytes written so far.
+ */
+@property (nonatomic, readonly) unsigned long long length;
+
+/*! Appends bytes to the entry data.
+ @return NO if the bytes can't be written or if the writer is already closed. Writer that failed to write can only be cancelled, closing it discards the data.
+ */
+- (BOOL)writeBytes:(const void *)bytes length:(NSUInteger)length;
+
+/*! Appends data to the entry data.
+ */
+- (BOOL)writeData:(NSData *)data;
+
+/*! Reads the stream until it's at end and appends its contents to the entry data in fixed size chunks. Opens the stream if it's not open yet, stream is not closed.
+ @return NO if the stream fails or if the data can't be written.
+ */
+- (BOOL)writeContentsOfStream:(NSInputStream *)stream;
+
+/*! Finishes writing and atomically replaces the entry with the written data.
+ @return YES if the entry was replaced.
+ */
+- (BOOL)close;
+
+/*! Discards the written data, the entry is left intact.
+ */
+- (void)cancel;
+
+/*! Unavailable initializer, writers are created by file storage.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
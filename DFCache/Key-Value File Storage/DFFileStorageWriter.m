@@ -0,0 +1,143 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCachePrivate.h"
+#import "DFFileStoragePrivate.h"
+#import <unistd.h>
+
+/*! Size of the chunks that streams are read in.
+ */
+static const NSUInteger DFFileStorageWriterStreamChunkSize = 64 * 1024;
+
+typedef NS_ENUM(NSUInteger, _DFFileStorageWriterState) {
+    _DFFileStorageWriterStateOpen,
+    _DFFileStorageWriterStateFailed,
+    _DFFileStorageWriterStateClosed
+};
+
+static BOOL
+_DFFileStorageWriterWrite(int fd, const void *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const uint8_t *)bytes + written;
+        length -= written;
+    }
+    return YES;
+}
+
+@implementation DFFileStorageWriter {
+    DFFileStorage *_storage;
+    _DFFileStorageWriterState _state;
+}
+
+- (void)dealloc {
+    [self cancel];
+}
+
+- (instancetype)initWithStorage:(DFFileStorage *)storage key:(NSString *)key path:(NSString *)path attributes:(NSDictionary *)attributes prefix:(NSData *)prefix {
+    if (self = [super init]) {
+        _storage = storage;
+        _key = [key copy];
+        _path = [path copy];
+        _attributes = [attributes copy];
+        _dataChecksum = _dwarf_cache_checksum_seed;
+        NSString *temporaryPath;
+        _fileDescriptor = _dwarf_cache_make_temporary_file(path, &temporaryPath);
+        if (_fileDescriptor < 0) {
+            return nil;
+        }
+        _temporaryPath = temporaryPath;
+        if (prefix.length && !_DFFileStorageWriterWrite(_fileDescriptor, prefix.bytes, prefix.length)) {
+            [self cancel];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+- (BOOL)writeBytes:(const void *)bytes length:(NSUInteger)length {
+    if (_state != _DFFileStorageWriterStateOpen) {
+        return NO;
+    }
+    if (!_DFFileStorageWriterWrite(_fileDescriptor, bytes, length)) {
+        _state = _DFFileStorageWriterStateFailed;
+        return NO;
+    }
+    _dataChecksum = _dwarf_cache_checksum_update(_dataChecksum, bytes, length);
+    _length += length;
+    return YES;
+}
+
+- (BOOL)writeData:(NSData *)data {
+    return [self writeBytes:data.bytes length:data.length];
+}
+
+- (BOOL)writeContentsOfStream:(NSInputStream *)stream {
+    if (stream.streamStatus == NSStreamStatusNotOpen) {
+        [stream open];
+    }
+    uint8_t *buffer = malloc(DFFileStorageWriterStreamChunkSize);
+    if (!buffer) {
+        return NO;
+    }
+    BOOL success = YES;
+    while (success) {
+        NSInteger length = [stream read:buffer maxLength:DFFileStorageWriterStreamChunkSize];
+        if (length == 0) {
+            break;
+        }
+        success = length > 0 && [self writeBytes:buffer length:(NSUInteger)length];
+    }
+    free(buffer);
+    return success;
+}
+
+- (BOOL)close {
+    if (_state == _DFFileStorageWriterStateClosed) {
+        return NO;
+    }
+    BOOL success = _state == _DFFileStorageWriterStateOpen && [_storage _commitWriter:self];
+    if (!success) {
+        [self cancel];
+    }
+    _state = _DFFileStorageWriterStateClosed;
+    return success;
+}
+
+- (void)cancel {
+    if (_state == _DFFileStorageWriterStateClosed) {
+        return;
+    }
+    [self closeFileDescriptor];
+    if (_temporaryPath) {
+        unlink(_temporaryPath.fileSystemRepresentation);
+    }
+    _state = _DFFileStorageWriterStateClosed;
+}
+
+- (BOOL)closeFileDescriptor {
+    if (_fileDescriptor < 0) {
+        return YES;
+    }
+    BOOL success = close(_fileDescriptor) == 0;
+    _fileDescriptor = -1;
+    return success;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { key = %@; length = %llu }", [self class], self, _key, _length];
+}
+
+@end
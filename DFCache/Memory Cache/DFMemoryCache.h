@@ -0,0 +1,71 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSUInteger, DFMemoryCacheEvictionReason) {
+    /*! Object was evicted to satisfy total cost limit or count limit.
+     */
+    DFMemoryCacheEvictionReasonLimit,
+    /*! Object was evicted because its time to live has expired.
+     */
+    DFMemoryCacheEvictionReasonExpired
+};
+
+/*! Memory cache with deterministic LRU (or segmented LRU) eviction, strict total cost and count limits and time to live support.
+ @discussion DFMemoryCache is a drop-in replacement for NSCache, it can be passed to DFCache initializers. Unlike NSCache it never evicts objects on its own, objects are evicted only when limits are exceeded or when they expire, the least recently used objects are evicted first. Total cost and count limits are strict, they are enforced before the method that added the object returns.
+ @note Cache is thread-safe. Objects are distributed between lock stripes by key hash so that concurrent access to different keys rarely contends. Each stripe keeps its own recency list, eviction picks the least recently used object among stripe victims which closely approximates global LRU.
+ @note Delegate (NSCacheDelegate) is notified about evicted objects along with the eviction handler. Objects removed explicitly don't trigger either of them. evictsObjectsWithDiscardedContent property is ignored.
+ */
+@interface DFMemoryCache : NSCache
+
+/*! Initializes cache with a default number of lock stripes (8).
+ */
+- (instancetype)init;
+
+/*! Initializes cache with a given number of lock stripes (rounded up to the power of two).
+ */
+- (instancetype)initWithStripeCount:(NSUInteger)stripeCount NS_DESIGNATED_INITIALIZER;
+
+/*! Returns number of lock stripes.
+ */
+@property (nonatomic, readonly) NSUInteger stripeCount;
+
+/*! If YES cache uses segmented LRU: new objects are inserted into probationary segment and are promoted to protected segment on the second access. Objects from the probationary segment are evicted first which protects frequently used objects from being flushed by one-time accesses. Default value is NO. Should be set before the cache is used.
+ */
+@property (nonatomic, getter=isSegmented) BOOL segmented;
+
+/*! Default time to live for the objects, in seconds. Expired objects are never returned and are evicted lazily. Default value is 0 which means that objects never expire.
+ */
+@property (nonatomic) NSTimeInterval timeToLive;
+
+/*! Block that is called after objects are evicted. Called on the thread that triggered the eviction, without holding cache locks.
+ */
+@property (nullable, atomic, copy) void (^evictionHandler)(id key, id object, DFMemoryCacheEvictionReason reason);
+
+/*! Returns total cost of the objects in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+/*! Returns number of objects in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/*! Sets the object for the given key with a time to live that overrides timeToLive property. Time to live of 0 means that object never expires.
+ */
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost timeToLive:(NSTimeInterval)timeToLive;
+
+/*! Returns YES if the cache contains an object for the given key that hasn't expired. Unlike objectForKey: doesn't count as an access, the object is neither moved in the recency list nor promoted to the protected segment.
+ */
+- (BOOL)containsObjectForKey:(id)key;
+
+/*! Evicts all expired objects.
+ */
+- (void)removeExpiredObjects;
+
+@end
+
+NS_ASSUME_NONNULL_END
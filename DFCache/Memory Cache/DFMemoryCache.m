@@ -0,0 +1,462 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFMemoryCache.h"
+#import <pthread.h>
+
+/*! Fraction of the limits that protected segment can occupy in segmented mode.
+ */
+static const double DFMemoryCacheProtectedRatio = 0.8;
+
+@interface _DFMemoryCacheEntry : NSObject {
+    @package
+    id _key;
+    id _object;
+    NSUInteger _cost;
+    CFAbsoluteTime _expirationDate;
+    /*! Value of the cache access clock at the last access, orders entries across stripes.
+     */
+    uint64_t _accessStamp;
+    BOOL _protected;
+    _DFMemoryCacheEntry *__unsafe_unretained _prev;
+    _DFMemoryCacheEntry *__unsafe_unretained _next;
+}
+
+@end
+
+@implementation _DFMemoryCacheEntry
+
+@end
+
+
+/*! Part of the cache guarded by its own lock. Entries are retained by the map, lists don't retain them. Head of each list is the most recently used entry.
+ */
+@interface _DFMemoryCacheStripe : NSObject {
+    @package
+    pthread_mutex_t _mutex;
+    NSMapTable *_map;
+    _DFMemoryCacheEntry *__unsafe_unretained _probationHead;
+    _DFMemoryCacheEntry *__unsafe_unretained _probationTail;
+    _DFMemoryCacheEntry *__unsafe_unretained _protectedHead;
+    _DFMemoryCacheEntry *__unsafe_unretained _protectedTail;
+    NSUInteger _protectedCount;
+    NSUInteger _protectedCost;
+}
+
+@end
+
+@implementation _DFMemoryCacheStripe
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        pthread_mutex_init(&_mutex, NULL);
+        _map = [NSMapTable strongToStrongObjectsMapTable];
+    }
+    return self;
+}
+
+- (void)_insertEntry:(_DFMemoryCacheEntry *)entry protected:(BOOL)protected {
+    entry->_protected = protected;
+    entry->_prev = nil;
+    if (protected) {
+        entry->_next = _protectedHead;
+        if (_protectedHead) {
+            _protectedHead->_prev = entry;
+        } else {
+            _protectedTail = entry;
+        }
+        _protectedHead = entry;
+        _protectedCount++;
+        _protectedCost += entry->_cost;
+    } else {
+        entry->_next = _probationHead;
+        if (_probationHead) {
+            _probationHead->_prev = entry;
+        } else {
+            _probationTail = entry;
+        }
+        _probationHead = entry;
+    }
+}
+
+- (void)_unlinkEntry:(_DFMemoryCacheEntry *)entry {
+    if (entry->_prev) {
+        entry->_prev->_next = entry->_next;
+    } else if (entry->_protected) {
+        _protectedHead = entry->_next;
+    } else {
+        _probationHead = entry->_next;
+    }
+    if (entry->_next) {
+        entry->_next->_prev = entry->_prev;
+    } else if (entry->_protected) {
+        _protectedTail = entry->_prev;
+    } else {
+        _probationTail = entry->_prev;
+    }
+    if (entry->_protected) {
+        _protectedCount--;
+        _protectedCost -= entry->_cost;
+    }
+    entry->_prev = nil;
+    entry->_next = nil;
+}
+
+/*! Moves entry to the head of its list, in segmented mode promotes probationary entries to protected segment and demotes the least recently used protected entries that don't fit into given limits (0 means no limit).
+ */
+- (void)_touchEntry:(_DFMemoryCacheEntry *)entry segmented:(BOOL)segmented protectedCountLimit:(NSUInteger)countLimit protectedCostLimit:(NSUInteger)costLimit {
+    BOOL protected = entry->_protected || segmented;
+    [self _unlinkEntry:entry];
+    [self _insertEntry:entry protected:protected];
+    if (segmented) {
+        while (_protectedTail != entry && ((countLimit && _protectedCount > countLimit) || (costLimit && _protectedCost > costLimit))) {
+            _DFMemoryCacheEntry *demoted = _protectedTail;
+            [self _unlinkEntry:demoted];
+            [self _insertEntry:demoted protected:NO];
+        }
+    }
+}
+
+- (void)_removeEntry:(_DFMemoryCacheEntry *)entry {
+    [self _unlinkEntry:entry];
+    [_map removeObjectForKey:entry->_key];
+}
+
+- (_DFMemoryCacheEntry *)_victim {
+    return _probationTail ?: _protectedTail;
+}
+
+@end
+
+
+@implementation DFMemoryCache {
+    NSArray *_stripes;
+    NSUInteger _stripeMask;
+
+    /*! Guards totals and limits. Always acquired after the stripe lock, never before.
+     */
+    pthread_mutex_t _totalsMutex;
+    NSUInteger _totalCost;
+    NSUInteger _count;
+    NSUInteger _totalCostLimit;
+    NSUInteger _countLimit;
+
+    /*! Logical clock incremented atomically on each access.
+     */
+    uint64_t _clock;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_totalsMutex);
+}
+
+- (instancetype)init {
+    return [self initWithStripeCount:8];
+}
+
+- (instancetype)initWithStripeCount:(NSUInteger)stripeCount {
+    if (self = [super init]) {
+        NSUInteger count = 1;
+        while (count < stripeCount) {
+            count <<= 1;
+        }
+        NSMutableArray *stripes = [NSMutableArray new];
+        for (NSUInteger i = 0; i < count; i++) {
+            [stripes addObject:[_DFMemoryCacheStripe new]];
+        }
+        _stripes = [stripes copy];
+        _stripeMask = count - 1;
+        pthread_mutex_init(&_totalsMutex, NULL);
+    }
+    return self;
+}
+
+- (NSUInteger)stripeCount {
+    return _stripes.count;
+}
+
+- (_DFMemoryCacheStripe *)_stripeForKey:(id)key {
+    NSUInteger hash = [key hash];
+    hash ^= hash >> 16;
+    return _stripes[(hash * 0x9E3779B1) >> 7 & _stripeMask];
+}
+
+- (uint64_t)_tick {
+    return __atomic_add_fetch(&_clock, 1, __ATOMIC_RELAXED);
+}
+
+- (void)_addCost:(NSInteger)cost count:(NSInteger)count {
+    pthread_mutex_lock(&_totalsMutex);
+    _totalCost += cost;
+    _count += count;
+    pthread_mutex_unlock(&_totalsMutex);
+}
+
+#pragma mark - NSCache
+
+- (id)objectForKey:(id)key {
+    if (!key) {
+        return nil;
+    }
+    // Limits are guarded by the totals lock, they are read before the stripe lock is taken.
+    NSUInteger protectedCountLimit = 0, protectedCostLimit = 0;
+    if (_segmented) {
+        NSUInteger stripeCount = _stripes.count;
+        protectedCountLimit = self.countLimit * DFMemoryCacheProtectedRatio / stripeCount;
+        protectedCostLimit = self.totalCostLimit * DFMemoryCacheProtectedRatio / stripeCount;
+    }
+    _DFMemoryCacheStripe *stripe = [self _stripeForKey:key];
+    pthread_mutex_lock(&stripe->_mutex);
+    _DFMemoryCacheEntry *entry = [stripe->_map objectForKey:key];
+    _DFMemoryCacheEntry *expiredEntry;
+    if (entry) {
+        if (entry->_expirationDate && CFAbsoluteTimeGetCurrent() >= entry->_expirationDate) {
+            expiredEntry = entry;
+            entry = nil;
+            [stripe _removeEntry:expiredEntry];
+        } else {
+            entry->_accessStamp = [self _tick];
+            if (_segmented) {
+                [stripe _touchEntry:entry segmented:YES protectedCountLimit:protectedCountLimit protectedCostLimit:protectedCostLimit];
+            } else {
+                [stripe _touchEntry:entry segmented:NO protectedCountLimit:0 protectedCostLimit:0];
+            }
+        }
+    }
+    id object = entry ? entry->_object : nil;
+    pthread_mutex_unlock(&stripe->_mutex);
+    if (expiredEntry) {
+        [self _addCost:-(NSInteger)expiredEntry->_cost count:-1];
+        [self _didEvictEntries:@[expiredEntry] reason:DFMemoryCacheEvictionReasonExpired];
+    }
+    return object;
+}
+
+- (BOOL)containsObjectForKey:(id)key {
+    if (!key) {
+        return NO;
+    }
+    _DFMemoryCacheStripe *stripe = [self _stripeForKey:key];
+    pthread_mutex_lock(&stripe->_mutex);
+    _DFMemoryCacheEntry *entry = [stripe->_map objectForKey:key];
+    BOOL contains = entry && !(entry->_expirationDate && CFAbsoluteTimeGetCurrent() >= entry->_expirationDate);
+    pthread_mutex_unlock(&stripe->_mutex);
+    return contains;
+}
+
+- (void)setObject:(id)obj forKey:(id)key {
+    [self setObject:obj forKey:key cost:0];
+}
+
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost {
+    [self setObject:obj forKey:key cost:cost timeToLive:_timeToLive];
+}
+
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)cost timeToLive:(NSTimeInterval)timeToLive {
+    if (!obj || !key) {
+        return;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    _DFMemoryCacheStripe *stripe = [self _stripeForKey:key];
+    pthread_mutex_lock(&stripe->_mutex);
+    _DFMemoryCacheEntry *entry = [stripe->_map objectForKey:key];
+    NSInteger costDelta = cost;
+    NSInteger countDelta = 0;
+    if (entry) {
+        costDelta -= entry->_cost;
+        [stripe _unlinkEntry:entry];
+        entry->_cost = cost;
+        [stripe _insertEntry:entry protected:entry->_protected];
+    } else {
+        entry = [_DFMemoryCacheEntry new];
+        entry->_key = [key conformsToProtocol:@protocol(NSCopying)] ? [key copy] : key;
+        [stripe->_map setObject:entry forKey:entry->_key];
+        [stripe _insertEntry:entry protected:NO];
+        countDelta = 1;
+    }
+    entry->_object = obj;
+    entry->_cost = cost;
+    entry->_accessStamp = [self _tick];
+    entry->_expirationDate = timeToLive > 0 ? now + timeToLive : 0;
+    pthread_mutex_unlock(&stripe->_mutex);
+    [self _addCost:costDelta count:countDelta];
+    [self _trimToLimits];
+}
+
+- (void)removeObjectForKey:(id)key {
+    if (!key) {
+        return;
+    }
+    _DFMemoryCacheStripe *stripe = [self _stripeForKey:key];
+    pthread_mutex_lock(&stripe->_mutex);
+    _DFMemoryCacheEntry *entry = [stripe->_map objectForKey:key];
+    if (entry) {
+        [stripe _removeEntry:entry];
+    }
+    pthread_mutex_unlock(&stripe->_mutex);
+    if (entry) {
+        [self _addCost:-(NSInteger)entry->_cost count:-1];
+    }
+}
+
+- (void)removeAllObjects {
+    for (_DFMemoryCacheStripe *stripe in _stripes) {
+        NSUInteger cost = 0;
+        pthread_mutex_lock(&stripe->_mutex);
+        for (_DFMemoryCacheEntry *entry in [[stripe->_map objectEnumerator] allObjects]) {
+            cost += entry->_cost;
+        }
+        NSUInteger count = stripe->_map.count;
+        NSMapTable *map = stripe->_map;
+        stripe->_map = [NSMapTable strongToStrongObjectsMapTable];
+        stripe->_probationHead = stripe->_probationTail = nil;
+        stripe->_protectedHead = stripe->_protectedTail = nil;
+        stripe->_protectedCount = 0;
+        stripe->_protectedCost = 0;
+        pthread_mutex_unlock(&stripe->_mutex);
+        [self _addCost:-(NSInteger)cost count:-(NSInteger)count];
+        // Objects are released without holding the lock.
+        [map removeAllObjects];
+    }
+}
+
+- (NSUInteger)totalCostLimit {
+    pthread_mutex_lock(&_totalsMutex);
+    NSUInteger limit = _totalCostLimit;
+    pthread_mutex_unlock(&_totalsMutex);
+    return limit;
+}
+
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit {
+    pthread_mutex_lock(&_totalsMutex);
+    _totalCostLimit = totalCostLimit;
+    pthread_mutex_unlock(&_totalsMutex);
+    [self _trimToLimits];
+}
+
+- (NSUInteger)countLimit {
+    pthread_mutex_lock(&_totalsMutex);
+    NSUInteger limit = _countLimit;
+    pthread_mutex_unlock(&_totalsMutex);
+    return limit;
+}
+
+- (void)setCountLimit:(NSUInteger)countLimit {
+    pthread_mutex_lock(&_totalsMutex);
+    _countLimit = countLimit;
+    pthread_mutex_unlock(&_totalsMutex);
+    [self _trimToLimits];
+}
+
+- (NSUInteger)totalCost {
+    pthread_mutex_lock(&_totalsMutex);
+    NSUInteger totalCost = _totalCost;
+    pthread_mutex_unlock(&_totalsMutex);
+    return totalCost;
+}
+
+- (NSUInteger)count {
+    pthread_mutex_lock(&_totalsMutex);
+    NSUInteger count = _count;
+    pthread_mutex_unlock(&_totalsMutex);
+    return count;
+}
+
+#pragma mark - Eviction
+
+- (BOOL)_exceedsLimits {
+    pthread_mutex_lock(&_totalsMutex);
+    BOOL exceeds = (_totalCostLimit && _totalCost > _totalCostLimit) || (_countLimit && _count > _countLimit);
+    pthread_mutex_unlock(&_totalsMutex);
+    return exceeds;
+}
+
+/*! Evicts the least recently used entries among stripe victims until totals fit into limits. Probationary entries are evicted before protected ones.
+ */
+- (void)_trimToLimits {
+    NSMutableArray *evictedEntries;
+    while ([self _exceedsLimits]) {
+        _DFMemoryCacheStripe *victimStripe;
+        BOOL victimProtected = YES;
+        uint64_t victimAccessStamp = UINT64_MAX;
+        for (_DFMemoryCacheStripe *stripe in _stripes) {
+            pthread_mutex_lock(&stripe->_mutex);
+            _DFMemoryCacheEntry *victim = [stripe _victim];
+            if (victim && ((victimProtected && !victim->_protected) || (victimProtected == victim->_protected && victim->_accessStamp < victimAccessStamp))) {
+                victimProtected = victim->_protected;
+                victimAccessStamp = victim->_accessStamp;
+                victimStripe = stripe;
+            }
+            pthread_mutex_unlock(&stripe->_mutex);
+        }
+        if (!victimStripe) {
+            break;
+        }
+        pthread_mutex_lock(&victimStripe->_mutex);
+        _DFMemoryCacheEntry *victim = [victimStripe _victim];
+        if (victim) {
+            [victimStripe _removeEntry:victim];
+        }
+        pthread_mutex_unlock(&victimStripe->_mutex);
+        if (victim) {
+            [self _addCost:-(NSInteger)victim->_cost count:-1];
+            if (!evictedEntries) {
+                evictedEntries = [NSMutableArray new];
+            }
+            [evictedEntries addObject:victim];
+        }
+    }
+    if (evictedEntries) {
+        [self _didEvictEntries:evictedEntries reason:DFMemoryCacheEvictionReasonLimit];
+    }
+}
+
+- (void)removeExpiredObjects {
+    NSMutableArray *expiredEntries = [NSMutableArray new];
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    for (_DFMemoryCacheStripe *stripe in _stripes) {
+        NSUInteger cost = 0;
+        NSUInteger count = 0;
+        pthread_mutex_lock(&stripe->_mutex);
+        for (_DFMemoryCacheEntry *entry in [[stripe->_map objectEnumerator] allObjects]) {
+            if (entry->_expirationDate && now >= entry->_expirationDate) {
+                [stripe _removeEntry:entry];
+                [expiredEntries addObject:entry];
+                cost += entry->_cost;
+                count++;
+            }
+        }
+        pthread_mutex_unlock(&stripe->_mutex);
+        [self _addCost:-(NSInteger)cost count:-(NSInteger)count];
+    }
+    if (expiredEntries.count) {
+        [self _didEvictEntries:expiredEntries reason:DFMemoryCacheEvictionReasonExpired];
+    }
+}
+
+- (void)_didEvictEntries:(NSArray *)entries reason:(DFMemoryCacheEvictionReason)reason {
+    id<NSCacheDelegate> delegate = self.delegate;
+    BOOL notifiesDelegate = [delegate respondsToSelector:@selector(cache:willEvictObject:)];
+    void (^handler)(id, id, DFMemoryCacheEvictionReason) = self.evictionHandler;
+    for (_DFMemoryCacheEntry *entry in entries) {
+        if (notifiesDelegate) {
+            [delegate cache:self willEvictObject:entry->_object];
+        }
+        if (handler) {
+            handler(entry->_key, entry->_object, reason);
+        }
+    }
+}
+
+#pragma mark - Miscellaneous
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> { name = %@; count = %lu/%lu; total_cost = %lu/%lu; stripes = %lu }", [self class], self, self.name, (unsigned long)self.count, (unsigned long)self.countLimit, (unsigned long)self.totalCost, (unsigned long)self.totalCostLimit, (unsigned long)_stripes.count];
+}
+
+@end
@@ -0,0 +1,34 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Count-min sketch that estimates access frequencies of the keys in a fixed amount of memory. Counters saturate at 15. Sketch ages periodically: once the number of increments reaches the sample size all counters are halved, so that the sketch reflects recent popularity.
+ @note Sketch is not thread-safe.
+ */
+@interface DFCacheFrequencySketch : NSObject
+
+/*! Initializes sketch with a number of counters per row (rounded up to the power of two) and 4 rows.
+ */
+- (instancetype)initWithWidth:(NSUInteger)width NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init;
+
+/*! Number of increments after which counters are halved. Default value is 10 * width.
+ */
+@property (nonatomic) NSUInteger sampleSize;
+
+- (void)incrementHash:(uint64_t)hash;
+- (NSUInteger)frequencyForHash:(uint64_t)hash;
+- (void)removeAllCounts;
+
+/*! Returns hash of the given string to be used with the sketch.
+ */
++ (uint64_t)hashForString:(NSString *)string;
+
+@end
+
+NS_ASSUME_NONNULL_END
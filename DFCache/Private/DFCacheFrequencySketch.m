@@ -0,0 +1,95 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCacheFrequencySketch.h"
+
+static const NSUInteger DFCacheFrequencySketchDepth = 4;
+static const uint8_t DFCacheFrequencySketchMaxCount = 15;
+
+static const uint64_t DFCacheFrequencySketchSeeds[DFCacheFrequencySketchDepth] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+};
+
+static inline uint64_t
+_DFSketchMix(uint64_t hash, uint64_t seed) {
+    hash = (hash ^ seed) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+@implementation DFCacheFrequencySketch {
+    uint8_t *_counters;
+    NSUInteger _width;
+    NSUInteger _additions;
+}
+
+- (void)dealloc {
+    free(_counters);
+}
+
+- (instancetype)initWithWidth:(NSUInteger)width {
+    if (self = [super init]) {
+        _width = 16;
+        while (_width < width) {
+            _width <<= 1;
+        }
+        _counters = calloc(_width * DFCacheFrequencySketchDepth, sizeof(uint8_t));
+        _sampleSize = 10 * _width;
+    }
+    return self;
+}
+
+- (instancetype)init {
+    return [self initWithWidth:4096];
+}
+
+- (void)incrementHash:(uint64_t)hash {
+    BOOL incremented = NO;
+    for (NSUInteger row = 0; row < DFCacheFrequencySketchDepth; row++) {
+        uint8_t *counter = &_counters[row * _width + (_DFSketchMix(hash, DFCacheFrequencySketchSeeds[row]) & (_width - 1))];
+        if (*counter < DFCacheFrequencySketchMaxCount) {
+            (*counter)++;
+            incremented = YES;
+        }
+    }
+    if (incremented && ++_additions >= _sampleSize) {
+        [self _age];
+    }
+}
+
+- (NSUInteger)frequencyForHash:(uint64_t)hash {
+    uint8_t frequency = DFCacheFrequencySketchMaxCount;
+    for (NSUInteger row = 0; row < DFCacheFrequencySketchDepth; row++) {
+        frequency = MIN(frequency, _counters[row * _width + (_DFSketchMix(hash, DFCacheFrequencySketchSeeds[row]) & (_width - 1))]);
+    }
+    return frequency;
+}
+
+- (void)_age {
+    for (NSUInteger i = 0; i < _width * DFCacheFrequencySketchDepth; i++) {
+        _counters[i] >>= 1;
+    }
+    _additions /= 2;
+}
+
+- (void)removeAllCounts {
+    memset(_counters, 0, _width * DFCacheFrequencySketchDepth);
+    _additions = 0;
+}
+
++ (uint64_t)hashForString:(NSString *)string {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    unichar buffer[64];
+    NSUInteger length = string.length;
+    for (NSUInteger location = 0; location < length; location += 64) {
+        NSRange range = NSMakeRange(location, MIN(64, length - location));
+        [string getCharacters:buffer range:range];
+        for (NSUInteger i = 0; i < range.length; i++) {
+            hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+@end
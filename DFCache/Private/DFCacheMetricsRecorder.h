@@ -0,0 +1,99 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+#import "DFCacheMetrics.h"
+#import "DFDiskCache.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+enum {
+    DFCacheOperationCount = DFCacheOperationCleanup + 1,
+    /*! Durations below 16 ns are recorded exactly, each of the following power of two ranges is split into 16 sub-buckets.
+     */
+    DFCacheLatencyBucketCount = 16 + (64 - 4) * 16
+};
+
+/*! Returns index of the histogram bucket for the given duration, in nanoseconds.
+ */
+static inline NSUInteger
+_dwarf_cache_latency_bucket(uint64_t duration) {
+    if (duration < 16) {
+        return (NSUInteger)duration;
+    }
+    const unsigned shift = 63 - __builtin_clzll(duration) - 4;
+    return 16 + shift * 16 + (NSUInteger)((duration >> shift) - 16);
+}
+
+/*! Returns the largest duration that falls into the given histogram bucket, in nanoseconds.
+ */
+static inline uint64_t
+_dwarf_cache_latency_bucket_upper_bound(NSUInteger bucket) {
+    if (bucket < 16) {
+        return bucket;
+    }
+    const NSUInteger shift = (bucket - 16) / 16;
+    const uint64_t subBucket = 16 + (bucket - 16) % 16;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+
+@interface DFCacheLatencyHistogram ()
+
+/*! Initializes histogram with the given bucket counts and the minimum and maximum durations, in nanoseconds.
+ */
+- (instancetype)initWithBuckets:(const uint64_t *)buckets count:(uint64_t)count totalDuration:(uint64_t)totalDuration minimumDuration:(uint64_t)minimumDuration maximumDuration:(uint64_t)maximumDuration NS_DESIGNATED_INITIALIZER;
+
+@end
+
+
+@interface DFCacheMetrics ()
+
+- (instancetype)initWithDuration:(NSTimeInterval)duration histograms:(NSArray<DFCacheLatencyHistogram *> *)histograms NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readwrite) uint64_t memoryHitCount;
+@property (nonatomic, readwrite) uint64_t diskHitCount;
+@property (nonatomic, readwrite) uint64_t missCount;
+@property (nonatomic, readwrite) uint64_t expiredCount;
+@property (nonatomic, readwrite) unsigned long long expiredSize;
+@property (nonatomic, readwrite) uint64_t evictedCount;
+@property (nonatomic, readwrite) unsigned long long evictedSize;
+@property (nonatomic, readwrite) NSUInteger ioQueueDepth;
+@property (nonatomic, readwrite) NSUInteger maximumIOQueueDepth;
+
+@end
+
+
+/*! Records cache metrics. Counters and histograms are updated using relaxed atomic operations, recording never takes locks.
+ */
+@interface DFCacheMetricsRecorder : NSObject
+
+/*! Records duration of the operation that started at the given time (see _dwarf_cache_time).
+ */
+- (void)recordOperation:(DFCacheOperation)operation startTime:(uint64_t)startTime;
+
+/*! Records duration of the operation, in nanoseconds.
+ */
+- (void)recordOperation:(DFCacheOperation)operation duration:(uint64_t)duration;
+
+- (void)recordMemoryHit;
+- (void)recordDiskHit;
+- (void)recordMiss;
+- (void)recordCleanupStatistics:(DFDiskCacheCleanupStatistics)statistics;
+
+/*! Returns block that records IO queue wait and depth around the given block. IO queue depth is incremented immediately, returned block must be dispatched to the IO queue.
+ */
+- (dispatch_block_t)IOQueueBlockWithBlock:(dispatch_block_t)block;
+
+/*! Returns snapshot of the metrics.
+ */
+- (DFCacheMetrics *)metrics;
+
+/*! Resets counters and histograms. IO queue depth of the operations that are in progress is preserved.
+ */
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
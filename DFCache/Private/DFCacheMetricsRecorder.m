@@ -0,0 +1,165 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCacheMetricsRecorder.h"
+#import "DFCachePrivate.h"
+#import <stdatomic.h>
+
+typedef struct {
+    _Atomic(uint64_t) count;
+    _Atomic(uint64_t) total;
+    _Atomic(uint64_t) minimum;
+    _Atomic(uint64_t) maximum;
+    _Atomic(uint64_t) buckets[DFCacheLatencyBucketCount];
+} _DFCacheLatencyHistogramStorage;
+
+typedef struct {
+    _Atomic(uint64_t) memoryHitCount;
+    _Atomic(uint64_t) diskHitCount;
+    _Atomic(uint64_t) missCount;
+    _Atomic(uint64_t) expiredCount;
+    _Atomic(uint64_t) expiredSize;
+    _Atomic(uint64_t) evictedCount;
+    _Atomic(uint64_t) evictedSize;
+    _Atomic(uint64_t) ioQueueDepth;
+    _Atomic(uint64_t) maximumIOQueueDepth;
+    _Atomic(uint64_t) startTime;
+    _DFCacheLatencyHistogramStorage histograms[DFCacheOperationCount];
+} _DFCacheMetricsStorage;
+
+static inline void
+_DFCacheAtomicIncrement(_Atomic(uint64_t) *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static inline uint64_t
+_DFCacheAtomicLoad(_Atomic(uint64_t) *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static inline void
+_DFCacheAtomicMin(_Atomic(uint64_t) *counter, uint64_t value) {
+    uint64_t current = _DFCacheAtomicLoad(counter);
+    while (value < current && !atomic_compare_exchange_weak_explicit(counter, &current, value, memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+static inline void
+_DFCacheAtomicMax(_Atomic(uint64_t) *counter, uint64_t value) {
+    uint64_t current = _DFCacheAtomicLoad(counter);
+    while (value > current && !atomic_compare_exchange_weak_explicit(counter, &current, value, memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+@implementation DFCacheMetricsRecorder {
+    /*! Counters and histograms are kept in a C structure that is allocated when recorder is created.
+     */
+    _DFCacheMetricsStorage *_storage;
+}
+
+- (void)dealloc {
+    free(_storage);
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _storage = calloc(1, sizeof(_DFCacheMetricsStorage));
+        [self reset];
+    }
+    return self;
+}
+
+- (void)recordOperation:(DFCacheOperation)operation startTime:(uint64_t)startTime {
+    [self recordOperation:operation duration:_dwarf_cache_time() - startTime];
+}
+
+- (void)recordOperation:(DFCacheOperation)operation duration:(uint64_t)duration {
+    _DFCacheLatencyHistogramStorage *histogram = &_storage->histograms[operation];
+    _DFCacheAtomicIncrement(&histogram->buckets[_dwarf_cache_latency_bucket(duration)], 1);
+    _DFCacheAtomicIncrement(&histogram->total, duration);
+    _DFCacheAtomicMin(&histogram->minimum, duration);
+    _DFCacheAtomicMax(&histogram->maximum, duration);
+    _DFCacheAtomicIncrement(&histogram->count, 1);
+}
+
+- (void)recordMemoryHit {
+    _DFCacheAtomicIncrement(&_storage->memoryHitCount, 1);
+}
+
+- (void)recordDiskHit {
+    _DFCacheAtomicIncrement(&_storage->diskHitCount, 1);
+}
+
+- (void)recordMiss {
+    _DFCacheAtomicIncrement(&_storage->missCount, 1);
+}
+
+- (void)recordCleanupStatistics:(DFDiskCacheCleanupStatistics)statistics {
+    if (statistics.expiredCount) {
+        _DFCacheAtomicIncrement(&_storage->expiredCount, statistics.expiredCount);
+        _DFCacheAtomicIncrement(&_storage->expiredSize, statistics.expiredSize);
+    }
+    if (statistics.evictedCount) {
+        _DFCacheAtomicIncrement(&_storage->evictedCount, statistics.evictedCount);
+        _DFCacheAtomicIncrement(&_storage->evictedSize, statistics.evictedSize);
+    }
+}
+
+- (dispatch_block_t)IOQueueBlockWithBlock:(dispatch_block_t)block {
+    const uint64_t depth = atomic_fetch_add_explicit(&_storage->ioQueueDepth, 1, memory_order_relaxed) + 1;
+    _DFCacheAtomicMax(&_storage->maximumIOQueueDepth, depth);
+    const uint64_t enqueueTime = _dwarf_cache_time();
+    return ^{
+        [self recordOperation:DFCacheOperationIOQueueWait startTime:enqueueTime];
+        block();
+        atomic_fetch_sub_explicit(&_storage->ioQueueDepth, 1, memory_order_relaxed);
+    };
+}
+
+- (DFCacheMetrics *)metrics {
+    NSMutableArray *histograms = [[NSMutableArray alloc] initWithCapacity:DFCacheOperationCount];
+    uint64_t *buckets = malloc(sizeof(uint64_t) * DFCacheLatencyBucketCount);
+    for (NSUInteger operation = 0; operation < DFCacheOperationCount; operation++) {
+        _DFCacheLatencyHistogramStorage *histogram = &_storage->histograms[operation];
+        for (NSUInteger i = 0; i < DFCacheLatencyBucketCount; i++) {
+            buckets[i] = _DFCacheAtomicLoad(&histogram->buckets[i]);
+        }
+        [histograms addObject:[[DFCacheLatencyHistogram alloc] initWithBuckets:buckets count:_DFCacheAtomicLoad(&histogram->count) totalDuration:_DFCacheAtomicLoad(&histogram->total) minimumDuration:_DFCacheAtomicLoad(&histogram->minimum) maximumDuration:_DFCacheAtomicLoad(&histogram->maximum)]];
+    }
+    free(buckets);
+    const uint64_t duration = _dwarf_cache_time() - _DFCacheAtomicLoad(&_storage->startTime);
+    DFCacheMetrics *metrics = [[DFCacheMetrics alloc] initWithDuration:duration / 1e9 histograms:histograms];
+    metrics.memoryHitCount = _DFCacheAtomicLoad(&_storage->memoryHitCount);
+    metrics.diskHitCount = _DFCacheAtomicLoad(&_storage->diskHitCount);
+    metrics.missCount = _DFCacheAtomicLoad(&_storage->missCount);
+    metrics.expiredCount = _DFCacheAtomicLoad(&_storage->expiredCount);
+    metrics.expiredSize = _DFCacheAtomicLoad(&_storage->expiredSize);
+    metrics.evictedCount = _DFCacheAtomicLoad(&_storage->evictedCount);
+    metrics.evictedSize = _DFCacheAtomicLoad(&_storage->evictedSize);
+    metrics.ioQueueDepth = (NSUInteger)_DFCacheAtomicLoad(&_storage->ioQueueDepth);
+    metrics.maximumIOQueueDepth = (NSUInteger)_DFCacheAtomicLoad(&_storage->maximumIOQueueDepth);
+    return metrics;
+}
+
+- (void)reset {
+    atomic_store_explicit(&_storage->memoryHitCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->diskHitCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->missCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->expiredCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->expiredSize, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->evictedCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->evictedSize, 0, memory_order_relaxed);
+    atomic_store_explicit(&_storage->maximumIOQueueDepth, _DFCacheAtomicLoad(&_storage->ioQueueDepth), memory_order_relaxed);
+    for (NSUInteger operation = 0; operation < DFCacheOperationCount; operation++) {
+        _DFCacheLatencyHistogramStorage *histogram = &_storage->histograms[operation];
+        atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&histogram->total, 0, memory_order_relaxed);
+        atomic_store_explicit(&histogram->minimum, UINT64_MAX, memory_order_relaxed);
+        atomic_store_explicit(&histogram->maximum, 0, memory_order_relaxed);
+        for (NSUInteger i = 0; i < DFCacheLatencyBucketCount; i++) {
+            atomic_store_explicit(&histogram->buckets[i], 0, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&_storage->startTime, _dwarf_cache_time(), memory_order_relaxed);
+}
+
+@end
@@ -4,6 +4,10 @@
 
 #import <Foundation/Foundation.h>
 
+#pragma mark - Types -
+
+typedef unsigned long long _dwarf_cache_bytes;
+
 #pragma mark - Functions -
 
 static inline void
@@ -21,11 +25,94 @@ _dwarf_cache_callback(void (^block)(id), id object) {
 extern NSString *
 _dwarf_cache_sha1(const char *data, uint32_t length);
 
+/*! Length of the file names produced by _dwarf_cache_sha1 function.
+ */
+static const NSUInteger _dwarf_cache_sha1_length = 40;
+
+/*! Produces 128-bit hash value using non-cryptographic MurmurHash3 (x64, 128-bit variant, seed 0). Much faster than SHA-1 for short keys.
+ */
+extern void
+_dwarf_cache_murmur3_128(const void *data, size_t length, uint8_t hash[16]);
+
+/*! Produces 128-bit MurmurHash3 hash value.
+ @return String containing 128-bit hash value expressed as a 32 digit hexadecimal number.
+ */
+extern NSString *
+_dwarf_cache_murmur3(const char *data, uint32_t length);
+
+/*! Length of the file names produced by _dwarf_cache_murmur3 function.
+ */
+static const NSUInteger _dwarf_cache_murmur3_length = 32;
+
+/*! Returns lowercase hexadecimal representation of the given bytes.
+ */
+extern NSString *
+_dwarf_cache_hex_string(const uint8_t *bytes, size_t length);
+
+/*! Retrieves number of bytes allocated for the file at the given path.
+ @return NO if the file doesn't exist.
+ */
+extern BOOL
+_dwarf_cache_allocated_size(NSString *path, _dwarf_cache_bytes *size);
+
+/*! Atomically moves the file to the given path, creates missing intermediate directories of the destination path. Existing file at the destination path is replaced.
+ @return NO if the file can't be moved.
+ */
+extern BOOL
+_dwarf_cache_move_item(NSString *fromPath, NSString *toPath);
+
+/*! Creates hidden temporary file in the directory of the given path (e.g. ".<name>.XXXXXX") that is later renamed to the given path. Missing intermediate directories are created. Temporary files are never picked up by storage directory scans.
+ @param temporaryPath On return contains path of the created file.
+ @return File descriptor opened for writing or -1 if the file can't be created.
+ */
+extern int
+_dwarf_cache_make_temporary_file(NSString *path, NSString *__autoreleasing *temporaryPath);
+
+/*! Returns YES if the file name has the format of the temporary files created by _dwarf_cache_make_temporary_file. Hidden files of the storage itself (".df_*") never match.
+ */
+extern BOOL
+_dwarf_cache_is_temporary_filename(NSString *filename);
+
+/*! Writes file contents and metadata to stable storage.
+ @param barrier If YES, also flushes the drive cache (F_FULLFSYNC) where supported. Barrier applies to all previously synchronized files, so a group of files needs only one.
+ */
+extern BOOL
+_dwarf_cache_fsync(int fd, BOOL barrier);
+
+/*! Opens the file or directory at the given path and writes it to stable storage. Directories are synchronized to persist created, renamed and removed files.
+ */
+extern BOOL
+_dwarf_cache_fsync_path(NSString *path, BOOL barrier);
+
+/*! Returns monotonic time in nanoseconds. Used to measure durations of the cache operations.
+ */
+extern uint64_t
+_dwarf_cache_time(void);
+
+/*! Initial value of the FNV-1a checksum.
+ */
+static const uint32_t _dwarf_cache_checksum_seed = 2166136261u;
+
+/*! Continues 32-bit FNV-1a checksum with the given bytes, so that the checksum of the data can be computed chunk by chunk.
+ */
+static inline uint32_t
+_dwarf_cache_checksum_update(uint32_t hash, const void *bytes, size_t length) {
+    const uint8_t *data = bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*! Computes 32-bit FNV-1a checksum of the given bytes. Used to detect torn and corrupted records.
+ */
+static inline uint32_t
+_dwarf_cache_checksum(const void *bytes, size_t length) {
+    return _dwarf_cache_checksum_update(_dwarf_cache_checksum_seed, bytes, length);
+}
+
 /*! Returns user-friendly string with bytes.
  */
 extern NSString *
 _dwarf_bytes_to_str(unsigned long long bytes);
 
-#pragma mark - Types -
-
-typedef unsigned long long _dwarf_cache_bytes;
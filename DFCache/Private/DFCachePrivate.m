@@ -4,23 +4,183 @@
 
 #import "DFCachePrivate.h"
 #import <CommonCrypto/CommonCrypto.h>
+#import <fcntl.h>
+#import <mach/mach_time.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
 NSString *
-_dwarf_cache_to_string(unsigned char *hash, unsigned int length) {
-    char utf8[2 * length + 1];
-    char *temp = utf8;
-    for (int i = 0; i < length; i++) {
-        snprintf(temp, 3, "%02x", hash[i]);
-        temp += 2;
+_dwarf_cache_hex_string(const uint8_t *bytes, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[2 * length];
+    for (size_t i = 0; i < length; i++) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0x0F];
     }
-    return [NSString stringWithUTF8String:utf8];
+    return [[NSString alloc] initWithBytes:hex length:2 * length encoding:NSASCIIStringEncoding];
 }
 
 NSString *
 _dwarf_cache_sha1(const char *data, uint32_t length) {
     unsigned char hash[CC_SHA1_DIGEST_LENGTH];
     CC_SHA1(data, (CC_LONG)length, hash);
-    return _dwarf_cache_to_string(hash, CC_SHA1_DIGEST_LENGTH);
+    return _dwarf_cache_hex_string(hash, CC_SHA1_DIGEST_LENGTH);
+}
+
+static inline uint64_t
+_dwarf_cache_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+_dwarf_cache_fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline uint64_t
+_dwarf_cache_read64(const uint8_t *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return NSSwapLittleLongLongToHost(value);
+}
+
+void
+_dwarf_cache_murmur3_128(const void *data, size_t length, uint8_t hash[16]) {
+    const uint8_t *bytes = data;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0, h2 = 0;
+    const size_t blockCount = length / 16;
+    for (size_t i = 0; i < blockCount; i++) {
+        uint64_t k1 = _dwarf_cache_read64(bytes + i * 16);
+        uint64_t k2 = _dwarf_cache_read64(bytes + i * 16 + 8);
+        k1 *= c1; k1 = _dwarf_cache_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = _dwarf_cache_rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = _dwarf_cache_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = _dwarf_cache_rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    const uint8_t *tail = bytes + blockCount * 16;
+    const size_t tailLength = length & 15;
+    uint64_t k1 = 0, k2 = 0;
+    for (size_t i = tailLength; i > 8; i--) {
+        k2 = (k2 << 8) | tail[i - 1];
+    }
+    for (size_t i = MIN(tailLength, 8); i > 0; i--) {
+        k1 = (k1 << 8) | tail[i - 1];
+    }
+    if (tailLength > 8) {
+        k2 *= c2; k2 = _dwarf_cache_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (tailLength > 0) {
+        k1 *= c1; k1 = _dwarf_cache_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = _dwarf_cache_fmix64(h1);
+    h2 = _dwarf_cache_fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    h1 = NSSwapHostLongLongToLittle(h1);
+    h2 = NSSwapHostLongLongToLittle(h2);
+    memcpy(hash, &h1, sizeof(h1));
+    memcpy(hash + 8, &h2, sizeof(h2));
+}
+
+NSString *
+_dwarf_cache_murmur3(const char *data, uint32_t length) {
+    uint8_t hash[16];
+    _dwarf_cache_murmur3_128(data, length, hash);
+    return _dwarf_cache_hex_string(hash, sizeof(hash));
+}
+
+BOOL
+_dwarf_cache_allocated_size(NSString *path, _dwarf_cache_bytes *size) {
+    struct stat info;
+    if (lstat(path.fileSystemRepresentation, &info) != 0) {
+        return NO;
+    }
+    *size = (_dwarf_cache_bytes)info.st_blocks * 512;
+    return YES;
+}
+
+BOOL
+_dwarf_cache_move_item(NSString *fromPath, NSString *toPath) {
+    if (rename(fromPath.fileSystemRepresentation, toPath.fileSystemRepresentation) == 0) {
+        return YES;
+    }
+    struct stat info;
+    if (errno != ENOENT || lstat(fromPath.fileSystemRepresentation, &info) != 0) {
+        return NO;
+    }
+    return [[NSFileManager defaultManager] createDirectoryAtPath:[toPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil] && rename(fromPath.fileSystemRepresentation, toPath.fileSystemRepresentation) == 0;
+}
+
+int
+_dwarf_cache_make_temporary_file(NSString *path, NSString *__autoreleasing *temporaryPath) {
+    NSString *directory = [path stringByDeletingLastPathComponent];
+    NSString *templatePath = [directory stringByAppendingPathComponent:[NSString stringWithFormat:@".%@.XXXXXX", [path lastPathComponent]]];
+    char *buffer = strdup(templatePath.fileSystemRepresentation);
+    if (!buffer) {
+        return -1;
+    }
+    int fd = mkstemp(buffer);
+    if (fd < 0 && errno == ENOENT) {
+        // Fanout subdirectories are created lazily.
+        if ([[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil]) {
+            strcpy(buffer, templatePath.fileSystemRepresentation);
+            fd = mkstemp(buffer);
+        }
+    }
+    if (fd >= 0) {
+        *temporaryPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:buffer length:strlen(buffer)];
+    }
+    free(buffer);
+    return fd;
+}
+
+BOOL
+_dwarf_cache_is_temporary_filename(NSString *filename) {
+    const NSUInteger length = filename.length;
+    return length >= 9 && [filename characterAtIndex:0] == '.' && [filename characterAtIndex:length - 7] == '.' && ![filename hasPrefix:@".df_"];
+}
+
+BOOL
+_dwarf_cache_fsync(int fd, BOOL barrier) {
+#ifdef F_FULLFSYNC
+    // fsync on Darwin doesn't flush the drive cache. F_FULLFSYNC isn't supported by some file systems, fsync is used then.
+    if (barrier && fcntl(fd, F_FULLFSYNC) == 0) {
+        return YES;
+    }
+#endif
+    return fsync(fd) == 0;
+}
+
+BOOL
+_dwarf_cache_fsync_path(NSString *path, BOOL barrier) {
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return NO;
+    }
+    BOOL success = _dwarf_cache_fsync(fd, barrier);
+    close(fd);
+    return success;
+}
+
+uint64_t
+_dwarf_cache_time(void) {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom;
 }
 
 NSString *
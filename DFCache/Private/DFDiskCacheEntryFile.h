@@ -0,0 +1,49 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Format of the standalone disk cache entry files. Entry file starts with a compact binary header followed by the entry attributes and data, so that both data and attributes are read with a single read.
+ @discussion Header contains magic, version, attributes length and checksum, data length and checksum, and the checksum of the header itself. Files that don't start with the header magic are legacy files that contain raw data and keep attributes in extended file attributes. Files that start with the magic but have a truncated or invalid header are corrupted.
+ */
+@interface DFDiskCacheEntryFile : NSObject
+
+/*! Atomically writes entry file with the given data and attributes. Header, attributes and data are written to a temporary file which then replaces the entry file.
+ @param synchronize If YES, the temporary file is written to stable storage before it replaces the entry file and the directory is synchronized afterwards. Drive cache is not flushed.
+ */
++ (BOOL)writeData:(NSData *)data attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes toPath:(NSString *)path synchronize:(BOOL)synchronize;
+
+/*! Writes entry file with the given data and attributes to a temporary file in the directory of the given path. The caller renames the temporary file to the given path, e.g. under a lock that has to be held while the entry file is replaced.
+ @param synchronize If YES, the temporary file is written to stable storage.
+ @return Path of the temporary file or nil if the file couldn't be written.
+ */
++ (nullable NSString *)writeTemporaryFileWithData:(NSData *)data attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes forPath:(NSString *)path synchronize:(BOOL)synchronize;
+
+/*! Returns header followed by the encoded attributes for the entry with the given data length and checksum (see _dwarf_cache_checksum). Entry data follows the returned bytes. Length of the returned data depends only on the attributes, so entry file can be written with a placeholder header that is overwritten once the data length and checksum are known.
+ */
++ (NSData *)headerDataWithAttributes:(nullable NSDictionary<NSString *, NSData *> *)attributes dataLength:(unsigned long long)dataLength dataChecksum:(uint32_t)dataChecksum;
+
+/*! Reads the entry file with a single read (or maps it if the file is at least as large as the mapped read threshold, 0 disables mapping). Data checksum is verified for the files that are not mapped.
+ @param legacy On return YES if the file doesn't have a header, the contents of the file are returned as is.
+ @return Entry data or nil if the file doesn't exist or is corrupted.
+ */
++ (nullable NSData *)dataAtPath:(NSString *)path attributes:(NSDictionary<NSString *, NSData *> *_Nullable *_Nullable)attributes mappedReadThreshold:(unsigned long long)mappedReadThreshold legacy:(BOOL *)legacy;
+
+/*! Reads the header of the open entry file and returns offset and length of the entry data in the file without reading the data. Legacy files consist of the data only.
+ @param legacy On return YES if the file doesn't have a header.
+ @return NO if the file can't be read or is corrupted.
+ */
++ (BOOL)getDataOffset:(unsigned long long *)offset length:(unsigned long long *)length fileDescriptor:(int)fd legacy:(BOOL *)legacy;
+
+/*! Reads entry attributes without reading the data.
+ @param legacy On return YES if the file doesn't have a header.
+ @return Entry attributes or nil if the file doesn't exist, is corrupted or is a legacy file.
+ */
++ (nullable NSDictionary<NSString *, NSData *> *)attributesAtPath:(NSString *)path legacy:(BOOL *)legacy;
+
+@end
+
+NS_ASSUME_NONNULL_END
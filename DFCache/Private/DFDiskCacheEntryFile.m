@@ -0,0 +1,280 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCachePrivate.h"
+#import "DFDiskCacheEntryFile.h"
+#import <fcntl.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static const uint32_t DFDiskCacheEntryFileMagic = 0x45434644; // "DFCE"
+static const uint16_t DFDiskCacheEntryFileVersion = 1;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t attributesLength;
+    uint32_t attributesChecksum;
+    uint64_t dataLength;
+    uint32_t dataChecksum;
+    uint32_t checksum; // Checksum of the preceding header fields
+} _DFEntryFileHeader;
+
+#pragma mark - Encoding
+
+static inline void
+_DFEntryFileAppendString(NSMutableData *data, NSString *string) {
+    NSData *utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+    uint16_t length = utf8.length <= UINT16_MAX ? (uint16_t)utf8.length : 0;
+    [data appendBytes:&length length:sizeof(length)];
+    [data appendBytes:utf8.bytes length:length];
+}
+
+/*! Returns header followed by encoded attributes. Length of the header depends only on the attributes.
+ */
+static NSData *
+_DFEntryFileHeaderData(NSDictionary *attributes, unsigned long long dataLength, uint32_t dataChecksum) {
+    NSMutableData *header = [[NSMutableData alloc] initWithLength:sizeof(_DFEntryFileHeader)];
+    uint16_t count = (uint16_t)MIN(attributes.count, UINT16_MAX);
+    [header appendBytes:&count length:sizeof(count)];
+    [attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSData *attribute, BOOL *stop) {
+        uint32_t length = (uint32_t)attribute.length;
+        _DFEntryFileAppendString(header, name);
+        [header appendBytes:&length length:sizeof(length)];
+        [header appendData:attribute];
+    }];
+    _DFEntryFileHeader fields = {0};
+    fields.magic = DFDiskCacheEntryFileMagic;
+    fields.version = DFDiskCacheEntryFileVersion;
+    fields.attributesLength = (uint32_t)(header.length - sizeof(fields));
+    fields.attributesChecksum = _dwarf_cache_checksum((const uint8_t *)header.bytes + sizeof(fields), fields.attributesLength);
+    fields.dataLength = dataLength;
+    fields.dataChecksum = dataChecksum;
+    fields.checksum = _dwarf_cache_checksum(&fields, offsetof(_DFEntryFileHeader, checksum));
+    [header replaceBytesInRange:NSMakeRange(0, sizeof(fields)) withBytes:&fields];
+    return header;
+}
+
+static BOOL
+_DFEntryFileWrite(int fd, const void *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const uint8_t *)bytes + written;
+        length -= written;
+    }
+    return YES;
+}
+
+#pragma mark - Decoding
+
+typedef NS_ENUM(NSInteger, _DFEntryFileHeaderStatus) {
+    _DFEntryFileHeaderValid,
+    /*! File doesn't start with the magic, it was written by the previous versions.
+     */
+    _DFEntryFileHeaderLegacy,
+    /*! File starts with the magic but the header is truncated, fails verification or doesn't match the file length.
+     */
+    _DFEntryFileHeaderCorrupted
+};
+
+/*! Reads and verifies the header.
+ */
+static _DFEntryFileHeaderStatus
+_DFEntryFileReadHeader(const uint8_t *bytes, size_t length, unsigned long long fileLength, _DFEntryFileHeader *header) {
+    uint32_t magic;
+    if (length < sizeof(magic) || (memcpy(&magic, bytes, sizeof(magic)), magic != DFDiskCacheEntryFileMagic)) {
+        return _DFEntryFileHeaderLegacy;
+    }
+    if (length < sizeof(*header)) {
+        return _DFEntryFileHeaderCorrupted;
+    }
+    memcpy(header, bytes, sizeof(*header));
+    BOOL valid = header->version == DFDiskCacheEntryFileVersion &&
+    header->checksum == _dwarf_cache_checksum(header, offsetof(_DFEntryFileHeader, checksum)) &&
+    fileLength == sizeof(*header) + header->attributesLength + header->dataLength;
+    return valid ? _DFEntryFileHeaderValid : _DFEntryFileHeaderCorrupted;
+}
+
+static NSDictionary *
+_DFEntryFileParseAttributes(const uint8_t *bytes, _DFEntryFileHeader header) {
+    if (_dwarf_cache_checksum(bytes, header.attributesLength) != header.attributesChecksum) {
+        return nil;
+    }
+    const uint8_t *end = bytes + header.attributesLength;
+    uint16_t count;
+    if (end - bytes < (ptrdiff_t)sizeof(count)) {
+        return nil;
+    }
+    memcpy(&count, bytes, sizeof(count));
+    bytes += sizeof(count);
+    NSMutableDictionary *attributes = [[NSMutableDictionary alloc] initWithCapacity:count];
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t nameLength;
+        uint32_t length;
+        if (end - bytes < (ptrdiff_t)sizeof(nameLength)) {
+            return nil;
+        }
+        memcpy(&nameLength, bytes, sizeof(nameLength));
+        bytes += sizeof(nameLength);
+        if (end - bytes < (ptrdiff_t)(nameLength + sizeof(length))) {
+            return nil;
+        }
+        NSString *name = [[NSString alloc] initWithBytes:bytes length:nameLength encoding:NSUTF8StringEncoding];
+        bytes += nameLength;
+        memcpy(&length, bytes, sizeof(length));
+        bytes += sizeof(length);
+        if (!name || end - bytes < (ptrdiff_t)length) {
+            return nil;
+        }
+        attributes[name] = [NSData dataWithBytes:bytes length:length];
+        bytes += length;
+    }
+    return attributes;
+}
+
+@implementation DFDiskCacheEntryFile
+
++ (BOOL)writeData:(NSData *)data attributes:(NSDictionary *)attributes toPath:(NSString *)path synchronize:(BOOL)synchronize {
+    NSString *temporaryPath = [self writeTemporaryFileWithData:data attributes:attributes forPath:path synchronize:synchronize];
+    BOOL success = temporaryPath != nil;
+    if (success && rename(temporaryPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        unlink(temporaryPath.fileSystemRepresentation);
+        success = NO;
+    }
+    if (success && synchronize) {
+        // Persists the rename.
+        success = _dwarf_cache_fsync_path([path stringByDeletingLastPathComponent], NO);
+    }
+    return success;
+}
+
++ (NSString *)writeTemporaryFileWithData:(NSData *)data attributes:(NSDictionary *)attributes forPath:(NSString *)path synchronize:(BOOL)synchronize {
+    NSData *header = _DFEntryFileHeaderData(attributes, data.length, _dwarf_cache_checksum(data.bytes, data.length));
+    NSString *temporaryPath;
+    int fd = _dwarf_cache_make_temporary_file(path, &temporaryPath);
+    if (fd < 0) {
+        return nil;
+    }
+    BOOL success = _DFEntryFileWrite(fd, header.bytes, header.length) && _DFEntryFileWrite(fd, data.bytes, data.length);
+    success = success && (!synchronize || _dwarf_cache_fsync(fd, NO));
+    success = (close(fd) == 0) && success;
+    if (!success) {
+        unlink(temporaryPath.fileSystemRepresentation);
+        return nil;
+    }
+    return temporaryPath;
+}
+
++ (NSData *)headerDataWithAttributes:(NSDictionary *)attributes dataLength:(unsigned long long)dataLength dataChecksum:(uint32_t)dataChecksum {
+    return _DFEntryFileHeaderData(attributes, dataLength, dataChecksum);
+}
+
++ (NSData *)dataAtPath:(NSString *)path attributes:(NSDictionary **)attributes mappedReadThreshold:(unsigned long long)mappedReadThreshold legacy:(BOOL *)legacy {
+    *legacy = NO;
+    NSDataReadingOptions options = 0;
+    if (mappedReadThreshold > 0) {
+        struct stat info;
+        if (stat(path.fileSystemRepresentation, &info) != 0) {
+            return nil;
+        }
+        if ((unsigned long long)info.st_size >= mappedReadThreshold) {
+            options = NSDataReadingMappedIfSafe;
+        }
+    }
+    NSData *contents = [NSData dataWithContentsOfFile:path options:options error:nil];
+    if (!contents) {
+        return nil;
+    }
+    const uint8_t *bytes = contents.bytes;
+    _DFEntryFileHeader header;
+    switch (_DFEntryFileReadHeader(bytes, contents.length, contents.length, &header)) {
+        case _DFEntryFileHeaderValid: break;
+        case _DFEntryFileHeaderLegacy:
+            *legacy = YES;
+            return contents;
+        case _DFEntryFileHeaderCorrupted: return nil;
+    }
+    const uint8_t *dataBytes = bytes + sizeof(header) + header.attributesLength;
+    if (!(options & NSDataReadingMappedIfSafe) && _dwarf_cache_checksum(dataBytes, (size_t)header.dataLength) != header.dataChecksum) {
+        return nil;
+    }
+    if (attributes) {
+        NSDictionary *parsedAttributes = _DFEntryFileParseAttributes(bytes + sizeof(header), header);
+        if (!parsedAttributes) {
+            return nil;
+        }
+        *attributes = parsedAttributes;
+    }
+    // Data references the contents buffer (or mapping) instead of copying it.
+    return [[NSData alloc] initWithBytesNoCopy:(void *)dataBytes length:(NSUInteger)header.dataLength deallocator:^(void *deallocatedBytes, NSUInteger length) {
+        (void)contents;
+    }];
+}
+
++ (BOOL)getDataOffset:(unsigned long long *)offset length:(unsigned long long *)length fileDescriptor:(int)fd legacy:(BOOL *)legacy {
+    *legacy = NO;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return NO;
+    }
+    _DFEntryFileHeader header;
+    ssize_t headerLength;
+    do {
+        headerLength = pread(fd, &header, sizeof(header), 0);
+    } while (headerLength < 0 && errno == EINTR);
+    if (headerLength < 0) {
+        return NO;
+    }
+    _DFEntryFileHeaderStatus status = _DFEntryFileReadHeader((const uint8_t *)&header, (size_t)headerLength, (unsigned long long)info.st_size, &header);
+    if (status == _DFEntryFileHeaderCorrupted) {
+        return NO;
+    }
+    *legacy = status == _DFEntryFileHeaderLegacy;
+    *offset = *legacy ? 0 : sizeof(header) + header.attributesLength;
+    *length = *legacy ? (unsigned long long)info.st_size : header.dataLength;
+    return YES;
+}
+
++ (NSDictionary *)attributesAtPath:(NSString *)path legacy:(BOOL *)legacy {
+    *legacy = NO;
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return nil;
+    }
+    NSDictionary *attributes;
+    struct stat info;
+    _DFEntryFileHeader header;
+    if (fstat(fd, &info) == 0) {
+        ssize_t length;
+        do {
+            length = pread(fd, &header, sizeof(header), 0);
+        } while (length < 0 && errno == EINTR);
+        _DFEntryFileHeaderStatus status = length < 0 ? _DFEntryFileHeaderCorrupted : _DFEntryFileReadHeader((const uint8_t *)&header, (size_t)length, (unsigned long long)info.st_size, &header);
+        if (status == _DFEntryFileHeaderLegacy) {
+            *legacy = YES;
+        } else if (status == _DFEntryFileHeaderValid) {
+            uint8_t *bytes = malloc(MAX(header.attributesLength, 1));
+            if (bytes) {
+                do {
+                    length = pread(fd, bytes, header.attributesLength, sizeof(header));
+                } while (length < 0 && errno == EINTR);
+                if (length == header.attributesLength) {
+                    attributes = _DFEntryFileParseAttributes(bytes, header);
+                }
+                free(bytes);
+            }
+        }
+    }
+    close(fd);
+    return attributes;
+}
+
+@end
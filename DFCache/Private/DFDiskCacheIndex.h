@@ -0,0 +1,158 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+#import "DFDiskCacheEvictionPolicy.h"
+
+@class DFDiskCacheJournal;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Location of the entry contents. Entries are either stored in standalone files or packed into segment files.
+ */
+typedef struct {
+    /*! Identifier of the segment that contains the entry, 0 for entries stored in standalone files.
+     */
+    uint32_t segment;
+    /*! Length of the segment record, in bytes.
+     */
+    uint32_t length;
+    /*! Offset of the segment record, in bytes.
+     */
+    uint64_t offset;
+} DFDiskCacheLocation;
+
+static const DFDiskCacheLocation DFDiskCacheLocationFile = { 0, 0, 0 };
+
+static inline BOOL
+DFDiskCacheLocationIsPacked(DFDiskCacheLocation location) {
+    return location.segment != 0;
+}
+
+static inline BOOL
+DFDiskCacheLocationEqualToLocation(DFDiskCacheLocation location1, DFDiskCacheLocation location2) {
+    return location1.segment == location2.segment && location1.offset == location2.offset && location1.length == location2.length;
+}
+
+@interface DFDiskCacheEntry ()
+
+/*! Location of the entry contents.
+ */
+@property (nonatomic) DFDiskCacheLocation location;
+
+@end
+
+
+/*! Thread-safe in-memory index of the disk cache contents. Keeps track of the size, recency and frequency of each entry and consults eviction policy to decide which entries to evict.
+ */
+@interface DFDiskCacheIndex : NSObject
+
+/*! Initializes index with a journal that is used to persist index changes.
+ */
+- (instancetype)initWithJournal:(nullable DFDiskCacheJournal *)journal NS_DESIGNATED_INITIALIZER;
+
+/*! Returns journal used by the index. Journal must only be accessed with the index lock held, e.g. from the block passed to loadEntriesIfNeeded: method.
+ */
+@property (nullable, nonatomic, readonly) DFDiskCacheJournal *journal;
+
+/*! Eviction policy that the index reports changes to. Setting the policy populates it with the existing entries ordered by access date. Default policy is DFDiskCacheEvictionPolicyLRU.
+ */
+@property (nonatomic) id<DFDiskCacheEvictionPolicy> evictionPolicy;
+
+/*! Capacity that is passed to the eviction policy if the policy supports it.
+ */
+@property (nonatomic) unsigned long long capacity;
+
+/*! Returns YES if the index was populated.
+ */
+@property (nonatomic, readonly, getter=isLoaded) BOOL loaded;
+
+/*! Returns total size of all entries, in bytes.
+ */
+@property (nonatomic, readonly) unsigned long long totalSize;
+
+/*! Returns number of entries in the index.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/*! Populates the index with entries returned by the given block unless the index is already loaded. Entries are ordered by access date. The block is called with the index lock held.
+ */
+- (void)loadEntriesIfNeeded:(NSArray<DFDiskCacheEntry *> *(^)(void))block;
+
+/*! Compacts journal if it has grown too large.
+ */
+- (void)compactJournalIfNeeded;
+
+/*! Writes buffered journal records to disk.
+ */
+- (void)flushJournal;
+
+/*! Writes buffered journal records to disk and writes the journal log to stable storage.
+ */
+- (void)synchronizeJournal;
+
+/*! Inserts or updates entry for the given filename and reports access to the eviction policy. Expiration date of the existing entry is preserved.
+ */
+- (void)setSize:(unsigned long long)size forFilename:(NSString *)filename key:(nullable NSString *)key;
+
+/*! Inserts or updates entry for the given filename and reports access to the eviction policy.
+ @param expirationDate Expiration date expressed as a time interval since reference date, 0 means that entry never expires.
+ @param previousLocation On return contains the location of the replaced entry, if there was one.
+ @return YES if the entry replaced an existing one.
+ */
+- (BOOL)setSize:(unsigned long long)size location:(DFDiskCacheLocation)location expirationDate:(NSTimeInterval)expirationDate forFilename:(NSString *)filename key:(nullable NSString *)key previousLocation:(nullable DFDiskCacheLocation *)previousLocation;
+
+/*! Returns YES and the location of the entry if the index contains entry for the given filename.
+ */
+- (BOOL)getLocation:(DFDiskCacheLocation *)location forFilename:(NSString *)filename;
+
+/*! Returns YES and the location of the entry if the index contains entry for the given filename that hasn't expired. Expired entry is removed from the index, in which case method returns NO, sets expired to YES and returns the location of the removed entry.
+ */
+- (BOOL)getLocation:(DFDiskCacheLocation *)location forFilename:(NSString *)filename expired:(BOOL *)expired;
+
+/*! Same as getLocation:forFilename:expired:, also returns expiration date of the entry (0 if the entry never expires) with the same lookup.
+ */
+- (BOOL)getLocation:(DFDiskCacheLocation *)location expirationDate:(nullable NSTimeInterval *)expirationDate forFilename:(NSString *)filename expired:(BOOL *)expired;
+
+/*! Returns expiration date of the entry for the given filename, 0 if entry never expires or doesn't exist.
+ */
+- (NSTimeInterval)expirationDateForFilename:(NSString *)filename;
+
+/*! Updates location of the entry only if the entry is still at the given location. Doesn't change access order.
+ @return YES if the entry was moved.
+ */
+- (BOOL)moveFilename:(NSString *)filename fromLocation:(DFDiskCacheLocation)fromLocation toLocation:(DFDiskCacheLocation)toLocation;
+
+/*! Updates access date and access count of the entry and reports access to the eviction policy.
+ @return YES if the index contains entry for the given filename.
+ */
+- (BOOL)touchFilename:(NSString *)filename;
+
+/*! Returns keys of the entries that haven't expired ordered by access count and then by access date, most frequently accessed first. Entries without keys are skipped.
+ */
+- (NSArray<NSString *> *)keysOfMostFrequentlyAccessedEntries:(NSUInteger)count;
+
+- (BOOL)containsFilename:(NSString *)filename;
+
+- (void)removeFilename:(NSString *)filename;
+
+/*! Removes entry for the given filename.
+ @param location On return contains the location of the removed entry.
+ @return YES if the entry was removed.
+ */
+- (BOOL)removeFilename:(NSString *)filename location:(nullable DFDiskCacheLocation *)location;
+
+- (void)removeAllEntries;
+
+/*! Removes the entry chosen by the eviction policy and returns it. Returns nil if the index is empty.
+ */
+- (nullable DFDiskCacheEntry *)evictEntry;
+
+/*! Removes the entry that expired the earliest and returns it. Returns nil if there are no expired entries.
+ */
+- (nullable DFDiskCacheEntry *)removeExpiredEntry;
+
+@end
+
+NS_ASSUME_NONNULL_END
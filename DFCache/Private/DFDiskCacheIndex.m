@@ -0,0 +1,450 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFDiskCacheIndex.h"
+#import "DFDiskCacheJournal.h"
+#import <pthread.h>
+
+/*! Node of the expiration heap. Nodes are not removed when entries are removed or updated, stale nodes are skipped when they reach the top of the heap.
+ */
+@interface _DFDiskCacheExpirationNode : NSObject {
+    @package
+    NSTimeInterval _date;
+    DFDiskCacheEntry *_entry;
+}
+@end
+
+@implementation _DFDiskCacheExpirationNode
+@end
+
+static inline NSTimeInterval
+_DFExpirationDateAtIndex(NSArray *heap, NSUInteger index) {
+    return ((_DFDiskCacheExpirationNode *)heap[index])->_date;
+}
+
+
+@implementation DFDiskCacheIndex {
+    pthread_mutex_t _mutex;
+    NSMutableDictionary *_entries;
+    
+    /*! Min-heap of the expiring entries ordered by expiration date.
+     */
+    NSMutableArray *_expirations;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (instancetype)initWithJournal:(DFDiskCacheJournal *)journal {
+    if (self = [super init]) {
+        pthread_mutex_init(&_mutex, NULL);
+        _entries = [NSMutableDictionary new];
+        _expirations = [NSMutableArray new];
+        _journal = journal;
+        _evictionPolicy = [DFDiskCacheEvictionPolicyLRU new];
+    }
+    return self;
+}
+
+- (instancetype)init {
+    return [self initWithJournal:nil];
+}
+
+- (void)loadEntriesIfNeeded:(NSArray *(^)(void))block {
+    pthread_mutex_lock(&_mutex);
+    if (!_loaded) {
+        for (DFDiskCacheEntry *entry in [DFDiskCacheIndex _entriesSortedByAccessDate:block()]) {
+            if (!_entries[entry.filename]) {
+                _entries[entry.filename] = entry;
+                _totalSize += entry.size;
+                [_evictionPolicy didAddEntry:entry];
+                [self _scheduleExpirationOfEntry:entry];
+            }
+        }
+        _loaded = YES;
+        if ([_journal needsCompactionForEntryCount:_entries.count]) {
+            [_journal compactWithEntries:[self _allEntries]]();
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (void)compactJournalIfNeeded {
+    dispatch_block_t block;
+    pthread_mutex_lock(&_mutex);
+    if (_loaded && [_journal needsCompactionForEntryCount:_entries.count]) {
+        block = [_journal compactWithEntries:[self _allEntries]];
+    }
+    pthread_mutex_unlock(&_mutex);
+    if (block) {
+        block();
+    }
+}
+
+- (void)flushJournal {
+    pthread_mutex_lock(&_mutex);
+    [_journal flush];
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (void)synchronizeJournal {
+    pthread_mutex_lock(&_mutex);
+    [_journal synchronize];
+    pthread_mutex_unlock(&_mutex);
+}
+
+/*! Returns entries ordered from the least recently used to the most recently used one.
+ */
+- (NSArray *)_allEntries {
+    return [DFDiskCacheIndex _entriesSortedByAccessDate:[_entries allValues]];
+}
+
++ (NSArray *)_entriesSortedByAccessDate:(NSArray *)entries {
+    return [entries sortedArrayUsingComparator:^NSComparisonResult(DFDiskCacheEntry *entry1, DFDiskCacheEntry *entry2) {
+        return entry1.accessDate < entry2.accessDate ? NSOrderedAscending : (entry1.accessDate > entry2.accessDate ? NSOrderedDescending : NSOrderedSame);
+    }];
+}
+
+- (id<DFDiskCacheEvictionPolicy>)evictionPolicy {
+    pthread_mutex_lock(&_mutex);
+    id<DFDiskCacheEvictionPolicy> policy = _evictionPolicy;
+    pthread_mutex_unlock(&_mutex);
+    return policy;
+}
+
+- (void)setEvictionPolicy:(id<DFDiskCacheEvictionPolicy>)evictionPolicy {
+    pthread_mutex_lock(&_mutex);
+    if (_evictionPolicy != evictionPolicy) {
+        [_evictionPolicy removeAllEntries];
+        for (DFDiskCacheEntry *entry in [_entries allValues]) {
+            entry.policyContext = nil;
+        }
+        _evictionPolicy = evictionPolicy;
+        if ([_evictionPolicy respondsToSelector:@selector(setCapacity:)]) {
+            _evictionPolicy.capacity = _capacity;
+        }
+        for (DFDiskCacheEntry *entry in [self _allEntries]) {
+            [_evictionPolicy didAddEntry:entry];
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (unsigned long long)capacity {
+    pthread_mutex_lock(&_mutex);
+    unsigned long long capacity = _capacity;
+    pthread_mutex_unlock(&_mutex);
+    return capacity;
+}
+
+- (void)setCapacity:(unsigned long long)capacity {
+    pthread_mutex_lock(&_mutex);
+    _capacity = capacity;
+    if ([_evictionPolicy respondsToSelector:@selector(setCapacity:)]) {
+        _evictionPolicy.capacity = capacity;
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (void)setSize:(unsigned long long)size forFilename:(NSString *)filename key:(NSString *)key {
+    pthread_mutex_lock(&_mutex);
+    [self _setSize:size location:DFDiskCacheLocationFile expirationDate:NULL forFilename:filename key:key previousLocation:NULL];
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (BOOL)setSize:(unsigned long long)size location:(DFDiskCacheLocation)location expirationDate:(NSTimeInterval)expirationDate forFilename:(NSString *)filename key:(NSString *)key previousLocation:(DFDiskCacheLocation *)previousLocation {
+    pthread_mutex_lock(&_mutex);
+    BOOL replaced = [self _setSize:size location:location expirationDate:&expirationDate forFilename:filename key:key previousLocation:previousLocation];
+    pthread_mutex_unlock(&_mutex);
+    return replaced;
+}
+
+/*! Expiration date of the existing entry is preserved if expirationDate is NULL.
+ */
+- (BOOL)_setSize:(unsigned long long)size location:(DFDiskCacheLocation)location expirationDate:(NSTimeInterval *)expirationDate forFilename:(NSString *)filename key:(NSString *)key previousLocation:(DFDiskCacheLocation *)previousLocation {
+    DFDiskCacheEntry *entry = _entries[filename];
+    BOOL replaced = entry != nil;
+    unsigned long long previousSize = entry.size;
+    if (entry) {
+        _totalSize -= entry.size;
+        entry.accessCount++;
+        if (previousLocation) {
+            *previousLocation = entry.location;
+        }
+    } else {
+        entry = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+        _entries[filename] = entry;
+    }
+    if (key) {
+        entry.key = key;
+    }
+    entry.size = size;
+    entry.location = location;
+    entry.accessDate = CFAbsoluteTimeGetCurrent();
+    if (expirationDate && entry.expirationDate != *expirationDate) {
+        entry.expirationDate = *expirationDate;
+        [self _scheduleExpirationOfEntry:entry];
+    }
+    _totalSize += size;
+    if (replaced) {
+        [_evictionPolicy didUpdateEntry:entry previousSize:previousSize];
+    } else {
+        [_evictionPolicy didAddEntry:entry];
+    }
+    [_journal recordSetEntry:entry];
+    return replaced;
+}
+
+- (BOOL)getLocation:(DFDiskCacheLocation *)location forFilename:(NSString *)filename {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = _entries[filename];
+    if (entry && location) {
+        *location = entry.location;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return entry != nil;
+}
+
+- (BOOL)getLocation:(DFDiskCacheLocation *)location forFilename:(NSString *)filename expired:(BOOL *)expired {
+    return [self getLocation:location expirationDate:NULL forFilename:filename expired:expired];
+}
+
+- (BOOL)getLocation:(DFDiskCacheLocation *)location expirationDate:(NSTimeInterval *)expirationDate forFilename:(NSString *)filename expired:(BOOL *)expired {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = _entries[filename];
+    *expired = entry && entry.expirationDate && entry.expirationDate <= CFAbsoluteTimeGetCurrent();
+    if (entry && location) {
+        *location = entry.location;
+    }
+    if (expirationDate) {
+        *expirationDate = entry.expirationDate;
+    }
+    if (*expired) {
+        [self _removeEntry:entry];
+    }
+    pthread_mutex_unlock(&_mutex);
+    return entry && !*expired;
+}
+
+- (NSTimeInterval)expirationDateForFilename:(NSString *)filename {
+    pthread_mutex_lock(&_mutex);
+    NSTimeInterval expirationDate = [_entries[filename] expirationDate];
+    pthread_mutex_unlock(&_mutex);
+    return expirationDate;
+}
+
+- (BOOL)moveFilename:(NSString *)filename fromLocation:(DFDiskCacheLocation)fromLocation toLocation:(DFDiskCacheLocation)toLocation {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = _entries[filename];
+    BOOL moved = entry && DFDiskCacheLocationEqualToLocation(entry.location, fromLocation);
+    if (moved) {
+        entry.location = toLocation;
+        [_journal recordSetEntry:entry];
+    }
+    pthread_mutex_unlock(&_mutex);
+    return moved;
+}
+
+- (BOOL)touchFilename:(NSString *)filename {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = _entries[filename];
+    if (entry) {
+        entry.accessDate = CFAbsoluteTimeGetCurrent();
+        entry.accessCount++;
+        [_evictionPolicy didAccessEntry:entry];
+        [_journal recordAccessToEntry:entry];
+    }
+    pthread_mutex_unlock(&_mutex);
+    return entry != nil;
+}
+
+- (NSArray *)keysOfMostFrequentlyAccessedEntries:(NSUInteger)count {
+    pthread_mutex_lock(&_mutex);
+    const NSTimeInterval now = CFAbsoluteTimeGetCurrent();
+    NSMutableArray *entries = [[NSMutableArray alloc] initWithCapacity:_entries.count];
+    for (DFDiskCacheEntry *entry in [_entries objectEnumerator]) {
+        if (entry.key && (!entry.expirationDate || entry.expirationDate > now)) {
+            [entries addObject:entry];
+        }
+    }
+    [entries sortUsingComparator:^NSComparisonResult(DFDiskCacheEntry *entry1, DFDiskCacheEntry *entry2) {
+        if (entry1.accessCount != entry2.accessCount) {
+            return entry1.accessCount > entry2.accessCount ? NSOrderedAscending : NSOrderedDescending;
+        }
+        return entry1.accessDate > entry2.accessDate ? NSOrderedAscending : (entry1.accessDate < entry2.accessDate ? NSOrderedDescending : NSOrderedSame);
+    }];
+    NSMutableArray *keys = [[NSMutableArray alloc] initWithCapacity:MIN(count, entries.count)];
+    for (NSUInteger i = 0; i < MIN(count, entries.count); i++) {
+        [keys addObject:[entries[i] key]];
+    }
+    pthread_mutex_unlock(&_mutex);
+    return keys;
+}
+
+- (BOOL)containsFilename:(NSString *)filename {
+    pthread_mutex_lock(&_mutex);
+    BOOL contains = _entries[filename] != nil;
+    pthread_mutex_unlock(&_mutex);
+    return contains;
+}
+
+- (void)removeFilename:(NSString *)filename {
+    [self removeFilename:filename location:NULL];
+}
+
+- (BOOL)removeFilename:(NSString *)filename location:(DFDiskCacheLocation *)location {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = _entries[filename];
+    if (entry) {
+        if (location) {
+            *location = entry.location;
+        }
+        [self _removeEntry:entry];
+    }
+    pthread_mutex_unlock(&_mutex);
+    return entry != nil;
+}
+
+- (void)_removeEntry:(DFDiskCacheEntry *)entry {
+    _totalSize -= entry.size;
+    [_evictionPolicy didRemoveEntry:entry];
+    [_entries removeObjectForKey:entry.filename];
+    [_journal recordRemovalOfFilename:entry.filename];
+}
+
+- (void)removeAllEntries {
+    pthread_mutex_lock(&_mutex);
+    [_evictionPolicy removeAllEntries];
+    _totalSize = 0;
+    [_entries removeAllObjects];
+    [_expirations removeAllObjects];
+    [_journal recordRemovalOfAllEntries];
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (DFDiskCacheEntry *)evictEntry {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *entry = [_evictionPolicy nextVictim];
+    if (entry && _entries[entry.filename] == entry) {
+        _totalSize -= entry.size;
+        [_evictionPolicy didEvictEntry:entry];
+        [_entries removeObjectForKey:entry.filename];
+        [_journal recordRemovalOfFilename:entry.filename];
+    } else {
+        entry = nil;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return entry;
+}
+
+- (DFDiskCacheEntry *)removeExpiredEntry {
+    pthread_mutex_lock(&_mutex);
+    DFDiskCacheEntry *expiredEntry;
+    const NSTimeInterval now = CFAbsoluteTimeGetCurrent();
+    while (_expirations.count) {
+        _DFDiskCacheExpirationNode *node = _expirations[0];
+        if (node->_date > now) {
+            break;
+        }
+        [self _popExpiration];
+        DFDiskCacheEntry *entry = node->_entry;
+        if (_entries[entry.filename] == entry && entry.expirationDate == node->_date) {
+            [self _removeEntry:entry];
+            expiredEntry = entry;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+    return expiredEntry;
+}
+
+#pragma mark - Expiration Heap
+
+- (void)_scheduleExpirationOfEntry:(DFDiskCacheEntry *)entry {
+    if (!entry.expirationDate) {
+        return;
+    }
+    if (_expirations.count > _entries.count * 2 + 1024) {
+        [self _rebuildExpirations];
+    }
+    _DFDiskCacheExpirationNode *node = [_DFDiskCacheExpirationNode new];
+    node->_date = entry.expirationDate;
+    node->_entry = entry;
+    [_expirations addObject:node];
+    [self _siftUp:_expirations.count - 1];
+}
+
+/*! Drops stale nodes that accumulate when expiring entries are replaced or removed.
+ */
+- (void)_rebuildExpirations {
+    [_expirations removeAllObjects];
+    for (DFDiskCacheEntry *entry in [_entries allValues]) {
+        if (entry.expirationDate) {
+            _DFDiskCacheExpirationNode *node = [_DFDiskCacheExpirationNode new];
+            node->_date = entry.expirationDate;
+            node->_entry = entry;
+            [_expirations addObject:node];
+        }
+    }
+    for (NSInteger i = (NSInteger)_expirations.count / 2 - 1; i >= 0; i--) {
+        [self _siftDown:i];
+    }
+}
+
+- (void)_popExpiration {
+    [_expirations exchangeObjectAtIndex:0 withObjectAtIndex:_expirations.count - 1];
+    [_expirations removeLastObject];
+    if (_expirations.count) {
+        [self _siftDown:0];
+    }
+}
+
+- (void)_siftUp:(NSUInteger)index {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (_DFExpirationDateAtIndex(_expirations, parent) <= _DFExpirationDateAtIndex(_expirations, index)) {
+            break;
+        }
+        [_expirations exchangeObjectAtIndex:parent withObjectAtIndex:index];
+        index = parent;
+    }
+}
+
+- (void)_siftDown:(NSUInteger)index {
+    const NSUInteger count = _expirations.count;
+    while (YES) {
+        NSUInteger smallest = index;
+        NSUInteger left = index * 2 + 1, right = left + 1;
+        if (left < count && _DFExpirationDateAtIndex(_expirations, left) < _DFExpirationDateAtIndex(_expirations, smallest)) {
+            smallest = left;
+        }
+        if (right < count && _DFExpirationDateAtIndex(_expirations, right) < _DFExpirationDateAtIndex(_expirations, smallest)) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        [_expirations exchangeObjectAtIndex:index withObjectAtIndex:smallest];
+        index = smallest;
+    }
+}
+
+#pragma mark - Accessors
+
+- (unsigned long long)totalSize {
+    pthread_mutex_lock(&_mutex);
+    unsigned long long totalSize = _totalSize;
+    pthread_mutex_unlock(&_mutex);
+    return totalSize;
+}
+
+- (NSUInteger)count {
+    pthread_mutex_lock(&_mutex);
+    NSUInteger count = _entries.count;
+    pthread_mutex_unlock(&_mutex);
+    return count;
+}
+
+@end
@@ -0,0 +1,61 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+@class DFDiskCacheEntry;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Append-only journal that persists disk cache index between launches.
+ @discussion Journal consists of a snapshot of the index and a log of the changes that were made since the snapshot was taken (puts, removals and accesses). Records are buffered in memory and are appended to the log in batches. Files are hidden so that they are not listed as storage contents.
+ @note Journal is not thread-safe, access to it must be synchronized by the caller.
+ */
+@interface DFDiskCacheJournal : NSObject
+
+/*! Initializes journal that keeps its files in the given directory.
+ */
+- (instancetype)initWithDirectoryPath:(NSString *)path NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Returns names of the files used by the journal.
+ */
++ (NSSet<NSString *> *)filenames;
+
+/*! Replays snapshot and log and returns resulting entries. Returns nil if journal is missing or corrupted.
+ */
+- (nullable NSArray<DFDiskCacheEntry *> *)replay;
+
+- (void)recordSetEntry:(DFDiskCacheEntry *)entry;
+- (void)recordAccessToEntry:(DFDiskCacheEntry *)entry;
+- (void)recordRemovalOfFilename:(NSString *)filename;
+
+/*! Discards both snapshot and log.
+ */
+- (void)recordRemovalOfAllEntries;
+
+/*! Forces compaction, e.g. when the journal was found out of sync with storage contents.
+ */
+- (void)setNeedsCompaction;
+
+/*! Returns YES when the log has grown large enough compared to the number of entries or was damaged.
+ */
+- (BOOL)needsCompactionForEntryCount:(NSUInteger)count;
+
+/*! Starts compaction by serializing the given entries and rotating the log. Returns block that writes the snapshot. The block might be called outside of the journal synchronization.
+ */
+- (dispatch_block_t)compactWithEntries:(NSArray<DFDiskCacheEntry *> *)entries;
+
+/*! Writes buffered records to the log.
+ */
+- (void)flush;
+
+/*! Writes buffered records to the log and writes the log to stable storage.
+ */
+- (BOOL)synchronize;
+
+@end
+
+NS_ASSUME_NONNULL_END
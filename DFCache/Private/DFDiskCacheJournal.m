@@ -0,0 +1,383 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCachePrivate.h"
+#import "DFDiskCacheIndex.h"
+#import "DFDiskCacheJournal.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+static NSString *const DFDiskCacheJournalLogFilename = @".df_journal";
+static NSString *const DFDiskCacheJournalRotatedLogFilename = @".df_journal_rotated";
+static NSString *const DFDiskCacheJournalSnapshotFilename = @".df_journal_snapshot";
+
+static const uint32_t DFDiskCacheJournalLogMagic = 0x4C4A4644; // "DFJL"
+static const uint32_t DFDiskCacheJournalSnapshotMagic = 0x534A4644; // "DFJS"
+/*! Version 2 adds locations of the entries packed into segment files. Version 3 adds access counts used by eviction policies. Version 4 adds expiration dates. Version 5 stores absolute access counts in access records.
+ */
+static const uint32_t DFDiskCacheJournalVersion = 5;
+
+/*! Size of the records buffer that triggers writing records to the log.
+ */
+static const NSUInteger DFDiskCacheJournalBufferLimit = 32 * 1024;
+
+typedef NS_ENUM(uint8_t, DFDiskCacheJournalRecord) {
+    DFDiskCacheJournalRecordSet = 1,
+    DFDiskCacheJournalRecordRemove = 2,
+    DFDiskCacheJournalRecordAccess = 3
+};
+
+#pragma mark - Encoding
+
+static inline void
+_DFJournalAppend(NSMutableData *data, const void *bytes, size_t length) {
+    [data appendBytes:bytes length:length];
+}
+
+static inline void
+_DFJournalAppendString(NSMutableData *data, NSString *string) {
+    NSData *utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+    uint16_t length = utf8.length <= UINT16_MAX ? (uint16_t)utf8.length : 0;
+    _DFJournalAppend(data, &length, sizeof(length));
+    _DFJournalAppend(data, utf8.bytes, length);
+}
+
+/*! Each record is prefixed with the length of its body and is followed by the body checksum.
+ */
+static void
+_DFJournalAppendRecord(NSMutableData *data, DFDiskCacheJournalRecord type, NSString *filename, DFDiskCacheEntry *entry) {
+    NSUInteger start = data.length;
+    uint32_t length = 0;
+    _DFJournalAppend(data, &length, sizeof(length));
+    _DFJournalAppend(data, &type, sizeof(type));
+    _DFJournalAppendString(data, filename);
+    if (type == DFDiskCacheJournalRecordSet) {
+        unsigned long long size = entry.size;
+        NSTimeInterval accessDate = entry.accessDate;
+        _DFJournalAppend(data, &size, sizeof(size));
+        _DFJournalAppend(data, &accessDate, sizeof(accessDate));
+        _DFJournalAppendString(data, entry.key ?: @"");
+        DFDiskCacheLocation location = entry.location;
+        _DFJournalAppend(data, &location.segment, sizeof(location.segment));
+        _DFJournalAppend(data, &location.length, sizeof(location.length));
+        _DFJournalAppend(data, &location.offset, sizeof(location.offset));
+        uint32_t accessCount = (uint32_t)MIN(entry.accessCount, UINT32_MAX);
+        _DFJournalAppend(data, &accessCount, sizeof(accessCount));
+        NSTimeInterval expirationDate = entry.expirationDate;
+        _DFJournalAppend(data, &expirationDate, sizeof(expirationDate));
+    } else if (type == DFDiskCacheJournalRecordAccess) {
+        // Access count is absolute rather than an increment, so that replaying the record more than once is harmless.
+        NSTimeInterval accessDate = entry.accessDate;
+        _DFJournalAppend(data, &accessDate, sizeof(accessDate));
+        uint32_t accessCount = (uint32_t)MIN(entry.accessCount, UINT32_MAX);
+        _DFJournalAppend(data, &accessCount, sizeof(accessCount));
+    }
+    uint8_t *bytes = (uint8_t *)data.mutableBytes + start;
+    length = (uint32_t)(data.length - start - sizeof(length));
+    memcpy(bytes, &length, sizeof(length));
+    uint32_t checksum = _dwarf_cache_checksum(bytes + sizeof(length), length);
+    _DFJournalAppend(data, &checksum, sizeof(checksum));
+}
+
+static NSData *
+_DFJournalHeader(uint32_t magic) {
+    NSMutableData *data = [NSMutableData new];
+    _DFJournalAppend(data, &magic, sizeof(magic));
+    _DFJournalAppend(data, &DFDiskCacheJournalVersion, sizeof(DFDiskCacheJournalVersion));
+    return data;
+}
+
+#pragma mark - Decoding
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} _DFJournalReader;
+
+static inline BOOL
+_DFJournalRead(_DFJournalReader *reader, void *buffer, size_t length) {
+    if (reader->length - reader->offset < length) {
+        return NO;
+    }
+    memcpy(buffer, reader->bytes + reader->offset, length);
+    reader->offset += length;
+    return YES;
+}
+
+static inline NSString *
+_DFJournalReadString(_DFJournalReader *reader) {
+    uint16_t length;
+    if (!_DFJournalRead(reader, &length, sizeof(length)) || reader->length - reader->offset < length) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes:reader->bytes + reader->offset length:length encoding:NSUTF8StringEncoding];
+    reader->offset += length;
+    return string;
+}
+
+/*! Applies records to the given entries. Returns NO if the header is invalid. Sets damaged to YES if the records are truncated or corrupted, all the records before the damaged one are applied.
+ */
+static BOOL
+_DFJournalApply(NSData *data, uint32_t magic, NSMutableDictionary *entries, BOOL *damaged) {
+    _DFJournalReader reader = { data.bytes, data.length, 0 };
+    uint32_t headerMagic, version;
+    if (!_DFJournalRead(&reader, &headerMagic, sizeof(headerMagic)) ||
+        !_DFJournalRead(&reader, &version, sizeof(version)) ||
+        headerMagic != magic || version != DFDiskCacheJournalVersion) {
+        return NO;
+    }
+    while (reader.offset < reader.length) {
+        uint32_t length, checksum;
+        if (!_DFJournalRead(&reader, &length, sizeof(length)) ||
+            reader.length - reader.offset < (size_t)length + sizeof(checksum)) {
+            *damaged = YES;
+            break;
+        }
+        _DFJournalReader record = { reader.bytes + reader.offset, length, 0 };
+        reader.offset += length;
+        _DFJournalRead(&reader, &checksum, sizeof(checksum));
+        if (checksum != _dwarf_cache_checksum(record.bytes, length)) {
+            *damaged = YES;
+            break;
+        }
+        DFDiskCacheJournalRecord type;
+        NSString *filename;
+        if (!_DFJournalRead(&record, &type, sizeof(type)) || !(filename = _DFJournalReadString(&record))) {
+            *damaged = YES;
+            break;
+        }
+        if (type == DFDiskCacheJournalRecordSet) {
+            unsigned long long size;
+            NSTimeInterval accessDate;
+            NSString *key;
+            DFDiskCacheLocation location;
+            uint32_t accessCount;
+            NSTimeInterval expirationDate;
+            if (!_DFJournalRead(&record, &size, sizeof(size)) ||
+                !_DFJournalRead(&record, &accessDate, sizeof(accessDate)) ||
+                !(key = _DFJournalReadString(&record)) ||
+                !_DFJournalRead(&record, &location.segment, sizeof(location.segment)) ||
+                !_DFJournalRead(&record, &location.length, sizeof(location.length)) ||
+                !_DFJournalRead(&record, &location.offset, sizeof(location.offset)) ||
+                !_DFJournalRead(&record, &accessCount, sizeof(accessCount)) ||
+                !_DFJournalRead(&record, &expirationDate, sizeof(expirationDate))) {
+                *damaged = YES;
+                break;
+            }
+            DFDiskCacheEntry *entry = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+            entry.size = size;
+            entry.accessDate = accessDate;
+            entry.key = key.length ? key : nil;
+            entry.location = location;
+            entry.accessCount = MAX(accessCount, 1);
+            entry.expirationDate = expirationDate;
+            entries[filename] = entry;
+        } else if (type == DFDiskCacheJournalRecordAccess) {
+            NSTimeInterval accessDate;
+            uint32_t accessCount;
+            if (!_DFJournalRead(&record, &accessDate, sizeof(accessDate)) ||
+                !_DFJournalRead(&record, &accessCount, sizeof(accessCount))) {
+                *damaged = YES;
+                break;
+            }
+            DFDiskCacheEntry *entry = entries[filename];
+            entry.accessDate = accessDate;
+            entry.accessCount = MAX(accessCount, 1);
+        } else if (type == DFDiskCacheJournalRecordRemove) {
+            [entries removeObjectForKey:filename];
+        } else {
+            *damaged = YES;
+            break;
+        }
+    }
+    return YES;
+}
+
+#pragma mark - DFDiskCacheJournal
+
+@implementation DFDiskCacheJournal {
+    NSString *_path;
+    int _fd;
+    NSMutableData *_buffer;
+    NSUInteger _recordCount;
+    BOOL _damaged;
+}
+
+- (void)dealloc {
+    [self flush];
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (instancetype)initWithDirectoryPath:(NSString *)path {
+    if (self = [super init]) {
+        _path = [path copy];
+        _fd = -1;
+        _buffer = [NSMutableData new];
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
++ (NSSet *)filenames {
+    return [NSSet setWithObjects:DFDiskCacheJournalLogFilename, DFDiskCacheJournalRotatedLogFilename, DFDiskCacheJournalSnapshotFilename, nil];
+}
+
+- (NSString *)_pathForFilename:(NSString *)filename {
+    return [_path stringByAppendingPathComponent:filename];
+}
+
+#pragma mark - Replay
+
+- (NSArray *)replay {
+    // Journal that is missing or can't be replayed has to be rewritten from scratch.
+    _damaged = YES;
+    NSMutableDictionary *entries = [NSMutableDictionary new];
+    BOOL found = NO;
+    BOOL damaged = NO;
+    NSData *snapshot = [NSData dataWithContentsOfFile:[self _pathForFilename:DFDiskCacheJournalSnapshotFilename] options:NSDataReadingMappedIfSafe error:nil];
+    if (snapshot) {
+        if (!_DFJournalApply(snapshot, DFDiskCacheJournalSnapshotMagic, entries, &damaged) || damaged) {
+            return nil;
+        }
+        found = YES;
+    }
+    // Rotated log exists only if the app was terminated during compaction. Records are idempotent so it's safe to replay it on top of either old or new snapshot.
+    for (NSString *filename in @[DFDiskCacheJournalRotatedLogFilename, DFDiskCacheJournalLogFilename]) {
+        NSData *log = [NSData dataWithContentsOfFile:[self _pathForFilename:filename] options:NSDataReadingMappedIfSafe error:nil];
+        if (log) {
+            if (!_DFJournalApply(log, DFDiskCacheJournalLogMagic, entries, &damaged)) {
+                return nil;
+            }
+            found = YES;
+        }
+    }
+    _damaged = damaged;
+    return found ? [entries allValues] : nil;
+}
+
+#pragma mark - Records
+
+- (void)recordSetEntry:(DFDiskCacheEntry *)entry {
+    [self _appendRecord:DFDiskCacheJournalRecordSet filename:entry.filename entry:entry];
+}
+
+- (void)recordAccessToEntry:(DFDiskCacheEntry *)entry {
+    [self _appendRecord:DFDiskCacheJournalRecordAccess filename:entry.filename entry:entry];
+}
+
+- (void)recordRemovalOfFilename:(NSString *)filename {
+    [self _appendRecord:DFDiskCacheJournalRecordRemove filename:filename entry:nil];
+}
+
+- (void)_appendRecord:(DFDiskCacheJournalRecord)type filename:(NSString *)filename entry:(DFDiskCacheEntry *)entry {
+    _DFJournalAppendRecord(_buffer, type, filename, entry);
+    _recordCount++;
+    if (_buffer.length >= DFDiskCacheJournalBufferLimit) {
+        [self flush];
+    }
+}
+
+- (void)recordRemovalOfAllEntries {
+    [self _closeLog];
+    _buffer.length = 0;
+    _recordCount = 0;
+    _damaged = NO;
+    NSFileManager *manager = [NSFileManager defaultManager];
+    for (NSString *filename in [DFDiskCacheJournal filenames]) {
+        [manager removeItemAtPath:[self _pathForFilename:filename] error:nil];
+    }
+}
+
+- (void)flush {
+    if (!_buffer.length) {
+        return;
+    }
+    if (_fd < 0 && ![self _openLog]) {
+        return;
+    }
+    const uint8_t *bytes = _buffer.bytes;
+    size_t remaining = _buffer.length;
+    while (remaining > 0) {
+        ssize_t written = write(_fd, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _damaged = YES;
+            break;
+        }
+        bytes += written;
+        remaining -= written;
+    }
+    _buffer.length = 0;
+}
+
+- (BOOL)synchronize {
+    [self flush];
+    return _fd < 0 || _dwarf_cache_fsync(_fd, NO);
+}
+
+- (BOOL)_openLog {
+    _fd = open([self _pathForFilename:DFDiskCacheJournalLogFilename].fileSystemRepresentation, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0) {
+        return NO;
+    }
+    if (lseek(_fd, 0, SEEK_END) == 0) {
+        NSData *header = _DFJournalHeader(DFDiskCacheJournalLogMagic);
+        if (write(_fd, header.bytes, header.length) != (ssize_t)header.length) {
+            [self _closeLog];
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (void)_closeLog {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+#pragma mark - Compaction
+
+- (void)setNeedsCompaction {
+    _damaged = YES;
+}
+
+- (BOOL)needsCompactionForEntryCount:(NSUInteger)count {
+    return _damaged || _recordCount > MAX(count * 2, 10000);
+}
+
+- (dispatch_block_t)compactWithEntries:(NSArray *)entries {
+    NSMutableData *snapshot = [_DFJournalHeader(DFDiskCacheJournalSnapshotMagic) mutableCopy];
+    for (DFDiskCacheEntry *entry in entries) {
+        _DFJournalAppendRecord(snapshot, DFDiskCacheJournalRecordSet, entry.filename, entry);
+    }
+
+    // Records appended after this point go to the new log.
+    [self flush];
+    [self _closeLog];
+    NSString *logPath = [self _pathForFilename:DFDiskCacheJournalLogFilename];
+    NSString *rotatedLogPath = [self _pathForFilename:DFDiskCacheJournalRotatedLogFilename];
+    BOOL rotated = rename(logPath.fileSystemRepresentation, rotatedLogPath.fileSystemRepresentation) == 0;
+    _recordCount = 0;
+    _damaged = NO;
+
+    NSString *snapshotPath = [self _pathForFilename:DFDiskCacheJournalSnapshotFilename];
+    return ^{
+        if ([snapshot writeToFile:snapshotPath options:NSDataWritingAtomic error:nil] && rotated) {
+            unlink(rotatedLogPath.fileSystemRepresentation);
+        }
+    };
+}
+
+@end
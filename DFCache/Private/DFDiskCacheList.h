@@ -0,0 +1,60 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+@class DFDiskCacheEntry;
+@class DFDiskCacheList;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Node of the doubly linked list used by eviction policies. Node might outlive its entry (e.g. ghost entries in ARC), so it keeps a copy of the entry filename and size.
+ */
+@interface DFDiskCacheListNode : NSObject {
+    @package
+    DFDiskCacheListNode *__unsafe_unretained _prev;
+    DFDiskCacheListNode *_next;
+}
+
+- (instancetype)initWithEntry:(nullable DFDiskCacheEntry *)entry;
+
+/*! Entry is not retained, policy must remove the node (or reset the entry) when the entry is removed.
+ */
+@property (nullable, nonatomic, unsafe_unretained) DFDiskCacheEntry *entry;
+@property (nonatomic, copy) NSString *filename;
+@property (nonatomic) unsigned long long size;
+
+/*! List that currently contains the node.
+ */
+@property (nullable, nonatomic, unsafe_unretained) DFDiskCacheList *list;
+
+/*! Value that policy can associate with the node (e.g. frequency or priority).
+ */
+@property (nonatomic) double value;
+
+@end
+
+
+/*! Doubly linked list of nodes that keeps track of the total size of its nodes. Head is the least recently added node.
+ */
+@interface DFDiskCacheList : NSObject
+
+@property (nullable, nonatomic, readonly) DFDiskCacheListNode *head;
+@property (nullable, nonatomic, readonly) DFDiskCacheListNode *tail;
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) unsigned long long size;
+
+- (void)appendNode:(DFDiskCacheListNode *)node;
+- (void)removeNode:(DFDiskCacheListNode *)node;
+- (void)moveNodeToTail:(DFDiskCacheListNode *)node;
+
+/*! Updates size of the node that belongs to the list.
+ */
+- (void)setSize:(unsigned long long)size forNode:(DFDiskCacheListNode *)node;
+
+- (void)removeAllNodes;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,95 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFDiskCacheEvictionPolicy.h"
+#import "DFDiskCacheList.h"
+
+@implementation DFDiskCacheListNode
+
+- (instancetype)initWithEntry:(DFDiskCacheEntry *)entry {
+    if (self = [super init]) {
+        _entry = entry;
+        _filename = [entry.filename copy];
+        _size = entry.size;
+    }
+    return self;
+}
+
+@end
+
+
+@implementation DFDiskCacheList
+
+- (void)dealloc {
+    [self removeAllNodes];
+}
+
+- (void)appendNode:(DFDiskCacheListNode *)node {
+    node->_prev = _tail;
+    node->_next = nil;
+    if (_tail) {
+        _tail->_next = node;
+    } else {
+        _head = node;
+    }
+    _tail = node;
+    node.list = self;
+    _count++;
+    _size += node.size;
+}
+
+- (void)removeNode:(DFDiskCacheListNode *)node {
+    if (node.list != self) {
+        return;
+    }
+    DFDiskCacheListNode *retainedNode = node; // Node might be retained only by the previous node
+    if (node->_prev) {
+        node->_prev->_next = node->_next;
+    } else {
+        _head = node->_next;
+    }
+    if (node->_next) {
+        node->_next->_prev = node->_prev;
+    } else {
+        _tail = node->_prev;
+    }
+    retainedNode->_prev = nil;
+    retainedNode->_next = nil;
+    retainedNode.list = nil;
+    _count--;
+    _size -= retainedNode.size;
+}
+
+- (void)moveNodeToTail:(DFDiskCacheListNode *)node {
+    if (node.list == self && node != _tail) {
+        DFDiskCacheListNode *retainedNode = node;
+        [self removeNode:retainedNode];
+        [self appendNode:retainedNode];
+    }
+}
+
+- (void)setSize:(unsigned long long)size forNode:(DFDiskCacheListNode *)node {
+    if (node.list == self) {
+        _size = _size - node.size + size;
+    }
+    node.size = size;
+}
+
+- (void)removeAllNodes {
+    // Nodes are unlinked iteratively to avoid deep recursion when releasing long chains.
+    DFDiskCacheListNode *node = _head;
+    while (node) {
+        DFDiskCacheListNode *next = node->_next;
+        node->_prev = nil;
+        node->_next = nil;
+        node.list = nil;
+        node = next;
+    }
+    _head = nil;
+    _tail = nil;
+    _count = 0;
+    _size = 0;
+}
+
+@end
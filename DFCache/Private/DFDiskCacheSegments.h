@@ -0,0 +1,87 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+#import "DFDiskCacheIndex.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Log-structured storage for small entries. Entries are appended to large segment files, each entry is read with a single pread using its location.
+ @discussion Segment file consists of a header followed by records. Each record has a fixed size header (magic, body length, body checksum, record type) and a body with entry filename, attributes and data. Removals are recorded as tombstones so that removed entries are not restored when the segments are scanned after the journal is lost. Entries replaced or removed since they were appended become dead space which is reclaimed by compaction.
+ @note Segments are thread-safe. Reads don't block each other and are not blocked by appends.
+ */
+@interface DFDiskCacheSegments : NSObject
+
+/*! Initializes segments that keep segment files in the given directory. Directory is created lazily.
+ */
+- (instancetype)initWithDirectoryPath:(NSString *)path NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Returns segments directory path.
+ */
+@property (nonatomic, readonly) NSString *path;
+
+/*! Size after which the segment that entries are appended to is sealed and a new segment is started. Default value is 4 Mb.
+ */
+@property (nonatomic) unsigned long long segmentSizeLimit;
+
+/*! Appends entry to the active segment and counts it as live.
+ @param location On return contains the location of the appended record.
+ @return YES if the entry was appended.
+ */
+- (BOOL)appendData:(NSData *)data attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes filename:(NSString *)filename location:(DFDiskCacheLocation *)location;
+
+/*! Appends tombstone for the given filename.
+ */
+- (void)appendTombstoneForFilename:(NSString *)filename;
+
+/*! Writes the segments that records were appended to since the last synchronization to stable storage. Segments directory is synchronized as well if new segments were created.
+ @return NO if any of the segments couldn't be synchronized.
+ */
+- (BOOL)synchronize;
+
+/*! Reads the record at the given location with a single pread and verifies it. Returns nil if the segment no longer exists or if the record is corrupted.
+ */
+- (nullable NSData *)dataAtLocation:(DFDiskCacheLocation)location filename:(NSString *)filename attributes:(NSDictionary<NSString *, NSData *> *_Nullable *_Nullable)attributes;
+
+/*! Returns YES if the segment with a given identifier exists.
+ */
+- (BOOL)containsSegment:(uint32_t)segment;
+
+/*! Counts record at the given location as live. Used when the entries are restored from the journal.
+ */
+- (void)retainLocation:(DFDiskCacheLocation)location;
+
+/*! Counts record at the given location as dead space.
+ */
+- (void)releaseLocation:(DFDiskCacheLocation)location;
+
+/*! Scans all segments and returns entries that were appended and not removed since. Access dates are set to the segments modification dates.
+ */
+- (NSArray<DFDiskCacheEntry *> *)scanEntries;
+
+/*! Returns YES if any of the segments would be compacted by compactWithIndex:.
+ */
+- (BOOL)needsCompaction;
+
+/*! Copies live records from the segments that consist mostly of dead space (or that are too small) to the active segment and deletes those segments. Records are checked against and moved in the given index. Segment is kept if any of its records can't be copied, e.g. when the disk is full.
+ */
+- (void)compactWithIndex:(DFDiskCacheIndex *)index;
+
+/*! Returns total size of all segments, in bytes.
+ */
+@property (nonatomic, readonly) unsigned long long totalSize;
+
+/*! Returns total size of live records, in bytes.
+ */
+@property (nonatomic, readonly) unsigned long long liveSize;
+
+/*! Deletes all segments.
+ */
+- (void)removeAllSegments;
+
+@end
+
+NS_ASSUME_NONNULL_END
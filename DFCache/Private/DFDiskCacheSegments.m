@@ -0,0 +1,581 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCachePrivate.h"
+#import "DFDiskCacheSegments.h"
+#import <fcntl.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static const uint32_t DFDiskCacheSegmentMagic = 0x47534644; // "DFSG"
+static const uint32_t DFDiskCacheSegmentRecordMagic = 0x52534644; // "DFSR"
+static const uint32_t DFDiskCacheSegmentVersion = 1;
+
+typedef NS_ENUM(uint8_t, DFDiskCacheSegmentRecord) {
+    DFDiskCacheSegmentRecordPut = 1,
+    DFDiskCacheSegmentRecordTombstone = 2
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} _DFSegmentHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length; // Length of the body
+    uint32_t checksum; // Checksum of the body
+    uint8_t type;
+    uint8_t reserved[3];
+} _DFSegmentRecordHeader;
+
+#pragma mark - Encoding
+
+static inline void
+_DFSegmentAppendString(NSMutableData *data, NSString *string) {
+    NSData *utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+    uint16_t length = utf8.length <= UINT16_MAX ? (uint16_t)utf8.length : 0;
+    [data appendBytes:&length length:sizeof(length)];
+    [data appendBytes:utf8.bytes length:length];
+}
+
+static NSData *
+_DFSegmentRecord(DFDiskCacheSegmentRecord type, NSString *filename, NSDictionary *attributes, NSData *value) {
+    NSMutableData *record = [[NSMutableData alloc] initWithCapacity:sizeof(_DFSegmentRecordHeader) + filename.length + value.length + 64];
+    record.length = sizeof(_DFSegmentRecordHeader);
+    _DFSegmentAppendString(record, filename);
+    if (type == DFDiskCacheSegmentRecordPut) {
+        uint16_t count = (uint16_t)MIN(attributes.count, UINT16_MAX);
+        [record appendBytes:&count length:sizeof(count)];
+        [attributes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSData *attribute, BOOL *stop) {
+            uint32_t length = (uint32_t)attribute.length;
+            _DFSegmentAppendString(record, name);
+            [record appendBytes:&length length:sizeof(length)];
+            [record appendData:attribute];
+        }];
+        uint32_t length = (uint32_t)value.length;
+        [record appendBytes:&length length:sizeof(length)];
+        [record appendData:value];
+    }
+    _DFSegmentRecordHeader header = {0};
+    header.magic = DFDiskCacheSegmentRecordMagic;
+    header.length = (uint32_t)(record.length - sizeof(header));
+    header.checksum = _dwarf_cache_checksum((const uint8_t *)record.bytes + sizeof(header), header.length);
+    header.type = type;
+    [record replaceBytesInRange:NSMakeRange(0, sizeof(header)) withBytes:&header];
+    return record;
+}
+
+#pragma mark - Decoding
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} _DFSegmentReader;
+
+static inline BOOL
+_DFSegmentRead(_DFSegmentReader *reader, void *buffer, size_t length) {
+    if (reader->length - reader->offset < length) {
+        return NO;
+    }
+    memcpy(buffer, reader->bytes + reader->offset, length);
+    reader->offset += length;
+    return YES;
+}
+
+static inline NSString *
+_DFSegmentReadString(_DFSegmentReader *reader) {
+    uint16_t length;
+    if (!_DFSegmentRead(reader, &length, sizeof(length)) || reader->length - reader->offset < length) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes:reader->bytes + reader->offset length:length encoding:NSUTF8StringEncoding];
+    reader->offset += length;
+    return string;
+}
+
+/*! Reads and verifies record header. Returns NO if the bytes don't start with a complete record.
+ */
+static BOOL
+_DFSegmentReadRecordHeader(const uint8_t *bytes, size_t length, _DFSegmentRecordHeader *header) {
+    if (length < sizeof(*header)) {
+        return NO;
+    }
+    memcpy(header, bytes, sizeof(*header));
+    return header->magic == DFDiskCacheSegmentRecordMagic && length - sizeof(*header) >= header->length;
+}
+
+/*! Parses the body of the record. Range of the value is relative to the beginning of the body.
+ */
+static BOOL
+_DFSegmentParseRecordBody(const uint8_t *bytes, _DFSegmentRecordHeader header, NSString **filename, NSDictionary **attributes, NSRange *valueRange) {
+    if (_dwarf_cache_checksum(bytes, header.length) != header.checksum) {
+        return NO;
+    }
+    _DFSegmentReader reader = { bytes, header.length, 0 };
+    if (!(*filename = _DFSegmentReadString(&reader))) {
+        return NO;
+    }
+    if (header.type != DFDiskCacheSegmentRecordPut) {
+        return header.type == DFDiskCacheSegmentRecordTombstone;
+    }
+    uint16_t count;
+    if (!_DFSegmentRead(&reader, &count, sizeof(count))) {
+        return NO;
+    }
+    NSMutableDictionary *parsedAttributes = attributes && count ? [[NSMutableDictionary alloc] initWithCapacity:count] : nil;
+    for (uint16_t i = 0; i < count; i++) {
+        NSString *name = _DFSegmentReadString(&reader);
+        uint32_t length;
+        if (!name || !_DFSegmentRead(&reader, &length, sizeof(length)) || reader.length - reader.offset < length) {
+            return NO;
+        }
+        parsedAttributes[name] = [NSData dataWithBytes:reader.bytes + reader.offset length:length];
+        reader.offset += length;
+    }
+    uint32_t length;
+    if (!_DFSegmentRead(&reader, &length, sizeof(length)) || reader.length - reader.offset < length) {
+        return NO;
+    }
+    if (attributes) {
+        *attributes = parsedAttributes;
+    }
+    *valueRange = NSMakeRange(reader.offset, length);
+    return YES;
+}
+
+static BOOL
+_DFSegmentWrite(int fd, const void *bytes, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const uint8_t *)bytes + written;
+        length -= written;
+        offset += written;
+    }
+    return YES;
+}
+
+#pragma mark - _DFDiskCacheSegment
+
+@interface _DFDiskCacheSegment : NSObject {
+    @package
+    uint32_t _identifier;
+    int _fd;
+    unsigned long long _size;
+    unsigned long long _liveSize;
+    NSTimeInterval _modificationDate;
+}
+
+@end
+
+@implementation _DFDiskCacheSegment
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+@end
+
+#pragma mark - DFDiskCacheSegments
+
+@implementation DFDiskCacheSegments {
+    /*! Guards appends and sizes of the segments.
+     */
+    pthread_mutex_t _mutex;
+
+    /*! Guards segments dictionary and segment file descriptors. Reads take read lock, adding and deleting segments requires write lock.
+     */
+    pthread_rwlock_t _lock;
+
+    NSMutableDictionary *_segments;
+    _DFDiskCacheSegment *_activeSegment;
+    uint32_t _lastIdentifier;
+
+    /*! Segments that records were appended to since the last synchronization.
+     */
+    NSMutableSet *_unsynchronizedSegments;
+    BOOL _directoryNeedsSynchronization;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_mutex);
+    pthread_rwlock_destroy(&_lock);
+}
+
+- (instancetype)initWithDirectoryPath:(NSString *)path {
+    if (self = [super init]) {
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_rwlock_init(&_lock, NULL);
+        _path = [path copy];
+        _segmentSizeLimit = 1024 * 1024 * 4; // 4 Mb
+        _segments = [NSMutableDictionary new];
+        _unsynchronizedSegments = [NSMutableSet new];
+        [self _loadSegments];
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+- (NSString *)_pathForIdentifier:(uint32_t)identifier {
+    return [_path stringByAppendingPathComponent:[NSString stringWithFormat:@"%08x", identifier]];
+}
+
+/*! Opens existing segments. Segments from previous launches are sealed, new records are always appended to a new segment so that a torn tail of the last segment never precedes valid records.
+ */
+- (void)_loadSegments {
+    for (NSString *filename in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_path error:nil]) {
+        char *end;
+        unsigned long identifier = strtoul(filename.UTF8String, &end, 16);
+        if (filename.length != 8 || *end != '\0' || identifier == 0 || identifier > UINT32_MAX) {
+            continue;
+        }
+        NSString *path = [_path stringByAppendingPathComponent:filename];
+        int fd = open(path.fileSystemRepresentation, O_RDONLY);
+        struct stat info;
+        if (fd < 0) {
+            continue;
+        }
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            continue;
+        }
+        _DFDiskCacheSegment *segment = [_DFDiskCacheSegment new];
+        segment->_identifier = (uint32_t)identifier;
+        segment->_fd = fd;
+        segment->_size = info.st_size;
+        segment->_modificationDate = (NSTimeInterval)info.st_mtime - kCFAbsoluteTimeIntervalSince1970;
+        _segments[@(segment->_identifier)] = segment;
+        _lastIdentifier = MAX(_lastIdentifier, segment->_identifier);
+    }
+}
+
+#pragma mark - Append
+
+- (BOOL)appendData:(NSData *)data attributes:(NSDictionary *)attributes filename:(NSString *)filename location:(DFDiskCacheLocation *)location {
+    NSData *record = _DFSegmentRecord(DFDiskCacheSegmentRecordPut, filename, attributes, data);
+    return [self _appendRecord:record live:YES location:location];
+}
+
+- (void)appendTombstoneForFilename:(NSString *)filename {
+    NSData *record = _DFSegmentRecord(DFDiskCacheSegmentRecordTombstone, filename, nil, nil);
+    [self _appendRecord:record live:NO location:NULL];
+}
+
+- (BOOL)_appendRecord:(NSData *)record live:(BOOL)live location:(DFDiskCacheLocation *)location {
+    if (record.length > UINT32_MAX) {
+        return NO;
+    }
+    BOOL success = NO;
+    pthread_mutex_lock(&_mutex);
+    _DFDiskCacheSegment *segment = [self _activeSegmentForRecordLength:record.length];
+    if (segment && _DFSegmentWrite(segment->_fd, record.bytes, record.length, segment->_size)) {
+        if (location) {
+            location->segment = segment->_identifier;
+            location->length = (uint32_t)record.length;
+            location->offset = segment->_size;
+        }
+        segment->_size += record.length;
+        [_unsynchronizedSegments addObject:segment];
+        if (live) {
+            segment->_liveSize += record.length;
+        }
+        success = YES;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return success;
+}
+
+/*! Returns segment that the record of the given length should be appended to. Seals active segment and starts a new one when the active segment is full.
+ @note Called with the mutex held.
+ */
+- (_DFDiskCacheSegment *)_activeSegmentForRecordLength:(NSUInteger)length {
+    if (_activeSegment && (_activeSegment->_size + length <= _segmentSizeLimit || _activeSegment->_size == sizeof(_DFSegmentHeader))) {
+        return _activeSegment;
+    }
+    mkdir(_path.fileSystemRepresentation, 0755);
+    uint32_t identifier = _lastIdentifier + 1;
+    int fd = open([self _pathForIdentifier:identifier].fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nil;
+    }
+    _DFSegmentHeader header = { DFDiskCacheSegmentMagic, DFDiskCacheSegmentVersion };
+    if (!_DFSegmentWrite(fd, &header, sizeof(header), 0)) {
+        close(fd);
+        return nil;
+    }
+    _DFDiskCacheSegment *segment = [_DFDiskCacheSegment new];
+    segment->_identifier = identifier;
+    segment->_fd = fd;
+    segment->_size = sizeof(header);
+    segment->_modificationDate = CFAbsoluteTimeGetCurrent();
+    _lastIdentifier = identifier;
+    _activeSegment = segment;
+    _directoryNeedsSynchronization = YES;
+
+    pthread_rwlock_wrlock(&_lock);
+    _segments[@(identifier)] = segment;
+    pthread_rwlock_unlock(&_lock);
+    return segment;
+}
+
+- (BOOL)synchronize {
+    pthread_mutex_lock(&_mutex);
+    NSSet *segments = [_unsynchronizedSegments copy];
+    BOOL synchronizeDirectory = _directoryNeedsSynchronization;
+    [_unsynchronizedSegments removeAllObjects];
+    _directoryNeedsSynchronization = NO;
+    pthread_mutex_unlock(&_mutex);
+
+    // Segments are retained, their descriptors stay open even if the segments are deleted meanwhile.
+    BOOL success = YES;
+    for (_DFDiskCacheSegment *segment in segments) {
+        success = _dwarf_cache_fsync(segment->_fd, NO) && success;
+    }
+    if (synchronizeDirectory) {
+        success = _dwarf_cache_fsync_path(_path, NO) && success;
+    }
+    return success;
+}
+
+#pragma mark - Read
+
+- (NSData *)dataAtLocation:(DFDiskCacheLocation)location filename:(NSString *)filename attributes:(NSDictionary **)attributes {
+    if (location.length < sizeof(_DFSegmentRecordHeader)) {
+        return nil;
+    }
+    void *bytes = malloc(location.length);
+    if (!bytes) {
+        return nil;
+    }
+    ssize_t length = -1;
+    pthread_rwlock_rdlock(&_lock);
+    _DFDiskCacheSegment *segment = _segments[@(location.segment)];
+    if (segment) {
+        do {
+            length = pread(segment->_fd, bytes, location.length, (off_t)location.offset);
+        } while (length < 0 && errno == EINTR);
+    }
+    pthread_rwlock_unlock(&_lock);
+
+    NSData *record = [NSData dataWithBytesNoCopy:bytes length:location.length freeWhenDone:YES];
+    _DFSegmentRecordHeader header;
+    NSString *recordFilename;
+    NSRange range;
+    if (length != location.length ||
+        !_DFSegmentReadRecordHeader(bytes, location.length, &header) ||
+        header.type != DFDiskCacheSegmentRecordPut ||
+        !_DFSegmentParseRecordBody((const uint8_t *)bytes + sizeof(header), header, &recordFilename, attributes, &range) ||
+        ![recordFilename isEqualToString:filename]) {
+        return nil;
+    }
+    return [record subdataWithRange:NSMakeRange(range.location + sizeof(header), range.length)];
+}
+
+- (BOOL)containsSegment:(uint32_t)segment {
+    pthread_rwlock_rdlock(&_lock);
+    BOOL contains = _segments[@(segment)] != nil;
+    pthread_rwlock_unlock(&_lock);
+    return contains;
+}
+
+#pragma mark - Live Size
+
+- (void)retainLocation:(DFDiskCacheLocation)location {
+    pthread_mutex_lock(&_mutex);
+    _DFDiskCacheSegment *segment = _segments[@(location.segment)];
+    if (segment) {
+        segment->_liveSize += location.length;
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (void)releaseLocation:(DFDiskCacheLocation)location {
+    pthread_mutex_lock(&_mutex);
+    _DFDiskCacheSegment *segment = _segments[@(location.segment)];
+    if (segment) {
+        segment->_liveSize -= MIN(segment->_liveSize, location.length);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (unsigned long long)totalSize {
+    unsigned long long size = 0;
+    pthread_mutex_lock(&_mutex);
+    for (_DFDiskCacheSegment *segment in [_segments allValues]) {
+        size += segment->_size;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return size;
+}
+
+- (unsigned long long)liveSize {
+    unsigned long long size = 0;
+    pthread_mutex_lock(&_mutex);
+    for (_DFDiskCacheSegment *segment in [_segments allValues]) {
+        size += segment->_liveSize;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return size;
+}
+
+#pragma mark - Scan
+
+/*! Returns segments sorted by identifier, the oldest segment goes first.
+ */
+- (NSArray *)_sortedSegments {
+    pthread_rwlock_rdlock(&_lock);
+    NSArray *segments = [[_segments allValues] sortedArrayUsingComparator:^NSComparisonResult(_DFDiskCacheSegment *segment1, _DFDiskCacheSegment *segment2) {
+        return segment1->_identifier < segment2->_identifier ? NSOrderedAscending : (segment1->_identifier > segment2->_identifier ? NSOrderedDescending : NSOrderedSame);
+    }];
+    pthread_rwlock_unlock(&_lock);
+    return segments;
+}
+
+/*! Enumerates records of the given segment. Enumeration stops at the first record that is truncated or when the block sets stop to YES.
+ */
+- (void)_enumerateRecordsInSegment:(_DFDiskCacheSegment *)segment usingBlock:(void (^)(DFDiskCacheSegmentRecord type, NSString *filename, DFDiskCacheLocation location, NSData *record, BOOL *stop))block {
+    NSData *contents = [NSData dataWithContentsOfFile:[self _pathForIdentifier:segment->_identifier] options:NSDataReadingMappedIfSafe error:nil];
+    _DFSegmentHeader header;
+    if (contents.length < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, contents.bytes, sizeof(header));
+    if (header.magic != DFDiskCacheSegmentMagic || header.version != DFDiskCacheSegmentVersion) {
+        return;
+    }
+    const uint8_t *bytes = contents.bytes;
+    size_t offset = sizeof(header);
+    _DFSegmentRecordHeader recordHeader;
+    BOOL stop = NO;
+    while (!stop && _DFSegmentReadRecordHeader(bytes + offset, contents.length - offset, &recordHeader)) {
+        size_t length = sizeof(recordHeader) + recordHeader.length;
+        NSString *filename;
+        NSRange range;
+        // Records with invalid checksum are skipped, the length of the record is still trusted since the header is intact.
+        if (_DFSegmentParseRecordBody(bytes + offset + sizeof(recordHeader), recordHeader, &filename, NULL, &range)) {
+            DFDiskCacheLocation location = { segment->_identifier, (uint32_t)length, offset };
+            block(recordHeader.type, filename, location, [contents subdataWithRange:NSMakeRange(offset, length)], &stop);
+        }
+        offset += length;
+    }
+}
+
+- (NSArray *)scanEntries {
+    NSMutableDictionary *entries = [NSMutableDictionary new];
+    for (_DFDiskCacheSegment *segment in [self _sortedSegments]) {
+        [self _enumerateRecordsInSegment:segment usingBlock:^(DFDiskCacheSegmentRecord type, NSString *filename, DFDiskCacheLocation location, NSData *record, BOOL *stop) {
+            if (type == DFDiskCacheSegmentRecordPut) {
+                DFDiskCacheEntry *entry = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+                entry.size = location.length;
+                entry.location = location;
+                entry.accessDate = segment->_modificationDate;
+                entries[filename] = entry;
+            } else {
+                [entries removeObjectForKey:filename];
+            }
+        }];
+    }
+    return [entries allValues];
+}
+
+#pragma mark - Compaction
+
+- (BOOL)needsCompaction {
+    for (_DFDiskCacheSegment *segment in [self _sortedSegments]) {
+        if ([self _shouldCompactSegment:segment]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+/*! Returns YES if the segment is sealed and consists mostly of dead space or is too small.
+ */
+- (BOOL)_shouldCompactSegment:(_DFDiskCacheSegment *)segment {
+    pthread_mutex_lock(&_mutex);
+    BOOL compact = segment != _activeSegment && (segment->_liveSize * 2 < segment->_size || segment->_size < _segmentSizeLimit / 4);
+    pthread_mutex_unlock(&_mutex);
+    return compact;
+}
+
+- (void)compactWithIndex:(DFDiskCacheIndex *)index {
+    // Compaction is not reentrant, only one compaction runs at a time.
+    @synchronized(self) {
+        BOOL oldest = YES;
+        for (_DFDiskCacheSegment *segment in [self _sortedSegments]) {
+            BOOL compact = [self _shouldCompactSegment:segment];
+            if (!compact || ![self _compactSegment:segment oldest:oldest index:index]) {
+                oldest = NO;
+            }
+        }
+    }
+}
+
+/*! Copies live records and the tombstones that are still needed to the active segment and removes the segment.
+ @return NO if any record couldn't be copied (e.g. the disk is full). The segment is kept, records that were already copied are dead in it.
+ */
+- (BOOL)_compactSegment:(_DFDiskCacheSegment *)segment oldest:(BOOL)oldest index:(DFDiskCacheIndex *)index {
+    __block BOOL copied = YES;
+    [self _enumerateRecordsInSegment:segment usingBlock:^(DFDiskCacheSegmentRecord type, NSString *filename, DFDiskCacheLocation location, NSData *record, BOOL *stop) {
+        if (type == DFDiskCacheSegmentRecordPut) {
+            DFDiskCacheLocation currentLocation;
+            if (![index getLocation:&currentLocation forFilename:filename] || !DFDiskCacheLocationEqualToLocation(currentLocation, location)) {
+                return; // Dead record
+            }
+            DFDiskCacheLocation newLocation;
+            if (![self _appendRecord:record live:YES location:&newLocation]) {
+                copied = NO;
+            } else if ([index moveFilename:filename fromLocation:location toLocation:newLocation]) {
+                [self releaseLocation:location];
+            } else {
+                // Entry was replaced or removed while being copied.
+                [self releaseLocation:newLocation];
+            }
+        } else if (!oldest && ![index getLocation:NULL forFilename:filename]) {
+            // Tombstone might still shadow a record in one of the older segments.
+            copied = [self _appendRecord:record live:NO location:NULL];
+        }
+        *stop = !copied;
+    }];
+    if (!copied) {
+        return NO;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    pthread_rwlock_wrlock(&_lock);
+    [_segments removeObjectForKey:@(segment->_identifier)];
+    pthread_rwlock_unlock(&_lock);
+    pthread_mutex_unlock(&_mutex);
+    unlink([self _pathForIdentifier:segment->_identifier].fileSystemRepresentation);
+    return YES;
+}
+
+#pragma mark - Remove
+
+- (void)removeAllSegments {
+    pthread_mutex_lock(&_mutex);
+    pthread_rwlock_wrlock(&_lock);
+    [_segments removeAllObjects];
+    [_unsynchronizedSegments removeAllObjects];
+    _activeSegment = nil;
+    pthread_rwlock_unlock(&_lock);
+    [[NSFileManager defaultManager] removeItemAtPath:_path error:nil];
+    pthread_mutex_unlock(&_mutex);
+}
+
+@end
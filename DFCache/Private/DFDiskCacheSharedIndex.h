@@ -0,0 +1,91 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+@class DFDiskCacheEntry;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Index of the entry files shared by all processes (and disk cache instances) that use the same storage directory. Keeps size, access date and expiration date of each entry.
+ @discussion Index is an open addressing hash table stored in a memory-mapped file in the storage directory. Access is serialized by an exclusive flock on the index file, so the lock is released by the system when the process that holds it dies. The index is marked as dirty while it's locked, the process that finds it dirty after taking the lock repairs the totals left by the process that died in the middle of the update. Index that is created, found corrupted or left in the middle of a resize needs to be populated by scanning the storage directory.
+ @note Methods take the lock themselves. Lock is recursive, use lock and unlock methods to perform a sequence of operations atomically.
+ */
+@interface DFDiskCacheSharedIndex : NSObject <NSLocking>
+
+/*! Opens or creates index files in the given directory.
+ @return Index or nil if the index files can't be opened.
+ */
+- (nullable instancetype)initWithDirectoryPath:(NSString *)path error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Returns NO if the index was created, found corrupted or left in the middle of a resize and has to be populated.
+ */
+@property (nonatomic, readonly, getter=isPopulated) BOOL populated;
+
+/*! Returns total size of all entries, in bytes.
+ */
+@property (nonatomic, readonly) unsigned long long totalSize;
+
+/*! Returns number of entries in the index.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/*! Replaces contents of the index with the given entries and marks the index as populated.
+ */
+- (void)populateWithEntries:(NSArray<DFDiskCacheEntry *> *)entries;
+
+/*! Returns all entries, entries don't have keys.
+ */
+- (NSArray<DFDiskCacheEntry *> *)allEntries;
+
+/*! Returns YES and the size and expiration date of the entry if the index contains entry for the given filename.
+ */
+- (BOOL)getSize:(nullable unsigned long long *)size expirationDate:(nullable NSTimeInterval *)expirationDate forFilename:(NSString *)filename;
+
+/*! Inserts or updates entry for the given filename, access date is set to the current date.
+ @param expirationDate Expiration date expressed as a time interval since reference date, 0 means that entry never expires.
+ */
+- (void)setSize:(unsigned long long)size expirationDate:(NSTimeInterval)expirationDate forFilename:(NSString *)filename;
+
+/*! Updates access date of the entry.
+ @return YES if the index contains entry for the given filename.
+ */
+- (BOOL)touchFilename:(NSString *)filename;
+
+/*! Removes entry for the given filename.
+ @return YES if the entry was removed.
+ */
+- (BOOL)removeFilename:(NSString *)filename;
+
+/*! Removes entry only if it wasn't accessed or replaced since the given entry was returned by the index.
+ @return YES if the entry was removed.
+ */
+- (BOOL)removeEntry:(DFDiskCacheEntry *)entry;
+
+- (void)removeAllEntries;
+
+/*! Returns entries that expired before the given date, earliest first.
+ */
+- (NSArray<DFDiskCacheEntry *> *)expiredEntriesAtDate:(NSTimeInterval)date;
+
+/*! Returns the least recently accessed entries which total size is at least the given size, least recently accessed first.
+ */
+- (NSArray<DFDiskCacheEntry *> *)leastRecentlyUsedEntriesWithTotalSize:(unsigned long long)size;
+
+/*! Takes the eviction lock unless it's held by another process or disk cache instance. Doesn't block.
+ @return YES if the lock was taken.
+ */
+- (BOOL)tryLockEviction;
+
+- (void)unlockEviction;
+
+/*! Writes the index file to stable storage.
+ */
+- (BOOL)synchronize;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,589 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFDiskCacheIndex.h"
+#import "DFDiskCacheSharedIndex.h"
+#import <fcntl.h>
+#import <pthread.h>
+#import <sys/file.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static NSString *const DFDiskCacheSharedIndexFilename = @".df_shared_index";
+static NSString *const DFDiskCacheSharedIndexEvictionLockFilename = @".df_shared_index.eviction";
+
+static const uint32_t DFDiskCacheSharedIndexMagic = 0x44465349; // "DFSI"
+static const uint32_t DFDiskCacheSharedIndexVersion = 1;
+
+/*! Minimum number of slots in the hash table, must be a power of two.
+ */
+static const uint32_t DFDiskCacheSharedIndexMinimumSlotCount = 1024;
+
+typedef NS_ENUM(uint32_t, _DFSharedIndexSlotState) {
+    _DFSharedIndexSlotStateEmpty = 0,
+    _DFSharedIndexSlotStateUsed = 1,
+    _DFSharedIndexSlotStateRemoved = 2
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t count;
+    uint32_t removedCount;
+    /*! Set while the index is locked. Index that is found dirty after taking the lock was left by a process that died while holding the lock.
+     */
+    uint32_t dirty;
+    uint32_t populated;
+    uint32_t reserved;
+    uint64_t totalSize;
+} _DFSharedIndexHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t size;
+    double accessDate;
+    double expirationDate;
+    uint32_t state;
+    uint32_t filenameLength;
+    char filename[48];
+} _DFSharedIndexSlot;
+
+typedef struct {
+    const char *bytes;
+    size_t length;
+    uint64_t hash;
+} _DFSharedIndexKey;
+
+typedef struct {
+    double date;
+    uint32_t index;
+} _DFSharedIndexSortItem;
+
+static size_t
+_DFSharedIndexLength(uint32_t slotCount) {
+    return sizeof(_DFSharedIndexHeader) + (size_t)slotCount * sizeof(_DFSharedIndexSlot);
+}
+
+/*! Makes hash table key for the given filename. Filenames produced by the key hash functions always fit into the slot.
+ @return NO if the filename doesn't fit into the slot.
+ */
+static BOOL
+_DFSharedIndexKeyMake(NSString *filename, _DFSharedIndexKey *key) {
+    const char *bytes = filename.UTF8String;
+    if (!bytes) {
+        return NO;
+    }
+    const size_t length = strlen(bytes);
+    if (length >= sizeof(((_DFSharedIndexSlot *)NULL)->filename)) {
+        return NO;
+    }
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 1099511628211ULL;
+    }
+    *key = (_DFSharedIndexKey){ bytes, length, hash };
+    return YES;
+}
+
+static DFDiskCacheEntry *
+_DFSharedIndexEntry(const _DFSharedIndexSlot *slot) {
+    NSString *filename = [[NSString alloc] initWithBytes:slot->filename length:slot->filenameLength encoding:NSUTF8StringEncoding];
+    if (!filename) {
+        return nil;
+    }
+    DFDiskCacheEntry *entry = [[DFDiskCacheEntry alloc] initWithFilename:filename];
+    entry.size = slot->size;
+    entry.accessDate = slot->accessDate;
+    entry.expirationDate = slot->expirationDate;
+    return entry;
+}
+
+static int
+_DFSharedIndexCompareSortItems(const void *lhs, const void *rhs) {
+    const double date1 = ((const _DFSharedIndexSortItem *)lhs)->date;
+    const double date2 = ((const _DFSharedIndexSortItem *)rhs)->date;
+    return date1 < date2 ? -1 : (date1 > date2 ? 1 : 0);
+}
+
+@implementation DFDiskCacheSharedIndex {
+    int _fd;
+    int _evictionFd;
+    _DFSharedIndexHeader *_header;
+    _DFSharedIndexSlot *_slots;
+    size_t _mappedLength;
+
+    /*! Recursive mutex that serializes threads of the current process, flock is only taken by the outermost lock.
+     */
+    pthread_mutex_t _mutex;
+    NSUInteger _lockCount;
+}
+
+- (void)dealloc {
+    [self _unmap];
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    if (_evictionFd >= 0) {
+        close(_evictionFd);
+    }
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (instancetype)initWithDirectoryPath:(NSString *)path error:(NSError **)error {
+    if (self = [super init]) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&_mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        _fd = open([path stringByAppendingPathComponent:DFDiskCacheSharedIndexFilename].fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        _evictionFd = _fd < 0 ? -1 : open([path stringByAppendingPathComponent:DFDiskCacheSharedIndexEvictionLockFilename].fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (_evictionFd < 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            }
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+#pragma mark - NSLocking
+
+- (void)lock {
+    pthread_mutex_lock(&_mutex);
+    if (_lockCount++ == 0) {
+        while (flock(_fd, LOCK_EX) != 0 && errno == EINTR) {}
+        [self _prepareIndex];
+    }
+}
+
+- (void)unlock {
+    if (--_lockCount == 0) {
+        if (_header) {
+            _header->dirty = 0;
+        }
+        flock(_fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+#pragma mark - Entries
+
+- (BOOL)isPopulated {
+    [self lock];
+    BOOL populated = _header && _header->populated;
+    [self unlock];
+    return populated;
+}
+
+- (unsigned long long)totalSize {
+    [self lock];
+    unsigned long long totalSize = _header ? _header->totalSize : 0;
+    [self unlock];
+    return totalSize;
+}
+
+- (NSUInteger)count {
+    [self lock];
+    NSUInteger count = _header ? _header->count : 0;
+    [self unlock];
+    return count;
+}
+
+- (void)populateWithEntries:(NSArray *)entries {
+    [self lock];
+    uint32_t slotCount = DFDiskCacheSharedIndexMinimumSlotCount;
+    while (slotCount < entries.count * 2) {
+        slotCount <<= 1;
+    }
+    if ([self _resetWithSlotCount:slotCount]) {
+        for (DFDiskCacheEntry *entry in entries) {
+            _DFSharedIndexKey key;
+            if (_DFSharedIndexKeyMake(entry.filename, &key)) {
+                [self _insertKey:&key size:entry.size accessDate:entry.accessDate expirationDate:entry.expirationDate];
+            }
+        }
+        _header->populated = 1;
+    }
+    [self unlock];
+}
+
+- (NSArray *)allEntries {
+    NSMutableArray *entries = [NSMutableArray new];
+    [self lock];
+    for (uint32_t i = 0; _header && i < _header->slotCount; i++) {
+        DFDiskCacheEntry *entry = _slots[i].state == _DFSharedIndexSlotStateUsed ? _DFSharedIndexEntry(&_slots[i]) : nil;
+        if (entry) {
+            [entries addObject:entry];
+        }
+    }
+    [self unlock];
+    return entries;
+}
+
+- (BOOL)getSize:(unsigned long long *)size expirationDate:(NSTimeInterval *)expirationDate forFilename:(NSString *)filename {
+    _DFSharedIndexKey key;
+    if (!_DFSharedIndexKeyMake(filename, &key)) {
+        return NO;
+    }
+    [self lock];
+    const int64_t index = [self _indexOfKey:&key insertionIndex:NULL];
+    if (index >= 0) {
+        if (size) {
+            *size = _slots[index].size;
+        }
+        if (expirationDate) {
+            *expirationDate = _slots[index].expirationDate;
+        }
+    }
+    [self unlock];
+    return index >= 0;
+}
+
+- (void)setSize:(unsigned long long)size expirationDate:(NSTimeInterval)expirationDate forFilename:(NSString *)filename {
+    _DFSharedIndexKey key;
+    if (!_DFSharedIndexKeyMake(filename, &key)) {
+        return;
+    }
+    [self lock];
+    const int64_t index = [self _indexOfKey:&key insertionIndex:NULL];
+    if (index >= 0) {
+        _DFSharedIndexSlot *slot = &_slots[index];
+        _header->totalSize = _header->totalSize - slot->size + size;
+        slot->size = size;
+        slot->accessDate = CFAbsoluteTimeGetCurrent();
+        slot->expirationDate = expirationDate;
+    } else if (_header && [self _reserveSlot]) {
+        [self _insertKey:&key size:size accessDate:CFAbsoluteTimeGetCurrent() expirationDate:expirationDate];
+    }
+    [self unlock];
+}
+
+- (BOOL)touchFilename:(NSString *)filename {
+    _DFSharedIndexKey key;
+    if (!_DFSharedIndexKeyMake(filename, &key)) {
+        return NO;
+    }
+    [self lock];
+    const int64_t index = [self _indexOfKey:&key insertionIndex:NULL];
+    if (index >= 0) {
+        _slots[index].accessDate = CFAbsoluteTimeGetCurrent();
+    }
+    [self unlock];
+    return index >= 0;
+}
+
+- (BOOL)removeFilename:(NSString *)filename {
+    _DFSharedIndexKey key;
+    if (!_DFSharedIndexKeyMake(filename, &key)) {
+        return NO;
+    }
+    [self lock];
+    const int64_t index = [self _indexOfKey:&key insertionIndex:NULL];
+    if (index >= 0) {
+        [self _removeSlotAtIndex:(uint32_t)index];
+    }
+    [self unlock];
+    return index >= 0;
+}
+
+- (BOOL)removeEntry:(DFDiskCacheEntry *)entry {
+    _DFSharedIndexKey key;
+    if (!_DFSharedIndexKeyMake(entry.filename, &key)) {
+        return NO;
+    }
+    [self lock];
+    const int64_t index = [self _indexOfKey:&key insertionIndex:NULL];
+    const BOOL unchanged = index >= 0 && _slots[index].accessDate == entry.accessDate && _slots[index].size == entry.size;
+    if (unchanged) {
+        [self _removeSlotAtIndex:(uint32_t)index];
+    }
+    [self unlock];
+    return unchanged;
+}
+
+- (void)removeAllEntries {
+    [self lock];
+    if (_header && [self _resetWithSlotCount:DFDiskCacheSharedIndexMinimumSlotCount]) {
+        _header->populated = 1;
+    }
+    [self unlock];
+}
+
+- (NSArray *)expiredEntriesAtDate:(NSTimeInterval)date {
+    NSMutableArray *entries = [NSMutableArray new];
+    [self lock];
+    uint32_t count;
+    _DFSharedIndexSortItem *items = [self _sortedItemsWithDate:^double(const _DFSharedIndexSlot *slot) {
+        return (slot->expirationDate > 0 && slot->expirationDate <= date) ? slot->expirationDate : -1;
+    } count:&count];
+    for (uint32_t i = 0; i < count; i++) {
+        DFDiskCacheEntry *entry = _DFSharedIndexEntry(&_slots[items[i].index]);
+        if (entry) {
+            [entries addObject:entry];
+        }
+    }
+    free(items);
+    [self unlock];
+    return entries;
+}
+
+- (NSArray *)leastRecentlyUsedEntriesWithTotalSize:(unsigned long long)size {
+    NSMutableArray *entries = [NSMutableArray new];
+    [self lock];
+    uint32_t count;
+    _DFSharedIndexSortItem *items = [self _sortedItemsWithDate:^double(const _DFSharedIndexSlot *slot) {
+        return slot->accessDate;
+    } count:&count];
+    unsigned long long totalSize = 0;
+    for (uint32_t i = 0; i < count && totalSize < size; i++) {
+        DFDiskCacheEntry *entry = _DFSharedIndexEntry(&_slots[items[i].index]);
+        if (entry) {
+            [entries addObject:entry];
+            totalSize += entry.size;
+        }
+    }
+    free(items);
+    [self unlock];
+    return entries;
+}
+
+#pragma mark - Eviction Lock
+
+- (BOOL)tryLockEviction {
+    int result;
+    while ((result = flock(_evictionFd, LOCK_EX | LOCK_NB)) != 0 && errno == EINTR) {}
+    return result == 0;
+}
+
+- (void)unlockEviction {
+    flock(_evictionFd, LOCK_UN);
+}
+
+- (BOOL)synchronize {
+    [self lock];
+    BOOL success = _header && msync(_header, _mappedLength, MS_SYNC) == 0;
+    [self unlock];
+    return success;
+}
+
+#pragma mark - Hash Table
+
+/*! Maps the index file (remapping it if it was resized by another process), validates the header and repairs the index that was left dirty. Called when the flock is taken.
+ */
+- (void)_prepareIndex {
+    struct stat info;
+    if (fstat(_fd, &info) != 0) {
+        [self _unmap];
+        return;
+    }
+    if ((size_t)info.st_size != _mappedLength) {
+        [self _unmap];
+        if ((size_t)info.st_size >= sizeof(_DFSharedIndexHeader)) {
+            [self _mapLength:(size_t)info.st_size];
+        }
+    }
+    const uint32_t slotCount = _header ? _header->slotCount : 0;
+    const BOOL valid = _header && _header->magic == DFDiskCacheSharedIndexMagic && _header->version == DFDiskCacheSharedIndexVersion && slotCount >= DFDiskCacheSharedIndexMinimumSlotCount && (slotCount & (slotCount - 1)) == 0 && _DFSharedIndexLength(slotCount) == _mappedLength;
+    if (!valid) {
+        // Index is created or corrupted, it has to be populated.
+        [self _resetWithSlotCount:DFDiskCacheSharedIndexMinimumSlotCount];
+    } else if (_header->dirty) {
+        [self _repair];
+    }
+    if (_header) {
+        _header->dirty = 1;
+    }
+}
+
+- (BOOL)_mapLength:(size_t)length {
+    void *bytes = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (bytes == MAP_FAILED) {
+        return NO;
+    }
+    _header = bytes;
+    _slots = (_DFSharedIndexSlot *)((uint8_t *)bytes + sizeof(_DFSharedIndexHeader));
+    _mappedLength = length;
+    return YES;
+}
+
+- (void)_unmap {
+    if (_header) {
+        munmap(_header, _mappedLength);
+    }
+    _header = NULL;
+    _slots = NULL;
+    _mappedLength = 0;
+}
+
+/*! Resizes the index file to fit the given number of slots and removes all entries. Index is marked as not populated.
+ */
+- (BOOL)_resetWithSlotCount:(uint32_t)slotCount {
+    const size_t length = _DFSharedIndexLength(slotCount);
+    if (length != _mappedLength) {
+        [self _unmap];
+        if (ftruncate(_fd, (off_t)length) != 0 || ![self _mapLength:length]) {
+            return NO;
+        }
+    }
+    memset(_header, 0, length);
+    _header->magic = DFDiskCacheSharedIndexMagic;
+    _header->version = DFDiskCacheSharedIndexVersion;
+    _header->slotCount = slotCount;
+    _header->dirty = 1;
+    return YES;
+}
+
+/*! Recalculates totals that might have been left inconsistent by the process that died in the middle of the update.
+ */
+- (void)_repair {
+    uint32_t count = 0;
+    uint32_t removedCount = 0;
+    uint64_t totalSize = 0;
+    for (uint32_t i = 0; i < _header->slotCount; i++) {
+        if (_slots[i].state == _DFSharedIndexSlotStateUsed) {
+            count++;
+            totalSize += _slots[i].size;
+        } else if (_slots[i].state == _DFSharedIndexSlotStateRemoved) {
+            removedCount++;
+        }
+    }
+    _header->count = count;
+    _header->removedCount = removedCount;
+    _header->totalSize = totalSize;
+}
+
+/*! Returns index of the slot that contains the given key or -1 if there is no such slot.
+ @param insertionIndex On return contains index of the slot that the key should be inserted into, -1 if the table is full.
+ */
+- (int64_t)_indexOfKey:(const _DFSharedIndexKey *)key insertionIndex:(int64_t *)insertionIndex {
+    int64_t insertion = -1;
+    const uint32_t slotCount = _header ? _header->slotCount : 0;
+    for (uint32_t i = 0; i < slotCount; i++) {
+        const uint32_t index = (uint32_t)(key->hash + i) & (slotCount - 1);
+        const _DFSharedIndexSlot *slot = &_slots[index];
+        if (slot->state == _DFSharedIndexSlotStateEmpty) {
+            if (insertion < 0) {
+                insertion = index;
+            }
+            break;
+        }
+        if (slot->state == _DFSharedIndexSlotStateRemoved) {
+            if (insertion < 0) {
+                insertion = index;
+            }
+        } else if (slot->hash == key->hash && slot->filenameLength == key->length && memcmp(slot->filename, key->bytes, key->length) == 0) {
+            return index;
+        }
+    }
+    if (insertionIndex) {
+        *insertionIndex = insertion;
+    }
+    return -1;
+}
+
+/*! Inserts key that is not in the table.
+ */
+- (void)_insertKey:(const _DFSharedIndexKey *)key size:(uint64_t)size accessDate:(double)accessDate expirationDate:(double)expirationDate {
+    int64_t index;
+    if ([self _indexOfKey:key insertionIndex:&index] >= 0 || index < 0) {
+        return;
+    }
+    _DFSharedIndexSlot *slot = &_slots[index];
+    if (slot->state == _DFSharedIndexSlotStateRemoved) {
+        _header->removedCount--;
+    }
+    memset(slot, 0, sizeof(_DFSharedIndexSlot));
+    slot->hash = key->hash;
+    slot->size = size;
+    slot->accessDate = accessDate;
+    slot->expirationDate = expirationDate;
+    slot->filenameLength = (uint32_t)key->length;
+    memcpy(slot->filename, key->bytes, key->length);
+    slot->state = _DFSharedIndexSlotStateUsed;
+    _header->count++;
+    _header->totalSize += size;
+}
+
+- (void)_removeSlotAtIndex:(uint32_t)index {
+    _DFSharedIndexSlot *slot = &_slots[index];
+    slot->state = _DFSharedIndexSlotStateRemoved;
+    _header->count--;
+    _header->removedCount++;
+    _header->totalSize -= slot->size;
+}
+
+/*! Makes sure that the table has room for one more entry, the table is rehashed when it's 3/4 full (removed slots included).
+ */
+- (BOOL)_reserveSlot {
+    if ((uint64_t)(_header->count + _header->removedCount + 1) * 4 <= (uint64_t)_header->slotCount * 3) {
+        return YES;
+    }
+    uint32_t slotCount = _header->slotCount;
+    while ((uint64_t)(_header->count + 1) * 2 > slotCount) {
+        slotCount <<= 1;
+    }
+    return [self _rehashWithSlotCount:slotCount];
+}
+
+/*! Resizes the table to the given number of slots and re-inserts the used slots.
+ */
+- (BOOL)_rehashWithSlotCount:(uint32_t)slotCount {
+    const uint32_t count = _header->count;
+    _DFSharedIndexSlot *slots = malloc(MAX(count, 1) * sizeof(_DFSharedIndexSlot));
+    if (!slots) {
+        return NO;
+    }
+    uint32_t usedCount = 0;
+    for (uint32_t i = 0; i < _header->slotCount && usedCount < count; i++) {
+        if (_slots[i].state == _DFSharedIndexSlotStateUsed) {
+            slots[usedCount++] = _slots[i];
+        }
+    }
+    const uint32_t populated = _header->populated;
+    BOOL success = [self _resetWithSlotCount:slotCount];
+    if (success) {
+        for (uint32_t i = 0; i < usedCount; i++) {
+            const _DFSharedIndexKey key = { slots[i].filename, slots[i].filenameLength, slots[i].hash };
+            [self _insertKey:&key size:slots[i].size accessDate:slots[i].accessDate expirationDate:slots[i].expirationDate];
+        }
+        // Index is marked as populated only after all entries are re-inserted. If the process dies in the middle, the index that is left is populated again by scanning the storage directory, repair can't recover entries that weren't re-inserted.
+        _header->populated = populated;
+    }
+    free(slots);
+    return success;
+}
+
+/*! Returns indexes of the used slots sorted by the date returned by the block, slots for which the block returns a negative date are skipped. The caller is responsible for freeing the returned buffer.
+ */
+- (_DFSharedIndexSortItem *)_sortedItemsWithDate:(double (^)(const _DFSharedIndexSlot *slot))block count:(uint32_t *)count {
+    *count = 0;
+    if (!_header || !_header->count) {
+        return NULL;
+    }
+    _DFSharedIndexSortItem *items = malloc(_header->count * sizeof(_DFSharedIndexSortItem));
+    if (!items) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < _header->slotCount && *count < _header->count; i++) {
+        if (_slots[i].state == _DFSharedIndexSlotStateUsed) {
+            const double date = block(&_slots[i]);
+            if (date >= 0) {
+                items[(*count)++] = (_DFSharedIndexSortItem){ date, i };
+            }
+        }
+    }
+    qsort(items, *count, sizeof(_DFSharedIndexSortItem), _DFSharedIndexCompareSortItems);
+    return items;
+}
+
+@end
@@ -0,0 +1,18 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Input stream that reads the given range of the open file with positional reads. Stream takes ownership of the file descriptor, so it keeps reading the same file even if the entry is replaced or removed while the stream is open.
+ @note Stream is meant to be read synchronously, scheduling it in a run loop has no effect and no stream events are delivered. NSStreamFileCurrentOffsetKey property is supported, offsets are relative to the beginning of the data.
+ */
+@interface DFFileStorageInputStream : NSInputStream
+
+- (instancetype)initWithFileDescriptor:(int)fd offset:(unsigned long long)offset length:(unsigned long long)length;
+
+@end
+
+NS_ASSUME_NONNULL_END
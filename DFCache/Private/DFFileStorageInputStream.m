@@ -0,0 +1,128 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFFileStorageInputStream.h"
+#import <unistd.h>
+
+@implementation DFFileStorageInputStream {
+    int _fd;
+    unsigned long long _offset;
+    unsigned long long _length;
+    unsigned long long _position;
+    NSStreamStatus _status;
+    NSError *_error;
+    id<NSStreamDelegate> __weak _delegate;
+}
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (instancetype)initWithFileDescriptor:(int)fd offset:(unsigned long long)offset length:(unsigned long long)length {
+    if (self = [super init]) {
+        _fd = fd;
+        _offset = offset;
+        _length = length;
+        _status = NSStreamStatusNotOpen;
+    }
+    return self;
+}
+
+#pragma mark - NSStream
+
+- (void)open {
+    if (_status == NSStreamStatusNotOpen) {
+        _status = _position < _length ? NSStreamStatusOpen : NSStreamStatusAtEnd;
+    }
+}
+
+- (void)close {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _status = NSStreamStatusClosed;
+}
+
+- (NSStreamStatus)streamStatus {
+    return _status;
+}
+
+- (NSError *)streamError {
+    return _error;
+}
+
+- (id<NSStreamDelegate>)delegate {
+    return _delegate ?: (id<NSStreamDelegate>)self;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate {
+    _delegate = delegate;
+}
+
+- (id)propertyForKey:(NSString *)key {
+    return [key isEqualToString:NSStreamFileCurrentOffsetKey] ? @(_position) : nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key {
+    if (![key isEqualToString:NSStreamFileCurrentOffsetKey] || ![property isKindOfClass:[NSNumber class]] || _status == NSStreamStatusClosed || _status == NSStreamStatusError) {
+        return NO;
+    }
+    _position = MIN([property unsignedLongLongValue], _length);
+    if (_status == NSStreamStatusOpen || _status == NSStreamStatusAtEnd) {
+        _status = _position < _length ? NSStreamStatusOpen : NSStreamStatusAtEnd;
+    }
+    return YES;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)runLoop forMode:(NSString *)mode {
+    // Do nothing, stream is read synchronously.
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)runLoop forMode:(NSString *)mode {
+    // Do nothing, stream is read synchronously.
+}
+
+#pragma mark - NSInputStream
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)maxLength {
+    if (_status == NSStreamStatusAtEnd) {
+        return 0;
+    }
+    if (_status != NSStreamStatusOpen) {
+        return -1;
+    }
+    const size_t length = (size_t)MIN((unsigned long long)maxLength, _length - _position);
+    ssize_t count;
+    do {
+        count = pread(_fd, buffer, length, (off_t)(_offset + _position));
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        _status = NSStreamStatusError;
+        return -1;
+    }
+    if (count == 0) {
+        // File was truncated.
+        _status = NSStreamStatusAtEnd;
+        return 0;
+    }
+    _position += (unsigned long long)count;
+    if (_position >= _length) {
+        _status = NSStreamStatusAtEnd;
+    }
+    return count;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)length {
+    return NO;
+}
+
+- (BOOL)hasBytesAvailable {
+    return _status == NSStreamStatusOpen;
+}
+
+@end
@@ -0,0 +1,58 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import <Foundation/Foundation.h>
+#import "DFFileStorage.h"
+#import "DFFileStorageWriter.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface DFFileStorageWriter ()
+
+/*! Initializes writer that writes into a new temporary file for the file at the given path.
+ @param prefix Bytes that are written at the beginning of the file before the data (e.g. entry header). Prefix is not counted as data.
+ @return Writer or nil if the temporary file can't be created.
+ */
+- (nullable instancetype)initWithStorage:(DFFileStorage *)storage key:(NSString *)key path:(NSString *)path attributes:(nullable NSDictionary<NSString *, NSData *> *)attributes prefix:(nullable NSData *)prefix NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSString *path;
+@property (nonatomic, readonly) NSString *temporaryPath;
+@property (nullable, nonatomic, readonly) NSDictionary<NSString *, NSData *> *attributes;
+
+/*! Descriptor of the temporary file, -1 after the file is closed.
+ */
+@property (nonatomic, readonly) int fileDescriptor;
+
+/*! FNV-1a checksum of the written data (see _dwarf_cache_checksum).
+ */
+@property (nonatomic, readonly) uint32_t dataChecksum;
+
+/*! Expiration date of the entry, used by disk cache.
+ */
+@property (nullable, nonatomic) NSDate *expirationDate;
+
+/*! Closes the temporary file.
+ @return NO if the file can't be closed.
+ */
+- (BOOL)closeFileDescriptor;
+
+@end
+
+
+@interface DFFileStorage ()
+
+/*! Called when the writer is closed, closes the temporary file and moves it in place of the entry. Subclasses that store entries differently override this method.
+ @return YES if the entry was replaced. If NO is returned, writer removes the temporary file.
+ */
+- (BOOL)_commitWriter:(DFFileStorageWriter *)writer;
+
+/*! Opens the file that contains the data of the entry for the given key and returns the range of the data in the file. Subclasses that store entries differently override this method.
+ @param packedData On return contains the data of the entry that doesn't have its own file, file descriptor is -1 then.
+ @return File descriptor opened for reading (owned by the caller) or -1 if the entry doesn't exist or doesn't have its own file.
+ */
+- (int)_openDataForKey:(NSString *)key offset:(unsigned long long *)offset length:(unsigned long long *)length packedData:(NSData *_Nullable *_Nonnull)packedData;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -8,6 +8,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 extern NSString *const DFValueTransformerNSCodingName;
 extern NSString *const DFValueTransformerJSONName;
+extern NSString *const DFValueTransformerPropertyListName;
 
 #if TARGET_OS_IOS || TARGET_OS_TV
 extern NSString *const DFValueTransformerUIImageName;
@@ -17,6 +18,10 @@ extern NSString *const DFValueTransformerUIImageName;
 @protocol DFValueTransforming <NSObject>
 
 - (nullable NSData *)transformedValue:(id)value;
+
+/*! Decodes value from the given data.
+ @discussion Data might be memory-mapped (see mappedReadThreshold property of DFFileStorage). Transformers should decode straight from the data without copying it, values that retain the data keep the mapping alive.
+ */
 - (nullable id)reverseTransfomedValue:(NSData *)data;
 
 @optional
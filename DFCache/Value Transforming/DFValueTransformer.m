@@ -8,6 +8,7 @@
 
 NSString *const DFValueTransformerNSCodingName = @"DFValueTransformerNSCodingName";
 NSString *const DFValueTransformerJSONName = @"DFValueTransformerJSONName";
+NSString *const DFValueTransformerPropertyListName = @"DFValueTransformerPropertyListName";
 
 #if TARGET_OS_IOS || TARGET_OS_TV
 NSString *const DFValueTransformerUIImageName = @"DFValueTransformerUIImageName";
@@ -0,0 +1,77 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFValueTransformer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(uint8_t, DFCompressionCodec) {
+    /*! Data is stored uncompressed.
+     */
+    DFCompressionCodecNone = 0,
+    /*! LZ4, the fastest codec with the lowest compression ratio. Requires libcompression (iOS 9, OS X 10.11, watchOS 2, tvOS 9).
+     */
+    DFCompressionCodecLZ4 = 1,
+    /*! LZFSE, compression ratio comparable to zlib at a much higher speed. Requires libcompression.
+     */
+    DFCompressionCodecLZFSE = 2,
+    /*! zlib (deflate), available on all platforms.
+     */
+    DFCompressionCodecZlib = 3,
+    /*! LZMA, the highest compression ratio and the slowest encoding. Requires libcompression.
+     */
+    DFCompressionCodecLZMA = 4
+};
+
+/*! Value transformer that compresses data produced by another value transformer.
+ @discussion Each entry is prefixed with a small header that contains the codec tag and the length of the uncompressed data, so changing the codec doesn't affect existing entries. Data that doesn't start with the header (e.g. written before the compression was enabled) is passed to the underlying transformer as is. Compression is skipped for data that is already compressed (JPEG, PNG, GIF, gzip, zip and other formats recognized by their signatures), for the small data and for the data that doesn't compress well enough.
+ @note Register compressing transformer under the same name as the underlying transformer to compress new entries while keeping the old entries readable, e.g. [factory registerValueTransformer:[[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerNSCoding new]] forName:DFValueTransformerNSCodingName]. Factory picks the transformer by the value, so if it prefers property list transformer (see DFValueTransformerFactory) property list values are encoded by the transformer registered under DFValueTransformerPropertyListName, wrap it as well to compress those.
+ */
+@interface DFValueTransformerCompressing : NSObject <DFValueTransforming>
+
+/*! Initializes transformer with LZFSE codec if it is available, zlib otherwise.
+ */
+- (instancetype)initWithValueTransformer:(id<DFValueTransforming>)valueTransformer;
+
+/*! Initializes transformer with a given codec. Falls back to zlib if the codec is not available.
+ */
+- (instancetype)initWithValueTransformer:(id<DFValueTransforming>)valueTransformer codec:(DFCompressionCodec)codec NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, readonly) id<DFValueTransforming> valueTransformer;
+
+/*! Codec that is used to compress new entries.
+ */
+@property (nonatomic, readonly) DFCompressionCodec codec;
+
+/*! If YES transformer skips compression for data that is already compressed or doesn't compress well enough. Default value is YES.
+ @discussion Compressibility of the large data is estimated by compressing a sample from the beginning of the data first.
+ */
+@property (nonatomic) BOOL adaptive;
+
+/*! Minimum length of the data that gets compressed. Default value is 256 bytes.
+ */
+@property (nonatomic) NSUInteger minimumLength;
+
+/*! Compressed data is stored only if its length doesn't exceed the given ratio of the original length. Default value is 0.9.
+ */
+@property (nonatomic) double maximumCompressionRatio;
+
+/*! Returns YES if the codec is available on the current platform.
+ */
++ (BOOL)isCodecAvailable:(DFCompressionCodec)codec;
+
+/*! Compresses data using a given codec. Returns nil if the codec is not available or compression fails.
+ */
++ (nullable NSData *)compressedData:(NSData *)data codec:(DFCompressionCodec)codec;
+
+/*! Decompresses data compressed using a given codec. Length of the uncompressed data must be known.
+ @return Decompressed data or nil if the decompression fails or if the length exceeds the maximum expansion ratio of the compressed data (4096) or 1 Gb, the buffer for the uncompressed data is not allocated in that case.
+ */
++ (nullable NSData *)decompressedData:(NSData *)data codec:(DFCompressionCodec)codec length:(NSUInteger)length;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,247 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFValueTransformerCompressing.h"
+#import <zlib.h>
+
+#if __has_include(<compression.h>)
+#import <compression.h>
+#define DF_LIBCOMPRESSION 1
+#else
+#define DF_LIBCOMPRESSION 0
+#endif
+
+static const uint32_t DFCompressionHeaderMagic = 0x5A434644; // "DFCZ"
+
+/*! Header that precedes each entry: magic, codec tag and the length of the uncompressed data.
+ */
+static const NSUInteger DFCompressionHeaderLength = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint64_t);
+
+/*! Data larger than the sample threshold is checked for compressibility by compressing a sample first.
+ */
+static const NSUInteger DFCompressionSampleThreshold = 64 * 1024;
+static const NSUInteger DFCompressionSampleLength = 16 * 1024;
+
+/*! Uncompressed length stored in the header is trusted only if it doesn't exceed the length of the compressed data multiplied by the maximum expansion ratio (higher than the ratio any of the codecs reaches on typical data) and the absolute limit. Data that compresses better than that is stored uncompressed.
+ */
+static const uint64_t DFCompressionMaximumExpansionRatio = 4096;
+static const uint64_t DFCompressionMaximumLength = 1024 * 1024 * 1024;
+
+static BOOL
+_DFCompressionIsLengthValid(uint64_t length, NSUInteger compressedLength) {
+    return length <= DFCompressionMaximumLength && length <= NSUIntegerMax && (length + DFCompressionMaximumExpansionRatio - 1) / DFCompressionMaximumExpansionRatio <= compressedLength;
+}
+
+#if DF_LIBCOMPRESSION
+static BOOL
+_DFCompressionAlgorithm(DFCompressionCodec codec, compression_algorithm *algorithm) {
+    switch (codec) {
+        case DFCompressionCodecLZ4: *algorithm = COMPRESSION_LZ4; return YES;
+        case DFCompressionCodecLZFSE: *algorithm = COMPRESSION_LZFSE; return YES;
+        case DFCompressionCodecLZMA: *algorithm = COMPRESSION_LZMA; return YES;
+        default: return NO;
+    }
+}
+#endif
+
+/*! Returns YES if the data starts with a signature of the format that is already compressed.
+ */
+static BOOL
+_DFCompressionIsCompressedFormat(NSData *data) {
+    if (data.length < 12) {
+        return NO;
+    }
+    const uint8_t *bytes = data.bytes;
+    return (bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) || // JPEG
+    memcmp(bytes, "\x89PNG", 4) == 0 ||
+    memcmp(bytes, "GIF8", 4) == 0 ||
+    (memcmp(bytes, "RIFF", 4) == 0 && memcmp(bytes + 8, "WEBP", 4) == 0) ||
+    memcmp(bytes + 4, "ftyp", 4) == 0 || // HEIF, MP4
+    (bytes[0] == 0x1F && bytes[1] == 0x8B) || // gzip
+    memcmp(bytes, "PK\x03\x04", 4) == 0 ||
+    memcmp(bytes, "BZh", 3) == 0 ||
+    memcmp(bytes, "\xFD" "7zXZ", 5) == 0 ||
+    memcmp(bytes, "\x28\xB5\x2F\xFD", 4) == 0; // zstd
+}
+
+@implementation DFValueTransformerCompressing
+
+- (instancetype)initWithValueTransformer:(id<DFValueTransforming>)valueTransformer {
+    DFCompressionCodec codec = [DFValueTransformerCompressing isCodecAvailable:DFCompressionCodecLZFSE] ? DFCompressionCodecLZFSE : DFCompressionCodecZlib;
+    return [self initWithValueTransformer:valueTransformer codec:codec];
+}
+
+- (instancetype)initWithValueTransformer:(id<DFValueTransforming>)valueTransformer codec:(DFCompressionCodec)codec {
+    if (self = [super init]) {
+        if (!valueTransformer) {
+            [NSException raise:NSInvalidArgumentException format:@"Attempting to initialize compressing transformer without value transformer"];
+        }
+        _valueTransformer = valueTransformer;
+        _codec = [DFValueTransformerCompressing isCodecAvailable:codec] ? codec : DFCompressionCodecZlib;
+        _adaptive = YES;
+        _minimumLength = 256;
+        _maximumCompressionRatio = 0.9;
+    }
+    return self;
+}
+
+- (instancetype)init {
+    [NSException raise:NSInternalInconsistencyException format:@"Please use designated initialzier"];
+    return nil;
+}
+
+#pragma mark - DFValueTransforming
+
+- (NSData *)transformedValue:(id)value {
+    NSData *data = [_valueTransformer transformedValue:value];
+    if (!data) {
+        return nil;
+    }
+    DFCompressionCodec codec = [self _shouldCompressData:data] ? _codec : DFCompressionCodecNone;
+    NSData *payload;
+    if (codec != DFCompressionCodecNone) {
+        payload = [DFValueTransformerCompressing compressedData:data codec:codec];
+        if (!payload || payload.length > data.length * _maximumCompressionRatio || !_DFCompressionIsLengthValid(data.length, payload.length)) {
+            codec = DFCompressionCodecNone;
+        }
+    }
+    if (codec == DFCompressionCodecNone) {
+        payload = data;
+    }
+    NSMutableData *entry = [[NSMutableData alloc] initWithCapacity:DFCompressionHeaderLength + payload.length];
+    uint64_t length = data.length;
+    [entry appendBytes:&DFCompressionHeaderMagic length:sizeof(DFCompressionHeaderMagic)];
+    [entry appendBytes:&codec length:sizeof(codec)];
+    [entry appendBytes:&length length:sizeof(length)];
+    [entry appendData:payload];
+    return entry;
+}
+
+- (BOOL)_shouldCompressData:(NSData *)data {
+    if (data.length < _minimumLength) {
+        return NO;
+    }
+    if (!_adaptive) {
+        return YES;
+    }
+    if (_DFCompressionIsCompressedFormat(data)) {
+        return NO;
+    }
+    if (data.length > DFCompressionSampleThreshold) {
+        NSData *sample = [data subdataWithRange:NSMakeRange(0, DFCompressionSampleLength)];
+        NSData *compressedSample = [DFValueTransformerCompressing compressedData:sample codec:_codec];
+        return compressedSample && compressedSample.length <= sample.length * _maximumCompressionRatio;
+    }
+    return YES;
+}
+
+- (id)reverseTransfomedValue:(NSData *)data {
+    if (data.length < DFCompressionHeaderLength) {
+        return [_valueTransformer reverseTransfomedValue:data];
+    }
+    const uint8_t *bytes = data.bytes;
+    uint32_t magic;
+    memcpy(&magic, bytes, sizeof(magic));
+    if (magic != DFCompressionHeaderMagic) {
+        // Entry was written before the compression was enabled.
+        return [_valueTransformer reverseTransfomedValue:data];
+    }
+    DFCompressionCodec codec = bytes[sizeof(magic)];
+    uint64_t length;
+    memcpy(&length, bytes + sizeof(magic) + sizeof(uint8_t), sizeof(length));
+    NSData *payload = [data subdataWithRange:NSMakeRange(DFCompressionHeaderLength, data.length - DFCompressionHeaderLength)];
+    if (codec != DFCompressionCodecNone && !_DFCompressionIsLengthValid(length, payload.length)) {
+        return nil;
+    }
+    NSData *decodedData = codec == DFCompressionCodecNone ? payload : [DFValueTransformerCompressing decompressedData:payload codec:codec length:(NSUInteger)length];
+    return decodedData ? [_valueTransformer reverseTransfomedValue:decodedData] : nil;
+}
+
+- (NSUInteger)costForValue:(id)value {
+    return [_valueTransformer respondsToSelector:@selector(costForValue:)] ? [_valueTransformer costForValue:value] : 0;
+}
+
+#pragma mark - Codecs
+
++ (BOOL)isCodecAvailable:(DFCompressionCodec)codec {
+    switch (codec) {
+        case DFCompressionCodecNone:
+        case DFCompressionCodecZlib:
+            return YES;
+        case DFCompressionCodecLZ4:
+        case DFCompressionCodecLZFSE:
+        case DFCompressionCodecLZMA:
+#if DF_LIBCOMPRESSION
+            // libcompression is weakly linked.
+            return compression_encode_buffer != NULL;
+#else
+            return NO;
+#endif
+    }
+    return NO;
+}
+
++ (NSData *)compressedData:(NSData *)data codec:(DFCompressionCodec)codec {
+    if (codec == DFCompressionCodecNone) {
+        return data;
+    }
+    if (![self isCodecAvailable:codec]) {
+        return nil;
+    }
+    if (codec == DFCompressionCodecZlib) {
+        uLongf length = compressBound((uLong)data.length);
+        NSMutableData *compressedData = [[NSMutableData alloc] initWithLength:length];
+        if (compress2(compressedData.mutableBytes, &length, data.bytes, (uLong)data.length, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            return nil;
+        }
+        compressedData.length = length;
+        return compressedData;
+    }
+#if DF_LIBCOMPRESSION
+    compression_algorithm algorithm;
+    if (!_DFCompressionAlgorithm(codec, &algorithm)) {
+        return nil;
+    }
+    // Codecs don't report required buffer size, incompressible data expands only slightly.
+    size_t capacity = data.length + data.length / 16 + 1024;
+    NSMutableData *compressedData = [[NSMutableData alloc] initWithLength:capacity];
+    size_t length = compression_encode_buffer(compressedData.mutableBytes, capacity, data.bytes, data.length, NULL, algorithm);
+    if (length == 0) {
+        return nil;
+    }
+    compressedData.length = length;
+    return compressedData;
+#else
+    return nil;
+#endif
+}
+
++ (NSData *)decompressedData:(NSData *)data codec:(DFCompressionCodec)codec length:(NSUInteger)length {
+    if (codec == DFCompressionCodecNone) {
+        return data.length == length ? data : nil;
+    }
+    if (![self isCodecAvailable:codec] || !_DFCompressionIsLengthValid(length, data.length)) {
+        return nil;
+    }
+    NSMutableData *decompressedData = [[NSMutableData alloc] initWithLength:length];
+    if (codec == DFCompressionCodecZlib) {
+        uLongf decompressedLength = (uLongf)length;
+        if (uncompress(decompressedData.mutableBytes, &decompressedLength, data.bytes, (uLong)data.length) != Z_OK || decompressedLength != length) {
+            return nil;
+        }
+        return decompressedData;
+    }
+#if DF_LIBCOMPRESSION
+    compression_algorithm algorithm;
+    if (!_DFCompressionAlgorithm(codec, &algorithm) || length == 0) {
+        return nil;
+    }
+    size_t decompressedLength = compression_decode_buffer(decompressedData.mutableBytes, length, data.bytes, data.length, NULL, algorithm);
+    return decompressedLength == length ? decompressedData : nil;
+#else
+    return nil;
+#endif
+}
+
+@end
@@ -32,6 +32,11 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)registerValueTransformer:(id<DFValueTransforming>)valueTransformer forName:(NSString *)name;
 
+/*! If YES property list values are encoded using DFValueTransformerPropertyList instead of NSCoding. Default value is NO.
+ @warning Property lists are encoded much faster and more compactly than keyed archives, but decoded containers and strings are immutable and the stored data changes format. Entries stored before the option is changed stay readable since the transformer name is stored with each entry.
+ */
+@property (nonatomic) BOOL prefersPropertyListTransformer;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -3,6 +3,7 @@
 // Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
 
 #import "DFValueTransformerFactory.h"
+#import "DFValueTransformerPropertyList.h"
 
 #if TARGET_OS_IOS || TARGET_OS_TV
 #import <UIKit/UIKit.h>
@@ -24,6 +25,7 @@ static id<DFValueTransformerFactory> _sharedFactory;
 
         [self registerValueTransformer:[DFValueTransformerNSCoding new] forName:DFValueTransformerNSCodingName];
         [self registerValueTransformer:[DFValueTransformerJSON new] forName:DFValueTransformerJSONName];
+        [self registerValueTransformer:[DFValueTransformerPropertyList new] forName:DFValueTransformerPropertyListName];
         
 #if TARGET_OS_IOS || TARGET_OS_TV
         DFValueTransformerUIImage *transformerUIImage = [DFValueTransformerUIImage new];
@@ -52,6 +54,11 @@ static id<DFValueTransformerFactory> _sharedFactory;
     }
 #endif
     
+    // Property lists are encoded much faster and more compactly than keyed archives.
+    if (_prefersPropertyListTransformer && [DFValueTransformerPropertyList isPropertyList:value]) {
+        return DFValueTransformerPropertyListName;
+    }
+    
     if ([value conformsToProtocol:@protocol(NSCoding)]) {
         return DFValueTransformerNSCodingName;
     }
@@ -0,0 +1,21 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFValueTransformer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Value transformer for property list objects (NSDictionary, NSArray, NSString, NSNumber, NSData and NSDate) that uses a compact binary format.
+ @discussion Values are encoded in a single pass into a growing buffer and decoded in a single pass straight from the data, without the class names, keys and object tables that NSKeyedArchiver produces. Repeated dictionary keys are encoded once and referenced afterwards. Transformer returns nil for values that are not property lists (including dictionaries with non-string keys).
+ @note Decoded containers and strings are immutable. NSData values are decoded without copying and retain the data they were decoded from.
+ */
+@interface DFValueTransformerPropertyList : DFValueTransformer
+
+/*! Returns YES if the value can be encoded by the transformer.
+ */
++ (BOOL)isPropertyList:(id)value;
+
+@end
+
+NS_ASSUME_NONNULL_END
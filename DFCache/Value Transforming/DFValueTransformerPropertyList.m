@@ -0,0 +1,491 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFValueTransformerPropertyList.h"
+
+static const uint8_t DFPropertyListVersion = 1;
+
+/*! Maximum nesting of containers, deeper values are rejected so that corrupted data can't exhaust the stack.
+ */
+static const NSUInteger DFPropertyListMaximumDepth = 512;
+
+/*! Maximum number of dictionary keys that are remembered for back-references.
+ */
+static const NSUInteger DFPropertyListMaximumKeyCount = 4096;
+
+typedef NS_ENUM(uint8_t, _DFPropertyListTag) {
+    _DFPropertyListTagFalse = 1,
+    _DFPropertyListTagTrue = 2,
+    _DFPropertyListTagInteger = 3, // Zigzag varint
+    _DFPropertyListTagUnsignedInteger = 4, // Varint, only for values that don't fit int64_t
+    _DFPropertyListTagFloat = 5,
+    _DFPropertyListTagDouble = 6,
+    _DFPropertyListTagString = 7, // Varint length, UTF-8 bytes
+    _DFPropertyListTagData = 8, // Varint length, bytes
+    _DFPropertyListTagDate = 9, // Time interval since reference date
+    _DFPropertyListTagArray = 10, // Varint count, values
+    _DFPropertyListTagDictionary = 11 // Varint count, (key, value) pairs
+};
+
+#pragma mark - Encoder
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    __unsafe_unretained NSMutableDictionary *keys;
+} _DFPropertyListEncoder;
+
+static BOOL
+_DFPropertyListEncoderReserve(_DFPropertyListEncoder *encoder, size_t length) {
+    if (encoder->capacity - encoder->length >= length) {
+        return YES;
+    }
+    size_t capacity = MAX(encoder->capacity * 2, encoder->length + length);
+    uint8_t *bytes = realloc(encoder->bytes, capacity);
+    if (!bytes) {
+        return NO;
+    }
+    encoder->bytes = bytes;
+    encoder->capacity = capacity;
+    return YES;
+}
+
+static inline size_t
+_DFPropertyListVarintLength(uint64_t value) {
+    size_t length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+/*! Writes varint, the caller must reserve enough space.
+ */
+static inline void
+_DFPropertyListPutVarint(uint8_t *bytes, uint64_t value) {
+    while (value >= 0x80) {
+        *bytes++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *bytes = (uint8_t)value;
+}
+
+static inline BOOL
+_DFPropertyListEncodeTagAndVarint(_DFPropertyListEncoder *encoder, uint8_t tag, uint64_t value) {
+    if (!_DFPropertyListEncoderReserve(encoder, 1 + 10)) {
+        return NO;
+    }
+    encoder->bytes[encoder->length++] = tag;
+    _DFPropertyListPutVarint(encoder->bytes + encoder->length, value);
+    encoder->length += _DFPropertyListVarintLength(value);
+    return YES;
+}
+
+static inline BOOL
+_DFPropertyListEncodeBytes(_DFPropertyListEncoder *encoder, const void *bytes, size_t length) {
+    if (!_DFPropertyListEncoderReserve(encoder, length)) {
+        return NO;
+    }
+    if (length) {
+        memcpy(encoder->bytes + encoder->length, bytes, length);
+        encoder->length += length;
+    }
+    return YES;
+}
+
+static inline BOOL
+_DFPropertyListEncodeTagAndBytes(_DFPropertyListEncoder *encoder, uint8_t tag, const void *bytes, size_t length) {
+    return _DFPropertyListEncodeBytes(encoder, &tag, sizeof(tag)) && _DFPropertyListEncodeBytes(encoder, bytes, length);
+}
+
+/*! Writes varint (length << shift) followed by the UTF-8 representation of the string. Converts the string straight into the buffer.
+ */
+static BOOL
+_DFPropertyListEncodeString(_DFPropertyListEncoder *encoder, NSString *string, unsigned shift) {
+    NSUInteger maximumLength = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    size_t prefixLength = _DFPropertyListVarintLength((uint64_t)maximumLength << shift);
+    if (!_DFPropertyListEncoderReserve(encoder, prefixLength + maximumLength)) {
+        return NO;
+    }
+    NSUInteger length = 0;
+    if (string.length && ![string getBytes:encoder->bytes + encoder->length + prefixLength maxLength:maximumLength usedLength:&length encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, string.length) remainingRange:NULL]) {
+        return NO;
+    }
+    uint64_t prefix = (uint64_t)length << shift;
+    size_t actualPrefixLength = _DFPropertyListVarintLength(prefix);
+    if (actualPrefixLength < prefixLength) {
+        memmove(encoder->bytes + encoder->length + actualPrefixLength, encoder->bytes + encoder->length + prefixLength, length);
+    }
+    _DFPropertyListPutVarint(encoder->bytes + encoder->length, prefix);
+    encoder->length += actualPrefixLength + length;
+    return YES;
+}
+
+/*! Keys are encoded as varint (length << 1) followed by the UTF-8 bytes the first time they appear, and as varint (index << 1 | 1) afterwards.
+ */
+static BOOL
+_DFPropertyListEncodeKey(_DFPropertyListEncoder *encoder, NSString *key) {
+    NSNumber *index = encoder->keys[key];
+    if (index) {
+        if (!_DFPropertyListEncoderReserve(encoder, 10)) {
+            return NO;
+        }
+        uint64_t reference = ((uint64_t)[index unsignedIntegerValue] << 1) | 1;
+        _DFPropertyListPutVarint(encoder->bytes + encoder->length, reference);
+        encoder->length += _DFPropertyListVarintLength(reference);
+        return YES;
+    }
+    if (encoder->keys.count < DFPropertyListMaximumKeyCount) {
+        encoder->keys[key] = @(encoder->keys.count);
+    }
+    return _DFPropertyListEncodeString(encoder, key, 1);
+}
+
+static BOOL
+_DFPropertyListEncodeNumber(_DFPropertyListEncoder *encoder, NSNumber *number) {
+    if ((__bridge CFBooleanRef)number == kCFBooleanTrue) {
+        return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagTrue, NULL, 0);
+    }
+    if ((__bridge CFBooleanRef)number == kCFBooleanFalse) {
+        return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagFalse, NULL, 0);
+    }
+    switch (number.objCType[0]) {
+        case 'f': {
+            uint32_t bits;
+            float value = number.floatValue;
+            memcpy(&bits, &value, sizeof(bits));
+            bits = NSSwapHostIntToLittle(bits);
+            return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagFloat, &bits, sizeof(bits));
+        }
+        case 'd': {
+            uint64_t bits;
+            double value = number.doubleValue;
+            memcpy(&bits, &value, sizeof(bits));
+            bits = NSSwapHostLongLongToLittle(bits);
+            return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagDouble, &bits, sizeof(bits));
+        }
+        case 'Q': {
+            unsigned long long value = number.unsignedLongLongValue;
+            if (value > INT64_MAX) {
+                return _DFPropertyListEncodeTagAndVarint(encoder, _DFPropertyListTagUnsignedInteger, value);
+            }
+        } // Fall through
+        default: {
+            int64_t value = number.longLongValue;
+            uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+            return _DFPropertyListEncodeTagAndVarint(encoder, _DFPropertyListTagInteger, zigzag);
+        }
+    }
+}
+
+static BOOL
+_DFPropertyListEncodeValue(_DFPropertyListEncoder *encoder, id value, NSUInteger depth) {
+    if ([value isKindOfClass:[NSString class]]) {
+        return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagString, NULL, 0) && _DFPropertyListEncodeString(encoder, value, 0);
+    }
+    if ([value isKindOfClass:[NSNumber class]]) {
+        return _DFPropertyListEncodeNumber(encoder, value);
+    }
+    if (depth >= DFPropertyListMaximumDepth) {
+        return NO;
+    }
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = value;
+        if (!_DFPropertyListEncodeTagAndVarint(encoder, _DFPropertyListTagDictionary, dictionary.count)) {
+            return NO;
+        }
+        BOOL __block success = YES;
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
+            if (![key isKindOfClass:[NSString class]] || !_DFPropertyListEncodeKey(encoder, key) || !_DFPropertyListEncodeValue(encoder, object, depth + 1)) {
+                success = NO;
+                *stop = YES;
+            }
+        }];
+        return success;
+    }
+    if ([value isKindOfClass:[NSArray class]]) {
+        NSArray *array = value;
+        if (!_DFPropertyListEncodeTagAndVarint(encoder, _DFPropertyListTagArray, array.count)) {
+            return NO;
+        }
+        for (id object in array) {
+            if (!_DFPropertyListEncodeValue(encoder, object, depth + 1)) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+    if ([value isKindOfClass:[NSData class]]) {
+        NSData *data = value;
+        return _DFPropertyListEncodeTagAndVarint(encoder, _DFPropertyListTagData, data.length) && _DFPropertyListEncodeBytes(encoder, data.bytes, data.length);
+    }
+    if ([value isKindOfClass:[NSDate class]]) {
+        uint64_t bits;
+        double interval = [value timeIntervalSinceReferenceDate];
+        memcpy(&bits, &interval, sizeof(bits));
+        bits = NSSwapHostLongLongToLittle(bits);
+        return _DFPropertyListEncodeTagAndBytes(encoder, _DFPropertyListTagDate, &bits, sizeof(bits));
+    }
+    return NO;
+}
+
+#pragma mark - Decoder
+
+typedef struct {
+    const uint8_t *bytes;
+    const uint8_t *end;
+    __unsafe_unretained NSData *data;
+    __unsafe_unretained NSMutableArray *keys;
+} _DFPropertyListDecoder;
+
+static inline BOOL
+_DFPropertyListDecodeVarint(_DFPropertyListDecoder *decoder, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (decoder->bytes >= decoder->end) {
+            return NO;
+        }
+        uint8_t byte = *decoder->bytes++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline BOOL
+_DFPropertyListDecodeLength(_DFPropertyListDecoder *decoder, uint64_t *length) {
+    return _DFPropertyListDecodeVarint(decoder, length) && *length <= (uint64_t)(decoder->end - decoder->bytes);
+}
+
+static inline BOOL
+_DFPropertyListDecodeFixed(_DFPropertyListDecoder *decoder, void *value, size_t length) {
+    if ((size_t)(decoder->end - decoder->bytes) < length) {
+        return NO;
+    }
+    memcpy(value, decoder->bytes, length);
+    decoder->bytes += length;
+    return YES;
+}
+
+static NSString *
+_DFPropertyListDecodeString(_DFPropertyListDecoder *decoder, uint64_t length) {
+    NSString *string = [[NSString alloc] initWithBytes:decoder->bytes length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    decoder->bytes += length;
+    return string;
+}
+
+static NSString *
+_DFPropertyListDecodeKey(_DFPropertyListDecoder *decoder) {
+    uint64_t value;
+    if (!_DFPropertyListDecodeVarint(decoder, &value)) {
+        return nil;
+    }
+    if (value & 1) {
+        uint64_t index = value >> 1;
+        return index < decoder->keys.count ? decoder->keys[(NSUInteger)index] : nil;
+    }
+    uint64_t length = value >> 1;
+    if (length > (uint64_t)(decoder->end - decoder->bytes)) {
+        return nil;
+    }
+    NSString *key = _DFPropertyListDecodeString(decoder, length);
+    if (key && decoder->keys.count < DFPropertyListMaximumKeyCount) {
+        [decoder->keys addObject:key];
+    }
+    return key;
+}
+
+static id _DFPropertyListDecodeValue(_DFPropertyListDecoder *decoder, NSUInteger depth);
+
+/*! Decodes container values into a temporary buffer, dictionary keys go to the first half of the buffer and values to the second. Each value takes at least one byte, so the count is bounded by the remaining length.
+ */
+static id
+_DFPropertyListDecodeContainer(_DFPropertyListDecoder *decoder, NSUInteger depth, BOOL dictionary) {
+    uint64_t count;
+    if (!_DFPropertyListDecodeLength(decoder, &count)) {
+        return nil;
+    }
+    NSUInteger capacity = (NSUInteger)count * (dictionary ? 2 : 1);
+    __strong id *objects = (__strong id *)calloc(MAX(capacity, 1), sizeof(id));
+    if (!objects) {
+        return nil;
+    }
+    id container;
+    NSUInteger decodedCount = 0;
+    for (; decodedCount < count; decodedCount++) {
+        if (dictionary) {
+            NSString *key = _DFPropertyListDecodeKey(decoder);
+            id object = key ? _DFPropertyListDecodeValue(decoder, depth + 1) : nil;
+            if (!object) {
+                break;
+            }
+            objects[decodedCount] = key;
+            objects[(NSUInteger)count + decodedCount] = object;
+        } else {
+            id object = _DFPropertyListDecodeValue(decoder, depth + 1);
+            if (!object) {
+                break;
+            }
+            objects[decodedCount] = object;
+        }
+    }
+    if (decodedCount == count) {
+        if (dictionary) {
+            container = [[NSDictionary alloc] initWithObjects:objects + (NSUInteger)count forKeys:objects count:(NSUInteger)count];
+        } else {
+            container = [[NSArray alloc] initWithObjects:objects count:(NSUInteger)count];
+        }
+    }
+    for (NSUInteger i = 0; i < capacity; i++) {
+        objects[i] = nil;
+    }
+    free(objects);
+    return container;
+}
+
+static id
+_DFPropertyListDecodeValue(_DFPropertyListDecoder *decoder, NSUInteger depth) {
+    if (decoder->bytes >= decoder->end) {
+        return nil;
+    }
+    uint8_t tag = *decoder->bytes++;
+    switch (tag) {
+        case _DFPropertyListTagFalse:
+            return @NO;
+        case _DFPropertyListTagTrue:
+            return @YES;
+        case _DFPropertyListTagInteger: {
+            uint64_t zigzag;
+            if (!_DFPropertyListDecodeVarint(decoder, &zigzag)) {
+                return nil;
+            }
+            return @((long long)((zigzag >> 1) ^ (0 - (zigzag & 1))));
+        }
+        case _DFPropertyListTagUnsignedInteger: {
+            uint64_t value;
+            return _DFPropertyListDecodeVarint(decoder, &value) ? @((unsigned long long)value) : nil;
+        }
+        case _DFPropertyListTagFloat: {
+            uint32_t bits;
+            if (!_DFPropertyListDecodeFixed(decoder, &bits, sizeof(bits))) {
+                return nil;
+            }
+            bits = NSSwapLittleIntToHost(bits);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return @(value);
+        }
+        case _DFPropertyListTagDouble:
+        case _DFPropertyListTagDate: {
+            uint64_t bits;
+            if (!_DFPropertyListDecodeFixed(decoder, &bits, sizeof(bits))) {
+                return nil;
+            }
+            bits = NSSwapLittleLongLongToHost(bits);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return tag == _DFPropertyListTagDate ? [NSDate dateWithTimeIntervalSinceReferenceDate:value] : @(value);
+        }
+        case _DFPropertyListTagString: {
+            uint64_t length;
+            return _DFPropertyListDecodeLength(decoder, &length) ? _DFPropertyListDecodeString(decoder, length) : nil;
+        }
+        case _DFPropertyListTagData: {
+            uint64_t length;
+            if (!_DFPropertyListDecodeLength(decoder, &length)) {
+                return nil;
+            }
+            const uint8_t *bytes = decoder->bytes;
+            decoder->bytes += length;
+            if (length == 0) {
+                return [NSData data];
+            }
+            // Data references the source buffer (or mapping) instead of copying it.
+            NSData *source = decoder->data;
+            return [[NSData alloc] initWithBytesNoCopy:(void *)bytes length:(NSUInteger)length deallocator:^(void *deallocatedBytes, NSUInteger deallocatedLength) {
+                (void)source;
+            }];
+        }
+        case _DFPropertyListTagArray:
+        case _DFPropertyListTagDictionary:
+            if (depth >= DFPropertyListMaximumDepth) {
+                return nil;
+            }
+            return _DFPropertyListDecodeContainer(decoder, depth, tag == _DFPropertyListTagDictionary);
+        default:
+            return nil;
+    }
+}
+
+#pragma mark - DFValueTransformerPropertyList
+
+@implementation DFValueTransformerPropertyList
+
++ (BOOL)isPropertyList:(id)value {
+    if ([value isKindOfClass:[NSString class]] ||
+        [value isKindOfClass:[NSNumber class]] ||
+        [value isKindOfClass:[NSData class]] ||
+        [value isKindOfClass:[NSDate class]]) {
+        return YES;
+    }
+    if ([value isKindOfClass:[NSArray class]]) {
+        for (id object in value) {
+            if (![self isPropertyList:object]) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        BOOL __block isPropertyList = YES;
+        [(NSDictionary *)value enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
+            if (![key isKindOfClass:[NSString class]] || ![self isPropertyList:object]) {
+                isPropertyList = NO;
+                *stop = YES;
+            }
+        }];
+        return isPropertyList;
+    }
+    return NO;
+}
+
+- (NSData *)transformedValue:(id)value {
+    if (!value) {
+        return nil;
+    }
+    NSMutableDictionary *keys = [NSMutableDictionary new];
+    _DFPropertyListEncoder encoder = { .bytes = NULL, .length = 0, .capacity = 0, .keys = keys };
+    BOOL success = _DFPropertyListEncoderReserve(&encoder, 256);
+    if (success) {
+        encoder.bytes[encoder.length++] = DFPropertyListVersion;
+        success = _DFPropertyListEncodeValue(&encoder, value, 0);
+    }
+    if (!success) {
+        free(encoder.bytes);
+        return nil;
+    }
+    return [[NSData alloc] initWithBytesNoCopy:encoder.bytes length:encoder.length freeWhenDone:YES];
+}
+
+- (id)reverseTransfomedValue:(NSData *)data {
+    if (data.length < 2) {
+        return nil;
+    }
+    const uint8_t *bytes = data.bytes;
+    if (bytes[0] != DFPropertyListVersion) {
+        return nil;
+    }
+    NSMutableArray *keys = [NSMutableArray new];
+    _DFPropertyListDecoder decoder = { .bytes = bytes + 1, .end = bytes + data.length, .data = data, .keys = keys };
+    id value = _DFPropertyListDecodeValue(&decoder, 0);
+    // Trailing bytes mean that the data is corrupted.
+    return decoder.bytes == decoder.end ? value : nil;
+}
+
+@end
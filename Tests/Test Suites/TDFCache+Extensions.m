@@ -114,6 +114,79 @@
     }
 }
 
+- (void)testBatchCachedObjectsForKeysPopulatesMemoryCache {
+    NSDictionary *strings;
+    [_cache storeStringsWithCount:5 strings:&strings];
+    NSArray *keys = [strings allKeys];
+    [_cache.memoryCache removeAllObjects];
+    
+    [_cache batchCachedObjectsForKeys:keys];
+    for (NSString *key in keys) {
+        XCTAssertEqualObjects([_cache.memoryCache objectForKey:key], strings[key]);
+    }
+}
+
+- (void)testBatchCachedObjectsForKeysReportsPartialResults {
+    _cache.ioQueueCount = 4;
+    NSDictionary *strings;
+    [_cache storeStringsWithCount:600 strings:&strings];
+    NSArray *keys = [strings allKeys];
+    [_cache.memoryCache removeAllObjects];
+    
+    NSMutableDictionary *partialResults = [NSMutableDictionary new];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_cache batchCachedObjectsForKeys:keys progressHandler:^(NSDictionary *partialBatch) {
+        XCTAssertTrue(partialBatch.count > 0);
+        [partialResults addEntriesFromDictionary:partialBatch];
+    } completion:^(NSDictionary *batch) {
+        XCTAssertEqualObjects(batch, strings);
+        XCTAssertEqualObjects(partialResults, strings);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
+- (void)testBatchCachedDataForKeysReportsPartialResults {
+    NSDictionary *strings;
+    [_cache storeStringsWithCount:10 strings:&strings];
+    NSArray *keys = [[strings allKeys] arrayByAddingObject:@"_missing_key"];
+    
+    NSMutableDictionary *partialResults = [NSMutableDictionary new];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_cache batchCachedDataForKeys:keys progressHandler:^(NSDictionary *partialBatch) {
+        [partialResults addEntriesFromDictionary:partialBatch];
+    } completion:^(NSDictionary *batch) {
+        XCTAssertEqual(batch.count, strings.count);
+        XCTAssertEqualObjects(partialResults, batch);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+}
+
+/*! Compares batch read of the objects that are not in the memory cache with the objects read one by one.
+ */
+- (void)testPerformanceBatchCachedObjectsForKeys {
+    NSDictionary *strings;
+    [_cache storeStringsWithCount:1000 strings:&strings];
+    NSArray *keys = [strings allKeys];
+    [self measureBlock:^{
+        [_cache.memoryCache removeAllObjects];
+        [_cache batchCachedObjectsForKeys:keys];
+    }];
+}
+
+- (void)testPerformanceCachedObjectsForKeysOneByOne {
+    NSDictionary *strings;
+    [_cache storeStringsWithCount:1000 strings:&strings];
+    NSArray *keys = [strings allKeys];
+    [self measureBlock:^{
+        [_cache.memoryCache removeAllObjects];
+        for (NSString *key in keys) {
+            [_cache cachedObjectForKey:key];
+        }
+    }];
+}
+
 - (void)testFirstCachedObjectForKeys {
     NSDictionary *strings;
     [_cache storeStringsWithCount:5 strings:&strings];
@@ -6,6 +6,163 @@
 #import "DFCache.h"
 #import <XCTest/XCTest.h>
 
+/*! Value transformer that counts decoded values. Decoding is slowed down so that concurrent lookups overlap.
+ */
+@interface TDFCacheCountingValueTransformer : DFValueTransformerNSCoding <DFValueTransformerFactory>
+
+@property (atomic) NSUInteger reverseTransformCount;
+
+@end
+
+@implementation TDFCacheCountingValueTransformer
+
+- (id)reverseTransfomedValue:(NSData *)data {
+    @synchronized(self) {
+        self.reverseTransformCount++;
+    }
+    [NSThread sleepForTimeInterval:0.1];
+    return [super reverseTransfomedValue:data];
+}
+
+- (NSString *)valueTransformerNameForValue:(id)value {
+    return @"counting";
+}
+
+- (id<DFValueTransforming>)valueTransformerForName:(NSString *)name {
+    return name ? self : nil;
+}
+
+@end
+
+
+/*! Value transformer that signals when decoding starts and blocks decoding until it is allowed to continue.
+ */
+@interface TDFCacheBlockingValueTransformer : DFValueTransformerNSCoding <DFValueTransformerFactory>
+
+@property (nonatomic, readonly) dispatch_semaphore_t decodingStarted;
+@property (nonatomic, readonly) dispatch_semaphore_t decodingAllowed;
+
+@end
+
+@implementation TDFCacheBlockingValueTransformer
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _decodingStarted = dispatch_semaphore_create(0);
+        _decodingAllowed = dispatch_semaphore_create(0);
+    }
+    return self;
+}
+
+- (id)reverseTransfomedValue:(NSData *)data {
+    dispatch_semaphore_signal(_decodingStarted);
+    dispatch_semaphore_wait(_decodingAllowed, DISPATCH_TIME_FOREVER);
+    return [super reverseTransfomedValue:data];
+}
+
+- (NSString *)valueTransformerNameForValue:(id)value {
+    return @"blocking";
+}
+
+- (id<DFValueTransforming>)valueTransformerForName:(NSString *)name {
+    return name ? self : nil;
+}
+
+@end
+
+
+/*! Value transformer that slows down encoding and records whether objects were encoded on IO queues.
+ */
+@interface TDFCacheSlowEncodingValueTransformer : DFValueTransformerNSCoding <DFValueTransformerFactory>
+
+@property (atomic) BOOL encodedOnIOQueue;
+
+@end
+
+@implementation TDFCacheSlowEncodingValueTransformer
+
+- (NSData *)transformedValue:(id)value {
+    if (strcmp(dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL), "DFCache::IOQueue") == 0) {
+        self.encodedOnIOQueue = YES;
+    }
+    [NSThread sleepForTimeInterval:0.05];
+    return [super transformedValue:value];
+}
+
+- (NSString *)valueTransformerNameForValue:(id)value {
+    return @"slow";
+}
+
+- (id<DFValueTransforming>)valueTransformerForName:(NSString *)name {
+    return name ? self : nil;
+}
+
+@end
+
+
+/*! Value transformer that reports string length as object cost.
+ */
+@interface TDFCacheCostValueTransformer : DFValueTransformerNSCoding <DFValueTransformerFactory>
+
+@end
+
+@implementation TDFCacheCostValueTransformer
+
+- (NSUInteger)costForValue:(id)value {
+    return [value length];
+}
+
+- (NSString *)valueTransformerNameForValue:(id)value {
+    return @"cost";
+}
+
+- (id<DFValueTransforming>)valueTransformerForName:(NSString *)name {
+    return name ? self : nil;
+}
+
+@end
+
+
+/*! Disk cache that counts writes.
+ */
+@interface TDFCacheCountingDiskCache : DFDiskCache
+
+@property (atomic) NSUInteger writeCount;
+
+@end
+
+@implementation TDFCacheCountingDiskCache
+
+- (void)setData:(NSData *)data attributes:(NSDictionary *)attributes expirationDate:(NSDate *)expirationDate forKey:(NSString *)key {
+    @synchronized(self) {
+        self.writeCount++;
+    }
+    [super setData:data attributes:attributes expirationDate:expirationDate forKey:key];
+}
+
+@end
+
+
+/*! Disk cache that is always full, cleanup doesn't evict anything. Records whether disk usage was checked on the main thread.
+ */
+@interface TDFCacheFullDiskCache : DFDiskCache
+
+@property (atomic) BOOL needsCleanupCheckedOnMainThread;
+
+@end
+
+@implementation TDFCacheFullDiskCache
+
+- (BOOL)needsCleanup {
+    if ([NSThread isMainThread]) {
+        self.needsCleanupCheckedOnMainThread = YES;
+    }
+    return YES;
+}
+
+@end
+
+
 @interface TDFCache : XCTestCase
 
 @end
@@ -37,6 +194,9 @@
     XCTAssertNotNil(cache.memoryCache);
     XCTAssertNotNil(cache.diskCache);
     XCTAssertTrue([cache.memoryCache.name isEqualToString:name]);
+    // Objects without cost don't make the default memory cache grow without limit.
+    XCTAssertTrue(cache.memoryCache.totalCostLimit > 0);
+    XCTAssertTrue(cache.memoryCache.countLimit > 0);
     
     XCTAssertThrows([[DFCache alloc] initWithName:@""]);
 }
@@ -57,6 +217,21 @@
     XCTAssertNil([cache cachedObjectForKey:@"key"]);
 }
 
+- (void)testWritesCrossingHighWatermarkStartCleanup {
+    [_cache setCleanupTimerEnabled:NO];
+    _cache.diskCache.capacity = 1000000;
+    _cache.diskCache.cleanupRate = 0.5f;
+    NSMutableData *data = [NSMutableData dataWithLength:100000];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [_cache storeData:data forKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i]];
+    }
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:3.0];
+    while (_cache.diskCache.contentsSize >= 500000 && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    XCTAssertTrue(_cache.diskCache.contentsSize < 500000);
+}
+
 - (void)testInitializationWithoutNameThrowsException {
     XCTAssertThrowsSpecificNamed([[DFCache alloc] initWithName:@"" memoryCache:nil], NSException, NSInvalidArgumentException);
     XCTAssertThrowsSpecificNamed([[DFCache alloc] initWithName:@""], NSException, NSInvalidArgumentException);
@@ -259,6 +434,33 @@
     }
 }
 
+#pragma mark - Expiration
+
+- (void)testStoreObjectWithTimeToLive {
+    [_cache storeObject:@"value" forKey:@"key" timeToLive:0.2];
+    [_cache storeData:[NSKeyedArchiver archivedDataWithRootObject:@"data"] forKey:@"key_data" timeToLive:0.2];
+    [_cache storeObject:@"value" forKey:@"key_persistent"];
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertNotNil([_cache cachedDataForKey:@"key_data"]);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+    XCTAssertNil([_cache cachedObjectForKey:@"key"]);
+    XCTAssertNil([_cache cachedDataForKey:@"key_data"]);
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key_persistent"], @"value");
+}
+
+- (void)testObjectReadFromDiskExpiresInMemory {
+    DFCache *cache = [[DFCache alloc] initWithName:@"_dt_testcase_ttl" memoryCache:[DFMemoryCache new]];
+    [cache storeObject:@"value" forKey:@"key" timeToLive:0.2];
+    [cache.memoryCache removeAllObjects];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertNotNil([cache.memoryCache objectForKey:@"key"]);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+    XCTAssertNil([cache.memoryCache objectForKey:@"key"]);
+    [cache removeAllObjects];
+}
+
 #pragma mark - Metadata Tests
 
 - (void)testStoreObjectWithMetadata {
@@ -290,6 +492,433 @@
     XCTAssertTrue([metadata[metaKey] isEqualToString:customValueMod]);
 }
 
+- (void)testMetadataIsEncodedAsPropertyList {
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache setMetadata:@{ @"meta_key" : @"meta_value", @"meta_date" : [NSDate dateWithTimeIntervalSinceReferenceDate:0] } forKey:@"key"];
+    XCTAssertEqualObjects([_cache metadataForKey:@"key"][@"meta_key"], @"meta_value");
+    NSData *data = [_cache.diskCache attributeForName:DFCacheAttributeMetadataKey key:@"key"];
+    id metadata = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:nil];
+    XCTAssertEqualObjects(metadata[@"meta_key"], @"meta_value");
+}
+
+- (void)testEntriesWrittenByPreviousVersionsAreReadable {
+    // Previous versions archived both value transformer name and metadata with NSKeyedArchiver.
+    NSDictionary *attributes = @{ @"_df_cache_value_transformer_name_key" : [NSKeyedArchiver archivedDataWithRootObject:DFValueTransformerNSCodingName],
+                                  DFCacheAttributeMetadataKey : [NSKeyedArchiver archivedDataWithRootObject:@{ @"meta_key" : @"meta_value" }] };
+    [_cache.diskCache setData:[NSKeyedArchiver archivedDataWithRootObject:@"value"] attributes:attributes forKey:@"key"];
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertEqualObjects([_cache metadataForKey:@"key"], @{ @"meta_key" : @"meta_value" });
+    
+    [_cache setMetadataValues:@{ @"meta_key_2" : @"meta_value_2" } forKey:@"key"];
+    NSDictionary *metadata = [_cache metadataForKey:@"key"];
+    XCTAssertEqualObjects(metadata[@"meta_key"], @"meta_value");
+    XCTAssertEqualObjects(metadata[@"meta_key_2"], @"meta_value_2");
+}
+
+#pragma mark - IO Queues
+
+- (void)testReadYourWritesWithMultipleIOQueues {
+    _cache.ioQueueCount = 4;
+    NSDictionary *objects;
+    [_cache storeStringsWithCount:50 strings:&objects];
+    for (NSString *key in objects) {
+        XCTAssertEqualObjects([_cache cachedObjectForKey:key], objects[key]);
+    }
+}
+
+- (void)testChangingIOQueueCountPreservesOrdering {
+    NSDictionary *objects;
+    [_cache storeStringsWithCount:50 strings:&objects];
+    _cache.ioQueueCount = 3;
+    for (NSString *key in objects) {
+        XCTAssertEqualObjects([_cache cachedObjectForKey:key], objects[key]);
+    }
+}
+
+- (void)testRemoveAllObjectsWithMultipleIOQueues {
+    _cache.ioQueueCount = 4;
+    NSDictionary *objects;
+    [_cache storeStringsWithCount:20 strings:&objects];
+    [_cache removeAllObjects];
+    for (NSString *key in objects) {
+        XCTAssertNil([_cache cachedObjectForKey:key]);
+    }
+}
+
+/*! Mixed read/write workload (80% reads) executed concurrently, compare with testPerformanceMixedWorkloadWithMultipleIOQueues.
+ */
+- (void)testPerformanceMixedWorkloadWithSingleIOQueue {
+    [self _measureMixedWorkloadWithIOQueueCount:1];
+}
+
+- (void)testPerformanceMixedWorkloadWithMultipleIOQueues {
+    [self _measureMixedWorkloadWithIOQueueCount:[NSProcessInfo processInfo].activeProcessorCount];
+}
+
+- (void)_measureMixedWorkloadWithIOQueueCount:(NSUInteger)count {
+    _cache.ioQueueCount = count;
+    NSDictionary *objects;
+    [_cache storeStringsWithCount:500 strings:&objects];
+    NSArray *keys = [objects allKeys];
+    [self measureBlock:^{
+        dispatch_apply(4000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            NSString *key = keys[i % keys.count];
+            if (i % 5 == 0) {
+                [_cache storeObject:objects[key] forKey:key];
+            } else {
+                [_cache cachedObjectForKey:key];
+            }
+        });
+        [_cache cachedDataForKey:keys[0]];
+    }];
+}
+
+#pragma mark - Request Coalescing
+
+- (void)testConcurrentLookupsShareSingleRead {
+    TDFCacheCountingValueTransformer *transformer = [TDFCacheCountingValueTransformer new];
+    _cache.valueTransfomerFactory = transformer;
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache cachedDataForKey:@"key"]; // Wait until the object is written
+    
+    NSUInteger count = 10;
+    for (NSUInteger i = 0; i < count; i++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+        [_cache cachedObjectForKey:@"key" completion:^(id object) {
+            XCTAssertEqualObjects(object, @"value");
+            [expectation fulfill];
+        }];
+    }
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    });
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+    XCTAssertEqual(transformer.reverseTransformCount, 1);
+}
+
+- (void)testWriteDuringPendingReadWins {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    TDFCacheBlockingValueTransformer *transformer = [TDFCacheBlockingValueTransformer new];
+    cache.valueTransfomerFactory = transformer;
+    [cache storeObject:@"value1" forKey:@"key"];
+    [cache cachedDataForKey:@"key"]; // Wait until the object is written
+    [cache.memoryCache removeAllObjects];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [cache cachedObjectForKey:@"key" completion:^(id object) {
+        [expectation fulfill];
+    }];
+    // The object is stored after the read got the data from disk and before the data is decoded.
+    XCTAssertEqual(dispatch_semaphore_wait(transformer.decodingStarted, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(3 * NSEC_PER_SEC))), 0);
+    [cache storeObject:@"value2" forKey:@"key"];
+    dispatch_semaphore_signal(transformer.decodingAllowed);
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+    XCTAssertEqualObjects([cache.memoryCache objectForKey:@"key"], @"value2");
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value2");
+}
+
+#pragma mark - Write Buffering
+
+- (void)testObjectsAreEncodedOutsideOfIOQueues {
+    TDFCacheSlowEncodingValueTransformer *transformer = [TDFCacheSlowEncodingValueTransformer new];
+    _cache.valueTransfomerFactory = transformer;
+    [_cache storeObject:@"value" forKey:@"key"];
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertFalse(transformer.encodedOnIOQueue);
+}
+
+- (void)testRepeatedWritesAreMerged {
+    TDFCacheCountingDiskCache *diskCache = [[TDFCacheCountingDiskCache alloc] initWithName:@"_dt_testcase_write_buffering"];
+    DFCache *cache = [[DFCache alloc] initWithDiskCache:diskCache memoryCache:nil];
+    cache.valueTransfomerFactory = [TDFCacheSlowEncodingValueTransformer new];
+    NSUInteger count = 20;
+    for (NSUInteger i = 0; i < count; i++) {
+        [cache storeObject:[NSString stringWithFormat:@"value%lu", (unsigned long)i] forKey:@"key"];
+    }
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value19");
+    XCTAssertTrue(diskCache.writeCount < count);
+    [cache removeAllObjects];
+}
+
+- (void)testStoreDataAfterStoreObjectWins {
+    _cache.valueTransfomerFactory = [TDFCacheSlowEncodingValueTransformer new];
+    NSData *data = [@"data" dataUsingEncoding:NSUTF8StringEncoding];
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache storeData:data forKey:@"key"];
+    XCTAssertEqualObjects([_cache cachedDataForKey:@"key"], data);
+}
+
+- (void)testMetadataSetAfterPendingWriteIsPreserved {
+    _cache.valueTransfomerFactory = [TDFCacheSlowEncodingValueTransformer new];
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache setMetadata:@{ @"meta_key" : @"meta_value" } forKey:@"key"];
+    XCTAssertEqualObjects([_cache metadataForKey:@"key"], @{ @"meta_key" : @"meta_value" });
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+}
+
+- (void)testRemovalDiscardsPendingWrite {
+    _cache.valueTransfomerFactory = [TDFCacheSlowEncodingValueTransformer new];
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache removeObjectForKey:@"key"];
+    XCTAssertNil([_cache cachedDataForKey:@"key"]);
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertNil([_cache cachedDataForKey:@"key"]);
+}
+
+#pragma mark - Prefetch
+
+/*! Stores objects and waits until they are written, memory cache is emptied afterwards.
+ */
+- (NSArray *)_storeObjects:(NSArray *)objects cache:(DFCache *)cache {
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < objects.count; i++) {
+        NSString *key = [NSString stringWithFormat:@"key_%lu", (unsigned long)i];
+        [cache storeObject:objects[i] forKey:key];
+        [keys addObject:key];
+    }
+    for (NSString *key in keys) {
+        [cache cachedDataForKey:key];
+    }
+    [cache.memoryCache removeAllObjects];
+    return keys;
+}
+
+- (NSArray *)_keys:(NSArray *)keys inMemoryCache:(NSCache *)memoryCache {
+    NSMutableArray *residentKeys = [NSMutableArray new];
+    for (NSString *key in keys) {
+        if ([memoryCache objectForKey:key]) {
+            [residentKeys addObject:key];
+        }
+    }
+    return residentKeys;
+}
+
+- (void)_waitUntil:(BOOL (^)(void))condition {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:3.0];
+    while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.02]];
+    }
+}
+
+- (void)testPrefetchPutsObjectsIntoMemoryCache {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    NSArray *keys = [self _storeObjects:@[ @"value0", @"value1", @"value2", @"value3", @"value4" ] cache:cache];
+    [cache prefetchObjectsForKeys:keys];
+    [self _waitUntil:^BOOL{
+        return [self _keys:keys inMemoryCache:cache.memoryCache].count == keys.count;
+    }];
+    for (NSUInteger i = 0; i < keys.count; i++) {
+        XCTAssertEqualObjects([cache.memoryCache objectForKey:keys[i]], ([NSString stringWithFormat:@"value%lu", (unsigned long)i]));
+    }
+    [cache removeAllObjects];
+}
+
+- (void)testPrefetchSkipsObjectsInMemoryCache {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    TDFCacheCountingValueTransformer *transformer = [TDFCacheCountingValueTransformer new];
+    cache.valueTransfomerFactory = transformer;
+    NSArray *keys = [self _storeObjects:@[ @"value0", @"value1" ] cache:cache];
+    [cache setObject:@"value0" forKey:keys[0]];
+    [cache prefetchObjectsForKeys:keys];
+    [self _waitUntil:^BOOL{
+        return [cache.memoryCache objectForKey:keys[1]] != nil;
+    }];
+    XCTAssertEqual(transformer.reverseTransformCount, 1);
+    [cache removeAllObjects];
+}
+
+- (void)testPrefetchRespectsCostLimit {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    cache.valueTransfomerFactory = [TDFCacheCostValueTransformer new];
+    NSMutableArray *objects = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [objects addObject:[@"" stringByPaddingToLength:100 withString:@"a" startingAtIndex:0]];
+    }
+    NSArray *keys = [self _storeObjects:objects cache:cache];
+    cache.prefetchCostLimit = 250;
+    [cache prefetchObjectsForKeys:keys];
+    [self _waitUntil:^BOOL{
+        return [self _keys:keys inMemoryCache:cache.memoryCache].count >= 3;
+    }];
+    [NSThread sleepForTimeInterval:0.2];
+    NSArray *prefetchedKeys = [self _keys:keys inMemoryCache:cache.memoryCache];
+    XCTAssertTrue(prefetchedKeys.count >= 3 && prefetchedKeys.count <= 4);
+    
+    // Cancellation frees the budget, prefetching resumes.
+    [cache cancelPrefetchingForKeys:prefetchedKeys];
+    [self _waitUntil:^BOOL{
+        return [self _keys:keys inMemoryCache:cache.memoryCache].count >= prefetchedKeys.count + 3;
+    }];
+    XCTAssertTrue([self _keys:keys inMemoryCache:cache.memoryCache].count >= prefetchedKeys.count + 3);
+    [cache removeAllObjects];
+}
+
+- (void)testPrefetchResumesWhenPrefetchedObjectsAreEvicted {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    cache.valueTransfomerFactory = [TDFCacheCostValueTransformer new];
+    NSMutableArray *objects = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [objects addObject:[@"" stringByPaddingToLength:100 withString:@"a" startingAtIndex:0]];
+    }
+    NSArray *keys = [self _storeObjects:objects cache:cache];
+    cache.prefetchCostLimit = 250;
+    [cache prefetchObjectsForKeys:keys];
+    [self _waitUntil:^BOOL{
+        return [self _keys:keys inMemoryCache:cache.memoryCache].count >= 3;
+    }];
+    [NSThread sleepForTimeInterval:0.2];
+    NSArray *prefetchedKeys = [self _keys:keys inMemoryCache:cache.memoryCache];
+    
+    // Objects evicted from memory cache no longer count towards the limit.
+    for (NSString *key in prefetchedKeys) {
+        [cache.memoryCache removeObjectForKey:key];
+    }
+    [cache prefetchObjectsForKeys:keys];
+    [self _waitUntil:^BOOL{
+        return [self _keys:keys inMemoryCache:cache.memoryCache].count >= 3;
+    }];
+    XCTAssertTrue([self _keys:keys inMemoryCache:cache.memoryCache].count >= 3);
+    [cache removeAllObjects];
+}
+
+- (void)testHighPriorityKeysArePrefetchedFirst {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    cache.valueTransfomerFactory = [TDFCacheCountingValueTransformer new];
+    NSArray *keys = [self _storeObjects:@[ @"value0", @"value1", @"value2", @"value3", @"value4", @"value5" ] cache:cache];
+    [cache prefetchObjectsForKeys:[keys subarrayWithRange:NSMakeRange(0, 5)] priority:DFCachePrefetchPriorityLow];
+    [cache prefetchObjectsForKeys:@[ keys[5] ] priority:DFCachePrefetchPriorityHigh];
+    [self _waitUntil:^BOOL{
+        return [cache.memoryCache objectForKey:keys[5]] != nil;
+    }];
+    XCTAssertNotNil([cache.memoryCache objectForKey:keys[5]]);
+    XCTAssertTrue([self _keys:keys inMemoryCache:cache.memoryCache].count < keys.count);
+    [cache removeAllObjects];
+}
+
+- (void)testUpdatingPrefetchWindowCancelsStaleKeys {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    TDFCacheCountingValueTransformer *transformer = [TDFCacheCountingValueTransformer new];
+    cache.valueTransfomerFactory = transformer;
+    NSArray *keys = [self _storeObjects:@[ @"value0", @"value1", @"value2", @"value3", @"value4", @"value5", @"value6", @"value7" ] cache:cache];
+    [cache updatePrefetchWindowWithKeys:[keys subarrayWithRange:NSMakeRange(0, 7)] priority:DFCachePrefetchPriorityNormal];
+    [cache updatePrefetchWindowWithKeys:@[ keys[7] ] priority:DFCachePrefetchPriorityNormal];
+    [self _waitUntil:^BOOL{
+        return [cache.memoryCache objectForKey:keys[7]] != nil;
+    }];
+    [NSThread sleepForTimeInterval:0.3];
+    XCTAssertNotNil([cache.memoryCache objectForKey:keys[7]]);
+    // Only the reads that were already in progress are completed.
+    XCTAssertTrue(transformer.reverseTransformCount <= 3);
+    [cache removeAllObjects];
+}
+
+- (void)testPrefetchMostFrequentlyAccessedObjects {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    NSArray *keys = [self _storeObjects:@[ @"value0", @"value1", @"value2" ] cache:cache];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [cache cachedDataForKey:keys[1]];
+    }
+    [cache prefetchMostFrequentlyAccessedObjects:1];
+    [self _waitUntil:^BOOL{
+        return [cache.memoryCache objectForKey:keys[1]] != nil;
+    }];
+    XCTAssertEqualObjects([cache.memoryCache objectForKey:keys[1]], @"value1");
+    XCTAssertNil([cache.memoryCache objectForKey:keys[0]]);
+    XCTAssertNil([cache.memoryCache objectForKey:keys[2]]);
+    [cache removeAllObjects];
+}
+
+#pragma mark - Metrics
+
+- (void)testMetricsAreDisabledByDefault {
+    XCTAssertFalse(_cache.metricsEnabled);
+    XCTAssertNil([_cache metrics]);
+    _cache.metricsEnabled = YES;
+    XCTAssertNotNil([_cache metrics]);
+    _cache.metricsEnabled = NO;
+    XCTAssertNil([_cache metrics]);
+}
+
+- (void)testMetricsCountHitsByTier {
+    DFCache *cache = [self _createCacheForMemoryCacheTesting];
+    cache.metricsEnabled = YES;
+    [cache storeObject:@"value" forKey:@"key"];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value");
+    [cache.memoryCache removeAllObjects];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertNil([cache cachedObjectForKey:@"missing_key"]);
+    DFCacheMetrics *metrics = [cache metrics];
+    XCTAssertEqual(metrics.memoryHitCount, 1);
+    XCTAssertEqual(metrics.diskHitCount, 1);
+    XCTAssertEqual(metrics.missCount, 1);
+    XCTAssertEqual([metrics latencyHistogramForOperation:DFCacheOperationMemoryLookup].count, 3);
+    [cache removeAllObjects];
+}
+
+- (void)testMetricsRecordLatencies {
+    _cache.metricsEnabled = YES;
+    for (NSUInteger i = 0; i < 20; i++) {
+        NSString *key = [NSString stringWithFormat:@"key_%lu", (unsigned long)i];
+        [_cache storeObject:@"value" forKey:key];
+        XCTAssertEqualObjects([_cache cachedObjectForKey:key], @"value");
+    }
+    DFCacheMetrics *metrics = [_cache metrics];
+    for (NSNumber *operation in @[ @(DFCacheOperationDiskRead), @(DFCacheOperationDecode), @(DFCacheOperationEncode), @(DFCacheOperationDiskWrite) ]) {
+        DFCacheLatencyHistogram *histogram = [metrics latencyHistogramForOperation:[operation unsignedIntegerValue]];
+        XCTAssertEqual(histogram.count, 20, @"Operation %@", operation);
+        XCTAssertTrue(histogram.minimumDuration <= [histogram durationAtPercentile:50]);
+        XCTAssertTrue([histogram durationAtPercentile:50] <= [histogram durationAtPercentile:99]);
+        XCTAssertTrue([histogram durationAtPercentile:99] <= histogram.maximumDuration);
+        XCTAssertEqual([histogram durationAtPercentile:100], histogram.maximumDuration);
+        XCTAssertTrue(histogram.meanDuration > 0 && histogram.meanDuration <= histogram.maximumDuration);
+    }
+    // Both writes and reads wait for IO queues.
+    XCTAssertTrue([metrics latencyHistogramForOperation:DFCacheOperationIOQueueWait].count >= 20);
+    XCTAssertTrue(metrics.maximumIOQueueDepth >= 1);
+}
+
+- (void)testMetricsRecordCleanup {
+    [_cache setCleanupTimerEnabled:NO];
+    _cache.metricsEnabled = YES;
+    _cache.diskCache.capacity = 1000000;
+    _cache.diskCache.cleanupRate = 0.5f;
+    NSMutableData *data = [NSMutableData dataWithLength:100000];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [_cache storeData:data forKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i]];
+    }
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:3.0];
+    while ([_cache metrics].evictedCount == 0 && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    DFCacheMetrics *metrics = [_cache metrics];
+    XCTAssertTrue(metrics.evictedCount > 0);
+    XCTAssertTrue(metrics.evictedSize >= metrics.evictedCount * 100000);
+    XCTAssertTrue([metrics latencyHistogramForOperation:DFCacheOperationCleanup].count > 0);
+}
+
+- (void)testResetMetrics {
+    _cache.metricsEnabled = YES;
+    [_cache storeObject:@"value" forKey:@"key"];
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertEqual([_cache metrics].diskHitCount, 1);
+    [_cache resetMetrics];
+    DFCacheMetrics *metrics = [_cache metrics];
+    XCTAssertEqual(metrics.diskHitCount, 0);
+    XCTAssertEqual([metrics latencyHistogramForOperation:DFCacheOperationDiskRead].count, 0);
+    XCTAssertEqual([[metrics latencyHistogramForOperation:DFCacheOperationDiskRead] durationAtPercentile:99], 0);
+}
+
+- (void)testMetricsAreReportedPeriodically {
+    _cache.metricsEnabled = YES;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"report"];
+    [_cache setMetricsReportingInterval:0.05 handler:^(DFCacheMetrics *metrics) {
+        XCTAssertTrue([NSThread isMainThread]);
+        [_cache setMetricsReportingInterval:0 handler:nil];
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+}
+
 #pragma mark - Data
 
 - (void)testCachedDataForKeyAsynchronous {
@@ -327,4 +956,171 @@
     XCTAssertTrue([data length] == [cachedData length]);
 }
 
+#pragma mark - Streaming
+
+- (void)testStoreDataFromStream {
+    NSMutableData *data = [NSMutableData new];
+    for (NSUInteger i = 0; i < 100000; i++) {
+        uint8_t byte = (uint8_t)i;
+        [data appendBytes:&byte length:1];
+    }
+    [_cache storeObject:@"value" forKey:@"key"];
+    XCTAssertNotNil([_cache.memoryCache objectForKey:@"key"]);
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"write"];
+    [_cache storeDataFromStream:[NSInputStream inputStreamWithData:data] forKey:@"key" completion:^(BOOL success) {
+        XCTAssertTrue(success);
+        XCTAssertTrue([NSThread isMainThread]);
+        XCTAssertNil([_cache.memoryCache objectForKey:@"key"]);
+        XCTAssertEqualObjects([_cache cachedDataForKey:@"key"], data);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+    
+    XCTAssertEqualObjects([_cache cachedDataForKey:@"key" offset:1000 length:10], [data subdataWithRange:NSMakeRange(1000, 10)]);
+    
+    NSInputStream *stream = [_cache cachedDataStreamForKey:@"key"];
+    NSMutableData *contents = [NSMutableData new];
+    uint8_t buffer[4096];
+    NSInteger length;
+    [stream open];
+    while ((length = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        [contents appendBytes:buffer length:(NSUInteger)length];
+    }
+    [stream close];
+    XCTAssertEqualObjects(contents, data);
+}
+
+- (void)testCancelledStreamingWriteLeavesDataIntact {
+    [_cache storeObject:@"value" forKey:@"key"];
+    NSData *data = [_cache cachedDataForKey:@"key"];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"write"];
+    [_cache storeDataForKey:@"key" timeToLive:0.0 writingBlock:^BOOL(DFFileStorageWriter *writer) {
+        [writer writeData:[@"partial" dataUsingEncoding:NSUTF8StringEncoding]];
+        return NO;
+    } completion:^(BOOL success) {
+        XCTAssertFalse(success);
+        XCTAssertEqualObjects([_cache cachedDataForKey:@"key"], data);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+}
+
+- (void)testCachedDataForKeyRangeAsynchronous {
+    [_cache storeObject:@"value" forKey:@"key"];
+    NSData *data = [_cache cachedDataForKey:@"key"];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [_cache cachedDataForKey:@"key" offset:2 length:4 completion:^(NSData *rangeData) {
+        XCTAssertEqualObjects(rangeData, [data subdataWithRange:NSMakeRange(2, 4)]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+}
+
+#pragma mark - Admission
+
+- (void)testAdmissionFilterEstimatesFrequencies {
+    DFCacheAdmissionFilter *filter = [DFCacheAdmissionFilter new];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [filter recordAccessForKey:@"key_1"];
+    }
+    [filter recordAccessForKey:@"key_2"];
+    XCTAssertEqual([filter frequencyForKey:@"key_1"], 3);
+    XCTAssertEqual([filter frequencyForKey:@"key_2"], 1);
+    XCTAssertEqual([filter frequencyForKey:@"key_3"], 0);
+    
+    XCTAssertTrue([filter shouldAdmitKey:@"key_1" toTier:DFCacheTierDisk]);
+    XCTAssertFalse([filter shouldAdmitKey:@"key_2" toTier:DFCacheTierDisk]);
+    XCTAssertTrue([filter shouldAdmitKey:@"key_2" toTier:DFCacheTierMemory]);
+    XCTAssertEqual(filter.rejectedDiskCount, 1);
+    XCTAssertEqual(filter.rejectedMemoryCount, 0);
+    
+    [filter reset];
+    XCTAssertEqual([filter frequencyForKey:@"key_1"], 0);
+    XCTAssertEqual(filter.rejectedDiskCount, 0);
+}
+
+- (void)testAdmissionFilterAgesFrequencies {
+    DFCacheAdmissionFilter *filter = [DFCacheAdmissionFilter new];
+    filter.sampleSize = 100;
+    for (NSUInteger i = 0; i < 8; i++) {
+        [filter recordAccessForKey:@"key"];
+    }
+    for (NSUInteger i = 0; i < 92; i++) {
+        [filter recordAccessForKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i]];
+    }
+    XCTAssertEqual([filter frequencyForKey:@"key"], 4);
+}
+
+- (DFCache *)_createCacheWithFullDiskCache {
+    TDFCacheFullDiskCache *diskCache = [[TDFCacheFullDiskCache alloc] initWithName:[[NSUUID UUID] UUIDString]];
+    return [[DFCache alloc] initWithDiskCache:diskCache memoryCache:nil];
+}
+
+- (void)testAdmissionFilterRejectsOneHitWondersWhenDiskIsFull {
+    DFCache *cache = [self _createCacheWithFullDiskCache];
+    cache.admissionFilter = [DFCacheAdmissionFilter new];
+    
+    [cache storeObject:@"value" forKey:@"key"];
+    XCTAssertNil([cache cachedObjectForKey:@"key"]);
+    XCTAssertEqual(cache.admissionFilter.rejectedDiskCount, 1);
+    
+    // Key is admitted once it was accessed again.
+    [cache storeObject:@"value" forKey:@"key"];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertEqual(cache.admissionFilter.rejectedDiskCount, 1);
+    [cache removeAllObjects];
+}
+
+- (void)testDiskAdmissionDoesntCheckDiskUsageOnCallerThread {
+    DFCache *cache = [self _createCacheWithFullDiskCache];
+    cache.admissionFilter = [DFCacheAdmissionFilter new];
+    [cache storeObject:@"value" forKey:@"key"];
+    [cache storeData:[@"data" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"data_key"];
+    XCTAssertNil([cache cachedDataForKey:@"key"]);
+    XCTAssertNil([cache cachedDataForKey:@"data_key"]);
+    XCTAssertEqual(cache.admissionFilter.rejectedDiskCount, 2);
+    XCTAssertFalse([(TDFCacheFullDiskCache *)cache.diskCache needsCleanupCheckedOnMainThread]);
+    [cache removeAllObjects];
+}
+
+- (void)testAdmissionFilterAdmitsWritesWhenDiskHasSpace {
+    _cache.admissionFilter = [DFCacheAdmissionFilter new];
+    [_cache storeObject:@"value" forKey:@"key"];
+    [_cache storeData:[@"data" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"data_key"];
+    XCTAssertEqualObjects([_cache cachedObjectForKey:@"key"], @"value");
+    XCTAssertNotNil([_cache cachedDataForKey:@"data_key"]);
+    XCTAssertEqual(_cache.admissionFilter.rejectedDiskCount, 0);
+}
+
+- (void)testRejectedWriteRemovesPreviousEntry {
+    DFCache *cache = [self _createCacheWithFullDiskCache];
+    [cache storeObject:@"value_1" forKey:@"key"];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], @"value_1");
+    
+    cache.admissionFilter = [DFCacheAdmissionFilter new];
+    [cache storeObject:@"value_2" forKey:@"key"];
+    XCTAssertNil([cache cachedObjectForKey:@"key"]);
+    [cache removeAllObjects];
+}
+
+- (void)testAdmissionFilterRejectsObjectsWhenMemoryCacheIsFull {
+    DFMemoryCache *memoryCache = [DFMemoryCache new];
+    memoryCache.countLimit = 1;
+    DFCache *cache = [[DFCache alloc] initWithDiskCache:nil memoryCache:memoryCache];
+    cache.admissionFilter = [DFCacheAdmissionFilter new];
+    cache.admissionFilter.memoryAdmissionFrequency = 2;
+    
+    [cache storeObject:@"value_1" forKey:@"key_1"];
+    [cache storeObject:@"value_2" forKey:@"key_2"];
+    XCTAssertEqualObjects([memoryCache objectForKey:@"key_1"], @"value_1");
+    XCTAssertNil([memoryCache objectForKey:@"key_2"]);
+    XCTAssertEqual(cache.admissionFilter.rejectedMemoryCount, 1);
+    
+    [cache storeObject:@"value_2" forKey:@"key_2"];
+    XCTAssertEqualObjects([memoryCache objectForKey:@"key_2"], @"value_2");
+}
+
 @end
@@ -3,8 +3,29 @@
 // Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
 
 #import "DFDiskCache.h"
+#import "NSURL+DFExtendedFileAttributes.h"
 #import <XCTest/XCTest.h>
 
+/*! LRU eviction policy that calls the handler when the entry is evicted, before disk cache discards contents of the entry. Handler is called with the index lock held.
+ */
+@interface TDFDiskCacheObservedEvictionPolicy : DFDiskCacheEvictionPolicyLRU
+
+@property (nonatomic, copy) void (^evictionHandler)(DFDiskCacheEntry *entry);
+
+@end
+
+@implementation TDFDiskCacheObservedEvictionPolicy
+
+- (void)didEvictEntry:(DFDiskCacheEntry *)entry {
+    [super didEvictEntry:entry];
+    if (self.evictionHandler) {
+        self.evictionHandler(entry);
+    }
+}
+
+@end
+
+
 @interface TDFDiskCache : XCTestCase
 
 @end
@@ -50,8 +71,870 @@
     XCTAssertTrue([_diskCache containsDataForKey:keys[1]]);
 }
 
+- (void)testCleanupStartsAtHighWatermark {
+    _diskCache.capacity = 1000000;
+    _diskCache.highWatermark = 0.9f;
+    _diskCache.cleanupRate = 0.5f;
+    for (NSUInteger i = 0; i < 8; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    XCTAssertFalse(_diskCache.needsCleanup);
+    [_diskCache cleanup];
+    XCTAssertTrue([_diskCache containsDataForKey:@"_key_0"]);
+    
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_8"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_9"];
+    XCTAssertTrue(_diskCache.needsCleanup);
+    [_diskCache cleanup];
+    XCTAssertFalse(_diskCache.needsCleanup);
+    XCTAssertTrue(_diskCache.contentsSize < 500000);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_0"]);
+}
+
+- (void)testCleanupStartsAtCleanupRateAboveHighWatermark {
+    _diskCache.capacity = 1000000;
+    _diskCache.highWatermark = 0.5f;
+    _diskCache.cleanupRate = 0.95f;
+    for (NSUInteger i = 0; i < 6; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    XCTAssertFalse(_diskCache.needsCleanup);
+    DFDiskCacheCleanupStatistics statistics;
+    XCTAssertTrue([_diskCache cleanupWithTimeBudget:DBL_MAX statistics:&statistics]);
+    XCTAssertEqual(statistics.evictedCount, 0);
+    
+    for (NSUInteger i = 6; i < 10; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    XCTAssertTrue(_diskCache.needsCleanup);
+    XCTAssertTrue([_diskCache cleanupWithTimeBudget:DBL_MAX statistics:&statistics]);
+    XCTAssertTrue(statistics.evictedCount > 0);
+    XCTAssertFalse(_diskCache.needsCleanup);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_0"]);
+}
+
+- (void)testCleanupWithTimeBudgetIsPerformedInSlices {
+    _diskCache.capacity = 1000000;
+    _diskCache.cleanupRate = 0.5f;
+    for (NSUInteger i = 0; i < 10; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    NSUInteger sliceCount = 1;
+    while (![_diskCache cleanupWithTimeBudget:0.0]) {
+        sliceCount++;
+        // Cleanup continues until low watermark is reached even though usage is already below high watermark.
+        XCTAssertTrue(_diskCache.contentsSize >= 500000);
+    }
+    XCTAssertTrue(sliceCount > 1);
+    XCTAssertTrue(_diskCache.contentsSize < 500000);
+}
+
+- (void)testWriteDuringEvictionIsNotDiscarded {
+    _diskCache.capacity = 1000000;
+    _diskCache.highWatermark = 0.5f;
+    _diskCache.cleanupRate = 0.5f;
+    TDFDiskCacheObservedEvictionPolicy *policy = [TDFDiskCacheObservedEvictionPolicy new];
+    _diskCache.evictionPolicy = policy;
+    for (NSUInteger i = 0; i < 8; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    NSMutableData *data = [NSMutableData dataWithLength:100000];
+    memset(data.mutableBytes, 7, data.length);
+    DFDiskCache *diskCache = _diskCache;
+    NSString *filename = [_diskCache filenameForKey:@"_key_0"];
+    dispatch_semaphore_t written = dispatch_semaphore_create(0);
+    policy.evictionHandler = ^(DFDiskCacheEntry *entry) {
+        if ([entry.filename isEqualToString:filename]) {
+            // The key is written again after its entry is removed from the index and before its file is removed. Write can't update the index until eviction finishes, the sleep gives it time to replace the file.
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [diskCache setData:data forKey:@"_key_0"];
+                dispatch_semaphore_signal(written);
+            });
+            [NSThread sleepForTimeInterval:0.1];
+        }
+    };
+    [_diskCache cleanup];
+    XCTAssertEqual(dispatch_semaphore_wait(written, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC))), 0);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_0"], data);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[_diskCache pathForKey:@"_key_0"]]);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_1"]);
+}
+
+- (void)testContentsSizeIsUpdatedByWritesAndRemovals {
+    XCTAssertEqual(_diskCache.contentsSize, 0);
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_2"];
+    unsigned long long size = _diskCache.contentsSize;
+    XCTAssertTrue(size >= 200000);
+    
+    [_diskCache removeDataForKey:@"_key_1"];
+    XCTAssertTrue(_diskCache.contentsSize < size);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertTrue([_diskCache containsDataForKey:@"_key_2"]);
+    
+    [_diskCache removeAllData];
+    XCTAssertEqual(_diskCache.contentsSize, 0);
+}
+
+- (void)testIndexIsBuiltFromExistingContents {
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_2"];
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_2"]);
+}
+
+- (void)testIndexIsRestoredFromJournal {
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_2"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_3"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_2"]);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_3"]);
+}
+
+- (void)testIndexIsCheckedAgainstStorageContents {
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_2"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    // Modify storage contents bypassing disk cache.
+    [[NSFileManager defaultManager] removeItemAtPath:[_diskCache pathForKey:@"_key_1"] error:nil];
+    [[self _dataWithLength:100000] writeToFile:[_diskCache pathForKey:@"_key_3"] atomically:YES];
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertFalse([diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_2"]);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_3"]);
+}
+
+- (void)testIndexIsRebuiltWhenJournalIsCorrupted {
+    [_diskCache setData:[self _dataWithLength:100000] forKey:@"_key_1"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    for (NSString *filename in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_diskCache.path error:nil]) {
+        if ([filename hasPrefix:@"."]) {
+            [[@"garbage" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[_diskCache.path stringByAppendingPathComponent:filename] atomically:YES];
+        }
+    }
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+}
+
+- (void)testKeysOfMostFrequentlyAccessedEntries {
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_2"];
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_3"];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache dataForKey:@"_key_2"];
+    }
+    [_diskCache dataForKey:@"_key_3"];
+    NSArray *expectedKeys = @[ @"_key_2", @"_key_3", @"_key_1" ];
+    XCTAssertEqualObjects([_diskCache keysOfMostFrequentlyAccessedEntries:10], expectedKeys);
+    XCTAssertEqualObjects([_diskCache keysOfMostFrequentlyAccessedEntries:1], @[ @"_key_2" ]);
+    XCTAssertEqualObjects([_diskCache keysOfMostFrequentlyAccessedEntries:0], @[]);
+    
+    // Access counts are persisted in the journal.
+    [_diskCache cleanup];
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache keysOfMostFrequentlyAccessedEntries:10], expectedKeys);
+}
+
+- (void)testRotatedLogReplayedOnTopOfSnapshotDoesNotDoubleAccessCounts {
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_1"];
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_2"];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache dataForKey:@"_key_2"];
+    }
+    [_diskCache cleanup]; // Flushes journal
+    
+    // Files added bypassing disk cache force compaction when the next instance loads the index.
+    [[self _dataWithLength:1000] writeToFile:[_diskCache pathForKey:@"_key_3"] atomically:YES];
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    [diskCache dataForKey:@"_key_1"];
+    [diskCache dataForKey:@"_key_1"];
+    [diskCache cleanup]; // Flushes journal
+    NSData *log = [NSData dataWithContentsOfFile:[_diskCache.path stringByAppendingPathComponent:@".df_journal"]];
+    XCTAssertNotNil(log);
+    
+    // Snapshot now covers the log. Simulate termination before the rotated log was removed.
+    [[self _dataWithLength:1000] writeToFile:[_diskCache pathForKey:@"_key_4"] atomically:YES];
+    XCTAssertTrue([[DFDiskCache alloc] initWithPath:_diskCache.path error:nil].contentsSize > 0);
+    [log writeToFile:[_diskCache.path stringByAppendingPathComponent:@".df_journal_rotated"] atomically:YES];
+    
+    DFDiskCache *restoredDiskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([restoredDiskCache keysOfMostFrequentlyAccessedEntries:2], (@[ @"_key_2", @"_key_1" ]));
+}
+
+#pragma mark - Entry Files
+
+- (void)testEntryFileAttributesAreStoredWithData {
+    NSData *data = [self _dataWithLength:10000];
+    NSData *attribute = [@"value" dataUsingEncoding:NSUTF8StringEncoding];
+    [_diskCache setData:data attributes:@{ @"_attr_1" : attribute } forKey:@"_key_1"];
+    XCTAssertNil([[_diskCache URLForKey:@"_key_1"] df_extendedAttributeDataForKey:@"_attr_1" error:NULL options:0]);
+    
+    NSDictionary *attributes;
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1" attributes:&attributes], data);
+    XCTAssertEqualObjects(attributes, @{ @"_attr_1" : attribute });
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_1" key:@"_key_1"], attribute);
+    
+    [_diskCache setAttribute:attribute forName:@"_attr_2" key:@"_key_1"];
+    [_diskCache removeAttributeForName:@"_attr_1" key:@"_key_1"];
+    XCTAssertNil([_diskCache attributeForName:@"_attr_1" key:@"_key_1"]);
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_2" key:@"_key_1"], attribute);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+    
+    _diskCache.mappedReadThreshold = 1;
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+}
+
+- (void)testLegacyEntryFilesAreMigrated {
+    NSData *data = [self _dataWithLength:10000];
+    NSData *attribute = [@"value" dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *path = [_diskCache pathForKey:@"_key_1"];
+    [data writeToFile:path atomically:YES];
+    [[NSURL fileURLWithPath:path] df_setExtendedAttributeData:attribute forKey:@"_attr_1" options:0];
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache attributeForName:@"_attr_1" key:@"_key_1"], attribute);
+    NSDictionary *attributes;
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1" attributes:&attributes], data);
+    XCTAssertEqualObjects(attributes[@"_attr_1"], attribute);
+    
+    // File is rewritten with a header, attributes no longer live in extended file attributes.
+    XCTAssertNotEqualObjects([NSData dataWithContentsOfFile:path], data);
+    XCTAssertNil([[NSURL fileURLWithPath:path] df_extendedAttributeDataForKey:@"_attr_1" error:NULL options:0]);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqualObjects([diskCache attributeForName:@"_attr_1" key:@"_key_1"], attribute);
+}
+
+- (void)testCorruptedEntryFileIsRemoved {
+    NSData *data = [self _dataWithLength:10000];
+    [_diskCache setData:data forKey:@"_key_1"];
+    NSString *path = [_diskCache pathForKey:@"_key_1"];
+    NSMutableData *contents = [[NSData dataWithContentsOfFile:path] mutableCopy];
+    ((uint8_t *)contents.mutableBytes)[contents.length - 1] ^= 0xff;
+    [contents writeToFile:path atomically:YES];
+    
+    XCTAssertNil([_diskCache dataForKey:@"_key_1"]);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+}
+
+- (void)testEntryFilesWithDamagedHeaderAreRemoved {
+    NSData *data = [self _dataWithLength:10000];
+    NSString *path = [_diskCache pathForKey:@"_key_1"];
+    // Header checksum mismatch, truncated header and truncated data.
+    for (NSNumber *damage in @[ @0, @1, @2 ]) {
+        [_diskCache setData:data forKey:@"_key_1"];
+        NSMutableData *contents = [[NSData dataWithContentsOfFile:path] mutableCopy];
+        if (damage.integerValue == 0) {
+            ((uint8_t *)contents.mutableBytes)[8] ^= 0xff;
+        } else {
+            contents.length = damage.integerValue == 1 ? 16 : contents.length - 100;
+        }
+        [contents writeToFile:path atomically:YES];
+        
+        XCTAssertNil([_diskCache dataForKey:@"_key_1"]);
+        XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+    }
+    
+    // Ranged reads don't return damaged files either.
+    [_diskCache setData:data forKey:@"_key_1"];
+    NSMutableData *contents = [[NSData dataWithContentsOfFile:path] mutableCopy];
+    ((uint8_t *)contents.mutableBytes)[8] ^= 0xff;
+    [contents writeToFile:path atomically:YES];
+    XCTAssertNil([_diskCache dataForKey:@"_key_1" offset:0 length:100]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+}
+
+#pragma mark - Expiration
+
+- (void)testExpiredEntriesAreNotReturned {
+    NSData *data = [self _dataWithLength:1000];
+    [_diskCache setData:data attributes:nil expirationDate:[NSDate dateWithTimeIntervalSinceNow:0.1] forKey:@"_key_1"];
+    _diskCache.packedEntrySizeLimit = 4096;
+    [_diskCache setData:data attributes:nil expirationDate:[NSDate dateWithTimeIntervalSinceNow:0.1] forKey:@"_key_2"];
+    [_diskCache setData:data forKey:@"_key_3"];
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+    XCTAssertNotNil([_diskCache expirationDateForKey:@"_key_1"]);
+    XCTAssertNil([_diskCache expirationDateForKey:@"_key_3"]);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertNil([_diskCache dataForKey:@"_key_1"]);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_2"]);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_3"], data);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[_diskCache pathForKey:@"_key_1"]]);
+}
+
+- (void)testExpirationDateIsReadAlongWithData {
+    NSData *data = [self _dataWithLength:1000];
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:100];
+    [_diskCache setData:data attributes:@{ @"_attr_1" : data } expirationDate:expirationDate forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    NSDictionary *attributes;
+    NSDate *readExpirationDate;
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1" attributes:&attributes expirationDate:&readExpirationDate], data);
+    XCTAssertEqualObjects(attributes[@"_attr_1"], data);
+    XCTAssertEqualWithAccuracy([readExpirationDate timeIntervalSinceReferenceDate], [expirationDate timeIntervalSinceReferenceDate], 0.001);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_2" attributes:NULL expirationDate:&readExpirationDate], data);
+    XCTAssertNil(readExpirationDate);
+}
+
+- (void)testCleanupRemovesExpiredEntriesFirst {
+    _diskCache.capacity = 1000000;
+    _diskCache.highWatermark = 0.5f;
+    _diskCache.cleanupRate = 0.5f;
+    for (NSUInteger i = 0; i < 4; i++) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    // The most recently used entry expires, least recently used ones would have been evicted first otherwise.
+    [_diskCache setData:[self _dataWithLength:200000] attributes:nil expirationDate:[NSDate dateWithTimeIntervalSinceNow:0.1] forKey:@"_key_expiring"];
+    XCTAssertTrue(_diskCache.needsCleanup);
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    
+    [_diskCache cleanup];
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_expiring"]);
+    for (NSUInteger i = 0; i < 4; i++) {
+        XCTAssertTrue([_diskCache containsDataForKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]]);
+    }
+}
+
+- (void)testExpirationDatesArePersisted {
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:100];
+    [_diskCache setData:[self _dataWithLength:1000] attributes:nil expirationDate:expirationDate forKey:@"_key_1"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualWithAccuracy([[diskCache expirationDateForKey:@"_key_1"] timeIntervalSinceReferenceDate], [expirationDate timeIntervalSinceReferenceDate], 0.001);
+}
+
+- (void)testChangingAttributesPreservesExpirationDate {
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:100];
+    [_diskCache setData:[self _dataWithLength:1000] attributes:nil expirationDate:expirationDate forKey:@"_key_1"];
+    [_diskCache setAttribute:[@"value" dataUsingEncoding:NSUTF8StringEncoding] forName:@"_attr_1" key:@"_key_1"];
+    XCTAssertEqualWithAccuracy([[_diskCache expirationDateForKey:@"_key_1"] timeIntervalSinceReferenceDate], [expirationDate timeIntervalSinceReferenceDate], 0.001);
+    
+    // Writing data without expiration date resets it.
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_1"];
+    XCTAssertNil([_diskCache expirationDateForKey:@"_key_1"]);
+}
+
+#pragma mark - Segments
+
+- (void)testSmallEntriesArePacked {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:200];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_2"], data);
+    XCTAssertTrue([_diskCache containsDataForKey:@"_key_1"]);
+    XCTAssertEqual([_diskCache contentsWithResourceKeys:nil].count, 0);
+    XCTAssertTrue(_diskCache.contentsSize > 0);
+    
+    [_diskCache removeDataForKey:@"_key_1"];
+    XCTAssertNil([_diskCache dataForKey:@"_key_1"]);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_1"]);
+}
+
+- (void)testLargeEntriesAreStoredInFiles {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:10000];
+    [_diskCache setData:[self _dataWithLength:200] forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_1"];
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqual([_diskCache contentsWithResourceKeys:nil].count, 1);
+    
+    // Entry moves back to segments, standalone file is removed.
+    [_diskCache setData:[self _dataWithLength:200] forKey:@"_key_1"];
+    XCTAssertEqual([_diskCache dataForKey:@"_key_1"].length, 200);
+    XCTAssertEqual([_diskCache contentsWithResourceKeys:nil].count, 0);
+}
+
+- (void)testPackedEntryAttributes {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:200];
+    NSData *attribute = [@"value" dataUsingEncoding:NSUTF8StringEncoding];
+    [_diskCache setData:data attributes:@{ @"_attr_1" : attribute } forKey:@"_key_1"];
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_1" key:@"_key_1"], attribute);
+    
+    [_diskCache setAttribute:attribute forName:@"_attr_2" key:@"_key_1"];
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_1" key:@"_key_1"], attribute);
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_2" key:@"_key_1"], attribute);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1"], data);
+    
+    [_diskCache removeAttributeForName:@"_attr_1" key:@"_key_1"];
+    XCTAssertNil([_diskCache attributeForName:@"_attr_1" key:@"_key_1"]);
+    XCTAssertEqualObjects([_diskCache attributeForName:@"_attr_2" key:@"_key_1"], attribute);
+}
+
+- (void)testPackedEntriesAreRestoredFromJournal {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:200];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_2"], data);
+}
+
+- (void)testPackedEntriesAreRestoredFromSegmentsWhenJournalIsMissing {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:200];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    [_diskCache removeDataForKey:@"_key_2"];
+    [_diskCache cleanup];
+    [self _removeJournal];
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertFalse([diskCache containsDataForKey:@"_key_2"]);
+}
+
+- (void)testCompactionReclaimsDeadSpace {
+    _diskCache.packedEntrySizeLimit = 4096;
+    _diskCache.segmentSizeLimit = 4096;
+    _diskCache.capacity = DFDiskCacheCapacityUnlimited;
+    for (NSUInteger i = 0; i < 100; i++) {
+        [_diskCache setData:[self _dataWithLength:200] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    NSData *data = [self _dataWithLength:200];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [_diskCache setData:data forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    NSUInteger segmentCount = [self _segmentCount];
+    [_diskCache cleanup];
+    XCTAssertTrue([self _segmentCount] < segmentCount);
+    for (NSUInteger i = 0; i < 100; i++) {
+        XCTAssertEqualObjects([_diskCache dataForKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]], data);
+    }
+    
+    // Compacted locations are persisted.
+    [_diskCache cleanup];
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_0"], data);
+}
+
+- (NSUInteger)_segmentCount {
+    NSString *path = [_diskCache.path stringByAppendingPathComponent:@".df_segments"];
+    return [[NSFileManager defaultManager] contentsOfDirectoryAtPath:path error:nil].count;
+}
+
+- (void)testCompactionKeepsSegmentWhenRecordCantBeCopied {
+    _diskCache.packedEntrySizeLimit = 4096;
+    _diskCache.segmentSizeLimit = 4096;
+    _diskCache.capacity = DFDiskCacheCapacityUnlimited;
+    NSData *data = [self _dataWithLength:1000];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache setData:data forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    // The second segment is filled so that copying a record requires a new segment.
+    [_diskCache setData:data forKey:@"_key_3"];
+    [_diskCache setData:[self _dataWithLength:2000] forKey:@"_key_4"];
+    [_diskCache removeDataForKey:@"_key_0"];
+    [_diskCache removeDataForKey:@"_key_1"];
+    
+    // New segment can't be created, so the live record of the first segment can't be copied.
+    NSString *segmentsPath = [_diskCache.path stringByAppendingPathComponent:@".df_segments"];
+    NSFileManager *manager = [NSFileManager defaultManager];
+    XCTAssertTrue([manager setAttributes:@{ NSFilePosixPermissions : @0555 } ofItemAtPath:segmentsPath error:nil]);
+    [_diskCache cleanup];
+    [manager setAttributes:@{ NSFilePosixPermissions : @0755 } ofItemAtPath:segmentsPath error:nil];
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_2"], data);
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_2"], data);
+    XCTAssertFalse([diskCache containsDataForKey:@"_key_0"]);
+    
+    // Compaction succeeds once there is room for the copy.
+    [_diskCache cleanup];
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_2"], data);
+}
+
+#pragma mark - Key Hashing and Fanout
+
+- (void)testEntriesAreMovedToFanoutLayout {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:100000];
+    NSData *packedData = [self _dataWithLength:200];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:packedData forKey:@"_key_2"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    diskCache.packedEntrySizeLimit = 4096;
+    diskCache.keyHash = DFFileStorageKeyHashMurmur3;
+    diskCache.directoryFanout = 2;
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_2"], packedData);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[diskCache pathForKey:@"_key_1"]]);
+    XCTAssertEqual([diskCache contentsWithResourceKeys:nil].count, 1);
+    
+    // Migrated entries are persisted.
+    [diskCache cleanup];
+    DFDiskCache *reopenedDiskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    reopenedDiskCache.keyHash = DFFileStorageKeyHashMurmur3;
+    reopenedDiskCache.directoryFanout = 2;
+    XCTAssertEqualObjects([reopenedDiskCache dataForKey:@"_key_1"], data);
+    XCTAssertEqualObjects([reopenedDiskCache dataForKey:@"_key_2"], packedData);
+}
+
+- (void)testLegacyEntriesAreMigratedWhenJournalIsMissing {
+    NSData *data = [self _dataWithLength:100000];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    [_diskCache cleanup];
+    [self _removeJournal];
+    
+    // Keys are unknown, entries are migrated when accessed.
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    diskCache.keyHash = DFFileStorageKeyHashMurmur3;
+    diskCache.directoryFanout = 1;
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[diskCache pathForKey:@"_key_1"]]);
+    [diskCache removeDataForKey:@"_key_2"];
+    XCTAssertFalse([diskCache containsDataForKey:@"_key_2"]);
+    XCTAssertEqual([diskCache contentsWithResourceKeys:nil].count, 1);
+}
+
+#pragma mark - Streaming
+
+- (void)testStreamedEntriesAreStoredInFiles {
+    _diskCache.packedEntrySizeLimit = 4096;
+    [_diskCache setData:[self _dataWithLength:200] forKey:@"_key_1"];
+    unsigned long long contentsSize = _diskCache.contentsSize;
+    
+    NSData *data = [self _dataWithLength:100000];
+    DFFileStorageWriter *writer = [_diskCache writerForKey:@"_key_1" attributes:@{ @"attr" : [self _dataWithLength:10] } expirationDate:nil];
+    XCTAssertTrue([writer writeData:[data subdataWithRange:NSMakeRange(0, 50000)]]);
+    XCTAssertTrue([writer writeContentsOfStream:[NSInputStream inputStreamWithData:[data subdataWithRange:NSMakeRange(50000, 50000)]]]);
+    XCTAssertEqual([_diskCache dataForKey:@"_key_1"].length, 200);
+    XCTAssertTrue([writer close]);
+    
+    NSDictionary *attributes;
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1" attributes:&attributes], data);
+    XCTAssertEqual(attributes.count, 1);
+    XCTAssertEqual([_diskCache contentsWithResourceKeys:nil].count, 1);
+    XCTAssertTrue(_diskCache.contentsSize >= contentsSize + data.length);
+    
+    // Entry is restored after relaunch.
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+}
+
+- (void)testRangedReadsSkipEntryHeader {
+    _diskCache.packedEntrySizeLimit = 4096;
+    NSData *data = [self _dataWithLength:10000];
+    NSData *packedData = [self _dataWithLength:200];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:packedData forKey:@"_key_2"];
+    
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1" offset:0 length:100], [data subdataWithRange:NSMakeRange(0, 100)]);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_1" offset:9950 length:100], [data subdataWithRange:NSMakeRange(9950, 50)]);
+    XCTAssertEqualObjects([_diskCache dataForKey:@"_key_2" offset:10 length:20], [packedData subdataWithRange:NSMakeRange(10, 20)]);
+    XCTAssertEqualObjects([self _contentsOfStream:[_diskCache inputStreamForKey:@"_key_1"]], data);
+    XCTAssertEqualObjects([self _contentsOfStream:[_diskCache inputStreamForKey:@"_key_2"]], packedData);
+    XCTAssertNil([_diskCache inputStreamForKey:@"_key_3"]);
+}
+
+- (void)testStreamedEntriesExpire {
+    DFFileStorageWriter *writer = [_diskCache writerForKey:@"_key_1" attributes:nil expirationDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertTrue([writer writeData:[self _dataWithLength:10000]]);
+    XCTAssertTrue([writer close]);
+    XCTAssertNotNil([_diskCache expirationDateForKey:@"_key_1"]);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertNil([_diskCache dataForKey:@"_key_1" offset:0 length:100]);
+    XCTAssertNil([_diskCache inputStreamForKey:@"_key_1"]);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_1"]);
+}
+
+- (void)testStreamedEntriesAreRemovedByCleanup {
+    _diskCache.capacity = 150000;
+    _diskCache.cleanupRate = 0.5f;
+    for (NSUInteger i = 0; i < 3; i++) {
+        DFFileStorageWriter *writer = [_diskCache writerForKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i] attributes:nil expirationDate:nil];
+        XCTAssertTrue([writer writeData:[self _dataWithLength:100000]]);
+        XCTAssertTrue([writer close]);
+    }
+    XCTAssertTrue(_diskCache.contentsSize >= 300000);
+    [_diskCache cleanup];
+    XCTAssertTrue(_diskCache.contentsSize <= 75000);
+    XCTAssertFalse([_diskCache containsDataForKey:@"_key_0"]);
+}
+
+- (void)testStaleTemporaryFilesAreRemoved {
+    [_diskCache setData:[self _dataWithLength:10000] forKey:@"_key_1"];
+    NSString *path = [_diskCache pathForKey:@"_key_2"];
+    NSString *directoryPath = [path stringByDeletingLastPathComponent];
+    NSString *stalePath = [directoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@".%@.AbC123", [path lastPathComponent]]];
+    NSString *recentPath = [directoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@".%@.dEf456", [path lastPathComponent]]];
+    NSFileManager *manager = [NSFileManager defaultManager];
+    [manager createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+    XCTAssertTrue([[self _dataWithLength:1000] writeToFile:stalePath atomically:NO]);
+    XCTAssertTrue([[self _dataWithLength:1000] writeToFile:recentPath atomically:NO]);
+    XCTAssertTrue([manager setAttributes:@{ NSFileModificationDate : [NSDate dateWithTimeIntervalSinceNow:-7200] } ofItemAtPath:stalePath error:nil]);
+    
+    // Stale temporary files are removed after relaunch, recently modified ones and hidden files of the storage are kept.
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqual([diskCache dataForKey:@"_key_1"].length, 10000);
+    [diskCache cleanup];
+    XCTAssertFalse([manager fileExistsAtPath:stalePath]);
+    XCTAssertTrue([manager fileExistsAtPath:recentPath]);
+    diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    XCTAssertEqual([diskCache dataForKey:@"_key_1"].length, 10000);
+    [manager removeItemAtPath:recentPath error:nil];
+}
+
+#pragma mark - Shared Mode
+
+- (void)testSharedWritesAndRemovalsAreVisibleToOtherInstances {
+    NSString *path = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:@"_tests_shared_"];
+    DFDiskCache *diskCache1 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    DFDiskCache *diskCache2 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    XCTAssertTrue(diskCache1.isShared);
+    XCTAssertFalse(_diskCache.isShared);
+    
+    NSData *data = [self _dataWithLength:10000];
+    XCTAssertNil([diskCache2 dataForKey:@"_key_1"]);
+    [diskCache1 setData:data forKey:@"_key_1"];
+    XCTAssertEqualObjects([diskCache2 dataForKey:@"_key_1"], data);
+    XCTAssertEqual(diskCache1.contentsSize, diskCache2.contentsSize);
+    XCTAssertTrue(diskCache2.contentsSize > 0);
+    
+    [diskCache2 removeDataForKey:@"_key_1"];
+    XCTAssertFalse([diskCache1 containsDataForKey:@"_key_1"]);
+    XCTAssertEqual(diskCache1.contentsSize, 0);
+    
+    [diskCache1 setData:data forKey:@"_key_2"];
+    [diskCache2 removeAllData];
+    XCTAssertNil([diskCache1 dataForKey:@"_key_2"]);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testSharedIndexIsPopulatedFromExistingEntries {
+    NSData *data = [self _dataWithLength:10000];
+    [_diskCache setData:data forKey:@"_key_1"];
+    [_diskCache setData:data forKey:@"_key_2"];
+    [_diskCache cleanup]; // Flushes journal
+    
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path shared:YES error:nil];
+    XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+    XCTAssertTrue([diskCache containsDataForKey:@"_key_2"]);
+    XCTAssertEqual(diskCache.contentsSize, _diskCache.contentsSize);
+    [diskCache removeAllData];
+}
+
+- (void)testSharedEntriesAreNotPacked {
+    NSString *path = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:@"_tests_shared_"];
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    diskCache.packedEntrySizeLimit = 4096;
+    [diskCache setData:[self _dataWithLength:200] forKey:@"_key_1"];
+    XCTAssertEqual([diskCache contentsWithResourceKeys:nil].count, 1);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testSharedEntriesExpire {
+    NSString *path = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:@"_tests_shared_"];
+    DFDiskCache *diskCache1 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    DFDiskCache *diskCache2 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:0.1];
+    [diskCache1 setData:[self _dataWithLength:1000] attributes:nil expirationDate:expirationDate forKey:@"_key_1"];
+    XCTAssertEqualWithAccuracy([[diskCache2 expirationDateForKey:@"_key_1"] timeIntervalSinceReferenceDate], expirationDate.timeIntervalSinceReferenceDate, 0.001);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    DFDiskCacheCleanupStatistics statistics;
+    XCTAssertTrue([diskCache2 cleanupWithTimeBudget:DBL_MAX statistics:&statistics]);
+    XCTAssertEqual(statistics.expiredCount, 1);
+    XCTAssertFalse([diskCache1 containsDataForKey:@"_key_1"]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[diskCache1 pathForKey:@"_key_1"]]);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testSharedCleanupEvictsLeastRecentlyUsedEntries {
+    NSString *path = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:@"_tests_shared_"];
+    DFDiskCache *diskCache1 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    DFDiskCache *diskCache2 = [[DFDiskCache alloc] initWithPath:path shared:YES error:nil];
+    diskCache2.capacity = 1000000;
+    diskCache2.highWatermark = 0.5f;
+    diskCache2.cleanupRate = 0.25f;
+    for (NSUInteger i = 0; i < 6; i++) {
+        [diskCache1 setData:[self _dataWithLength:100000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    // Access by another instance counts as well.
+    XCTAssertNotNil([diskCache1 dataForKey:@"_key_0"]);
+    XCTAssertTrue(diskCache2.needsCleanup);
+    
+    [diskCache2 cleanup];
+    XCTAssertTrue(diskCache1.contentsSize <= 250000);
+    XCTAssertTrue([diskCache1 containsDataForKey:@"_key_0"]);
+    XCTAssertFalse([diskCache1 containsDataForKey:@"_key_1"]);
+    XCTAssertEqual(diskCache1.contentsSize, diskCache2.contentsSize);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - Durability
+
+- (void)testEntriesAreWrittenWithEachDurability {
+    NSData *data = [self _dataWithLength:100000];
+    NSData *packedData = [self _dataWithLength:200];
+    NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:3600];
+    for (NSNumber *durability in @[ @(DFDiskCacheDurabilityNone), @(DFDiskCacheDurabilityBatched), @(DFDiskCacheDurabilityPerWrite) ]) {
+        _diskCache.durability = [durability unsignedIntegerValue];
+        _diskCache.packedEntrySizeLimit = 4096;
+        [_diskCache setData:data attributes:nil expirationDate:expirationDate forKey:@"_key_1"];
+        [_diskCache setData:packedData forKey:@"_key_2"];
+        [_diskCache synchronize];
+        
+        DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+        XCTAssertEqualObjects([diskCache dataForKey:@"_key_1"], data);
+        XCTAssertEqualObjects([diskCache dataForKey:@"_key_2"], packedData);
+        XCTAssertEqualWithAccuracy([[diskCache expirationDateForKey:@"_key_1"] timeIntervalSinceReferenceDate], expirationDate.timeIntervalSinceReferenceDate, 0.001);
+        [_diskCache removeAllData];
+    }
+}
+
+- (void)testBatchedWritesAreCommittedWhenGroupIsFull {
+    _diskCache.durability = DFDiskCacheDurabilityBatched;
+    _diskCache.durabilityBatchSize = 4;
+    _diskCache.durabilityBatchInterval = 60.0;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache setData:[self _dataWithLength:1000] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    XCTAssertEqual([[_diskCache valueForKey:@"_unsynchronizedWriteCount"] unsignedIntegerValue], 3);
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_3"];
+    XCTAssertEqual([[_diskCache valueForKey:@"_unsynchronizedWriteCount"] unsignedIntegerValue], 0);
+}
+
+- (void)testBatchedWritesAreCommittedAfterInterval {
+    _diskCache.durability = DFDiskCacheDurabilityBatched;
+    _diskCache.durabilityBatchInterval = 0.1;
+    [_diskCache setData:[self _dataWithLength:1000] forKey:@"_key_1"];
+    XCTAssertEqual([[_diskCache valueForKey:@"_unsynchronizedWriteCount"] unsignedIntegerValue], 1);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"commit"];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.5 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        XCTAssertEqual([[_diskCache valueForKey:@"_unsynchronizedWriteCount"] unsignedIntegerValue], 0);
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+}
+
+/*! Reports write latency for each durability. Batched durability is expected to be close to no durability, per-write durability is bound by the drive flush latency.
+ */
+- (void)testPerformanceWritesWithDurability {
+    _diskCache.capacity = DFDiskCacheCapacityUnlimited;
+    NSData *data = [self _dataWithLength:8000];
+    NSUInteger count = 200;
+    for (NSNumber *durability in @[ @(DFDiskCacheDurabilityNone), @(DFDiskCacheDurabilityBatched), @(DFDiskCacheDurabilityPerWrite) ]) {
+        _diskCache.durability = [durability unsignedIntegerValue];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < count; i++) {
+            [_diskCache setData:data forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+        }
+        [_diskCache synchronize];
+        NSLog(@"durability %@: %.3f ms per write", durability, (CFAbsoluteTimeGetCurrent() - start) * 1000.0 / count);
+        [_diskCache removeAllData];
+    }
+}
+
+#pragma mark - Performance
+
+/*! Compares startup time of the index loaded from the journal against the full storage directory scan. Number of entries can be changed using DF_BENCHMARK_ENTRY_COUNT environment variable (e.g. 10000, 100000, 1000000).
+ */
+- (void)testPerformanceIndexLoadingFromJournal {
+    [self _populateDiskCacheForBenchmark];
+    [self measureBlock:^{
+        DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+        XCTAssertTrue(diskCache.contentsSize > 0);
+    }];
+}
+
+- (void)testPerformanceIndexLoadingFromDirectoryScan {
+    [self _populateDiskCacheForBenchmark];
+    [self measureBlock:^{
+        [self _removeJournal];
+        DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+        XCTAssertTrue(diskCache.contentsSize > 0);
+    }];
+}
+
+/*! Compares small entries (200 bytes to 4 Kb) writes and reads for packed entries and standalone files.
+ */
+- (void)testPerformanceSmallEntriesPacked {
+    _diskCache.packedEntrySizeLimit = 4096;
+    [self _measureSmallEntries];
+}
+
+- (void)testPerformanceSmallEntriesInFiles {
+    [self _measureSmallEntries];
+}
+
+- (void)_measureSmallEntries {
+    _diskCache.capacity = DFDiskCacheCapacityUnlimited;
+    NSMutableArray *values = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [values addObject:[self _dataWithLength:200 + (i * 37) % 3896]];
+    }
+    [self measureBlock:^{
+        [values enumerateObjectsUsingBlock:^(NSData *data, NSUInteger i, BOOL *stop) {
+            [_diskCache setData:data forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+        }];
+        for (NSUInteger i = 0; i < values.count; i++) {
+            [_diskCache dataForKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+        }
+    }];
+}
+
+- (void)_populateDiskCacheForBenchmark {
+    NSUInteger count = [[[NSProcessInfo processInfo] environment][@"DF_BENCHMARK_ENTRY_COUNT"] integerValue] ?: 10000;
+    NSData *data = [self _dataWithLength:64];
+    _diskCache.capacity = DFDiskCacheCapacityUnlimited;
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            [_diskCache setData:data forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+        }
+    }
+    [_diskCache cleanup]; // Flushes and compacts journal
+}
+
+- (void)_removeJournal {
+    for (NSString *filename in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_diskCache.path error:nil]) {
+        if ([filename hasPrefix:@".df_journal"]) {
+            [[NSFileManager defaultManager] removeItemAtPath:[_diskCache.path stringByAppendingPathComponent:filename] error:nil];
+        }
+    }
+}
+
 #pragma mark - Helpers 
 
+- (NSData *)_contentsOfStream:(NSInputStream *)stream {
+    NSMutableData *contents = [NSMutableData new];
+    uint8_t buffer[1024];
+    [stream open];
+    NSInteger length;
+    while ((length = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        [contents appendBytes:buffer length:(NSUInteger)length];
+    }
+    [stream close];
+    return length < 0 ? nil : contents;
+}
+
 - (NSData *)_dataWithLength:(unsigned long long)length {
     void *raw = malloc(length);
     return [NSData dataWithBytes:raw length:length];
@@ -0,0 +1,294 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFDiskCache.h"
+#import "DFDiskCacheEvictionPolicy.h"
+#import <XCTest/XCTest.h>
+
+/*! Minimal model of the disk cache index used to drive eviction policies directly.
+ */
+@interface TDFEvictionSimulator : NSObject
+
+- (instancetype)initWithPolicy:(id<DFDiskCacheEvictionPolicy>)policy capacity:(unsigned long long)capacity;
+
+@property (nonatomic, readonly) id<DFDiskCacheEvictionPolicy> policy;
+@property (nonatomic, readonly) NSUInteger hitCount;
+@property (nonatomic, readonly) NSUInteger missCount;
+@property (nonatomic, readonly) unsigned long long bytesWritten;
+
+/*! Reads the entry with a given key, on miss writes the entry and evicts entries until the total size fits into capacity.
+ @return YES if the entry was in the cache.
+ */
+- (BOOL)accessKey:(NSString *)key size:(unsigned long long)size;
+
+- (BOOL)containsKey:(NSString *)key;
+
+@end
+
+@implementation TDFEvictionSimulator {
+    NSMutableDictionary *_entries;
+    unsigned long long _capacity;
+    unsigned long long _totalSize;
+}
+
+- (instancetype)initWithPolicy:(id<DFDiskCacheEvictionPolicy>)policy capacity:(unsigned long long)capacity {
+    if (self = [super init]) {
+        _policy = policy;
+        _capacity = capacity;
+        _entries = [NSMutableDictionary new];
+        if ([policy respondsToSelector:@selector(setCapacity:)]) {
+            policy.capacity = capacity;
+        }
+    }
+    return self;
+}
+
+- (BOOL)accessKey:(NSString *)key size:(unsigned long long)size {
+    DFDiskCacheEntry *entry = _entries[key];
+    if (entry) {
+        entry.accessCount++;
+        [_policy didAccessEntry:entry];
+        _hitCount++;
+        return YES;
+    }
+    _missCount++;
+    entry = [[DFDiskCacheEntry alloc] initWithFilename:key];
+    entry.key = key;
+    entry.size = size;
+    _entries[key] = entry;
+    _totalSize += size;
+    _bytesWritten += size;
+    [_policy didAddEntry:entry];
+    DFDiskCacheEntry *victim;
+    while (_totalSize > _capacity && (victim = [_policy nextVictim])) {
+        _totalSize -= victim.size;
+        [_policy didEvictEntry:victim];
+        [_entries removeObjectForKey:victim.filename];
+    }
+    return NO;
+}
+
+- (BOOL)containsKey:(NSString *)key {
+    return _entries[key] != nil;
+}
+
+@end
+
+
+@interface TDFDiskCacheEvictionPolicy : XCTestCase
+
+@end
+
+@implementation TDFDiskCacheEvictionPolicy {
+    DFDiskCache *_diskCache;
+}
+
+- (void)setUp {
+    NSString *path = [[DFDiskCache cachesDirectoryPath] stringByAppendingPathComponent:@"_tests_"];
+    _diskCache = [[DFDiskCache alloc] initWithPath:path error:nil];
+}
+
+- (void)tearDown {
+    [_diskCache removeAllData];
+}
+
+#pragma mark - Policies
+
+- (void)testLRUEvictsLeastRecentlyUsedEntry {
+    TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:[DFDiskCacheEvictionPolicyLRU new] capacity:300];
+    [simulator accessKey:@"a" size:100];
+    [simulator accessKey:@"b" size:100];
+    [simulator accessKey:@"c" size:100];
+    [simulator accessKey:@"a" size:100];
+    [simulator accessKey:@"d" size:100];
+    XCTAssertTrue([simulator containsKey:@"a"]);
+    XCTAssertFalse([simulator containsKey:@"b"]);
+    XCTAssertTrue([simulator containsKey:@"c"]);
+    XCTAssertTrue([simulator containsKey:@"d"]);
+}
+
+- (void)testLFUEvictsLeastFrequentlyUsedEntry {
+    TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:[DFDiskCacheEvictionPolicyLFU new] capacity:300];
+    [simulator accessKey:@"a" size:100];
+    [simulator accessKey:@"b" size:100];
+    [simulator accessKey:@"c" size:100];
+    [simulator accessKey:@"a" size:100];
+    [simulator accessKey:@"c" size:100];
+    [simulator accessKey:@"b" size:100];
+    [simulator accessKey:@"a" size:100];
+    XCTAssertEqualObjects([simulator.policy nextVictim].filename, @"c");
+}
+
+- (void)testGDSFEvictsLargeEntriesFirst {
+    TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:[DFDiskCacheEvictionPolicyGDSF new] capacity:1000];
+    [simulator accessKey:@"small_1" size:100];
+    [simulator accessKey:@"large" size:600];
+    [simulator accessKey:@"small_2" size:100];
+    [simulator accessKey:@"small_3" size:300];
+    XCTAssertTrue([simulator containsKey:@"small_1"]);
+    XCTAssertFalse([simulator containsKey:@"large"]);
+    XCTAssertTrue([simulator containsKey:@"small_2"]);
+    XCTAssertTrue([simulator containsKey:@"small_3"]);
+}
+
+- (void)testWTinyLFUIsScanResistant {
+    [self _testPolicyIsScanResistant:[DFDiskCacheEvictionPolicyWTinyLFU new]];
+}
+
+- (void)testARCIsScanResistant {
+    [self _testPolicyIsScanResistant:[DFDiskCacheEvictionPolicyARC new]];
+}
+
+- (void)_testPolicyIsScanResistant:(id<DFDiskCacheEvictionPolicy>)policy {
+    TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:policy capacity:100 * 100];
+    for (NSUInteger round = 0; round < 4; round++) {
+        for (NSUInteger i = 0; i < 50; i++) {
+            [simulator accessKey:[NSString stringWithFormat:@"hot_%lu", (unsigned long)i] size:100];
+        }
+    }
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [simulator accessKey:[NSString stringWithFormat:@"scan_%lu", (unsigned long)i] size:100];
+    }
+    NSUInteger remaining = 0;
+    for (NSUInteger i = 0; i < 50; i++) {
+        remaining += [simulator containsKey:[NSString stringWithFormat:@"hot_%lu", (unsigned long)i]];
+    }
+    XCTAssertTrue(remaining >= 40, @"%@ kept %lu of 50 hot entries", [policy class], (unsigned long)remaining);
+}
+
+- (void)testPoliciesEvictAllEntries {
+    for (id<DFDiskCacheEvictionPolicy> policy in [self _allPolicies]) {
+        TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:policy capacity:0];
+        for (NSUInteger i = 0; i < 100; i++) {
+            [simulator accessKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i] size:i + 1];
+        }
+        XCTAssertNil([policy nextVictim], @"%@", [policy class]);
+    }
+}
+
+#pragma mark - Disk Cache
+
+- (void)testDiskCacheUsesEvictionPolicy {
+    _diskCache.evictionPolicy = [DFDiskCacheEvictionPolicyLFU new];
+    _diskCache.capacity = 250000;
+    _diskCache.cleanupRate = 1.f;
+    NSArray *keys = @[ @"_key_1", @"_key_2", @"_key_3", @"_key_4" ];
+    for (NSString *key in keys) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:key];
+    }
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache dataForKey:keys[0]];
+    }
+    [_diskCache dataForKey:keys[3]];
+    [_diskCache cleanup];
+    XCTAssertTrue([_diskCache containsDataForKey:keys[0]]);
+    XCTAssertFalse([_diskCache containsDataForKey:keys[1]]);
+    XCTAssertFalse([_diskCache containsDataForKey:keys[2]]);
+    XCTAssertTrue([_diskCache containsDataForKey:keys[3]]);
+}
+
+- (void)testAccessCountsArePersisted {
+    _diskCache.cleanupRate = 1.f;
+    NSArray *keys = @[ @"_key_1", @"_key_2", @"_key_3", @"_key_4" ];
+    for (NSString *key in keys) {
+        [_diskCache setData:[self _dataWithLength:100000] forKey:key];
+    }
+    for (NSUInteger i = 0; i < 3; i++) {
+        [_diskCache dataForKey:keys[0]];
+    }
+    // The first entry is now the least recently used one, but the most frequently used one.
+    for (NSUInteger i = 1; i < keys.count; i++) {
+        [_diskCache dataForKey:keys[i]];
+    }
+    [_diskCache cleanup]; // Flushes journal
+
+    DFDiskCache *diskCache = [[DFDiskCache alloc] initWithPath:_diskCache.path error:nil];
+    diskCache.evictionPolicy = [DFDiskCacheEvictionPolicyLFU new];
+    diskCache.capacity = 250000;
+    diskCache.cleanupRate = 1.f;
+    [diskCache cleanup];
+    XCTAssertTrue([diskCache containsDataForKey:keys[0]]);
+    XCTAssertFalse([diskCache containsDataForKey:keys[1]]);
+    XCTAssertFalse([diskCache containsDataForKey:keys[2]]);
+}
+
+#pragma mark - Trace Replay
+
+/*! Replays an access trace against each policy with the same capacity and logs hit ratio and bytes written (each miss is a write).
+ @discussion Trace is read from the file at DF_TRACE_PATH environment variable, each line has a key and a size in bytes separated by whitespace. When the variable is not set a synthetic trace is used: Zipfian popularity (s = 0.9) over 10000 keys with sizes from 1 Kb to 256 Kb, interleaved with scans of keys that are accessed only once.
+ */
+- (void)testTraceReplay {
+    NSArray *trace = [self _trace];
+    unsigned long long capacity = 64 * 1024 * 1024;
+    for (id<DFDiskCacheEvictionPolicy> policy in [self _allPolicies]) {
+        TDFEvictionSimulator *simulator = [[TDFEvictionSimulator alloc] initWithPolicy:policy capacity:capacity];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSArray *access in trace) {
+            [simulator accessKey:access[0] size:[access[1] unsignedLongLongValue]];
+        }
+        double hitRatio = (double)simulator.hitCount / MAX(simulator.hitCount + simulator.missCount, 1);
+        NSLog(@"%@: hit ratio %.4f, bytes written %llu, %lu accesses in %.3f s", [policy class], hitRatio, simulator.bytesWritten, (unsigned long)trace.count, CFAbsoluteTimeGetCurrent() - start);
+        XCTAssertTrue(simulator.hitCount + simulator.missCount == trace.count);
+    }
+}
+
+- (NSArray *)_trace {
+    NSString *path = [[NSProcessInfo processInfo] environment][@"DF_TRACE_PATH"];
+    if (path) {
+        NSString *contents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
+        NSMutableArray *trace = [NSMutableArray new];
+        for (NSString *line in [contents componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+            NSArray *components = [line componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+            if (components.count >= 2) {
+                [trace addObject:@[ components[0], @(strtoull([components[1] UTF8String], NULL, 10)) ]];
+            }
+        }
+        return trace;
+    }
+    NSUInteger keyCount = 10000;
+    double *cdf = malloc(sizeof(double) * keyCount);
+    double sum = 0.0;
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        sum += 1.0 / pow(i + 1, 0.9);
+        cdf[i] = sum;
+    }
+    srand48(42);
+    NSMutableArray *trace = [NSMutableArray new];
+    NSUInteger scanIndex = 0;
+    for (NSUInteger i = 0; i < 200000; i++) {
+        if (i % 20000 == 19999) {
+            for (NSUInteger j = 0; j < 2000; j++, scanIndex++) {
+                [trace addObject:@[ [NSString stringWithFormat:@"scan_%lu", (unsigned long)scanIndex], @(32 * 1024) ]];
+            }
+        }
+        double value = drand48() * sum;
+        NSUInteger low = 0, high = keyCount - 1;
+        while (low < high) {
+            NSUInteger middle = (low + high) / 2;
+            if (cdf[middle] < value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        unsigned long long size = 1024ull << ((low * 2654435761u) % 9); // 1 Kb to 256 Kb
+        [trace addObject:@[ [NSString stringWithFormat:@"key_%lu", (unsigned long)low], @(size) ]];
+    }
+    free(cdf);
+    return trace;
+}
+
+#pragma mark - Helpers
+
+- (NSArray *)_allPolicies {
+    return @[ [DFDiskCacheEvictionPolicyLRU new], [DFDiskCacheEvictionPolicyLFU new], [DFDiskCacheEvictionPolicyGDSF new], [DFDiskCacheEvictionPolicyWTinyLFU new], [DFDiskCacheEvictionPolicyARC new] ];
+}
+
+- (NSData *)_dataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    return data;
+}
+
+@end
@@ -5,6 +5,7 @@
 #import "DFFileStorage.h"
 #import "DFDiskCache.h"
 #import <XCTest/XCTest.h>
+#import <mach/mach.h>
 
 @interface TDFFileStorage : XCTestCase
 
@@ -111,6 +112,233 @@
     }
 }
 
+#pragma mark - Key Hashing and Fanout
+
+- (void)testMurmur3Filenames {
+    _storage.keyHash = DFFileStorageKeyHashMurmur3;
+    XCTAssertEqualObjects([_storage filenameForKey:@"key"], @"bc3e1d01f387f8a0cda32c153b5de0bc");
+    XCTAssertEqualObjects([_storage filenameForKey:@"http://example.com/image.jpg"], @"489b73fd35ace7ecbf583da56d183bd1");
+    XCTAssertEqual([_storage filenameForKey:@"_key"].length, 32);
+}
+
+- (void)testDirectoryFanout {
+    NSData *data = [self _tempData];
+    _storage.keyHash = DFFileStorageKeyHashMurmur3;
+    _storage.directoryFanout = 2;
+    NSString *expectedPath = [_storage.path stringByAppendingPathComponent:@"bc/3e/bc3e1d01f387f8a0cda32c153b5de0bc"];
+    XCTAssertEqualObjects([_storage pathForKey:@"key"], expectedPath);
+    
+    [_storage setData:data forKey:@"key"];
+    [_storage setData:data forKey:@"_key"];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:expectedPath]);
+    XCTAssertEqualObjects([_storage dataForKey:@"key"], data);
+    XCTAssertTrue([_storage containsDataForKey:@"_key"]);
+    XCTAssertEqual([_storage contentsWithResourceKeys:nil].count, 2);
+    XCTAssertTrue(_storage.contentsSize > 0);
+    
+    [_storage removeDataForKey:@"key"];
+    XCTAssertNil([_storage dataForKey:@"key"]);
+    XCTAssertEqual([_storage contentsWithResourceKeys:nil].count, 1);
+}
+
+- (void)testLegacyFilesAreReadableAfterLayoutChange {
+    NSData *data = [self _tempData];
+    [_storage setData:data forKey:@"_key_1"];
+    [_storage setData:data forKey:@"_key_2"];
+    [_storage setData:data forKey:@"_key_3"];
+    NSString *legacyPath = [_storage pathForKey:@"_key_1"];
+    
+    DFFileStorage *storage = [[DFFileStorage alloc] initWithPath:_storage.path error:nil];
+    storage.keyHash = DFFileStorageKeyHashMurmur3;
+    storage.directoryFanout = 1;
+    XCTAssertEqualObjects([storage dataForKey:@"_key_1"], data);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPath]);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[storage pathForKey:@"_key_1"]]);
+    XCTAssertTrue([storage containsDataForKey:@"_key_2"]);
+    
+    [storage removeDataForKey:@"_key_3"];
+    XCTAssertNil([storage dataForKey:@"_key_3"]);
+    XCTAssertEqual([storage contentsWithResourceKeys:nil].count, 2);
+}
+
+/*! Reports time per key for file name hashing and path construction with SHA-1 and MurmurHash3.
+ */
+- (void)testPerformanceKeyHashing {
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 100000; i++) {
+        [keys addObject:[NSString stringWithFormat:@"http://example.com/images/%lu.jpg", (unsigned long)i]];
+    }
+    for (NSNumber *keyHash in @[ @(DFFileStorageKeyHashSHA1), @(DFFileStorageKeyHashMurmur3) ]) {
+        _storage.keyHash = [keyHash unsignedIntegerValue];
+        for (NSUInteger fanout = 0; fanout <= DFFileStorageMaximumDirectoryFanout; fanout++) {
+            _storage.directoryFanout = fanout;
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            for (NSString *key in keys) {
+                @autoreleasepool {
+                    [_storage filenameForKey:key];
+                }
+            }
+            CFAbsoluteTime hashDuration = CFAbsoluteTimeGetCurrent() - start;
+            start = CFAbsoluteTimeGetCurrent();
+            for (NSString *key in keys) {
+                @autoreleasepool {
+                    [_storage pathForKey:key];
+                }
+            }
+            CFAbsoluteTime pathDuration = CFAbsoluteTimeGetCurrent() - start;
+            NSLog(@"hash %@, fanout %lu: filename %.0f ns/op, path %.0f ns/op", keyHash, (unsigned long)fanout, hashDuration * 1e9 / keys.count, pathDuration * 1e9 / keys.count);
+        }
+    }
+}
+
+#pragma mark - Mapped Reads
+
+- (void)testMappedReads {
+    NSData *data = [self _tempData];
+    NSString *key = @"_key";
+    _storage.mappedReadThreshold = 1000;
+    [_storage setData:data forKey:key];
+    NSData *mappedData = [_storage dataForKey:key];
+    XCTAssertEqualObjects(mappedData, data);
+    
+    // Mapped data remains valid after the file is replaced or removed.
+    [_storage setData:[self _tempData] forKey:key];
+    [_storage removeDataForKey:key];
+    XCTAssertEqualObjects(mappedData, data);
+    XCTAssertNil([_storage dataForKey:key]);
+}
+
+/*! Compares latency and peak resident size for reads of large (8 Mb) entries which are decoded by reading only a part of the data (e.g. image header, archive index).
+ */
+- (void)testPerformanceLargeEntryReadsMapped {
+    _storage.mappedReadThreshold = 64 * 1024;
+    [self _measureLargeEntryReads];
+}
+
+- (void)testPerformanceLargeEntryReadsCopied {
+    [self _measureLargeEntryReads];
+}
+
+- (void)_measureLargeEntryReads {
+    NSUInteger count = 10;
+    size_t length = 8 * 1024 * 1024;
+    for (NSUInteger i = 0; i < count; i++) {
+        void *bytes = calloc(1, length);
+        [_storage setData:[NSData dataWithBytesNoCopy:bytes length:length] forKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+    }
+    mach_vm_size_t __block peakResidentSize = 0;
+    mach_vm_size_t initialResidentSize = [self _residentSize];
+    [self measureBlock:^{
+        NSMutableArray *values = [NSMutableArray new];
+        for (NSUInteger i = 0; i < count; i++) {
+            NSData *data = [_storage dataForKey:[NSString stringWithFormat:@"_key_%lu", (unsigned long)i]];
+            XCTAssertEqual(data.length, length);
+            XCTAssertEqual(((const uint8_t *)data.bytes)[0], 0);
+            [values addObject:data];
+        }
+        peakResidentSize = MAX(peakResidentSize, [self _residentSize]);
+    }];
+    NSLog(@"Peak resident size growth: %@", [NSByteCountFormatter stringFromByteCount:(long long)(peakResidentSize - MIN(peakResidentSize, initialResidentSize)) countStyle:NSByteCountFormatterCountStyleBinary]);
+}
+
+- (mach_vm_size_t)_residentSize {
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+}
+
+#pragma mark - Streaming
+
+- (void)testWriterReplacesEntryOnClose {
+    NSString *key = @"_key";
+    NSData *previousData = [self _tempData];
+    [_storage setData:previousData forKey:key];
+    
+    NSData *data = [self _tempData];
+    DFFileStorageWriter *writer = [_storage writerForKey:key attributes:@{ @"attr" : [@"value" dataUsingEncoding:NSUTF8StringEncoding] }];
+    XCTAssertNotNil(writer);
+    XCTAssertTrue([writer writeData:[data subdataWithRange:NSMakeRange(0, 4000)]]);
+    XCTAssertTrue([writer writeData:[data subdataWithRange:NSMakeRange(4000, data.length - 4000)]]);
+    XCTAssertEqual(writer.length, data.length);
+    
+    // Entry is replaced only when the writer is closed.
+    XCTAssertEqualObjects([_storage dataForKey:key], previousData);
+    XCTAssertTrue([writer close]);
+    XCTAssertEqualObjects([_storage dataForKey:key], data);
+    XCTAssertEqualObjects([_storage attributeForName:@"attr" key:key], [@"value" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertFalse([writer writeData:data]);
+    XCTAssertEqual([_storage contentsWithResourceKeys:nil].count, 1);
+}
+
+- (void)testCancelledWriterLeavesEntryIntact {
+    NSString *key = @"_key";
+    NSData *data = [self _tempData];
+    [_storage setData:data forKey:key];
+    
+    DFFileStorageWriter *writer = [_storage writerForKey:key attributes:nil];
+    XCTAssertTrue([writer writeData:[self _tempData]]);
+    [writer cancel];
+    XCTAssertFalse([writer close]);
+    XCTAssertEqualObjects([_storage dataForKey:key], data);
+    
+    // Temporary files are removed.
+    NSString *directoryPath = [[_storage pathForKey:key] stringByDeletingLastPathComponent];
+    NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directoryPath error:nil];
+    XCTAssertEqual(contents.count, 1);
+}
+
+- (void)testWriterWritesContentsOfStream {
+    NSString *key = @"_key";
+    NSMutableData *data = [NSMutableData new];
+    for (NSUInteger i = 0; i < 50; i++) {
+        [data appendData:[self _tempData]];
+    }
+    DFFileStorageWriter *writer = [_storage writerForKey:key attributes:nil];
+    XCTAssertTrue([writer writeContentsOfStream:[NSInputStream inputStreamWithData:data]]);
+    XCTAssertTrue([writer close]);
+    XCTAssertEqualObjects([_storage dataForKey:key], data);
+}
+
+- (void)testRangedReads {
+    NSString *key = @"_key";
+    NSData *data = [self _tempData];
+    [_storage setData:data forKey:key];
+    
+    XCTAssertEqualObjects([_storage dataForKey:key offset:100 length:200], [data subdataWithRange:NSMakeRange(100, 200)]);
+    XCTAssertEqualObjects([_storage dataForKey:key offset:data.length - 10 length:100], [data subdataWithRange:NSMakeRange(data.length - 10, 10)]);
+    XCTAssertEqual([_storage dataForKey:key offset:data.length + 10 length:100].length, 0);
+    XCTAssertNil([_storage dataForKey:@"_missing_key" offset:0 length:100]);
+}
+
+- (void)testInputStream {
+    NSString *key = @"_key";
+    NSData *data = [self _tempData];
+    [_storage setData:data forKey:key];
+    
+    NSInputStream *stream = [_storage inputStreamForKey:key];
+    XCTAssertNotNil(stream);
+    
+    // Stream reads the entry as it was when the stream was created.
+    [_storage removeDataForKey:key];
+    XCTAssertEqualObjects([self _contentsOfStream:stream], data);
+    XCTAssertNil([_storage inputStreamForKey:key]);
+}
+
+- (NSData *)_contentsOfStream:(NSInputStream *)stream {
+    NSMutableData *contents = [NSMutableData new];
+    uint8_t buffer[1024];
+    [stream open];
+    NSInteger length;
+    while ((length = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        [contents appendBytes:buffer length:(NSUInteger)length];
+    }
+    [stream close];
+    return length < 0 ? nil : contents;
+}
+
 #pragma mark - Helpers
 
 - (NSData *)_tempData {
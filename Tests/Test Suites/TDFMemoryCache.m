@@ -0,0 +1,207 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFMemoryCache.h"
+#import <XCTest/XCTest.h>
+
+@interface TDFMemoryCache : XCTestCase <NSCacheDelegate>
+
+@end
+
+@implementation TDFMemoryCache {
+    DFMemoryCache *_cache;
+    NSMutableArray *_delegateEvictedObjects;
+}
+
+- (void)setUp {
+    [super setUp];
+    _cache = [DFMemoryCache new];
+    _delegateEvictedObjects = [NSMutableArray new];
+}
+
+- (void)cache:(NSCache *)cache willEvictObject:(id)obj {
+    [_delegateEvictedObjects addObject:obj];
+}
+
+- (void)testWriteAndRead {
+    [_cache setObject:@"value" forKey:@"key"];
+    XCTAssertEqualObjects([_cache objectForKey:@"key"], @"value");
+    XCTAssertEqual(_cache.count, 1);
+    [_cache removeObjectForKey:@"key"];
+    XCTAssertNil([_cache objectForKey:@"key"]);
+    XCTAssertEqual(_cache.count, 0);
+}
+
+- (void)testCountLimitEvictsLeastRecentlyUsedObject {
+    _cache.countLimit = 3;
+    [_cache setObject:@"1" forKey:@"key_1"];
+    [_cache setObject:@"2" forKey:@"key_2"];
+    [_cache setObject:@"3" forKey:@"key_3"];
+    [_cache objectForKey:@"key_1"];
+    [_cache setObject:@"4" forKey:@"key_4"];
+    XCTAssertEqual(_cache.count, 3);
+    XCTAssertNotNil([_cache objectForKey:@"key_1"]);
+    XCTAssertNil([_cache objectForKey:@"key_2"]);
+    XCTAssertNotNil([_cache objectForKey:@"key_3"]);
+    XCTAssertNotNil([_cache objectForKey:@"key_4"]);
+}
+
+- (void)testContainsObjectDoesntUpdateRecency {
+    _cache.countLimit = 3;
+    [_cache setObject:@"1" forKey:@"key_1"];
+    [_cache setObject:@"2" forKey:@"key_2"];
+    [_cache setObject:@"3" forKey:@"key_3"];
+    XCTAssertTrue([_cache containsObjectForKey:@"key_1"]);
+    [_cache setObject:@"4" forKey:@"key_4"];
+    XCTAssertFalse([_cache containsObjectForKey:@"key_1"]);
+    XCTAssertTrue([_cache containsObjectForKey:@"key_2"]);
+}
+
+- (void)testTotalCostLimitIsStrict {
+    _cache.totalCostLimit = 1000;
+    for (NSUInteger i = 0; i < 100; i++) {
+        [_cache setObject:@(i) forKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i] cost:150];
+        XCTAssertTrue(_cache.totalCost <= 1000);
+    }
+    XCTAssertEqual(_cache.count, 6);
+    XCTAssertNotNil([_cache objectForKey:@"key_99"]);
+
+    [_cache setObject:@"value" forKey:@"key_99" cost:50];
+    XCTAssertEqual(_cache.totalCost, 800);
+
+    _cache.totalCostLimit = 300;
+    XCTAssertTrue(_cache.totalCost <= 300);
+    XCTAssertNotNil([_cache objectForKey:@"key_99"]);
+}
+
+- (void)testSegmentedCacheProtectsFrequentlyUsedObjects {
+    DFMemoryCache *cache = [[DFMemoryCache alloc] initWithStripeCount:1];
+    cache.segmented = YES;
+    cache.countLimit = 10;
+    for (NSUInteger i = 0; i < 5; i++) {
+        NSString *key = [NSString stringWithFormat:@"hot_%lu", (unsigned long)i];
+        [cache setObject:@(i) forKey:key];
+        [cache objectForKey:key];
+    }
+    for (NSUInteger i = 0; i < 100; i++) {
+        [cache setObject:@(i) forKey:[NSString stringWithFormat:@"scan_%lu", (unsigned long)i]];
+    }
+    for (NSUInteger i = 0; i < 5; i++) {
+        XCTAssertNotNil([cache objectForKey:[NSString stringWithFormat:@"hot_%lu", (unsigned long)i]]);
+    }
+}
+
+- (void)testSegmentedCacheProtectsFrequentlyUsedObjectsAfterRemoveAll {
+    DFMemoryCache *cache = [[DFMemoryCache alloc] initWithStripeCount:1];
+    cache.segmented = YES;
+    cache.totalCostLimit = 100;
+    for (NSUInteger pass = 0; pass < 2; pass++) {
+        for (NSUInteger i = 0; i < 5; i++) {
+            NSString *key = [NSString stringWithFormat:@"hot_%lu", (unsigned long)i];
+            [cache setObject:@(i) forKey:key cost:10];
+            [cache objectForKey:key];
+        }
+        if (pass == 0) {
+            [cache removeAllObjects];
+        }
+    }
+    for (NSUInteger i = 0; i < 100; i++) {
+        [cache setObject:@(i) forKey:[NSString stringWithFormat:@"scan_%lu", (unsigned long)i] cost:10];
+    }
+    for (NSUInteger i = 0; i < 5; i++) {
+        XCTAssertNotNil([cache objectForKey:[NSString stringWithFormat:@"hot_%lu", (unsigned long)i]]);
+    }
+}
+
+- (void)testObjectsExpire {
+    [_cache setObject:@"value" forKey:@"key" cost:0 timeToLive:0.1];
+    [_cache setObject:@"value" forKey:@"key_persistent"];
+    XCTAssertNotNil([_cache objectForKey:@"key"]);
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertNil([_cache objectForKey:@"key"]);
+    XCTAssertNotNil([_cache objectForKey:@"key_persistent"]);
+    XCTAssertEqual(_cache.count, 1);
+}
+
+- (void)testRemoveExpiredObjects {
+    _cache.timeToLive = 0.1;
+    [_cache setObject:@"value_1" forKey:@"key_1" cost:10];
+    [_cache setObject:@"value_2" forKey:@"key_2" cost:10];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    [_cache removeExpiredObjects];
+    XCTAssertEqual(_cache.count, 0);
+    XCTAssertEqual(_cache.totalCost, 0);
+}
+
+- (void)testEvictionCallbacks {
+    NSMutableArray *evictedKeys = [NSMutableArray new];
+    NSMutableArray *reasons = [NSMutableArray new];
+    _cache.evictionHandler = ^(id key, id object, DFMemoryCacheEvictionReason reason) {
+        [evictedKeys addObject:key];
+        [reasons addObject:@(reason)];
+    };
+    _cache.delegate = self;
+    _cache.countLimit = 1;
+    [_cache setObject:@"value_1" forKey:@"key_1"];
+    [_cache setObject:@"value_2" forKey:@"key_2"];
+    XCTAssertEqualObjects(evictedKeys, @[ @"key_1" ]);
+    XCTAssertEqualObjects(reasons, @[ @(DFMemoryCacheEvictionReasonLimit) ]);
+    XCTAssertEqualObjects(_delegateEvictedObjects, @[ @"value_1" ]);
+
+    // Explicit removals don't trigger callbacks.
+    [_cache removeObjectForKey:@"key_2"];
+    [_cache removeAllObjects];
+    XCTAssertEqual(evictedKeys.count, 1);
+}
+
+- (void)testConcurrentAccessKeepsTotalsConsistent {
+    _cache.countLimit = 100;
+    _cache.totalCostLimit = 5000;
+    dispatch_apply(10000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSString *key = [NSString stringWithFormat:@"key_%lu", (unsigned long)(i % 500)];
+        if (i % 3 == 0) {
+            [_cache removeObjectForKey:key];
+        } else if (i % 2 == 0) {
+            [_cache setObject:@(i) forKey:key cost:i % 100];
+        } else {
+            [_cache objectForKey:key];
+        }
+    });
+    XCTAssertTrue(_cache.count <= 100);
+    XCTAssertTrue(_cache.totalCost <= 5000);
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < 500; i++) {
+        count += [_cache objectForKey:[NSString stringWithFormat:@"key_%lu", (unsigned long)i]] != nil;
+    }
+    XCTAssertEqual(count, _cache.count);
+    [_cache removeAllObjects];
+    XCTAssertEqual(_cache.count, 0);
+    XCTAssertEqual(_cache.totalCost, 0);
+}
+
+#pragma mark - Performance
+
+- (void)testPerformanceConcurrentReads {
+    [self _measureConcurrentReadsWithCache:[DFMemoryCache new]];
+}
+
+- (void)testPerformanceConcurrentReadsNSCache {
+    [self _measureConcurrentReadsWithCache:[NSCache new]];
+}
+
+- (void)_measureConcurrentReadsWithCache:(NSCache *)cache {
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        NSString *key = [NSString stringWithFormat:@"key_%lu", (unsigned long)i];
+        [keys addObject:key];
+        [cache setObject:@(i) forKey:key cost:1];
+    }
+    [self measureBlock:^{
+        dispatch_apply(200000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [cache objectForKey:keys[i % keys.count]];
+        });
+    }];
+}
+
+@end
@@ -0,0 +1,153 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCache.h"
+#import <XCTest/XCTest.h>
+
+@interface DFValueTransformerCompressing (Tests)
+
+- (BOOL)_shouldCompressData:(NSData *)data;
+
+@end
+
+
+@interface TDFValueTransformerCompressing : XCTestCase
+
+@end
+
+@implementation TDFValueTransformerCompressing
+
+- (NSArray *)_availableCodecs {
+    NSMutableArray *codecs = [NSMutableArray new];
+    for (NSNumber *codec in @[ @(DFCompressionCodecLZ4), @(DFCompressionCodecLZFSE), @(DFCompressionCodecZlib), @(DFCompressionCodecLZMA) ]) {
+        if ([DFValueTransformerCompressing isCodecAvailable:[codec unsignedCharValue]]) {
+            [codecs addObject:codec];
+        }
+    }
+    return codecs;
+}
+
+/*! Returns JSON-like compressible object.
+ */
+- (id)_compressibleObjectWithCount:(NSUInteger)count {
+    NSMutableArray *object = [NSMutableArray new];
+    for (NSUInteger i = 0; i < count; i++) {
+        [object addObject:@{ @"identifier" : @(i), @"name" : [NSString stringWithFormat:@"name_%lu", (unsigned long)(i % 100)], @"tags" : @[ @"cache", @"disk", @"memory" ] }];
+    }
+    return object;
+}
+
+- (NSData *)_randomDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [[NSMutableData alloc] initWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    return data;
+}
+
+- (void)testRoundTripWithAllCodecs {
+    id object = [self _compressibleObjectWithCount:1000];
+    NSData *rawData = [[DFValueTransformerJSON new] transformedValue:object];
+    for (NSNumber *codec in [self _availableCodecs]) {
+        DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new] codec:[codec unsignedCharValue]];
+        XCTAssertEqual(transformer.codec, [codec unsignedCharValue]);
+        NSData *data = [transformer transformedValue:object];
+        XCTAssertTrue(data.length < rawData.length / 2, @"Codec %@", codec);
+        XCTAssertEqualObjects([transformer reverseTransfomedValue:data], object, @"Codec %@", codec);
+    }
+}
+
+- (void)testEntriesWrittenWithDifferentCodecsAreReadable {
+    id object = [self _compressibleObjectWithCount:100];
+    DFValueTransformerCompressing *zlib = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new] codec:DFCompressionCodecZlib];
+    NSData *data = [zlib transformedValue:object];
+    for (NSNumber *codec in [self _availableCodecs]) {
+        DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new] codec:[codec unsignedCharValue]];
+        XCTAssertEqualObjects([transformer reverseTransfomedValue:data], object);
+    }
+}
+
+- (void)testUncompressedEntriesAreReadable {
+    id object = [self _compressibleObjectWithCount:100];
+    NSData *data = [[DFValueTransformerJSON new] transformedValue:object];
+    DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new]];
+    XCTAssertEqualObjects([transformer reverseTransfomedValue:data], object);
+}
+
+- (void)testIncompressibleDataIsStoredUncompressed {
+    DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerNSCoding new]];
+    NSData *object = [self _randomDataWithLength:200000];
+    NSData *rawData = [[DFValueTransformerNSCoding new] transformedValue:object];
+    NSData *data = [transformer transformedValue:object];
+    XCTAssertTrue(data.length <= rawData.length + 16);
+    XCTAssertEqualObjects([transformer reverseTransfomedValue:data], object);
+}
+
+- (void)testEntriesWithImplausibleUncompressedLengthAreRejected {
+    DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new] codec:DFCompressionCodecZlib];
+    NSMutableData *data = [[transformer transformedValue:[self _compressibleObjectWithCount:100]] mutableCopy];
+    uint64_t length = UINT64_MAX / 2;
+    [data replaceBytesInRange:NSMakeRange(sizeof(uint32_t) + sizeof(uint8_t), sizeof(length)) withBytes:&length];
+    XCTAssertNil([transformer reverseTransfomedValue:data]);
+    NSData *payload = [DFValueTransformerCompressing compressedData:[self _randomDataWithLength:1000] codec:DFCompressionCodecZlib];
+    XCTAssertNil([DFValueTransformerCompressing decompressedData:payload codec:DFCompressionCodecZlib length:payload.length * 100000]);
+}
+
+- (void)testCompressedFormatsAreDetected {
+    DFValueTransformerCompressing *transformer = [[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerJSON new] codec:DFCompressionCodecZlib];
+    NSMutableData *jpeg = [[NSMutableData alloc] initWithLength:10000];
+    memcpy(jpeg.mutableBytes, "\xFF\xD8\xFF\xE0", 4);
+    XCTAssertFalse([transformer _shouldCompressData:jpeg]);
+    transformer.adaptive = NO;
+    XCTAssertTrue([transformer _shouldCompressData:jpeg]);
+}
+
+- (void)testCompressingTransformerWithCache {
+    DFValueTransformerFactory *factory = [DFValueTransformerFactory new];
+    [factory registerValueTransformer:[[DFValueTransformerCompressing alloc] initWithValueTransformer:[DFValueTransformerNSCoding new]] forName:DFValueTransformerNSCodingName];
+    DFCache *cache = [[DFCache alloc] initWithName:@"_dt_testcase_compression" memoryCache:nil];
+    cache.valueTransfomerFactory = factory;
+    id object = [self _compressibleObjectWithCount:1000];
+    [cache storeObject:object forKey:@"key"];
+    XCTAssertEqualObjects([cache cachedObjectForKey:@"key"], object);
+    XCTAssertTrue([cache cachedDataForKey:@"key"].length < [[DFValueTransformerNSCoding new] transformedValue:object].length / 2);
+    [cache removeAllObjects];
+}
+
+#pragma mark - Benchmark
+
+/*! Reports encode and decode throughput and compression ratio for each available codec.
+ */
+- (void)testBenchmarkCodecs {
+    NSMutableArray *objects = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 20; i++) {
+        [objects addObject:[self _compressibleObjectWithCount:500 + i * 100]];
+    }
+    NSMutableArray *payloads = [NSMutableArray new];
+    NSUInteger totalLength = 0;
+    for (id object in objects) {
+        NSData *data = [[DFValueTransformerNSCoding new] transformedValue:object];
+        [payloads addObject:data];
+        totalLength += data.length;
+    }
+    for (NSNumber *codec in [self _availableCodecs]) {
+        DFCompressionCodec value = [codec unsignedCharValue];
+        NSMutableArray *compressed = [NSMutableArray new];
+        NSUInteger compressedLength = 0;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSData *data in payloads) {
+            NSData *compressedData = [DFValueTransformerCompressing compressedData:data codec:value];
+            [compressed addObject:compressedData];
+            compressedLength += compressedData.length;
+        }
+        CFAbsoluteTime encodeDuration = CFAbsoluteTimeGetCurrent() - start;
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < payloads.count; i++) {
+            XCTAssertNotNil([DFValueTransformerCompressing decompressedData:compressed[i] codec:value length:[payloads[i] length]]);
+        }
+        CFAbsoluteTime decodeDuration = CFAbsoluteTimeGetCurrent() - start;
+        double megabytes = totalLength / (1024.0 * 1024.0);
+        NSLog(@"codec %@: encode %.1f MB/s, decode %.1f MB/s, ratio %.2f, saved %lu of %lu bytes", codec, megabytes / encodeDuration, megabytes / decodeDuration, (double)totalLength / compressedLength, (unsigned long)(totalLength - compressedLength), (unsigned long)totalLength);
+    }
+}
+
+@end
@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Alexander Grebenyuk (github.com/kean).
+
+#import "DFCache.h"
+#import <XCTest/XCTest.h>
+
+@interface TDFValueTransformerPropertyList : XCTestCase
+
+@end
+
+@implementation TDFValueTransformerPropertyList {
+    DFValueTransformerPropertyList *_transformer;
+}
+
+- (void)setUp {
+    [super setUp];
+
+    _transformer = [DFValueTransformerPropertyList new];
+}
+
+/*! Returns payload similar to the decoded JSON responses.
+ */
+- (id)_objectWithCount:(NSUInteger)count {
+    NSMutableArray *object = [NSMutableArray new];
+    for (NSUInteger i = 0; i < count; i++) {
+        [object addObject:@{ @"identifier" : @(i),
+                             @"name" : [NSString stringWithFormat:@"Name %lu", (unsigned long)i],
+                             @"rating" : @(i / 7.0),
+                             @"enabled" : @(i % 2 == 0),
+                             @"tags" : @[ @"cache", @"disk", @"memory" ],
+                             @"owner" : @{ @"identifier" : @(i * 31), @"name" : @"kean" } }];
+    }
+    return object;
+}
+
+- (id)_roundTrip:(id)value {
+    NSData *data = [_transformer transformedValue:value];
+    XCTAssertNotNil(data);
+    return [_transformer reverseTransfomedValue:data];
+}
+
+#pragma mark - Round Trip
+
+- (void)testScalarValues {
+    NSArray *values = @[ @"", @"value", @"Юникод 🚀", @YES, @NO, @0, @(-1), @(INT64_MIN), @(INT64_MAX), @(UINT64_MAX), @(1.5f), @(M_PI), @(-0.0), [NSData data], [@"data" dataUsingEncoding:NSUTF8StringEncoding], [NSDate dateWithTimeIntervalSinceReferenceDate:123456.789] ];
+    for (id value in values) {
+        XCTAssertEqualObjects([self _roundTrip:value], value);
+    }
+}
+
+- (void)testNumberTypesArePreserved {
+    XCTAssertEqual([self _roundTrip:@YES], @YES);
+    XCTAssertEqual([self _roundTrip:@NO], @NO);
+    XCTAssertEqual(strcmp([[self _roundTrip:@(1.5)] objCType], @encode(double)), 0);
+    XCTAssertEqual(strcmp([[self _roundTrip:@(1.5f)] objCType], @encode(float)), 0);
+    XCTAssertEqual([[self _roundTrip:@(UINT64_MAX)] unsignedLongLongValue], UINT64_MAX);
+}
+
+- (void)testContainers {
+    id object = [self _objectWithCount:100];
+    XCTAssertEqualObjects([self _roundTrip:object], object);
+    XCTAssertEqualObjects([self _roundTrip:@[]], @[]);
+    XCTAssertEqualObjects([self _roundTrip:@{}], @{});
+    NSString *longString = [@"" stringByPaddingToLength:100000 withString:@"long string " startingAtIndex:0];
+    XCTAssertEqualObjects([self _roundTrip:@{ longString : longString }], @{ longString : longString });
+}
+
+- (void)testRepeatedKeysAreEncodedOnce {
+    id object = [self _objectWithCount:100];
+    NSData *data = [_transformer transformedValue:object];
+    NSData *lookup = [@"identifier" dataUsingEncoding:NSUTF8StringEncoding];
+    NSRange range = [data rangeOfData:lookup options:0 range:NSMakeRange(0, data.length)];
+    XCTAssertTrue(range.location != NSNotFound);
+    XCTAssertEqual([data rangeOfData:lookup options:0 range:NSMakeRange(NSMaxRange(range), data.length - NSMaxRange(range))].location, (NSUInteger)NSNotFound);
+    XCTAssertTrue(data.length < [NSKeyedArchiver archivedDataWithRootObject:object].length / 2);
+}
+
+#pragma mark - Unsupported Values
+
+- (void)testUnsupportedValuesAreRejected {
+    NSArray *values = @[ [NSNull null], @[ [NSObject new] ], @{ @1 : @"value" }, @{ @"key" : [NSURL URLWithString:@"http://example.com"] } ];
+    for (id value in values) {
+        XCTAssertFalse([DFValueTransformerPropertyList isPropertyList:value]);
+        XCTAssertNil([_transformer transformedValue:value]);
+    }
+    XCTAssertTrue([DFValueTransformerPropertyList isPropertyList:[self _objectWithCount:10]]);
+}
+
+- (void)testCorruptedDataIsRejected {
+    NSData *data = [_transformer transformedValue:[self _objectWithCount:10]];
+    for (NSUInteger length = 0; length < data.length; length++) {
+        XCTAssertNil([_transformer reverseTransfomedValue:[data subdataWithRange:NSMakeRange(0, length)]]);
+    }
+    NSMutableData *trailingData = [data mutableCopy];
+    [trailingData appendBytes:"\x01" length:1];
+    XCTAssertNil([_transformer reverseTransfomedValue:trailingData]);
+
+    // Container that claims more values than there are bytes.
+    XCTAssertNil([_transformer reverseTransfomedValue:[NSData dataWithBytes:"\x01\x0A\xFF\xFF\xFF\xFF\x0F" length:7]]);
+}
+
+#pragma mark - Factory
+
+- (void)testFactoryUsesTransformerForPropertyListsWhenPreferred {
+    DFValueTransformerFactory *factory = [DFValueTransformerFactory new];
+    XCTAssertEqualObjects([factory valueTransformerNameForValue:[self _objectWithCount:1]], DFValueTransformerNSCodingName);
+    factory.prefersPropertyListTransformer = YES;
+    XCTAssertEqualObjects([factory valueTransformerNameForValue:[self _objectWithCount:1]], DFValueTransformerPropertyListName);
+    XCTAssertEqualObjects([factory valueTransformerNameForValue:[NSURL URLWithString:@"http://example.com"]], DFValueTransformerNSCodingName);
+    XCTAssertTrue([[factory valueTransformerForName:DFValueTransformerPropertyListName] isKindOfClass:[DFValueTransformerPropertyList class]]);
+}
+
+#pragma mark - Benchmark
+
+/*! Reports encode and decode time and encoded size for the property list, NSCoding and JSON transformers.
+ */
+- (void)testBenchmarkTransformers {
+    NSArray *payloads = @[ [self _objectWithCount:10], [self _objectWithCount:1000], @{ @"items" : [self _objectWithCount:100], @"cursor" : @"abcdef", @"count" : @100 } ];
+    NSDictionary *transformers = @{ @"plist" : [DFValueTransformerPropertyList new], @"nscoding" : [DFValueTransformerNSCoding new], @"json" : [DFValueTransformerJSON new] };
+    for (NSUInteger i = 0; i < payloads.count; i++) {
+        for (NSString *name in transformers) {
+            id<DFValueTransforming> transformer = transformers[name];
+            NSUInteger iterations = 50;
+            NSData *data;
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            for (NSUInteger j = 0; j < iterations; j++) {
+                data = [transformer transformedValue:payloads[i]];
+            }
+            CFAbsoluteTime encodeDuration = CFAbsoluteTimeGetCurrent() - start;
+            start = CFAbsoluteTimeGetCurrent();
+            for (NSUInteger j = 0; j < iterations; j++) {
+                XCTAssertNotNil([transformer reverseTransfomedValue:data]);
+            }
+            CFAbsoluteTime decodeDuration = CFAbsoluteTimeGetCurrent() - start;
+            NSLog(@"payload %lu, %@: encode %.3f ms, decode %.3f ms, %lu bytes", (unsigned long)i, name, encodeDuration * 1000.0 / iterations, decodeDuration * 1000.0 / iterations, (unsigned long)data.length);
+        }
+    }
+}
+
+@end